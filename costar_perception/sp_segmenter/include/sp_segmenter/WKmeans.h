@@ -61,4 +61,71 @@ private:
     int thread_num;		//omp_get_num_threads()
     size_t total_count;		//0
     bool weight_flag;		//flagging the weighted kmeans
+};
+
+// Writes descriptors into fixed-size .cvmat shards (saveMat format) so that 
+// MiniBatchKmeans can stream them from disk instead of holding all samples in memory
+class ShardWriter {
+public:
+    ShardWriter(const std::string &out_dir_, const std::string &prefix_, int shard_rows_ = 100000);
+    ~ShardWriter();
+
+    void AddData(const cv::Mat &data);
+    void Flush();
+    std::vector<std::string> getShards(){ return shard_files; }
+
+private:
+    std::string out_dir;
+    std::string prefix;
+    int shard_rows;
+    int buf_rows;
+    std::vector<cv::Mat> buf;
+    std::vector<std::string> shard_files;
+};
+
+// Mini-batch kmeans (Sculley, WWW 2010) for dictionary learning.
+// Data is either added in memory or streamed from .cvmat shards one shard at a time,
+// so peak memory is one shard + one batch + the centers regardless of the sample size.
+// Distances of a batch to all centers are computed at once with gemm
+// (||x||^2 - 2x'c + ||c||^2), and the centers are initialized by kmeans++ on a subsample.
+class MiniBatchKmeans {
+public:
+    MiniBatchKmeans();
+    ~MiniBatchKmeans();
+
+    void setThreadNum(int thread_num_){ omp_set_num_threads(thread_num_);thread_num = thread_num_;}
+    void setBatchSize(int batch_size_){ batch_size = batch_size_; }
+    void setMaxIter(int max_iter_){ max_iter = max_iter_; }
+    void setInitSampleNum(int init_num_){ init_num = init_num_; }
+    void setTolerance(float tol_){ tol = tol_; }
+
+    void AddData(cv::Mat data);
+    void AddShard(const std::string &shard_file);
+    // add all .cvmat files in shard_dir, returns the number of shards added
+    int AddShardDir(const std::string &shard_dir);
+
+    void W_Cluster(cv::Mat &centers, int K);
+
+    // squared L2 distances between each row of data and each row of centers, data.rows x centers.rows
+    static cv::Mat sqrDist(const cv::Mat &data, const cv::Mat &centers, const cv::Mat &center_sqr_norm);
+
+private:
+    cv::Mat Initialize(int K);                      //kmeans++ seeding on init_num sampled rows
+    cv::Mat SampleRows(int num);                    //uniform sample over all data and shards
+    float UpdateBatch(const cv::Mat &batch, cv::Mat &centers, std::vector<float> &counts);
+
+    int loadShard(size_t idx, cv::Mat &shard);
+
+    std::vector<cv::Mat> mem_data;
+    std::vector<std::string> shard_files;
+    std::vector<size_t> shard_rows;
+    size_t total_rows;
+
+    int fea_len;			//-1
+    int thread_num;		//omp_get_max_threads()
+    int batch_size;		//1024
+    int max_iter;		//number of passes over the data, 10
+    int init_num;		//number of rows used for kmeans++, 20000
+    float tol;			//relative change of the smoothed batch energy to stop, 1e-4
+    cv::RNG rng;
 };
\ No newline at end of file
@@ -0,0 +1,38 @@
+/*
+ * File:   feature_projection.h
+ *
+ * Linear dimensionality reduction of the pooled superpixel features before svm scoring,
+ * fea_out = (fea - mean) * basis^T. The basis is either learned with PCA or a sparse random projection.
+ */
+
+#ifndef FEATURE_PROJECTION_H
+#define FEATURE_PROJECTION_H
+
+#include "sp_segmenter/utility/utility.h"
+
+class FeatureProjection
+{
+public:
+    FeatureProjection() {}
+
+    // data holds one CV_32FC1 sample per row
+    void trainPCA(const cv::Mat &data, const int &dim);
+    // Achlioptas sparse random projection, entries are sqrt(3/dim) * {+1, 0, -1} with probability {1/6, 2/3, 1/6}
+    void trainRandom(const int &in_dim, const int &dim, const unsigned int &seed = 0);
+
+    // saved as a single cvmat, the first row is the mean and the rest is the basis
+    bool save(const std::string &filename) const;
+    bool load(const std::string &filename);
+
+    bool empty() const { return basis_.empty(); }
+    int getInputDim() const { return basis_.cols; }
+    int getOutputDim() const { return basis_.rows; }
+
+    // projects every row of fea
+    cv::Mat project(const cv::Mat &fea) const;
+
+private:
+    cv::Mat mean_, basis_;
+};
+
+#endif  /* FEATURE_PROJECTION_H */
@@ -9,6 +9,8 @@
 #define FEATURES_H
 
 #include "sp_segmenter/utility/utility.h"
+#include "sp_segmenter/quantized_svm.h"
+#include "sp_segmenter/feature_projection.h"
 //#include "../omp/ompcore.h"
 
 struct Hypo{
@@ -146,9 +148,9 @@ public:
     Hier_Pooler(float rad = 0.03);
     ~Hier_Pooler();
     
-    std::vector<cv::Mat> getHierFea(MulInfoT &data, int layer);
+    std::vector<cv::Mat> getHierFea(MulInfoT &data, int layer) const;
     // For the usage of Dictionary Learning, SubSampling features
-    std::vector<cv::Mat> getRawFea(MulInfoT &data, int layer, size_t max_num);
+    std::vector<cv::Mat> getRawFea(MulInfoT &data, int layer, size_t max_num) const;
     
     void setRatio(float rr_) {ratio=rr_;}
     std::vector<int> LoadDict_L0(std::string path, std::string colorK, std::string depthK, std::string jointK="");
@@ -156,27 +158,29 @@ public:
     std::vector<int> LoadDict_L2(std::string dict_path, std::vector<std::string> dictK);
     
     std::vector<int> sampleRaw_L0(const pcl::PointCloud<PointT>::Ptr cloud, const pcl::PointCloud<NormalT>::Ptr cloud_normal,
-                    cv::Mat &depth_fea, cv::Mat &color_fea, int max_num, float rad = 0.03);
-    std::vector<cv::Mat> EncodeLayer_L0(const cv::Mat &depth_fea, const cv::Mat &color_fea);
+                    cv::Mat &depth_fea, cv::Mat &color_fea, int max_num, float rad = 0.03) const;
+    std::vector<cv::Mat> EncodeLayer_L0(const cv::Mat &depth_fea, const cv::Mat &color_fea) const;
     
 private:
-    void computeRaw_L0(MulInfoT &data, cv::Mat &depth_fea, cv::Mat &color_fea, float rad = 0.03);
+    void computeRaw_L0(MulInfoT &data, cv::Mat &depth_fea, cv::Mat &color_fea, float rad = 0.03) const;
     
     
-    std::vector<cv::Mat> PoolLayer_L1(const MulInfoT &data, const std::vector<cv::Mat> code_L0, std::vector<size_t> idxs, bool max_pool=true);
-    std::vector<cv::Mat> EncodeLayer_L1(const std::vector<cv::Mat> rawfea_L1);
+    std::vector<cv::Mat> PoolLayer_L1(const MulInfoT &data, const std::vector<cv::Mat> code_L0, std::vector<size_t> idxs, bool max_pool=true) const;
+    std::vector<cv::Mat> EncodeLayer_L1(const std::vector<cv::Mat> rawfea_L1) const;
     
-    std::vector<cv::Mat> PoolLayer_L2(const MulInfoT &data, const std::vector<cv::Mat> code_L1, std::vector<size_t> idxs, bool max_pool=true);
-    std::vector<cv::Mat> EncodeLayer_L2(const std::vector<cv::Mat> rawfea_L2);
+    std::vector<cv::Mat> PoolLayer_L2(const MulInfoT &data, const std::vector<cv::Mat> code_L1, std::vector<size_t> idxs, bool max_pool=true) const;
+    std::vector<cv::Mat> EncodeLayer_L2(const std::vector<cv::Mat> rawfea_L2) const;
     
+    // FLANN searches only read the index, so the const methods can be used from several threads at once.
+    // The trees are mutable because cv::flann::Index::knnSearch is not declared const
     cv::Mat dict_color_L0, dict_depth_L0, dict_joint_L0;
-    cv::flann::Index tree_color_L0, tree_depth_L0, tree_joint_L0;
+    mutable cv::flann::Index tree_color_L0, tree_depth_L0, tree_joint_L0;
     
     cv::Mat dict_colorInLAB_L1, dict_colorInXYZ_L1, dict_depthInLAB_L1, dict_depthInXYZ_L1;
-    cv::flann::Index tree_colorInLAB_L1, tree_colorInXYZ_L1, tree_depthInLAB_L1, tree_depthInXYZ_L1;
+    mutable cv::flann::Index tree_colorInLAB_L1, tree_colorInXYZ_L1, tree_depthInLAB_L1, tree_depthInXYZ_L1;
     
     cv::Mat dict_colorInLAB_L2, dict_colorInXYZ_L2, dict_depthInLAB_L2, dict_depthInXYZ_L2;
-    cv::flann::Index tree_colorInLAB_L2, tree_colorInXYZ_L2, tree_depthInLAB_L2, tree_depthInXYZ_L2;
+    mutable cv::flann::Index tree_colorInLAB_L2, tree_colorInXYZ_L2, tree_depthInLAB_L2, tree_depthInXYZ_L2;
     
     //0: color-lab
     //1: depth-lab
@@ -296,24 +300,36 @@ public:
     
     void build_SP_LAB(const std::vector< boost::shared_ptr<Pooler_L0> > &lab_pooler_set, bool max_pool_flag = false);
     void build_SP_FPFH(const std::vector< boost::shared_ptr<Pooler_L0> > &fpfh_pooler_set, float radius, bool max_pool_flag = false);
-    void build_SP_SIFT(const std::vector< boost::shared_ptr<Pooler_L0> > &sift_pooler_set, Hier_Pooler &cshot_producer,  const std::vector<cv::SiftFeatureDetector*> &sift_det_vec, bool max_pool_flag = false);
+    void build_SP_SIFT(const std::vector< boost::shared_ptr<Pooler_L0> > &sift_pooler_set, const Hier_Pooler &cshot_producer,  const std::vector<cv::SiftFeatureDetector*> &sift_det_vec, bool max_pool_flag = false);
     
 //    pcl::PointCloud<PointT>::Ptr semanticSegment(const std::vector<model*> &model_set, int level);
     std::vector<cv::Mat> gethardNegtive(const model *model_set, int level, bool max_pool = false);
+    // same as above, scores[i] is the svm margin of the i-th returned feature
+    std::vector<cv::Mat> gethardNegtive(const model *model_set, int level, std::vector<float> &scores, bool max_pool = false, 
+        const FeatureProjection *projection = NULL);
+
+    // batched inference, score all superpixels of one level in parallel.
+    // labels[i] and scores[i] correspond to the i-th superpixel of that level, label -1 means no feature.
+    // If the model was trained on projected features, the same projection has to be given
+    void predictLevel(const model *cur_model, int level, std::vector<int> &labels, std::vector<float> &scores, bool max_pool = false, 
+        const FeatureProjection *projection = NULL);
+    void predictLevel(const QuantizedSVM *cur_model, int level, std::vector<int> &labels, std::vector<float> &scores, bool max_pool = false, 
+        const FeatureProjection *projection = NULL);
 
     // load the svm model and the order of superpixels level
     // level means order of superpixels for classification
     // right now I only provide level=0,1,2 for classification, 
-    void InputSemantics(const model *model_set, int level, bool reset = false, bool max_pool = false);
+    void InputSemantics(const model *model_set, int level, bool reset = false, bool max_pool = false, const FeatureProjection *projection = NULL);
+    void InputSemantics(const QuantizedSVM *model_set, int level, bool reset = false, bool max_pool = false, const FeatureProjection *projection = NULL);
 
     // get the result of the SVM
     pcl::PointCloud<PointLT>::Ptr getSemanticLabels();
     std::vector<cv::Mat> sampleSPFea(const int level, int sample_num = -1, bool max_pool_flag = false, bool normalized = true);
 //    std::vector<cv::Mat> sampleSPRawFea(const int level, int sample_num = -1, bool max_pool_flag = false);
     
-    void init(const pcl::PointCloud<PointT>::Ptr cloud, Hier_Pooler &cshot_producer, float radius, float ss_ = 0.005);
+    void init(const pcl::PointCloud<PointT>::Ptr cloud, const Hier_Pooler &cshot_producer, float radius, float ss_ = 0.005);
     // If not use SIFT pooling!!! Use this light version.
-    void lightInit(const pcl::PointCloud<PointT>::Ptr cloud, Hier_Pooler &cshot_producer, float radius, float down_ss = 0.005);
+    void lightInit(const pcl::PointCloud<PointT>::Ptr cloud, const Hier_Pooler &cshot_producer, float radius, float down_ss = 0.005);
     void reset();
     
     void extractForeground(bool constrained_flag);
@@ -326,6 +342,13 @@ private:
 //    std::vector<cv::Mat> getSPRawFea(const IDXSET &idx_set, bool max_pool);
             
     std::vector<cv::Mat> getSPFea(const IDXSET &idx_set, bool max_pool = false, bool normalized = true);
+    // pool and classify one superpixel, returns the label used by InputSemantics or -1 if it has no feature.
+    // sp_fea is always the pooled feature before projection
+    int predictSP(const model *cur_model, const std::vector<int> &sp_idx, bool max_pool, const FeatureProjection *projection, 
+        cv::Mat &sp_fea, float &score);
+    int predictSP(const QuantizedSVM *cur_model, const std::vector<int> &sp_idx, bool max_pool, const FeatureProjection *projection, 
+        cv::Mat &sp_fea, float &score);
+    void accumulateSemantics(int model_num, int level, bool reset, const std::vector<int> &sp_label, const std::vector<float> &sp_score);
     
     MulInfoT data;
     spExt ext_sp;
@@ -0,0 +1,132 @@
+#ifndef SP_SEGMENTER_FRAME_LOG_H
+#define SP_SEGMENTER_FRAME_LOG_H
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <fstream>
+#include <condition_variable>
+#include <stdint.h>
+
+#include "sp_segmenter/semantic_segmentation.h"
+
+// Binary log of segmentation sessions, written by RosSemanticSegmentation (recordFile parameter) and read by
+// sp_segmenter_replay. The file is a header followed by chunks:
+//   PARM  effective parameters of the session, once after the header
+//   TABL  table convex hull, whenever the segmenter gets a new table
+//   FRAM  input cloud, crop box, ObjRecRANSAC mode and preferred orientation of one call, the labels and poses it produced
+//   INDX  offset of every chunk, written on close and followed by a trailer pointing to it
+// Clouds are stored one field after another and LZF compressed, the same way as binary_compressed PCD files.
+// Numbers are written in host byte order. A log without index (the recorder crashed) is still readable,
+// the reader scans the chunks instead and stops at the first incomplete one.
+
+typedef std::map<std::string, std::string> FrameLogParameters;
+
+struct LoggedFrame
+{
+    uint64_t sequence;
+    double stamp;               // seconds, from the input cloud header
+    double segmentation_time;   // seconds the recorded call took
+    bool success;
+
+    bool use_crop_box;
+    Eigen::Vector3f crop_box_size;
+    Eigen::Affine3f crop_box_pose;
+    int objrecransac_mode;
+    bool use_preferred_orientation;
+    Eigen::Quaterniond preferred_orientation;
+
+    pcl::PointCloud<PointT>::Ptr cloud;
+    pcl::PointCloud<PointLT>::Ptr labels;
+    std::vector<objectTransformInformation> poses;
+
+    LoggedFrame();
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+enum FrameLogChunk {CHUNK_PARAMETERS, CHUNK_TABLE, CHUNK_FRAME, CHUNK_INDEX};
+
+struct FrameLogIndexEntry
+{
+    FrameLogChunk type;
+    uint64_t offset;
+    uint64_t sequence;  // frames only
+    double stamp;       // frames only
+};
+
+class FrameLogWriter
+{
+public:
+    // at most max_queued frames wait for compression, later frames are dropped so the caller never blocks on disk
+    explicit FrameLogWriter(const std::size_t &max_queued = 4);
+    ~FrameLogWriter();
+
+    bool open(const std::string &path, const FrameLogParameters &parameters);
+    bool isOpen() const { return file_.is_open(); }
+    // writes the index and closes the file. Called by the destructor
+    void close();
+
+    // returns false if the frame was dropped
+    bool writeFrame(const LoggedFrame &frame);
+    void writeTable(const pcl::PointCloud<PointT>::Ptr &table_corner_points);
+
+    unsigned long getWrittenFrames() const;
+    unsigned long getDroppedFrames() const;
+
+private:
+    struct Job
+    {
+        FrameLogChunk type;
+        LoggedFrame frame;
+        pcl::PointCloud<PointT>::Ptr table;
+    };
+
+    void run();
+    void writeChunk(const FrameLogChunk &type, const std::string &payload, const uint64_t &sequence, const double &stamp);
+
+    std::ofstream file_;
+    std::string path_;
+    std::vector<FrameLogIndexEntry> index_;
+    std::size_t max_queued_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<Job, Eigen::aligned_allocator<Job> > queue_;
+    std::thread worker_;
+    bool stop_;
+    unsigned long written_frames_, dropped_frames_;
+};
+
+class FrameLogReader
+{
+public:
+    FrameLogReader();
+
+    bool open(const std::string &path);
+
+    const FrameLogParameters &getParameters() const { return parameters_; }
+    std::size_t getNumberOfFrames() const { return frames_.size(); }
+    const FrameLogIndexEntry &getFrameEntry(const std::size_t &frame) const { return index_[frames_[frame]]; }
+
+    bool readFrame(const std::size_t &frame, LoggedFrame &result);
+    // the table that was in use when the frame was recorded, false if there was none.
+    // Frames that share a table get the same cloud
+    bool readTableForFrame(const std::size_t &frame, pcl::PointCloud<PointT>::Ptr &table_corner_points);
+
+private:
+    bool readIndex();
+    bool scanChunks();
+    bool readChunk(const FrameLogIndexEntry &entry, std::string &payload);
+
+    std::ifstream file_;
+    std::string path_;
+    uint64_t file_size_;
+    FrameLogParameters parameters_;
+    std::vector<FrameLogIndexEntry> index_;
+    std::vector<std::size_t> frames_;   // index_ position of every frame chunk
+    std::size_t cached_table_;          // index_ position of cached_table_points_
+    pcl::PointCloud<PointT>::Ptr cached_table_points_;
+};
+
+#endif // SP_SEGMENTER_FRAME_LOG_H
@@ -45,6 +45,10 @@ public:
     void mergeHypotheses(const pcl::PointCloud<myPointXYZ>::Ptr scene_xyz, std::list<AcceptedHypothesis> &acc_hypotheses, std::vector<poseT> &poses);
     pcl::PointCloud<myPointXYZ>::Ptr FillModelCloud(const std::vector<poseT> &poses);
     void setUseCUDA(bool useCUDA){objrec.setUseCUDA(useCUDA);}
+    // threads of one recognition, see TaskScheduler::getLibraryThreads
+    void setNumberOfThreads(int threads){objrec.setNumberOfThreads(threads);}
+    // probability of finding an object in the scene, the RANSAC iterations grow with -log(1 - p). 0.99 by default
+    void setSuccessProbability(double probability){successProbability = probability;}
     
 private:
     std::vector<ModelT> models;
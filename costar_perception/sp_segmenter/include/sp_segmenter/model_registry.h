@@ -0,0 +1,90 @@
+#ifndef SP_SEGMENTER_MODEL_REGISTRY_H
+#define SP_SEGMENTER_MODEL_REGISTRY_H
+
+#include <map>
+#include <mutex>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include "sp_segmenter/features.h"
+#include "sp_segmenter/seg.h"
+
+#ifdef USE_OBJRECRANSAC
+// greedyObjRansac.h has no include guard
+class greedyObjRansac;
+#endif
+
+// Models loaded once per process and shared by every SemanticSegmentation that asks for the same files and
+// parameters, e.g. one segmenter per camera or several python segmenters.
+// The registry only keeps weak references: a model is freed with the last segmenter using it, and loaded again
+// by the next one asking for it. Models are not modified after they are published, segmenters only query them.
+// Dictionaries and SVM models are read without locking, the same way the OpenMP loops of one segmenter already do.
+// ObjRecRANSAC keeps the scene of the running recognition next to its model table, so a shared detector has to be
+// locked while it is used.
+
+typedef std::vector< boost::shared_ptr<Pooler_L0> > PoolerSet;
+
+// liblinear models of one svm directory for superpixel orders 0..2, missing files are NULL
+struct SVMModelSet
+{
+    SVMModelSet();
+    ~SVMModelSet();
+
+    bool loaded;
+    std::vector<model*> binary_models, multi_models;
+    std::vector<QuantizedSVM> binary_qmodels, multi_qmodels;
+    std::vector<FeatureProjection> binary_projections, multi_projections;
+
+private:
+    SVMModelSet(const SVMModelSet &);
+    SVMModelSet &operator=(const SVMModelSet &);
+};
+
+#ifdef USE_OBJRECRANSAC
+struct SharedObjRecRANSAC
+{
+    boost::shared_ptr<greedyObjRansac> detector;
+    // hold while recognizing, visualizing or clearing meshes
+    std::mutex mutex;
+};
+#endif
+
+class ModelRegistry
+{
+public:
+    static ModelRegistry &instance();
+
+    // SHOT dictionaries, shared by segmenters with the same hier radius and ratio
+    boost::shared_ptr<const Hier_Pooler> getSHOTDictionary(const std::string &shot_path, const float &radius, const float &ratio);
+    // pooler set with the seed pool at index 1, as used for FPFH and SIFT
+    boost::shared_ptr<const PoolerSet> getSeedPoolerSet(const std::string &seed_file);
+    // HSI poolers of orders 1..5 for the LAB features
+    boost::shared_ptr<const PoolerSet> getLabPoolerSet();
+    boost::shared_ptr<const SVMModelSet> getSVMModels(const std::string &svm_path, const bool &use_binary_svm, const bool &use_multi_class_svm,
+        const int &quantized_svm_bits);
+    boost::shared_ptr<const ModelT> getMesh(const std::string &model_file, const std::string &model_name);
+#ifdef USE_OBJRECRANSAC
+    // detector with every model_files[i] added as model_names[i], in that order
+    boost::shared_ptr<SharedObjRecRANSAC> getObjRecRANSAC(const std::vector<std::string> &model_files, const std::vector<std::string> &model_names,
+        const double &pair_width, const double &voxel_size, const double &object_visibility, const double &scene_visibility, const bool &use_cuda);
+#endif
+
+    // number of models alive, shared or not
+    std::size_t size();
+
+private:
+    ModelRegistry() {}
+    ModelRegistry(const ModelRegistry &);
+    ModelRegistry &operator=(const ModelRegistry &);
+
+    template <typename T>
+        boost::shared_ptr<T> find(const std::string &key);
+    template <typename T>
+        void insert(const std::string &key, const boost::shared_ptr<T> &value);
+
+    // loading holds the lock, so a model requested by two segmenters at once is loaded only once
+    std::mutex mutex_;
+    std::map<std::string, boost::weak_ptr<void> > entries_;
+};
+
+#endif // SP_SEGMENTER_MODEL_REGISTRY_H
@@ -0,0 +1,49 @@
+/*
+ * File:   quantized_svm.h
+ *
+ * Low precision copy of a liblinear model for superpixel classification.
+ * Each class keeps its weights as int8 or int16 with one float scale, w[i][j] ~= scale[i] * q[i][j],
+ * and the pooled float cv::Mat rows are scored directly without being converted to feature_node,
+ * reading the weights only at their non-zero entries.
+ */
+
+#ifndef QUANTIZED_SVM_H
+#define QUANTIZED_SVM_H
+
+#include <stdint.h>
+
+#include "sp_segmenter/utility/utility.h"
+
+class QuantizedSVM
+{
+public:
+    QuantizedSVM() : nr_class_(0), nr_feature_(0), nr_w_(0), bits_(0) {}
+
+    // bits is either 8 or 16. Returns false if the model can not be quantized
+    bool quantize(const model *full_model, const int &bits);
+
+    bool save(const std::string &filename) const;
+    bool load(const std::string &filename);
+
+    bool empty() const { return nr_w_ == 0; }
+    int getNumClass() const { return nr_class_; }
+    // number of pooled feature columns, the constant bias feature used in training is not included
+    int getNumFeature() const { return nr_feature_; }
+    int getBits() const { return bits_; }
+    std::size_t getWeightBytes() const;
+
+    // fea is a 1 x getNumFeature() CV_32FC1 row. Fills dec_values and returns the label like liblinear predict_values
+    double predictValues(const cv::Mat &fea, double *dec_values) const;
+
+private:
+    int nr_class_, nr_feature_, nr_w_, bits_;
+    std::vector<int> label_;
+    std::vector<float> scale_;
+    // contribution of the constant bias feature, kept in full precision
+    std::vector<float> offset_;
+    // class major, nr_w_ x nr_feature_
+    std::vector<int8_t> w8_;
+    std::vector<int16_t> w16_;
+};
+
+#endif  /* QUANTIZED_SVM_H */
@@ -23,8 +23,10 @@
 #endif
 // include to convert from messages to pointclouds and vice versa
 #include <pcl_conversions/pcl_conversions.h>
+#include <boost/lexical_cast.hpp>
 
 #include "sp_segmenter/semantic_segmentation.h"
+#include "sp_segmenter/frame_log.h"
 
 // ros service messages for segmenting gripper
 #include "sp_segmenter/SegmentInGripper.h"
@@ -62,6 +64,21 @@ protected:
     void updateCloudData (const sensor_msgs::PointCloud2 &pc);
     void initializeSemanticSegmentationFromRosParam();
     void populateTFMap(std::vector<objectTransformInformation> all_poses);
+    // publishes the per frame profile on /diagnostics, does nothing unless built with BUILD_ENABLE_PROFILING
+    void publishDiagnostics();
+    // warns (throttled) when the last segmentation had to degrade to meet latencyBudget
+    void warnDegradation();
+    // appends one segmentation call to the frame log if recordFile is set
+    void recordFrame(const ros::Time &stamp, const pcl::PointCloud<PointT>::Ptr &cloud, const pcl::PointCloud<PointLT>::Ptr &labels,
+        const std::vector<objectTransformInformation> &poses, const bool &success, const double &segmentation_time);
+
+    // nh.param that also keeps the effective value, so a recorded session is replayed with the same configuration
+    template <typename T>
+    void readParam(const std::string &name, T &value, const T &default_value)
+    {
+        this->nh.param(name, value, default_value);
+        this->recorded_parameters_[name] = boost::lexical_cast<std::string>(value);
+    }
 
     ros::NodeHandle nh;
     bool classReady, useTFinsteadOfPoses;
@@ -88,8 +105,18 @@ protected:
     unsigned int table_corner_published;
     std::string POINTS_IN, POINTS_OUT, POSES_OUT;
     ros::Publisher pc_pub, pose_pub, detected_object_pub, table_corner_pub;
+#ifdef SP_SEGMENTER_PROFILING
+    ros::Publisher diagnostics_pub;
+    unsigned int number_of_profiled_frames;
+#endif
     ros::Subscriber pc_sub;
     unsigned int number_of_segmentation_done;
+
+    // Frame log related
+    boost::shared_ptr<FrameLogWriter> frame_log_;
+    FrameLogParameters recorded_parameters_;
+    pcl::PointCloud<PointT>::Ptr recorded_table_;
+    uint64_t number_of_recorded_frames_;
     
     std::vector<pcl::PointCloud<PointT>::Ptr, Eigen::aligned_allocator<pcl::PointCloud<PointT>::Ptr> > cloud_vec;
     int maxframes;
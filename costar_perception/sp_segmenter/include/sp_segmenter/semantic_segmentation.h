@@ -2,6 +2,7 @@
 #define SEMANTIC_SEGMENTATION_H
 
 #include <time.h> 
+#include <future>
 #include <Eigen/Dense>
 #include <Eigen/Geometry>
 #include <pcl/filters/crop_box.h>
@@ -15,9 +16,37 @@
 #include "sp_segmenter/seg.h"
 #include "sp_segmenter/spatial_pose.h"
 #include "sp_segmenter/table_segmenter.h"
+#include "sp_segmenter/model_registry.h"
+#include "sp_segmenter/utility/logger.h"
 
 enum ObjRecRansacMode {STANDARD_BEST, STANDARD_RECOGNIZE, GREEDY_RECOGNIZE};
 
+// stages of segmentPointCloud and calculateObjTransform that are timed on every call
+enum SegmentationStage {STAGE_CROP, STAGE_TABLE, STAGE_POOLER, STAGE_SVM, STAGE_POSE, NUM_SEGMENTATION_STAGES};
+
+// steps a request takes, in this order, when it would not finish within its latency budget (see setLatencyBudget)
+enum DegradationRung
+{
+    DEGRADE_COARSE_DOWNSAMPLE = 1 << 0,         // pool the features on a cloud downsampled twice as coarse
+    DEGRADE_SKIP_LEVEL1_SUPERPIXELS = 1 << 1,   // classify the order 0 superpixels only
+    DEGRADE_FEWER_RANSAC_ITERATIONS = 1 << 2,   // ObjRecRANSAC with about half of the iterations
+    DEGRADE_SKIP_POSE = 1 << 3,                 // no pose estimation, only the labelled cloud
+    NUM_DEGRADATION_RUNGS = 4
+};
+
+// deadline of one request and the rungs it took
+struct LatencyBudget
+{
+    LatencyBudget() : deadline(0), with_pose(false), rungs(0) {}
+
+    // get_wall_time the result is due at, 0 without a budget
+    double deadline;
+    // the request estimates poses after the segmentation, which has to leave time for them
+    bool with_pose;
+    // DegradationRung flags
+    unsigned int rungs;
+};
+
 #ifdef USE_OBJRECRANSAC
 #include "sp_segmenter/greedyObjRansac.h"
 #endif
@@ -83,6 +112,24 @@ struct objectTransformInformation
     }
 };
 
+// result of one cloud of the asynchronous calls
+struct SegmentationResult
+{
+    SegmentationResult() : success(false), degradation(0)
+    {
+        std::fill(stage_time, stage_time + NUM_SEGMENTATION_STAGES, 0.0);
+    }
+
+    bool success;
+    pcl::PointCloud<pcl::PointXYZL>::Ptr labelled_cloud;
+    // only filled by segmentAndCalculateObjTransformAsync
+    std::vector<objectTransformInformation> poses;
+    // seconds, like getLastStageTime
+    double stage_time[NUM_SEGMENTATION_STAGES];
+    // DegradationRung flags
+    unsigned int degradation;
+};
+
 class SemanticSegmentation
 {
 public:
@@ -99,7 +146,8 @@ public:
     // calculate all object poses based on the input labelled point cloud generated from segmentPointCloud function.
     std::vector<objectTransformInformation> calculateObjTransform(const pcl::PointCloud<pcl::PointXYZL>::Ptr &labelled_point_cloud);
 
-    // segment and calculate all object poses based on input cloud. It returns true if the segmentation successful and the detected object poses > 0
+    // segment and calculate all object poses based on input cloud. It returns true if the segmentation successful and the detected object poses > 0,
+    // or if the latency budget skipped the pose estimation (DEGRADE_SKIP_POSE), the poses are the ones of the previous calls then
     bool segmentAndCalculateObjTransform(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &input_cloud, 
         pcl::PointCloud<pcl::PointXYZL>::Ptr &labelled_point_cloud_result, std::vector<objectTransformInformation> &object_transform_result);
 
@@ -107,9 +155,42 @@ public:
     std::vector<objectTransformInformation> getUpdateOnOneObjTransform(const pcl::PointCloud<pcl::PointXYZL>::Ptr &labelled_point_cloud, const std::string &transform_name, const std::string &object_type);
 #endif
 
+// ---------------------------------------------------------- BATCH AND ASYNCHRONOUS OPERATIONS -------------------------------------------------------------------------------------
+    // The clouds are processed in parallel on WorkerPool::shared(), with visualization enabled they are processed in order on the calling thread.
+    // The parameters of the segmenter must not change until the calls return or the futures are ready, and the segmenter has to outlive the futures.
+
+    // segment several clouds, e.g. the views of a multi-view capture. results[i] is the labelled input_clouds[i], NULL if its segmentation failed.
+    // Returns the number of clouds segmented successfully, getLastStageTime returns the stage times summed over the clouds
+    std::size_t segmentPointClouds(const std::vector<pcl::PointCloud<pcl::PointXYZRGBA>::Ptr> &input_clouds, std::vector<pcl::PointCloud<pcl::PointXYZL>::Ptr> &results);
+    std::future<SegmentationResult> segmentPointCloudAsync(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &input_cloud);
+#ifdef USE_OBJRECRANSAC
+    // segmentation and pose recognition of the clouds run in parallel, the poses are then added to the object tree in input order,
+    // as if segmentAndCalculateObjTransform was called for one cloud after another. Returns the number of clouds with poses
+    std::size_t segmentAndCalculateObjTransforms(const std::vector<pcl::PointCloud<pcl::PointXYZRGBA>::Ptr> &input_clouds,
+        std::vector<pcl::PointCloud<pcl::PointXYZL>::Ptr> &labelled_point_cloud_results, std::vector<std::vector<objectTransformInformation> > &object_transform_results);
+    std::future<SegmentationResult> segmentAndCalculateObjTransformAsync(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &input_cloud);
+#endif
+
 // ---------------------------------------------------------- ADDITIONAL OPERATIONAL FUNCTIONS --------------------------------------------------------------------------------------
     bool getTableSurfaceFromPointCloud(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &input_cloud, const bool &save_table_pcd = false, const std::string &save_directory_path = ".");
     void convertPointCloudLabelToRGBA(const pcl::PointCloud<pcl::PointXYZL>::Ptr &input, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &output) const;
+
+    // wall time in seconds a stage took in the last segmentPointCloud or calculateObjTransform call, 0 if it did not run
+    double getLastStageTime(const SegmentationStage &stage) const;
+    static const char* getStageName(const SegmentationStage &stage);
+
+// ---------------------------------------------------------- LATENCY BUDGET ----------------------------------------------------------------------------------------------------------
+    // Seconds one request may take: segmentPointCloud, calculateObjTransform, segmentAndCalculateObjTransform, a batch, or one
+    // asynchronous call counted from the call. Before the pooling, the classification and the pose estimation the request compares
+    // the time left with the time those stages took on earlier undegraded requests, and takes the next DegradationRung while they would not fit.
+    // Crop and table segmentation always run, a request without history runs undegraded. 0 disables the budget (default)
+    void setLatencyBudget(const double &seconds);
+    double getLatencyBudget() const { return latency_budget_; }
+    // DegradationRung flags of the last segmentPointCloud, calculateObjTransform or segmentAndCalculateObjTransform,
+    // or of any cloud of the last batch. The asynchronous calls report theirs in SegmentationResult::degradation
+    unsigned int getLastDegradation() const { return last_degradation_; }
+    // names of the rungs, e.g. "coarse_downsample,skip_level1_superpixels", empty for none
+    static std::string getDegradationNames(const unsigned int &rungs);
 // --------------------------------- MAIN PARAMETERS for point cloud segmentation that needs to be set before initializeSemanticSegmentation ----------------------------------------
     void setDirectorySHOT(const std::string &path_to_shot_directory);
     void setDirectoryFPFH(const std::string &path_to_fpfh_directory);
@@ -123,6 +204,9 @@ public:
     void setDirectorySVM(const std::string &path_to_svm_directory, const bool &use_binary_svm, const bool &use_multi_class_svm);
     void setUseMultiClassSVM(const bool &use_multi_class_svm);
     void setUseBinarySVM(const bool &use_binary_svm);
+    // 0 uses the full precision liblinear models, 8 or 16 scores superpixels with int8/int16 weights.
+    // Needs to be called before setDirectorySVM
+    void setQuantizedSVMBits(const int &bits);
     template <typename NumericType>
         void setPointCloudDownsampleValue(const NumericType &down_ss);
     template <typename NumericType>
@@ -162,6 +246,9 @@ public:
     template <typename NumericType>
         void setCropAboveTableBoundary(const NumericType &min, const NumericType &max);
     void loadTableFromFile(const std::string &table_pcd_path);
+    // use a table convex hull from elsewhere (e.g. a recorded session) instead of segmenting or loading one
+    void setTableCornerPoints(const pcl::PointCloud<PointT>::Ptr &table_corner_points);
+    pcl::PointCloud<PointT>::Ptr getTableCornerPoints() const { return have_table_ ? table_corner_points_ : pcl::PointCloud<PointT>::Ptr(); }
     template <typename NumericType1, typename NumericType2, typename NumericType3>
         void setTableSegmentationParameters(const NumericType1 &table_distance_threshold,const NumericType2 &table_angular_threshold,const NumericType3 &table_minimal_inliers);
 
@@ -189,6 +276,28 @@ public:
 #endif
 
 protected:
+    // segmentPointCloud without touching stage_time_, so several clouds can be segmented at once
+    bool segmentCloud(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &input_cloud, pcl::PointCloud<pcl::PointXYZL>::Ptr &result, double *stage_time,
+        LatencyBudget &budget);
+    // segmentPointClouds with one budget per cloud
+    std::size_t segmentClouds(const std::vector<pcl::PointCloud<pcl::PointXYZRGBA>::Ptr> &input_clouds, std::vector<pcl::PointCloud<pcl::PointXYZL>::Ptr> &results,
+        std::vector<LatencyBudget> &budgets);
+    LatencyBudget startLatencyBudget(const bool &with_pose) const;
+    // seconds the stage is expected to take with the given rungs, 0 before any undegraded request
+    double expectedStageTime(const SegmentationStage &stage, const unsigned int &rungs);
+    // stage times of undegraded stages only, so the expectation stays the full cost
+    void updateExpectedStageTime(const SegmentationStage &stage, const double &seconds);
+#ifdef USE_OBJRECRANSAC
+    std::vector<objectTransformInformation> calculateObjTransform(const pcl::PointCloud<pcl::PointXYZL>::Ptr &labelled_point_cloud, LatencyBudget &budget);
+    // ObjRecRANSAC part of calculateObjTransform, can run for several clouds at once
+    std::vector<poseT> recognizePoses(const pcl::PointCloud<pcl::PointXYZL>::Ptr &labelled_point_cloud, LatencyBudget &budget);
+    // object tree part of calculateObjTransform, one call at a time
+    std::vector<objectTransformInformation> updateObjectTransforms(std::vector<poseT> all_poses);
+    // same, but leaves the tree alone and returns the poses it has if the budget skipped the pose estimation
+    std::vector<objectTransformInformation> updateObjectTransforms(const std::vector<poseT> &all_poses, const LatencyBudget &budget);
+    // (re)loads combined_ObjRecRANSAC_ with every model added so far
+    void loadCombinedObjRecRANSAC();
+#endif
     void cropPointCloud(pcl::PointCloud<PointT>::Ptr &cloud_input, 
         const Eigen::Affine3f &camera_transform_in_target, 
         const Eigen::Vector3f &box_size) const;
@@ -197,6 +306,14 @@ protected:
 #endif
     bool checkFolderExist(const std::string &directory_path) const;
     bool class_ready_;
+    double stage_time_[NUM_SEGMENTATION_STAGES];
+
+    // Latency budget
+    double latency_budget_;
+    unsigned int last_degradation_;
+    std::mutex expected_stage_time_mutex_;
+    // moving average of the undegraded stage times
+    double expected_stage_time_[NUM_SEGMENTATION_STAGES];
     bool visualizer_flag_;
 
     // Point Cloud Modifier Parameter
@@ -207,7 +324,10 @@ protected:
     // Training File Informations
     bool svm_loaded_, shot_loaded_, fpfh_loaded_, sift_loaded_;
     bool use_binary_svm_, use_multi_class_svm_;
-    std::vector<model*> binary_models_, multi_models_;
+    int quantized_svm_bits_;
+    // dictionaries, svm models, meshes and ObjRecRANSAC detectors come from the ModelRegistry and may be
+    // shared with other segmenters, they are never modified here
+    boost::shared_ptr<const SVMModelSet> svm_models_;
     std::vector<ModelT> mesh_set_;
     std::map<std::string, std::size_t> model_name_map_;
     std::size_t number_of_added_models_;
@@ -239,17 +359,21 @@ protected:
     // keep information about TF index
     std::map<std::string, unsigned int> object_class_transform_index_;
 #ifdef USE_OBJRECRANSAC
-    boost::shared_ptr<greedyObjRansac> combined_ObjRecRANSAC_;
-    std::vector<boost::shared_ptr<greedyObjRansac> > individual_ObjRecRANSAC_;
+    boost::shared_ptr<SharedObjRecRANSAC> combined_ObjRecRANSAC_;
+    std::vector<boost::shared_ptr<SharedObjRecRANSAC> > individual_ObjRecRANSAC_;
+    // the combined detector is built from all added models in initializeSemanticSegmentation
+    std::vector<std::string> combined_model_files_, combined_model_names_;
+    ModelObjRecRANSACParameter combined_parameter_;
 
     // map of symmetries for orientation normalization
     objectRtree segmented_object_tree_;
+    std::mutex object_tree_mutex_;
 #endif
     pcl::visualization::PCLVisualizer::Ptr viewer;
-    boost::shared_ptr<Hier_Pooler>  hie_producer;
-    std::vector< boost::shared_ptr<Pooler_L0> > sift_pooler_set;
-    std::vector< boost::shared_ptr<Pooler_L0> > fpfh_pooler_set;
-    std::vector< boost::shared_ptr<Pooler_L0> > lab_pooler_set;
+    boost::shared_ptr<const Hier_Pooler>  hie_producer;
+    boost::shared_ptr<const PoolerSet> sift_pooler_set;
+    boost::shared_ptr<const PoolerSet> fpfh_pooler_set;
+    boost::shared_ptr<const PoolerSet> lab_pooler_set;
     
     std::vector<cv::SiftFeatureDetector*> sift_det_vec;
 
@@ -14,10 +14,10 @@ void SemanticSegmentation::setMinConfidenceObjRecRANSAC(const NumericType &min_c
 template <typename NumericType>
 void SemanticSegmentation::setPreferredOrientation(const Eigen::Quaternion<NumericType> &base_rotation)
 {
-    if (!this->use_preferred_orientation_) std::cerr << "WARNING: setUsePreferredOrientation is false. No orientation preference will be used\n";
+    if (!this->use_preferred_orientation_) SP_LOG_WARN("setUsePreferredOrientation is false. No orientation preference will be used");
     else
     {
-        std::cerr << "Preferred orientation has been set.\n";
+        SP_LOG_INFO("Preferred orientation has been set.");
         this->base_rotation_ = base_rotation.template cast<double>  ();
     }
 }
@@ -20,6 +20,12 @@
 
 #include "sp_segmenter/features.h"
 
+// a mined hard negative and its svm margin
+struct ScoredFea{
+    float score;
+    sparseVec fea;
+};
+
 class feaExtractor{
 public:
     feaExtractor(): radius_(0.02), down_ss_(0.003), ratio_(0.1), order_(2), use_shot_(true), use_fpfh_(false), use_sift_(false) {};
@@ -50,6 +56,12 @@ public:
     // the vector final_fea stores the computed features for the in_path class at different orders
     // box_num: sample number extracted in one pcd files.
     int computeFeature(std::string in_path, std::vector< std::vector<sparseVec> > &final_fea, int box_num);
+
+    // score every superpixel of the background data in in_path with the binary models and keep the max_num
+    // highest scoring false positives for each order. hard_fea[ll] is a min-heap ordered by the svm margin
+    // projections[ll] is used with binary_models[ll] when it is not empty
+    int computeHardNegative(std::string in_path, const std::vector<model*> &binary_models, const std::vector<FeatureProjection> &projections, 
+        std::vector< std::vector<ScoredFea> > &hard_fea, std::size_t max_num);
     
 protected:
     void readData(std::string path, ObjectSet &scene_set);
@@ -79,7 +91,8 @@ public:
         shot_directory_("data/UW_shot_dict"), fpfh_directory_("data/UW_fpfh_dict"),
         binary_cc_(0.001), multi_cc_(0.001), background_sample_num_(66), foreground_sample_num_(100),
         skip_fea_(false), skip_background_(false), skip_multi_(false), cur_order_max_(3), 
-        use_shot_(true), use_fpfh_(false), use_sift_(false) 
+        use_shot_(true), use_fpfh_(false), use_sift_(false), fine_tune_eps_(0.1), hard_negative_num_(20000),
+        projection_type_("none"), projection_dim_(512)
     {
         pcl::console::setVerbosityLevel(pcl::console::L_ALWAYS);
     }
@@ -87,6 +100,19 @@ public:
     // Do the training
     void startTrainingSVM();
 
+    // Run the binary models in the SVM output directory over all background data, add the highest scoring
+    // false positives to the background features in the FEA output directory and retrain the binary models
+    void startHardNegativeMining();
+
+    // Quantize the models in the SVM output directory to int8 or int16 weights, report the accuracy loss against
+    // the full precision models on the features in the FEA output directory and save them next to them as *_f.qmodel
+    void calibrateQuantizedSVM(const int &bits);
+
+    // Register the last entry of setObjectNames as a new class on top of the models in base_svm_directory.
+    // Only the new class features are extracted, the other classes reuse the features cached in the FEA output directory.
+    // The new one-vs-rest model is trained from scratch while the existing ones are warm-started and fine-tuned.
+    void startIncrementalTrainingSVM(const std::string &base_svm_directory);
+
     // Setting up file IO locations. Return false if directory is not exist
     bool setInputPathSIFT(const std::string &directory_path);
     bool setInputPathSHOT(const std::string &directory_path);
@@ -136,10 +162,32 @@ public:
     // Skip Multi Class SVM (Inter Object classification)
     void setSkipMultiSVM(const bool &flag);
 
+    // stopping tolerance of the warm-started models in incremental training. Larger is shorter fine-tuning
+    template<typename NumericType>
+        void setFineTuneEps(const NumericType &eps)
+    {
+        fine_tune_eps_ = double(eps);
+    }
+
+    // maximum number of hard negatives added to the background class for each order
+    void setHardNegativeNumber(const unsigned int number_of_hard_negative);
+
+    // Reduce the features to projection_dim before svm training, projection_type is "none", "pca" or "random".
+    // The projection is saved next to each model as *_f.proj and applied by SemanticSegmentation
+    void setProjection(const std::string &projection_type, const unsigned int projection_dim);
+
 protected:
     bool checkFolderExist(const std::string &directory_path) const;
+    void setupExtractor(feaExtractor &ext) const;
     void extractFea();
+    void extractObjectFea(feaExtractor &object_ext, const std::size_t &object_idx);
+    bool loadTrainingProblem(const int &level, const bool &background_svm, problem &train_prob) const;
+    void freeTrainingProblem(problem &train_prob) const;
     void doSVM(const bool &background_svm);
+    void doIncrementalSVM(const bool &background_svm, const std::string &base_svm_directory);
+    void doQuantizeSVM(const bool &background_svm, const int &bits);
+    bool trainProjection(const problem &train_prob, FeatureProjection &projection) const;
+    void projectTrainingProblem(const FeatureProjection &projection, problem &train_prob) const;
 
     std::string trainining_directory_, sift_directory_, shot_directory_, fpfh_directory_;
     std::string fea_out_directory_, svm_out_directory_;
@@ -151,4 +199,8 @@ protected:
     unsigned int cur_order_max_;
 
     bool use_shot_, use_fpfh_, use_sift_;
+    double fine_tune_eps_;
+    unsigned int hard_negative_num_;
+    std::string projection_type_;
+    unsigned int projection_dim_;
 };
@@ -0,0 +1,20 @@
+#ifndef SP_SEGMENTER_LATENCY_SUMMARY_H
+#define SP_SEGMENTER_LATENCY_SUMMARY_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+// Latency statistics printed by sp_segmenter_bench and sp_segmenter_replay
+
+struct LatencySummary
+{
+    double mean, p50, p90, p99, max;
+};
+
+// samples in seconds, all zero without samples
+LatencySummary summarize(std::vector<double> samples);
+// writes "name": {"mean": ..., "p50": ..., ...} in milliseconds, one JSON member without the separator
+void writeSummary(std::ostream &os, const std::string &name, const std::vector<double> &samples);
+
+#endif // SP_SEGMENTER_LATENCY_SUMMARY_H
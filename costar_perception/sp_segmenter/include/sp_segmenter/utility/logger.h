@@ -0,0 +1,85 @@
+#ifndef SP_SEGMENTER_LOGGER_H
+#define SP_SEGMENTER_LOGGER_H
+
+#include <string>
+#include <sstream>
+#include <atomic>
+
+// Leveled logging for the segmentation path. Messages are formatted by the caller and queued, a background
+// thread writes them to stderr, so OpenMP workers do not serialize on the unbuffered stream.
+//
+//   SP_LOG_INFO("Loading SVM from " << path);
+//   SP_LOG_DEBUG_THROTTLE(1.0, "cloud set " << j << " size: " << size);   // at most once per second from here
+//
+// The level defaults to INFO and can be set with sp_log::setLevel or the SP_SEGMENTER_LOG_LEVEL environment
+// variable (debug, info, warn, error, none). Messages below the level are not formatted at all.
+// Error messages are written before the call returns, since an exit(0) often follows them.
+
+namespace sp_log
+{
+    enum Level
+    {
+        LEVEL_DEBUG = 0,
+        LEVEL_INFO,
+        LEVEL_WARN,
+        LEVEL_ERROR,
+        LEVEL_NONE
+    };
+
+    void setLevel(Level level);
+    Level getLevel();
+    /// Parses debug, info, warn, error or none, returns false and keeps the level otherwise
+    bool setLevel(const std::string &level);
+
+    inline bool enabled(Level level) { return level >= getLevel(); }
+
+    /// Queues one line. Returns immediately unless level is LEVEL_ERROR
+    void write(Level level, const std::string &message);
+    /// Blocks until every queued line is written
+    void flush();
+
+    /// Per call site rate limit, used by the *_THROTTLE macros
+    class Throttle
+    {
+    public:
+        Throttle() : last_(-1e30), suppressed_(0) {}
+        /// True if period seconds passed since the last allowed message, suppressed returns how many were skipped.
+        /// Safe to share between threads, only one of them wins a period
+        bool allow(double period, unsigned int &suppressed);
+    private:
+        std::atomic<double> last_;
+        std::atomic<unsigned int> suppressed_;
+    };
+}
+
+#define SP_LOG(level, msg) \
+    do { \
+        if (sp_log::enabled(level)) { \
+            std::ostringstream sp_log_stream; \
+            sp_log_stream << msg; \
+            sp_log::write(level, sp_log_stream.str()); \
+        } \
+    } while (0)
+
+#define SP_LOG_THROTTLE(level, period, msg) \
+    do { \
+        static sp_log::Throttle sp_log_throttle; \
+        unsigned int sp_log_suppressed = 0; \
+        if (sp_log::enabled(level) && sp_log_throttle.allow(period, sp_log_suppressed)) { \
+            std::ostringstream sp_log_stream; \
+            sp_log_stream << msg; \
+            if (sp_log_suppressed > 0) sp_log_stream << " (" << sp_log_suppressed << " similar messages suppressed)"; \
+            sp_log::write(level, sp_log_stream.str()); \
+        } \
+    } while (0)
+
+#define SP_LOG_DEBUG(msg) SP_LOG(sp_log::LEVEL_DEBUG, msg)
+#define SP_LOG_INFO(msg) SP_LOG(sp_log::LEVEL_INFO, msg)
+#define SP_LOG_WARN(msg) SP_LOG(sp_log::LEVEL_WARN, msg)
+#define SP_LOG_ERROR(msg) SP_LOG(sp_log::LEVEL_ERROR, msg)
+
+#define SP_LOG_DEBUG_THROTTLE(period, msg) SP_LOG_THROTTLE(sp_log::LEVEL_DEBUG, period, msg)
+#define SP_LOG_INFO_THROTTLE(period, msg) SP_LOG_THROTTLE(sp_log::LEVEL_INFO, period, msg)
+#define SP_LOG_WARN_THROTTLE(period, msg) SP_LOG_THROTTLE(sp_log::LEVEL_WARN, period, msg)
+
+#endif // SP_SEGMENTER_LOGGER_H
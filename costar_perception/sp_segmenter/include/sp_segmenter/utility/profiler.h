@@ -0,0 +1,102 @@
+#ifndef SP_SEGMENTER_PROFILER_H
+#define SP_SEGMENTER_PROFILER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+
+// Compile time switchable scoped timers and counters. They are only compiled in with SP_SEGMENTER_PROFILING
+// (cmake -DBUILD_ENABLE_PROFILING=ON), otherwise every SP_PROFILE_* macro expands to nothing and its
+// arguments are not evaluated.
+//
+//   SP_PROFILE_BEGIN_FRAME();                       // start a new per request report on this thread
+//   SP_PROFILE_SCOPE("spPooler/init");              // time until the end of the enclosing scope
+//   SP_PROFILE_COUNT("points/in", cloud->size());   // add to a counter
+//
+// A frame belongs to the request that began it, not to the process: probes record into the frame current on
+// their thread, and WorkerPool runs every task in the frame of the thread that submitted it, so the loops of a
+// request count towards it while concurrent segmenters and asynchronous calls keep their own frames.
+// Recording takes no lock and writes no shared memory: every thread adds to its own slots, which are merged into
+// the frame when the thread switches frames, ends a WorkerPool task or parallelFor chunk (SP_PROFILE_FLUSH), exits
+// or asks for the report. Probes with the same name are merged.
+
+struct ProfileEntry
+{
+    std::string name;
+    bool is_timer;
+    uint64_t calls;     // scopes closed or counter updates
+    double total_ms;    // timers only
+    double max_ms;      // timers only
+    int64_t value;      // counters only
+};
+
+namespace sp_profiler
+{
+#ifdef SP_SEGMENTER_PROFILING
+    class Frame;
+    typedef std::shared_ptr<Frame> FramePtr;
+
+    int registerProbe(const char *name, bool is_timer);
+    /// Adds nanoseconds to a timer or value to a counter of the current frame. A thread without frame gets one
+    void record(int probe, int64_t value);
+    /// Merges what the calling thread recorded into its frame, so the thread that owns the frame sees it in frameReport
+    void flush();
+    /// Starts a new frame and makes it current on the calling thread
+    void beginFrame();
+    /// The frame the calling thread records into, NULL before its first beginFrame or record
+    FramePtr currentFrame();
+
+    /// Makes frame current on the calling thread until the end of the scope
+    class ScopedFrame
+    {
+    public:
+        explicit ScopedFrame(const FramePtr &frame);
+        ~ScopedFrame();
+    private:
+        ScopedFrame(const ScopedFrame &);
+        ScopedFrame &operator=(const ScopedFrame &);
+        FramePtr previous_;
+    };
+
+    /// What was recorded in the current frame of the calling thread, by this thread and the tasks it submitted
+    std::vector<ProfileEntry> frameReport();
+
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(int probe);
+        ~ScopedTimer();
+    private:
+        int probe_;
+        int64_t start_;
+    };
+#else
+    inline std::vector<ProfileEntry> frameReport() { return std::vector<ProfileEntry>(); }
+#endif
+
+    /// One line per entry, for logs
+    std::string formatReport(const std::vector<ProfileEntry> &report);
+}
+
+#ifdef SP_SEGMENTER_PROFILING
+#define SP_PROFILE_CONCAT_(a, b) a##b
+#define SP_PROFILE_CONCAT(a, b) SP_PROFILE_CONCAT_(a, b)
+#define SP_PROFILE_SCOPE(name) \
+    static const int SP_PROFILE_CONCAT(sp_profile_probe_, __LINE__) = sp_profiler::registerProbe(name, true); \
+    sp_profiler::ScopedTimer SP_PROFILE_CONCAT(sp_profile_timer_, __LINE__)(SP_PROFILE_CONCAT(sp_profile_probe_, __LINE__))
+#define SP_PROFILE_COUNT(name, value) \
+    do { \
+        static const int sp_profile_probe = sp_profiler::registerProbe(name, false); \
+        sp_profiler::record(sp_profile_probe, (int64_t)(value)); \
+    } while (0)
+#define SP_PROFILE_BEGIN_FRAME() sp_profiler::beginFrame()
+#define SP_PROFILE_FLUSH() sp_profiler::flush()
+#else
+#define SP_PROFILE_SCOPE(name)
+#define SP_PROFILE_COUNT(name, value)
+#define SP_PROFILE_BEGIN_FRAME()
+#define SP_PROFILE_FLUSH()
+#endif
+
+#endif // SP_SEGMENTER_PROFILER_H
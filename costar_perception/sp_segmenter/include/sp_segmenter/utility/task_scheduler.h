@@ -0,0 +1,59 @@
+#ifndef SP_SEGMENTER_TASK_SCHEDULER_H
+#define SP_SEGMENTER_TASK_SCHEDULER_H
+
+#include <atomic>
+#include <string>
+#include <functional>
+
+// Runs the parallel loops of the segmentation path on WorkerPool::shared() instead of one OpenMP team per loop,
+// so the loops of a frame, of the frames of a batch and of several segmenters share one set of threads.
+//
+//   TaskScheduler::instance().parallelFor(TASK_CLASSIFY, 0, num, 8, [&](int j) { labels[j] = predict(j); });
+//
+// The calling thread runs iterations as well and the loop returns once all of them are done, so loops nest:
+// an inner loop queues its helpers like any other, and the caller makes progress even if no helper starts.
+// Every stage has a limit of threads running its loops at once over the whole process, set with setStageLimit or
+// SP_SEGMENTER_STAGE_THREADS (e.g. "features=4,pose=2"). A calling thread always runs its own loop and counts
+// towards the limit, the helpers only start while the stage is below it.
+// Libraries that start their own OpenMP threads (PCL *OMP estimators, ObjRecRANSAC) ask getLibraryThreads.
+
+enum TaskStage
+{
+    TASK_FEATURES = 0,  // normals, descriptors and their encoding
+    TASK_POOLING,       // superpixel feature pooling
+    TASK_CLASSIFY,      // SVM prediction of the superpixels
+    TASK_POSE,          // ObjRecRANSAC
+    NUM_TASK_STAGES
+};
+
+class TaskScheduler
+{
+public:
+    static TaskScheduler &instance();
+
+    // threads = 0 removes the limit, the stage may use the whole pool
+    void setStageLimit(const TaskStage &stage, const int &threads);
+    int getStageLimit(const TaskStage &stage) const;
+    // parses comma separated stage=threads pairs, returns false and changes nothing on errors
+    bool setStageLimits(const std::string &limits);
+    static const char *getStageName(const TaskStage &stage);
+
+    // threads a library may start for the stage: the stage limit, but 1 inside a loop, on a pool thread or in an
+    // OpenMP region, where the other threads already use the cores
+    int getLibraryThreads(const TaskStage &stage) const;
+
+    // body(i) for every i in [begin, end), grain iterations are taken at a time. The first exception thrown by
+    // body is rethrown once the loop is done, the iterations not started by then are skipped
+    void parallelFor(const TaskStage &stage, const int &begin, const int &end, const int &grain, const std::function<void(int)> &body);
+
+private:
+    TaskScheduler();
+    TaskScheduler(const TaskScheduler &);
+    TaskScheduler &operator=(const TaskScheduler &);
+
+    std::atomic<int> limits_[NUM_TASK_STAGES];
+    // threads running loops of the stage right now
+    std::atomic<int> active_[NUM_TASK_STAGES];
+};
+
+#endif // SP_SEGMENTER_TASK_SCHEDULER_H
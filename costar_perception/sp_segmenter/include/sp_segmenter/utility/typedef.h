@@ -68,7 +68,6 @@
 #define HNUM 50
 #define SNUM 20
 #define INUM 10
-#define THREADNUM 8
 #define FOCAL_LEN 525.0
 
 #define INF_ 10000000
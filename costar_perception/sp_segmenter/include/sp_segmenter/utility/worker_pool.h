@@ -0,0 +1,86 @@
+#ifndef SP_SEGMENTER_WORKER_POOL_H
+#define SP_SEGMENTER_WORKER_POOL_H
+
+#include <deque>
+#include <string>
+#include <mutex>
+#include <future>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#include "sp_segmenter/utility/profiler.h"
+
+// Fixed set of threads running queued tasks in submission order, used by the batch and asynchronous
+// SemanticSegmentation calls.
+//
+//   std::future<bool> done = WorkerPool::shared().submit(std::bind(&work, cloud));
+//
+// The shared pool has one thread per core, or SP_SEGMENTER_WORKERS threads if that environment variable is set.
+// SP_SEGMENTER_CPUS (e.g. "0-7,12") keeps its threads on those cpus, with one thread per listed cpu by default,
+// SP_SEGMENTER_PIN_THREADS=1 additionally puts every thread on a single cpu of the list.
+// Tasks record their SP_PROFILE_* probes into the profiler frame of the thread that submitted them.
+// A task must not wait for another task of the same pool, all threads may be busy waiting then. Loops that need
+// helpers go through TaskScheduler::parallelFor, which runs them on the waiting thread as well.
+
+class WorkerPool
+{
+public:
+    // threads = 0 uses one thread per core, or one per cpu if cpus is given. The threads only run on cpus,
+    // pin_threads puts thread i on cpus[i % cpus.size()] alone. Affinity is ignored outside linux
+    explicit WorkerPool(const std::size_t &threads = 0, const std::vector<int> &cpus = std::vector<int>(), const bool &pin_threads = false);
+    // runs the queued tasks, then joins the threads
+    ~WorkerPool();
+
+    static WorkerPool &shared();
+
+    std::size_t size() const { return workers_.size(); }
+    // true on the threads of any WorkerPool
+    static bool isWorkerThread();
+    // parses a cpu list like "0-3,8,10-11", returns false on errors
+    static bool parseCPUList(const std::string &list, std::vector<int> &cpus);
+
+    template <typename Function>
+        std::future<typename std::result_of<Function()>::type> submit(Function task);
+
+private:
+    WorkerPool(const WorkerPool &);
+    WorkerPool &operator=(const WorkerPool &);
+
+    // cpus of SP_SEGMENTER_CPUS, empty if unset or invalid
+    static std::vector<int> sharedCPUs();
+    void run();
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<std::function<void()> > queue_;
+    bool stop_;
+};
+
+template <typename Function>
+std::future<typename std::result_of<Function()>::type> WorkerPool::submit(Function task)
+{
+    typedef typename std::result_of<Function()>::type Result;
+    // std::function needs a copyable target, packaged_task is move only
+#ifdef SP_SEGMENTER_PROFILING
+    // the task leaves its frame, merging its probes, before the future is ready
+    sp_profiler::FramePtr frame = sp_profiler::currentFrame();
+    std::shared_ptr<std::packaged_task<Result()> > job(new std::packaged_task<Result()>([task, frame]() -> Result {
+        sp_profiler::ScopedFrame scope(frame);
+        return task();
+    }));
+#else
+    std::shared_ptr<std::packaged_task<Result()> > job(new std::packaged_task<Result()>(task));
+#endif
+    std::future<Result> result = job->get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back([job]() { (*job)(); });
+    }
+    wake_.notify_one();
+    return result;
+}
+
+#endif // SP_SEGMENTER_WORKER_POOL_H
@@ -0,0 +1,226 @@
+#ifndef PY_NUMPY_UTILS
+#define PY_NUMPY_UTILS
+// NumPy interop for the python bindings. Clouds produced in C++ are returned as read only NumPy views of the
+// PCL points, which keep the cloud alive, so nothing is copied. NumPy input is converted to a PCL cloud in one
+// pass without the GIL.
+// Include after boost/python.hpp and call initNumpy() at the start of the module.
+
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <boost/python.hpp>
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+#if PY_MAJOR_VERSION >= 3
+void *initNumpy()
+{
+  import_array();
+  return NULL;
+}
+#else
+void initNumpy()
+{
+  import_array();
+}
+#endif
+
+/// @brief Releases the GIL until the end of the scope, so other python threads
+///        (e.g. a second segmenter) run while C++ works. No python API calls allowed inside.
+class ScopedGILRelease
+{
+public:
+  ScopedGILRelease() : state_(PyEval_SaveThread()) {}
+  ~ScopedGILRelease() { PyEval_RestoreThread(state_); }
+private:
+  PyThreadState *state_;
+};
+
+template <typename PointType>
+void destroyCloudCapsule(PyObject *capsule)
+{
+  delete static_cast<typename pcl::PointCloud<PointType>::Ptr *>(PyCapsule_GetPointer(capsule, "sp_segmenter.cloud"));
+}
+
+/// @brief Read only view of one field of every point. Organized clouds are viewed as height x width,
+///        channels > 0 adds a last dimension of that many elements.
+template <typename PointType>
+boost::python::object makeCloudView(const typename pcl::PointCloud<PointType>::Ptr &cloud, const int &type,
+  const std::size_t &field_offset, const int &element_size, const int &channels)
+{
+  namespace python = boost::python;
+  if (!cloud)
+    return python::object();
+
+  npy_intp dims[3], strides[3];
+  int nd = 0;
+  if (cloud->height > 1 && std::size_t(cloud->width) * cloud->height == cloud->size())
+  {
+    dims[nd] = cloud->height;
+    strides[nd++] = npy_intp(sizeof(PointType)) * cloud->width;
+    dims[nd] = cloud->width;
+    strides[nd++] = sizeof(PointType);
+  }
+  else
+  {
+    dims[nd] = cloud->size();
+    strides[nd++] = sizeof(PointType);
+  }
+  if (channels > 0)
+  {
+    dims[nd] = channels;
+    strides[nd++] = element_size;
+  }
+
+  // an empty cloud has no storage, numpy allocates the (empty) array itself then
+  char *data = cloud->empty() ? NULL : reinterpret_cast<char *>(&cloud->points[0]) + field_offset;
+  PyObject *array = PyArray_New(&PyArray_Type, nd, dims, type, data ? strides : NULL, data, element_size, NPY_ARRAY_ALIGNED, NULL);
+  if (array == NULL)
+    python::throw_error_already_set();
+  if (data != NULL)
+  {
+    // the array owns a reference to the cloud, the cloud lives as long as any view of it
+    PyObject *owner = PyCapsule_New(new typename pcl::PointCloud<PointType>::Ptr(cloud), "sp_segmenter.cloud", destroyCloudCapsule<PointType>);
+    if (owner == NULL || PyArray_SetBaseObject(reinterpret_cast<PyArrayObject *>(array), owner) < 0)
+    {
+      Py_DECREF(array);
+      python::throw_error_already_set();
+    }
+  }
+  return python::object(python::handle<>(array));
+}
+
+template <typename PointType>
+std::size_t fieldOffset(const PointType &point, const void *field)
+{
+  return reinterpret_cast<const char *>(field) - reinterpret_cast<const char *>(&point);
+}
+
+/// @brief x, y, z of a cloud as float32 (N,3) or (H,W,3) view
+template <typename PointType>
+boost::python::object pointsToArray(const typename pcl::PointCloud<PointType>::Ptr &cloud)
+{
+  PointType p;
+  return makeCloudView<PointType>(cloud, NPY_FLOAT32, fieldOffset(p, &p.x), sizeof(float), 3);
+}
+
+/// @brief colors of a cloud as uint8 (N,4) or (H,W,4) view in memory order: b, g, r, a
+boost::python::object colorsToArray(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloud)
+{
+  pcl::PointXYZRGBA p;
+  return makeCloudView<pcl::PointXYZRGBA>(cloud, NPY_UINT8, fieldOffset(p, &p.rgba), 1, 4);
+}
+
+/// @brief labels of a labelled cloud as uint32 (N,) or (H,W) view
+boost::python::object labelsToArray(const pcl::PointCloud<pcl::PointXYZL>::Ptr &cloud)
+{
+  pcl::PointXYZL p;
+  return makeCloudView<pcl::PointXYZL>(cloud, NPY_UINT32, fieldOffset(p, &p.label), sizeof(uint32_t), 0);
+}
+
+inline uint8_t clampColor(const float &value)
+{
+  return value <= 0 ? 0 : (value >= 255 ? 255 : uint8_t(value + 0.5f));
+}
+
+/// @brief Builds a cloud from float points with shape (N,C) or (H,W,C):
+///        C = 3: x, y, z. C = 4: x, y, z and a PCL packed rgb float. C = 6: x, y, z, r, g, b with colors in 0-255.
+///        colors optionally gives uint8 r, g, b of the same points as (N,3) or (H,W,3).
+///        float32 C contiguous input is read in place, anything else is converted by numpy first.
+pcl::PointCloud<pcl::PointXYZRGBA>::Ptr arrayToPointCloud(const boost::python::object &points, const boost::python::object &colors)
+{
+  namespace python = boost::python;
+  PyObject *points_array = PyArray_FROMANY(points.ptr(), NPY_FLOAT32, 2, 3, NPY_ARRAY_IN_ARRAY);
+  if (points_array == NULL)
+    python::throw_error_already_set();
+  python::handle<> points_handle(points_array);
+  PyArrayObject *xyz = reinterpret_cast<PyArrayObject *>(points_array);
+
+  int nd = PyArray_NDIM(xyz);
+  npy_intp *dims = PyArray_DIMS(xyz);
+  int columns = dims[nd - 1];
+  if (columns != 3 && columns != 4 && columns != 6)
+  {
+    PyErr_SetString(PyExc_ValueError, "points must have 3 (xyz), 4 (xyz, packed rgb) or 6 (xyz, rgb) values per point");
+    python::throw_error_already_set();
+  }
+  uint32_t height = nd == 3 ? dims[0] : 1;
+  uint32_t width = nd == 3 ? dims[1] : dims[0];
+
+  python::handle<> colors_handle;
+  const uint8_t *rgb = NULL;
+  if (!colors.is_none())
+  {
+    PyObject *colors_array = PyArray_FROMANY(colors.ptr(), NPY_UINT8, 2, 3, NPY_ARRAY_IN_ARRAY);
+    if (colors_array == NULL)
+      python::throw_error_already_set();
+    colors_handle = python::handle<>(colors_array);
+    PyArrayObject *c = reinterpret_cast<PyArrayObject *>(colors_array);
+    if (PyArray_DIMS(c)[PyArray_NDIM(c) - 1] != 3 || PyArray_SIZE(c) != npy_intp(width) * height * 3)
+    {
+      PyErr_SetString(PyExc_ValueError, "colors must be uint8 r, g, b with one row per point");
+      python::throw_error_already_set();
+    }
+    rgb = static_cast<const uint8_t *>(PyArray_DATA(c));
+  }
+
+  const float *src = static_cast<const float *>(PyArray_DATA(xyz));
+  pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGBA>);
+  {
+    // the handles keep the arrays alive, only their memory is read from here on
+    ScopedGILRelease no_gil;
+    std::size_t n = std::size_t(width) * height;
+    cloud->resize(n);
+    cloud->width = width;
+    cloud->height = height;
+    bool is_dense = true;
+    for (std::size_t i = 0; i < n; i++)
+    {
+      const float *row = src + i * columns;
+      pcl::PointXYZRGBA &p = cloud->points[i];
+      p.x = row[0];
+      p.y = row[1];
+      p.z = row[2];
+      is_dense = is_dense && pcl_isfinite(p.x) && pcl_isfinite(p.y) && pcl_isfinite(p.z);
+
+      if (rgb != NULL)
+      {
+        p.r = rgb[i * 3];
+        p.g = rgb[i * 3 + 1];
+        p.b = rgb[i * 3 + 2];
+      }
+      else if (columns == 4)
+        memcpy(&p.rgba, &row[3], sizeof(uint32_t));
+      else if (columns == 6)
+      {
+        p.r = clampColor(row[3]);
+        p.g = clampColor(row[4]);
+        p.b = clampColor(row[5]);
+      }
+      else
+        p.r = p.g = p.b = 0;
+      p.a = 255;
+    }
+    cloud->is_dense = is_dense;
+  }
+  return cloud;
+}
+
+pcl::PointCloud<pcl::PointXYZRGBA>::Ptr arrayToPointCloudNoColor(const boost::python::object &points)
+{
+  return arrayToPointCloud(points, boost::python::object());
+}
+
+/// @brief zero filled array of the given shape and type, owned by numpy
+boost::python::object newArray(const int &nd, npy_intp *dims, const int &type)
+{
+  PyObject *array = PyArray_ZEROS(nd, dims, type, 0);
+  if (array == NULL)
+    boost::python::throw_error_already_set();
+  return boost::python::object(boost::python::handle<>(array));
+}
+
+#endif
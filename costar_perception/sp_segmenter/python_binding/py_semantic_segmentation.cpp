@@ -5,10 +5,12 @@
 **************/
 #include <boost/python.hpp>
 #include <boost/python/suite/indexing/vector_indexing_suite.hpp>
+#include <boost/python/stl_iterator.hpp>
 
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
 #include "py_input_to_cpp_utils.h"
+#include "py_numpy_utils.h"
 #include "sp_segmenter/semantic_segmentation.h"
 using namespace boost::python;
 
@@ -21,6 +23,128 @@ void printAllObjectTransformInformation(std::vector<objectTransformInformation>
     }
 }
 
+// poses as arrays: "poses" (K,7) with x, y, z, qw, qx, qy, qz in the camera frame, "confidence" (K,),
+// "model_index" (K,) and the lists "model_names" and "transform_names"
+dict posesToArrays(const std::vector<objectTransformInformation> &poses)
+{
+    npy_intp pose_dims[2] = {npy_intp(poses.size()), 7};
+    npy_intp dims[1] = {npy_intp(poses.size())};
+    object pose_array = newArray(2, pose_dims, NPY_FLOAT64);
+    object confidence_array = newArray(1, dims, NPY_FLOAT64);
+    object index_array = newArray(1, dims, NPY_INT32);
+    double *pose = static_cast<double *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(pose_array.ptr())));
+    double *confidence = static_cast<double *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(confidence_array.ptr())));
+    int32_t *model_index = static_cast<int32_t *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(index_array.ptr())));
+
+    list model_names, transform_names;
+    for (std::size_t i = 0; i < poses.size(); i++)
+    {
+        const objectTransformInformation &p = poses[i];
+        double values[7] = {p.origin_.x(), p.origin_.y(), p.origin_.z(), p.rotation_.w(), p.rotation_.x(), p.rotation_.y(), p.rotation_.z()};
+        std::copy(values, values + 7, pose + i * 7);
+        confidence[i] = p.confidence_;
+        model_index[i] = p.model_index_;
+        model_names.append(p.model_name_);
+        transform_names.append(p.transform_name_);
+    }
+
+    dict result;
+    result["poses"] = pose_array;
+    result["confidence"] = confidence_array;
+    result["model_index"] = index_array;
+    result["model_names"] = model_names;
+    result["transform_names"] = transform_names;
+    return result;
+}
+
+// The wrappers below release the GIL while segmenting, so python threads (e.g. another segmenter) keep running
+
+bool segmentPointCloudNoGIL(SemanticSegmentation &segmenter, const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &input_cloud, pcl::PointCloud<pcl::PointXYZL>::Ptr &result)
+{
+    ScopedGILRelease no_gil;
+    return segmenter.segmentPointCloud(input_cloud, result);
+}
+
+bool getTableSurfaceFromPointCloudNoGIL(SemanticSegmentation &segmenter, const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &input_cloud, const bool &save_table_pcd, const std::string &save_directory_path)
+{
+    ScopedGILRelease no_gil;
+    return segmenter.getTableSurfaceFromPointCloud(input_cloud, save_table_pcd, save_directory_path);
+}
+
+// segments a list of clouds on the worker pool, returns the labelled clouds with None for the failed ones
+list segmentPointClouds(SemanticSegmentation &segmenter, const object &input_clouds)
+{
+    std::vector<pcl::PointCloud<pcl::PointXYZRGBA>::Ptr> inputs((stl_input_iterator<pcl::PointCloud<pcl::PointXYZRGBA>::Ptr>(input_clouds)),
+        stl_input_iterator<pcl::PointCloud<pcl::PointXYZRGBA>::Ptr>());
+    std::vector<pcl::PointCloud<pcl::PointXYZL>::Ptr> results;
+    {
+        ScopedGILRelease no_gil;
+        segmenter.segmentPointClouds(inputs, results);
+    }
+    list labelled_clouds;
+    for (std::size_t i = 0; i < results.size(); i++)
+        labelled_clouds.append(results[i] ? object(results[i]) : object());
+    return labelled_clouds;
+}
+
+// returns the labelled cloud, or None if the segmentation failed
+object segmentArray(SemanticSegmentation &segmenter, const object &points, const object &colors)
+{
+    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr input_cloud = arrayToPointCloud(points, colors);
+    pcl::PointCloud<pcl::PointXYZL>::Ptr result;
+    if (!segmentPointCloudNoGIL(segmenter, input_cloud, result))
+        return object();
+    return object(result);
+}
+
+object segmentArrayNoColor(SemanticSegmentation &segmenter, const object &points)
+{
+    return segmentArray(segmenter, points, object());
+}
+
+#ifdef USE_OBJRECRANSAC
+std::vector<objectTransformInformation> calculateObjTransformNoGIL(SemanticSegmentation &segmenter, const pcl::PointCloud<pcl::PointXYZL>::Ptr &labelled_point_cloud)
+{
+    ScopedGILRelease no_gil;
+    return segmenter.calculateObjTransform(labelled_point_cloud);
+}
+
+bool segmentAndCalculateObjTransformNoGIL(SemanticSegmentation &segmenter, const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &input_cloud,
+    pcl::PointCloud<pcl::PointXYZL>::Ptr &labelled_point_cloud_result, std::vector<objectTransformInformation> &object_transform_result)
+{
+    ScopedGILRelease no_gil;
+    return segmenter.segmentAndCalculateObjTransform(input_cloud, labelled_point_cloud_result, object_transform_result);
+}
+
+std::vector<objectTransformInformation> getUpdateOnOneObjTransformNoGIL(SemanticSegmentation &segmenter, const pcl::PointCloud<pcl::PointXYZL>::Ptr &labelled_point_cloud,
+    const std::string &transform_name, const std::string &object_type)
+{
+    ScopedGILRelease no_gil;
+    return segmenter.getUpdateOnOneObjTransform(labelled_point_cloud, transform_name, object_type);
+}
+
+dict calculatePoseArrays(SemanticSegmentation &segmenter, const pcl::PointCloud<pcl::PointXYZL>::Ptr &labelled_point_cloud)
+{
+    return posesToArrays(calculateObjTransformNoGIL(segmenter, labelled_point_cloud));
+}
+
+// returns (labelled cloud, pose arrays), or None if the segmentation failed
+object segmentAndCalculatePoseArrays(SemanticSegmentation &segmenter, const object &points, const object &colors)
+{
+    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr input_cloud = arrayToPointCloud(points, colors);
+    pcl::PointCloud<pcl::PointXYZL>::Ptr labelled_point_cloud;
+    std::vector<objectTransformInformation> poses;
+    if (!segmentAndCalculateObjTransformNoGIL(segmenter, input_cloud, labelled_point_cloud, poses))
+        return object();
+    return make_tuple(labelled_point_cloud, posesToArrays(poses));
+}
+
+object segmentAndCalculatePoseArraysNoColor(SemanticSegmentation &segmenter, const object &points)
+{
+    return segmentAndCalculatePoseArrays(segmenter, points, object());
+}
+#endif
+
 void (SemanticSegmentation::*setCropBoxSize_d)(const double &,const double &,const double &) = &SemanticSegmentation::setCropBoxSize;
 void (SemanticSegmentation::*setCropBoxSize_f)(const float &,const float &,const float &) = &SemanticSegmentation::setCropBoxSize;
 void (SemanticSegmentation::*setDirectorySVM_1)(const std::string &) =  &SemanticSegmentation::setDirectorySVM;
@@ -28,10 +152,25 @@ void (SemanticSegmentation::*setDirectorySVM_2)(const std::string &, const bool
 
 BOOST_PYTHON_MODULE(SemanticSegmentationPy)
 {
+    initNumpy();
+#if PY_VERSION_HEX < 0x03070000
+    // needed before the GIL can be released in older pythons
+    PyEval_InitThreads();
+#endif
+
     def("loadPointCloudFromFile",loadPointCloudFromFile);
     def("makeEigenPose",makeEigenPose);
     def("printAllPoses",printAllObjectTransformInformation);
 
+    // NumPy interop, the *ToArray functions return read only views that keep the cloud alive
+    def("arrayToPointCloud", arrayToPointCloud);
+    def("arrayToPointCloud", arrayToPointCloudNoColor);
+    def("pointCloudToArray", pointsToArray<pcl::PointXYZRGBA>);
+    def("pointCloudColorsToArray", colorsToArray);
+    def("labelledCloudToArray", pointsToArray<pcl::PointXYZL>);
+    def("labelsToArray", labelsToArray);
+    def("posesToArrays", posesToArrays);
+
     class_<Eigen::Quaternionf>("EigenQuaternion")
         .def(init<float,float,float,float>())
         .def(init<double,double,double,double>())
@@ -66,10 +205,14 @@ BOOST_PYTHON_MODULE(SemanticSegmentationPy)
         .def(vector_indexing_suite< std::vector<objectTransformInformation>, true>())
     ;
 
-    class_<SemanticSegmentation>("SemanticSegmentation")
+    // holds mutexes, python only gets references to it
+    class_<SemanticSegmentation, boost::noncopyable>("SemanticSegmentation")
         .def("initializeSemanticSegmentation", &SemanticSegmentation::initializeSemanticSegmentation)
-        .def("segmentPointCloud", &SemanticSegmentation::segmentPointCloud)
-        .def("getTableSurfaceFromPointCloud",&SemanticSegmentation::getTableSurfaceFromPointCloud)
+        .def("segmentPointCloud", segmentPointCloudNoGIL)
+        .def("segmentPointClouds", segmentPointClouds)
+        .def("segmentArray", segmentArray)
+        .def("segmentArray", segmentArrayNoColor)
+        .def("getTableSurfaceFromPointCloud",getTableSurfaceFromPointCloudNoGIL)
         .def("convertPointCloudLabelToRGBA",&SemanticSegmentation::convertPointCloudLabelToRGBA)
         .def("setDirectorySHOT",&SemanticSegmentation::setDirectorySHOT)
         .def("setDirectoryFPFH",&SemanticSegmentation::setDirectoryFPFH)
@@ -81,10 +224,16 @@ BOOST_PYTHON_MODULE(SemanticSegmentationPy)
         .def("setDirectorySVM",setDirectorySVM_2)
         .def("setUseMultiClassSVM",&SemanticSegmentation::setUseMultiClassSVM)
         .def("setUseBinarySVM",&SemanticSegmentation::setUseBinarySVM)
+        .def("setQuantizedSVMBits",&SemanticSegmentation::setQuantizedSVMBits)
         .def("setPointCloudDownsampleValue",&SemanticSegmentation::setPointCloudDownsampleValue<double>)
         .def("setPointCloudDownsampleValue",&SemanticSegmentation::setPointCloudDownsampleValue<float>)
         .def("setHierFeaRatio",&SemanticSegmentation::setHierFeaRatio<double>)
         .def("setHierFeaRatio",&SemanticSegmentation::setHierFeaRatio<float>)
+        .def("setLatencyBudget",&SemanticSegmentation::setLatencyBudget)
+        .def("getLatencyBudget",&SemanticSegmentation::getLatencyBudget)
+        .def("getLastDegradation",&SemanticSegmentation::getLastDegradation)
+        .def("getDegradationNames",&SemanticSegmentation::getDegradationNames)
+        .staticmethod("getDegradationNames")
 
         .def("setUseVisualization", &SemanticSegmentation::setUseVisualization)
         .def("setUseTableSegmentation", &SemanticSegmentation::setUseTableSegmentation)
@@ -107,9 +256,12 @@ BOOST_PYTHON_MODULE(SemanticSegmentationPy)
         .def("setModeObjRecRANSAC", &SemanticSegmentation::setModeObjRecRANSAC)
         .def("setMinConfidenceObjRecRANSAC", &SemanticSegmentation::setMinConfidenceObjRecRANSAC<double>)
         .def("setMinConfidenceObjRecRANSAC", &SemanticSegmentation::setMinConfidenceObjRecRANSAC<float>)
-        .def("calculateObjTransform", &SemanticSegmentation::calculateObjTransform)
-        .def("segmentAndCalculateObjTransform", &SemanticSegmentation::segmentAndCalculateObjTransform)
-        .def("getUpdateOnOneObjTransform", &SemanticSegmentation::getUpdateOnOneObjTransform)  
+        .def("calculateObjTransform", calculateObjTransformNoGIL)
+        .def("calculatePoseArrays", calculatePoseArrays)
+        .def("segmentAndCalculateObjTransform", segmentAndCalculateObjTransformNoGIL)
+        .def("segmentAndCalculatePoseArrays", segmentAndCalculatePoseArrays)
+        .def("segmentAndCalculatePoseArrays", segmentAndCalculatePoseArraysNoColor)
+        .def("getUpdateOnOneObjTransform", getUpdateOnOneObjTransformNoGIL)
         .def("addModel", &SemanticSegmentation::addModel)
         // .def("setUsePreferredOrientation", &SemanticSegmentation::setUsePreferredOrientation)
         .def("setPreferredOrientation", &SemanticSegmentation::setPreferredOrientation<float>)
@@ -23,6 +23,9 @@ BOOST_PYTHON_MODULE(SpCompactPy)
 
     class_<SpCompact>("SpCompact")
         .def("startTrainingSVM", &SpCompact::startTrainingSVM)
+        .def("startIncrementalTrainingSVM", &SpCompact::startIncrementalTrainingSVM)
+        .def("startHardNegativeMining", &SpCompact::startHardNegativeMining)
+        .def("calibrateQuantizedSVM", &SpCompact::calibrateQuantizedSVM)
 
         .def("setInputPathSIFT", &SpCompact::setInputPathSIFT)
         .def("setInputPathSHOT", &SpCompact::setInputPathSHOT)
@@ -52,5 +55,8 @@ BOOST_PYTHON_MODULE(SpCompactPy)
         .def("setSkipFeaExtraction", &SpCompact::setSkipFeaExtraction)
         .def("setSkipBackgroundSVM", &SpCompact::setSkipBackgroundSVM)
         .def("setSkipMultiSVM", &SpCompact::setSkipMultiSVM)
+        .def("setFineTuneEps", &SpCompact::setFineTuneEps<double>)
+        .def("setHardNegativeNumber", &SpCompact::setHardNegativeNumber)
+        .def("setProjection", &SpCompact::setProjection)
     ;
 }
\ No newline at end of file
@@ -1,3 +1,4 @@
+import numpy
 from sp_segmenter.SemanticSegmentationPy import *
 
 segmenter = SemanticSegmentation()
@@ -99,3 +100,11 @@ if segmenter.segmentPointCloud(raw_unsegmented_points_that_contains_objects, seg
         print "List of detected object transform: ";
         printAllPoses(segmenter.calculateObjTransform(segmented_point_cloud_labels));
 
+
+# The same cloud as NumPy arrays: the arrays are views of the clouds, nothing is copied
+points = pointCloudToArray(raw_unsegmented_points_that_contains_objects)
+rgb = pointCloudColorsToArray(raw_unsegmented_points_that_contains_objects)[..., 2::-1]
+labelled_point_cloud = segmenter.segmentArray(points, rgb)
+if labelled_point_cloud is not None:
+    labels = labelsToArray(labelled_point_cloud)
+    print "Points per label: ", numpy.bincount(labels.ravel());
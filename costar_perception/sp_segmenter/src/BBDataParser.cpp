@@ -1,4 +1,5 @@
 #include "sp_segmenter/BBDataParser.h"
+#include "sp_segmenter/utility/task_scheduler.h"
 
 void readBBTrainALL(std::string path, std::string sub_path, CloudSet &clouds, NormalSet &normals, int c1, int c2)
 {
@@ -293,7 +294,7 @@ void BBStreamingNormal(std::string path, std::string sub_path, float radius, int
             pcl::NormalEstimationOMP<PointT, NormalT> normal_estimation;
             pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT>);
             normal_estimation.setSearchMethod (tree);
-            normal_estimation.setNumberOfThreads(8);
+            normal_estimation.setNumberOfThreads(TaskScheduler::instance().getLibraryThreads(TASK_FEATURES));
             normal_estimation.setRadiusSearch(radius);
             normal_estimation.setInputCloud (cloud);
             normal_estimation.setViewPoint(0,0,1);
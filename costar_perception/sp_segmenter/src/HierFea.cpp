@@ -1,6 +1,8 @@
 #include <opencv2/core/core.hpp>
 
 #include "sp_segmenter/features.h"
+#include "sp_segmenter/utility/profiler.h"
+#include "sp_segmenter/utility/task_scheduler.h"
 
 Hier_Pooler::Hier_Pooler(float rad)
 {
@@ -92,8 +94,9 @@ std::vector<int> Hier_Pooler::LoadDict_L2(std::string dict_path, std::vector<std
     return fea_dim;
 }
 
-void Hier_Pooler::computeRaw_L0(MulInfoT &data, cv::Mat& depth_fea, cv::Mat& color_fea, float rad)
+void Hier_Pooler::computeRaw_L0(MulInfoT &data, cv::Mat& depth_fea, cv::Mat& color_fea, float rad) const
 {
+    SP_PROFILE_SCOPE("Hier_Pooler/cshot");
     cv::Mat high_fea = cshot_cloud_ss(data.cloud, data.cloud_normals, data.down_lrf, data.down_cloud, rad, -1);
     
     depth_fea = cv::Mat::zeros(high_fea.rows, 352, CV_32FC1);
@@ -102,17 +105,15 @@ void Hier_Pooler::computeRaw_L0(MulInfoT &data, cv::Mat& depth_fea, cv::Mat& col
     high_fea.colRange(352, 1344).copyTo(color_fea);
     
     int num = data.down_cloud->size();
-    #pragma omp parallel for
-    for( int i = 0 ; i < num ; i++ )
-    {
+    TaskScheduler::instance().parallelFor(TASK_FEATURES, 0, num, 64, [&](int i) {
         cv::normalize(depth_fea.row(i),depth_fea.row(i));
         cv::normalize(color_fea.row(i),color_fea.row(i));
-    }
+    });
     
 }
 
 std::vector<int> Hier_Pooler::sampleRaw_L0(const pcl::PointCloud<PointT>::Ptr cloud, const pcl::PointCloud<NormalT>::Ptr cloud_normal,
-                    cv::Mat &depth_fea, cv::Mat &color_fea, int max_num, float rad)
+                    cv::Mat &depth_fea, cv::Mat &color_fea, int max_num, float rad) const
 {
     std::vector<int> idxs;
     cv::Mat high_fea = cshot_cloud_uni(cloud, cloud_normal, idxs, rad, max_num);
@@ -132,8 +133,9 @@ std::vector<int> Hier_Pooler::sampleRaw_L0(const pcl::PointCloud<PointT>::Ptr cl
     return idxs;
 }
 
-std::vector<cv::Mat> Hier_Pooler::EncodeLayer_L0(const cv::Mat &depth_fea, const cv::Mat &color_fea)
+std::vector<cv::Mat> Hier_Pooler::EncodeLayer_L0(const cv::Mat &depth_fea, const cv::Mat &color_fea) const
 {
+    SP_PROFILE_SCOPE("Hier_Pooler/encode_L0");
     int depth_len = dict_depth_L0.rows;
     int color_len = dict_color_L0.rows;
     int depthK = depth_len * ratio;
@@ -143,12 +145,10 @@ std::vector<cv::Mat> Hier_Pooler::EncodeLayer_L0(const cv::Mat &depth_fea, const
     
     std::vector<cv::Mat> depth_code_vec(num);  
     std::vector<cv::Mat> color_code_vec(num);
-    #pragma omp parallel for
-    for( int i = 0 ; i < num ; i++ )
-    {
+    TaskScheduler::instance().parallelFor(TASK_FEATURES, 0, num, 16, [&](int i) {
         depth_code_vec[i] = KNNEncoder(depth_fea.row(i), tree_depth_L0, depth_len, depthK);
         color_code_vec[i] = KNNEncoder(color_fea.row(i), tree_color_L0, color_len, colorK);
-    }
+    });
     std::vector<cv::Mat> fea_codes(2);  //color, depth
     cv::vconcat(depth_code_vec, fea_codes[0]);
     cv::vconcat(color_code_vec, fea_codes[1]);
@@ -156,7 +156,7 @@ std::vector<cv::Mat> Hier_Pooler::EncodeLayer_L0(const cv::Mat &depth_fea, const
     return fea_codes;
 }
 
-std::vector<cv::Mat> Hier_Pooler::PoolLayer_L1(const MulInfoT &data, const std::vector<cv::Mat> code_L0, std::vector<size_t> idxs, bool max_pool)
+std::vector<cv::Mat> Hier_Pooler::PoolLayer_L1(const MulInfoT &data, const std::vector<cv::Mat> code_L0, std::vector<size_t> idxs, bool max_pool) const
 {
     int num;
     bool subsampling = false;
@@ -251,7 +251,7 @@ std::vector<cv::Mat> Hier_Pooler::PoolLayer_L1(const MulInfoT &data, const std::
     return raw_fea_L1;
 }
 
-std::vector<cv::Mat> Hier_Pooler::PoolLayer_L2(const MulInfoT &data, const std::vector<cv::Mat> code_L1, std::vector<size_t> idxs, bool max_pool)
+std::vector<cv::Mat> Hier_Pooler::PoolLayer_L2(const MulInfoT &data, const std::vector<cv::Mat> code_L1, std::vector<size_t> idxs, bool max_pool) const
 {
     int num;
     bool subsampling = false;
@@ -346,7 +346,7 @@ std::vector<cv::Mat> Hier_Pooler::PoolLayer_L2(const MulInfoT &data, const std::
     return raw_fea_L2;
 }
 
-std::vector<cv::Mat> Hier_Pooler::EncodeLayer_L1(const std::vector<cv::Mat> rawfea_L1)
+std::vector<cv::Mat> Hier_Pooler::EncodeLayer_L1(const std::vector<cv::Mat> rawfea_L1) const
 {
     std::vector<cv::Mat> fea_L1(pool_type_num);
     for( int j = 0 ; j < pool_type_num ; j++ )
@@ -389,7 +389,7 @@ std::vector<cv::Mat> Hier_Pooler::EncodeLayer_L1(const std::vector<cv::Mat> rawf
     return fea_L1;
 }
 
-std::vector<cv::Mat> Hier_Pooler::EncodeLayer_L2(const std::vector<cv::Mat> rawfea_L2)
+std::vector<cv::Mat> Hier_Pooler::EncodeLayer_L2(const std::vector<cv::Mat> rawfea_L2) const
 {
     std::vector<cv::Mat> fea_L2(pool_type_num);
     for( int j = 0 ; j < pool_type_num ; j++ )
@@ -432,23 +432,18 @@ std::vector<cv::Mat> Hier_Pooler::EncodeLayer_L2(const std::vector<cv::Mat> rawf
     return fea_L2;
 }
 
-std::vector<cv::Mat> Hier_Pooler::getHierFea( MulInfoT &data, int layer)
+std::vector<cv::Mat> Hier_Pooler::getHierFea( MulInfoT &data, int layer) const
 {
     std::vector<cv::Mat> final_fea;
     if( layer < 0 )
         exit(0);
     
+    SP_PROFILE_SCOPE("Hier_Pooler/getHierFea");
     cv::Mat depth_fea, color_fea;
-    //double t1, t2;
-    //t1 = get_wall_time();
     computeRaw_L0(data, depth_fea, color_fea, pool_radius_L0);
-    //t2 = get_wall_time();
-    //std::cerr << "CSHOT Time-" << t2 - t1 << std::endl;
+    SP_PROFILE_COUNT("Hier_Pooler/keypoints", depth_fea.rows);
     
-    //t1 = get_wall_time();
     std::vector<cv::Mat> fea_L0 = EncodeLayer_L0(depth_fea, color_fea);
-    //t2 = get_wall_time();
-    //std::cerr << "Encoding Time-" << t2 - t1 << std::endl;
     if( dict_joint_L0.empty() == true )
     {
         for( size_t i = 0 ; i < fea_L0.size() ; i++ )
@@ -502,7 +497,7 @@ std::vector<cv::Mat> Hier_Pooler::getHierFea( MulInfoT &data, int layer)
     return final_fea;
 }
 
-std::vector<cv::Mat> Hier_Pooler::getRawFea( MulInfoT &data, int layer, size_t max_num)
+std::vector<cv::Mat> Hier_Pooler::getRawFea( MulInfoT &data, int layer, size_t max_num) const
 {
     std::vector<cv::Mat> raw_fea;
     cv::Mat depth_fea, color_fea;
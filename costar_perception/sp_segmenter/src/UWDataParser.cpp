@@ -1,4 +1,5 @@
 #include "sp_segmenter/UWDataParser.h"
+#include "sp_segmenter/utility/task_scheduler.h"
 
 void PreProcess_UW(std::string in_path, std::string out_path, pcl::visualization::PCLVisualizer::Ptr viewer)
 {
@@ -79,7 +80,7 @@ void PreProcess_UW(std::string in_path, std::string out_path, pcl::visualization
         pcl::NormalEstimationOMP<PointT, NormalT> normal_estimation;
         pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT>);
         normal_estimation.setSearchMethod (tree);
-        normal_estimation.setNumberOfThreads(8);
+        normal_estimation.setNumberOfThreads(TaskScheduler::instance().getLibraryThreads(TASK_FEATURES));
         normal_estimation.setRadiusSearch(radius);
         normal_estimation.setInputCloud (filtered_cloud);
         //normal_estimation.setViewPoint(0,0,1);
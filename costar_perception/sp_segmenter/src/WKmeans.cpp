@@ -1,4 +1,5 @@
 #include "sp_segmenter/WKmeans.h"
+#include <limits>
 
 WKmeans::WKmeans()
 {
@@ -489,4 +490,360 @@ void HierKmeans(const std::vector<protoT> &proto_set, cv::Mat &centers, int K)
 
     std::cerr<<"Final Center Number: "<<centers.rows<<std::endl;
 
-}
\ No newline at end of file
+}
+
+//Shard Writer
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+ShardWriter::ShardWriter(const std::string &out_dir_, const std::string &prefix_, int shard_rows_)
+{
+    out_dir = out_dir_;
+    if( out_dir.empty() == false && out_dir[out_dir.size()-1] != '/' )
+        out_dir += "/";
+    if( exists_dir(out_dir) == false )
+        boost::filesystem::create_directories(out_dir);
+    prefix = prefix_;
+    shard_rows = shard_rows_ > 0 ? shard_rows_ : 100000;
+    buf_rows = 0;
+}
+
+ShardWriter::~ShardWriter()
+{
+    Flush();
+}
+
+void ShardWriter::AddData(const cv::Mat &data)
+{
+    if( data.empty() == true )
+        return;
+    buf.push_back(data.clone());
+    buf_rows += data.rows;
+    if( buf_rows >= shard_rows )
+        Flush();
+}
+
+void ShardWriter::Flush()
+{
+    if( buf.empty() == true )
+        return;
+    cv::Mat shard;
+    cv::vconcat(buf, shard);
+    buf.clear();
+    buf_rows = 0;
+
+    std::stringstream ss;
+    ss << shard_files.size();
+    std::string shard_name(out_dir + prefix + "_shard_" + ss.str() + ".cvmat");
+    if( saveMat(shard_name, shard) == 0 )
+    {
+        std::cerr << "Failed to write shard: " << shard_name << std::endl;
+        return;
+    }
+    shard_files.push_back(shard_name);
+}
+
+//Mini-Batch Kmeans
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// only reads the header written by saveMat, to know the shard size without loading the data
+static bool readMatHeader(const std::string &filename, size_t &rows, size_t &cols)
+{
+    std::ifstream in(filename.c_str(), std::ios::in|std::ios::binary);
+    if( !in )
+        return false;
+    size_t chan, eSiz;
+    in.read((char*)&cols,sizeof(cols));
+    in.read((char*)&rows,sizeof(rows));
+    in.read((char*)&chan,sizeof(chan));
+    in.read((char*)&eSiz,sizeof(eSiz));
+    return in.good() && chan == 1 && eSiz == sizeof(float);
+}
+
+MiniBatchKmeans::MiniBatchKmeans() : rng(cv::getTickCount())
+{
+    total_rows = 0;
+    fea_len = -1;
+    thread_num = omp_get_max_threads();
+    batch_size = 1024;
+    max_iter = 10;
+    init_num = 20000;
+    tol = 1e-4;
+}
+
+MiniBatchKmeans::~MiniBatchKmeans(){}
+
+void MiniBatchKmeans::AddData(cv::Mat data)
+{
+    if( data.empty() == true )
+        return;
+    if( fea_len < 0 )
+        fea_len = data.cols;
+    if( data.cols != fea_len || data.type() != CV_32FC1 )
+    {
+        std::cerr << "data.cols != feature len" << std::endl;
+        exit(0);
+    }
+    mem_data.push_back(data);
+    total_rows += data.rows;
+}
+
+void MiniBatchKmeans::AddShard(const std::string &shard_file)
+{
+    size_t rows, cols;
+    if( readMatHeader(shard_file, rows, cols) == false )
+    {
+        std::cerr << "Invalid shard: " << shard_file << std::endl;
+        return;
+    }
+    if( rows == 0 )
+        return;
+    if( fea_len < 0 )
+        fea_len = cols;
+    if( (int)cols != fea_len )
+    {
+        std::cerr << "shard.cols != feature len: " << shard_file << std::endl;
+        exit(0);
+    }
+    shard_files.push_back(shard_file);
+    shard_rows.push_back(rows);
+    total_rows += rows;
+}
+
+int MiniBatchKmeans::AddShardDir(const std::string &shard_dir)
+{
+    std::string workspace(shard_dir);
+    if( workspace.empty() == false && workspace[workspace.size()-1] != '/' )
+        workspace += "/";
+
+    std::vector<std::string> files;
+    find_files(workspace, ".cvmat", files);
+    std::sort(files.begin(), files.end());
+    size_t pre_num = shard_files.size();
+    for( size_t i = 0 ; i < files.size() ; i++ )
+        AddShard(workspace + files[i]);
+    return shard_files.size() - pre_num;
+}
+
+int MiniBatchKmeans::loadShard(size_t idx, cv::Mat &shard)
+{
+    // sources are indexed with in-memory blocks first and then the disk shards
+    if( idx < mem_data.size() )
+        shard = mem_data[idx];
+    else
+        readMat(shard_files[idx - mem_data.size()], shard);
+    return shard.rows;
+}
+
+cv::Mat MiniBatchKmeans::sqrDist(const cv::Mat &data, const cv::Mat &centers, const cv::Mat &center_sqr_norm)
+{
+    // ||x-c||^2 = ||x||^2 - 2x'c + ||c||^2, the cross term is a single gemm over the whole block
+    cv::Mat dist;
+    cv::gemm(data, centers, -2.0, cv::Mat(), 0, dist, cv::GEMM_2_T);
+
+    cv::Mat data_sqr_norm;
+    cv::reduce(data.mul(data), data_sqr_norm, 1, CV_REDUCE_SUM);
+    for( int i = 0 ; i < dist.rows ; i++ )
+    {
+        float *ptr = dist.ptr<float>(i);
+        const float *c_ptr = center_sqr_norm.ptr<float>(0);
+        float x_norm = data_sqr_norm.at<float>(i, 0);
+        for( int k = 0 ; k < dist.cols ; k++ )
+        {
+            float buf = ptr[k] + x_norm + c_ptr[k];
+            ptr[k] = buf > 0 ? buf : 0;
+        }
+    }
+    return dist;
+}
+
+cv::Mat MiniBatchKmeans::SampleRows(int num)
+{
+    size_t source_num = mem_data.size() + shard_files.size();
+    std::vector<size_t> source_rows(source_num);
+    for( size_t i = 0 ; i < mem_data.size() ; i++ )
+        source_rows[i] = mem_data[i].rows;
+    for( size_t i = 0 ; i < shard_rows.size() ; i++ )
+        source_rows[mem_data.size() + i] = shard_rows[i];
+
+    // draw global row ids, then visit every source at most once
+    std::vector<size_t> global_idx(num);
+    for( int i = 0 ; i < num ; i++ )
+        global_idx[i] = (size_t)(rng.uniform(0.0, 1.0) * total_rows) % total_rows;
+    std::sort(global_idx.begin(), global_idx.end());
+
+    cv::Mat sample = cv::Mat::zeros(num, fea_len, CV_32FC1);
+    size_t offset = 0, r = 0;
+    for( size_t s = 0 ; s < source_num && r < global_idx.size() ; s++ )
+    {
+        if( global_idx[r] >= offset + source_rows[s] )
+        {
+            offset += source_rows[s];
+            continue;
+        }
+        cv::Mat shard;
+        loadShard(s, shard);
+        while( r < global_idx.size() && global_idx[r] < offset + source_rows[s] )
+        {
+            shard.row(global_idx[r] - offset).copyTo(sample.row(r));
+            r++;
+        }
+        offset += source_rows[s];
+    }
+    return sample;
+}
+
+cv::Mat MiniBatchKmeans::Initialize(int K)
+{
+    int num = std::max(K, (int)std::min((size_t)init_num, total_rows));
+    cv::Mat sample = SampleRows(num);
+
+    cv::Mat centers = cv::Mat::zeros(K, fea_len, CV_32FC1);
+    int first = rng.uniform(0, num);
+    sample.row(first).copyTo(centers.row(0));
+
+    // squared distances of unnormalized features can exceed INF_
+    std::vector<float> min_dist(num, std::numeric_limits<float>::max());
+    for( int k = 1 ; k < K ; k++ )
+    {
+        cv::Mat pre_center = centers.row(k-1);
+        double sum = 0;
+        #pragma omp parallel for schedule(static) reduction(+:sum)
+        for( int i = 0 ; i < num ; i++ )
+        {
+            float dist = cv::norm(sample.row(i), pre_center, cv::NORM_L2SQR);
+            if( dist < min_dist[i] )
+                min_dist[i] = dist;
+            sum += min_dist[i];
+        }
+
+        // D^2 weighting, fall back to uniform if all samples are already centers
+        int picked = num - 1;
+        if( sum <= 0 )
+            picked = rng.uniform(0, num);
+        else
+        {
+            double target = rng.uniform(0.0, 1.0) * sum, acc = 0;
+            for( int i = 0 ; i < num ; i++ )
+            {
+                acc += min_dist[i];
+                if( acc >= target )
+                {
+                    picked = i;
+                    break;
+                }
+            }
+        }
+        sample.row(picked).copyTo(centers.row(k));
+    }
+    return centers;
+}
+
+float MiniBatchKmeans::UpdateBatch(const cv::Mat &batch, cv::Mat &centers, std::vector<float> &counts)
+{
+    int K = centers.rows;
+    int num = batch.rows;
+    cv::Mat center_sqr_norm;
+    cv::reduce(centers.mul(centers), center_sqr_norm, 0, CV_REDUCE_SUM);
+
+    // assignment, split the batch into contiguous blocks so that each thread runs one gemm
+    std::vector<int> labels(num, 0);
+    int block = (num + thread_num - 1) / thread_num;
+    float energy = 0;
+    #pragma omp parallel for schedule(static, 1) reduction(+:energy)
+    for( int t = 0 ; t < thread_num ; t++ )
+    {
+        int start = t * block;
+        int end = std::min(num, start + block);
+        if( start >= end )
+            continue;
+        cv::Mat dist = sqrDist(batch.rowRange(start, end), centers, center_sqr_norm);
+        for( int i = 0 ; i < dist.rows ; i++ )
+        {
+            cv::Point min_loc;
+            double min_val;
+            cv::minMaxLoc(dist.row(i), &min_val, NULL, &min_loc, NULL);
+            labels[start + i] = min_loc.x;
+            energy += min_val;
+        }
+    }
+
+    // per-center learning rate 1/count, applied to the batch mean of each center
+    cv::Mat sums = cv::Mat::zeros(K, fea_len, CV_32FC1);
+    std::vector<int> batch_count(K, 0);
+    for( int i = 0 ; i < num ; i++ )
+    {
+        sums.row(labels[i]) += batch.row(i);
+        batch_count[labels[i]]++;
+    }
+    #pragma omp parallel for schedule(dynamic, 1)
+    for( int k = 0 ; k < K ; k++ )
+    {
+        if( batch_count[k] == 0 )
+            continue;
+        counts[k] += batch_count[k];
+        cv::Mat cur_center = centers.row(k);
+        cur_center += (sums.row(k) - batch_count[k] * cur_center) / counts[k];
+    }
+    return energy / num;
+}
+
+void MiniBatchKmeans::W_Cluster(cv::Mat &centers, int K)
+{
+    if( total_rows < (size_t)K )
+    {
+        std::cerr << "Not enough data for " << K << " centers: " << total_rows << std::endl;
+        exit(0);
+    }
+    std::cerr << "Kmeans++ Initialization (" << K << ")..." << std::endl;
+    cv::Mat tmp_centers = Initialize(K);
+    std::vector<float> counts(K, 0);
+
+    size_t source_num = mem_data.size() + shard_files.size();
+    float pre_energy = -1;
+    for( int t = 0 ; t < max_iter ; t++ )
+    {
+        std::vector<size_t> source_order;
+        GenRandSeq(source_order, source_num);
+
+        double epoch_energy = 0;
+        size_t batch_num = 0;
+        for( size_t s = 0 ; s < source_num ; s++ )
+        {
+            cv::Mat shard;
+            int rows = loadShard(source_order[s], shard);
+
+            std::vector<int> row_order(rows);
+            for( int i = 0 ; i < rows ; i++ )
+                row_order[i] = i;
+            std::random_shuffle(row_order.begin(), row_order.end());
+
+            for( int b = 0 ; b < rows ; b += batch_size )
+            {
+                int cur_size = std::min(batch_size, rows - b);
+                cv::Mat batch(cur_size, fea_len, CV_32FC1);
+                for( int i = 0 ; i < cur_size ; i++ )
+                    shard.row(row_order[b + i]).copyTo(batch.row(i));
+                epoch_energy += UpdateBatch(batch, tmp_centers, counts);
+                batch_num++;
+            }
+        }
+
+        // reseed centers that never received any sample
+        int dead_num = 0;
+        for( int k = 0 ; k < K ; k++ )
+            if( counts[k] == 0 )
+                dead_num++;
+        if( dead_num > 0 )
+        {
+            cv::Mat reseed = SampleRows(dead_num);
+            for( int k = 0, d = 0 ; k < K ; k++ )
+                if( counts[k] == 0 )
+                    reseed.row(d++).copyTo(tmp_centers.row(k));
+        }
+
+        float cur_energy = batch_num > 0 ? epoch_energy / batch_num : 0;
+        std::cerr << "Epoch-" << t << " Energy: " << cur_energy << " Dead: " << dead_num << std::endl;
+        if( pre_energy > 0 && dead_num == 0 && fabs(pre_energy - cur_energy) / pre_energy < tol )
+            break;
+        pre_energy = cur_energy;
+    }
+    centers = tmp_centers;
+}
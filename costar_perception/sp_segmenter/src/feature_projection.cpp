@@ -0,0 +1,69 @@
+#include <cmath>
+#include <algorithm>
+
+#include "sp_segmenter/feature_projection.h"
+
+void FeatureProjection::trainPCA(const cv::Mat &data, const int &dim)
+{
+    // with fewer samples than dimensions cv::PCA works on the sample covariance, so the cost stays bounded
+    cv::PCA pca(data, cv::Mat(), CV_PCA_DATA_AS_ROW, std::min(dim, data.rows));
+    pca.mean.convertTo(mean_, CV_32FC1);
+    pca.eigenvectors.convertTo(basis_, CV_32FC1);
+}
+
+void FeatureProjection::trainRandom(const int &in_dim, const int &dim, const unsigned int &seed)
+{
+    cv::RNG rng(seed);
+    float val = std::sqrt(3.0 / dim);
+    mean_ = cv::Mat::zeros(1, in_dim, CV_32FC1);
+    basis_ = cv::Mat::zeros(dim, in_dim, CV_32FC1);
+    for( int r = 0 ; r < dim ; r++ )
+    {
+        float *ptr = basis_.ptr<float>(r);
+        for( int c = 0 ; c < in_dim ; c++ )
+        {
+            int draw = rng.uniform(0, 6);
+            if( draw == 0 )
+                ptr[c] = val;
+            else if( draw == 1 )
+                ptr[c] = -val;
+        }
+    }
+}
+
+bool FeatureProjection::save(const std::string &filename) const
+{
+    if( empty() == true )
+        return false;
+    cv::Mat packed;
+    cv::vconcat(mean_, basis_, packed);
+    return saveMat(filename, packed) == 1;
+}
+
+bool FeatureProjection::load(const std::string &filename)
+{
+    cv::Mat packed;
+    if( readMat(filename, packed) == 0 || packed.rows < 2 || packed.type() != CV_32FC1 )
+    {
+        std::cerr << "Failed to load projection: " << filename << std::endl;
+        mean_.release();
+        basis_.release();
+        return false;
+    }
+    mean_ = packed.row(0).clone();
+    basis_ = packed.rowRange(1, packed.rows).clone();
+    return true;
+}
+
+cv::Mat FeatureProjection::project(const cv::Mat &fea) const
+{
+    if( fea.cols != basis_.cols )
+    {
+        std::cerr << "FeatureProjection: fea.cols != input dimension " << fea.cols << " " << basis_.cols << std::endl;
+        exit(0);
+    }
+    cv::Mat centered = fea - cv::repeat(mean_, fea.rows, 1);
+    cv::Mat result;
+    cv::gemm(centered, basis_, 1.0, cv::Mat(), 0.0, result, cv::GEMM_2_T);
+    return result;
+}
@@ -0,0 +1,653 @@
+#include "sp_segmenter/frame_log.h"
+
+#include <cstring>
+#include <pcl/io/lzf.h>
+
+namespace
+{
+    const char FILE_MAGIC[8] = {'S', 'P', 'F', 'R', 'M', 'L', 'O', 'G'};
+    const char INDEX_MAGIC[8] = {'S', 'P', 'F', 'R', 'M', 'I', 'D', 'X'};
+    const uint32_t FILE_VERSION = 1;
+    const char *CHUNK_TAGS[] = {"PARM", "TABL", "FRAM", "INDX"};
+    // tag and payload size
+    const uint64_t CHUNK_HEADER_SIZE = 12;
+    // index offset and INDEX_MAGIC
+    const uint64_t TRAILER_SIZE = 16;
+
+    class ByteWriter
+    {
+    public:
+        template <typename T>
+        void put(const T &value)
+        {
+            data.append(reinterpret_cast<const char *>(&value), sizeof(T));
+        }
+
+        void putString(const std::string &value)
+        {
+            put<uint32_t>(value.size());
+            data.append(value);
+        }
+
+        std::string data;
+    };
+
+    class ByteReader
+    {
+    public:
+        explicit ByteReader(const std::string &data) : data_(data), position_(0), ok_(true) {}
+
+        template <typename T>
+        T get()
+        {
+            T value = T();
+            if (!has(sizeof(T)))
+                return value;
+            memcpy(&value, data_.data() + position_, sizeof(T));
+            position_ += sizeof(T);
+            return value;
+        }
+
+        std::string getString()
+        {
+            return getBytes(get<uint32_t>());
+        }
+
+        std::string getBytes(const std::size_t &size)
+        {
+            if (!has(size))
+                return std::string();
+            std::string value = data_.substr(position_, size);
+            position_ += size;
+            return value;
+        }
+
+        bool ok() const { return ok_; }
+
+    private:
+        bool has(const std::size_t &size)
+        {
+            if (ok_ && position_ + size <= data_.size())
+                return true;
+            ok_ = false;
+            return false;
+        }
+
+        const std::string &data_;
+        std::size_t position_;
+        bool ok_;
+    };
+
+    // the fourth field of the point types that are logged
+    inline uint32_t &lastField(PointT &p) { return p.rgba; }
+    inline uint32_t &lastField(PointLT &p) { return p.label; }
+
+    void putCompressed(ByteWriter &out, const std::string &raw)
+    {
+        std::string compressed(raw.size(), '\0');
+        unsigned int compressed_size = raw.empty() ? 0 : pcl::lzfCompress(raw.data(), raw.size(), &compressed[0], compressed.size());
+        out.put<uint32_t>(raw.size());
+        // lzf returns 0 when the data does not get smaller, it is stored as is then
+        out.put<uint8_t>(compressed_size > 0);
+        if (compressed_size > 0)
+            out.putString(compressed.substr(0, compressed_size));
+        else
+            out.putString(raw);
+    }
+
+    bool getCompressed(ByteReader &in, std::string &raw)
+    {
+        uint32_t raw_size = in.get<uint32_t>();
+        bool is_compressed = in.get<uint8_t>();
+        std::string stored = in.getString();
+        if (!in.ok())
+            return false;
+        if (!is_compressed)
+        {
+            raw.swap(stored);
+            return raw.size() == raw_size;
+        }
+        raw.assign(raw_size, '\0');
+        return raw_size == 0 || pcl::lzfDecompress(stored.data(), stored.size(), &raw[0], raw_size) == raw_size;
+    }
+
+    // x, y, z and the last field of all points one after another, so each run of similar values compresses well
+    template <typename PointType>
+    void putCloud(ByteWriter &out, const typename pcl::PointCloud<PointType>::Ptr &cloud)
+    {
+        out.put<uint8_t>(bool(cloud));
+        if (!cloud)
+            return;
+
+        std::size_t n = cloud->size();
+        out.put<uint32_t>(cloud->width);
+        out.put<uint32_t>(cloud->height);
+        out.put<uint8_t>(cloud->is_dense);
+        std::string raw(n * 4 * sizeof(float), '\0');
+        float *x = reinterpret_cast<float *>(&raw[0]);
+        float *y = x + n, *z = y + n;
+        uint32_t *last = reinterpret_cast<uint32_t *>(z + n);
+        for (std::size_t i = 0; i < n; i++)
+        {
+            PointType &p = cloud->points[i];
+            x[i] = p.x;
+            y[i] = p.y;
+            z[i] = p.z;
+            last[i] = lastField(p);
+        }
+        putCompressed(out, raw);
+    }
+
+    template <typename PointType>
+    bool getCloud(ByteReader &in, typename pcl::PointCloud<PointType>::Ptr &cloud)
+    {
+        cloud.reset();
+        if (!in.get<uint8_t>())
+            return in.ok();
+
+        uint32_t width = in.get<uint32_t>();
+        uint32_t height = in.get<uint32_t>();
+        bool is_dense = in.get<uint8_t>();
+        std::string raw;
+        std::size_t n = std::size_t(width) * height;
+        if (!getCompressed(in, raw) || raw.size() != n * 4 * sizeof(float))
+            return false;
+
+        cloud.reset(new pcl::PointCloud<PointType>());
+        cloud->resize(n);
+        cloud->width = width;
+        cloud->height = height;
+        cloud->is_dense = is_dense;
+        const float *x = reinterpret_cast<const float *>(raw.data());
+        const float *y = x + n, *z = y + n;
+        const uint32_t *last = reinterpret_cast<const uint32_t *>(z + n);
+        for (std::size_t i = 0; i < n; i++)
+        {
+            PointType &p = cloud->points[i];
+            p.x = x[i];
+            p.y = y[i];
+            p.z = z[i];
+            lastField(p) = last[i];
+        }
+        return true;
+    }
+
+    void putFrame(ByteWriter &out, const LoggedFrame &frame)
+    {
+        // sequence and stamp first, the reader picks them up when it has to rebuild the index
+        out.put<uint64_t>(frame.sequence);
+        out.put<double>(frame.stamp);
+        out.put<double>(frame.segmentation_time);
+        out.put<uint8_t>(frame.success);
+        out.put<uint8_t>(frame.use_crop_box);
+        out.put<int32_t>(frame.objrecransac_mode);
+        for (int i = 0; i < 3; i++)
+            out.put<float>(frame.crop_box_size[i]);
+        Eigen::Vector3f translation(frame.crop_box_pose.translation());
+        Eigen::Quaternionf rotation(frame.crop_box_pose.rotation());
+        for (int i = 0; i < 3; i++)
+            out.put<float>(translation[i]);
+        out.put<float>(rotation.w());
+        out.put<float>(rotation.x());
+        out.put<float>(rotation.y());
+        out.put<float>(rotation.z());
+        out.put<uint8_t>(frame.use_preferred_orientation);
+        out.put<double>(frame.preferred_orientation.w());
+        out.put<double>(frame.preferred_orientation.x());
+        out.put<double>(frame.preferred_orientation.y());
+        out.put<double>(frame.preferred_orientation.z());
+
+        putCloud<PointT>(out, frame.cloud);
+        putCloud<PointLT>(out, frame.labels);
+
+        out.put<uint32_t>(frame.poses.size());
+        for (std::size_t i = 0; i < frame.poses.size(); i++)
+        {
+            const objectTransformInformation &pose = frame.poses[i];
+            out.putString(pose.transform_name_);
+            out.putString(pose.model_name_);
+            out.put<uint32_t>(pose.model_index_);
+            for (int j = 0; j < 3; j++)
+                out.put<float>(pose.origin_[j]);
+            out.put<float>(pose.rotation_.w());
+            out.put<float>(pose.rotation_.x());
+            out.put<float>(pose.rotation_.y());
+            out.put<float>(pose.rotation_.z());
+            out.put<double>(pose.confidence_);
+        }
+    }
+
+    bool getFrame(ByteReader &in, LoggedFrame &frame)
+    {
+        frame.sequence = in.get<uint64_t>();
+        frame.stamp = in.get<double>();
+        frame.segmentation_time = in.get<double>();
+        frame.success = in.get<uint8_t>();
+        frame.use_crop_box = in.get<uint8_t>();
+        frame.objrecransac_mode = in.get<int32_t>();
+        for (int i = 0; i < 3; i++)
+            frame.crop_box_size[i] = in.get<float>();
+        Eigen::Vector3f translation;
+        for (int i = 0; i < 3; i++)
+            translation[i] = in.get<float>();
+        float w = in.get<float>(), x = in.get<float>(), y = in.get<float>(), z = in.get<float>();
+        frame.crop_box_pose = Eigen::Translation3f(translation) * Eigen::Quaternionf(w, x, y, z);
+        frame.use_preferred_orientation = in.get<uint8_t>();
+        double qw = in.get<double>(), qx = in.get<double>(), qy = in.get<double>(), qz = in.get<double>();
+        frame.preferred_orientation = Eigen::Quaterniond(qw, qx, qy, qz);
+
+        if (!getCloud<PointT>(in, frame.cloud) || !getCloud<PointLT>(in, frame.labels))
+            return false;
+
+        uint32_t number_of_poses = in.get<uint32_t>();
+        frame.poses.clear();
+        for (uint32_t i = 0; i < number_of_poses && in.ok(); i++)
+        {
+            objectTransformInformation pose;
+            pose.transform_name_ = in.getString();
+            pose.model_name_ = in.getString();
+            pose.model_index_ = in.get<uint32_t>();
+            for (int j = 0; j < 3; j++)
+                pose.origin_[j] = in.get<float>();
+            float w = in.get<float>(), x = in.get<float>(), y = in.get<float>(), z = in.get<float>();
+            pose.rotation_ = Eigen::Quaternionf(w, x, y, z);
+            pose.confidence_ = in.get<double>();
+            frame.poses.push_back(pose);
+        }
+        return in.ok();
+    }
+
+    bool parseTag(const char *tag, FrameLogChunk &type)
+    {
+        for (int i = CHUNK_PARAMETERS; i <= CHUNK_INDEX; i++)
+        {
+            if (strncmp(tag, CHUNK_TAGS[i], 4) == 0)
+            {
+                type = FrameLogChunk(i);
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+LoggedFrame::LoggedFrame() : sequence(0), stamp(0), segmentation_time(0), success(false), use_crop_box(false),
+    crop_box_size(Eigen::Vector3f::Zero()), crop_box_pose(Eigen::Affine3f::Identity()), objrecransac_mode(STANDARD_RECOGNIZE),
+    use_preferred_orientation(false), preferred_orientation(Eigen::Quaterniond::Identity())
+{}
+
+// ------------------------------------------------------------ WRITER ------------------------------------------------------------
+
+FrameLogWriter::FrameLogWriter(const std::size_t &max_queued) : max_queued_(max_queued), stop_(false), written_frames_(0), dropped_frames_(0)
+{}
+
+FrameLogWriter::~FrameLogWriter()
+{
+    this->close();
+}
+
+bool FrameLogWriter::open(const std::string &path, const FrameLogParameters &parameters)
+{
+    this->close();
+    file_.open(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!file_.is_open())
+    {
+        SP_LOG_ERROR("Failed to open frame log: " << path);
+        return false;
+    }
+    path_ = path;
+    index_.clear();
+    written_frames_ = dropped_frames_ = 0;
+
+    file_.write(FILE_MAGIC, sizeof(FILE_MAGIC));
+    file_.write(reinterpret_cast<const char *>(&FILE_VERSION), sizeof(FILE_VERSION));
+
+    ByteWriter out;
+    out.put<uint32_t>(parameters.size());
+    for (FrameLogParameters::const_iterator it = parameters.begin(); it != parameters.end(); ++it)
+    {
+        out.putString(it->first);
+        out.putString(it->second);
+    }
+    writeChunk(CHUNK_PARAMETERS, out.data, 0, 0);
+
+    stop_ = false;
+    worker_ = std::thread(&FrameLogWriter::run, this);
+    SP_LOG_INFO("Recording frames to " << path);
+    return true;
+}
+
+void FrameLogWriter::close()
+{
+    if (!file_.is_open())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_one();
+    // the worker writes what is still queued before it returns
+    worker_.join();
+
+    uint64_t index_offset = file_.tellp();
+    ByteWriter out;
+    out.put<uint64_t>(index_.size());
+    for (std::size_t i = 0; i < index_.size(); i++)
+    {
+        out.put<uint32_t>(index_[i].type);
+        out.put<uint64_t>(index_[i].offset);
+        out.put<uint64_t>(index_[i].sequence);
+        out.put<double>(index_[i].stamp);
+    }
+    writeChunk(CHUNK_INDEX, out.data, 0, 0);
+    file_.write(reinterpret_cast<const char *>(&index_offset), sizeof(index_offset));
+    file_.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    file_.close();
+
+    SP_LOG_INFO("Closed frame log " << path_ << ": " << written_frames_ << " frames written, " << dropped_frames_ << " dropped");
+}
+
+bool FrameLogWriter::writeFrame(const LoggedFrame &frame)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!file_.is_open() || stop_)
+            return false;
+
+        std::size_t queued_frames = 0;
+        for (std::deque<Job, Eigen::aligned_allocator<Job> >::const_iterator it = queue_.begin(); it != queue_.end(); ++it)
+            queued_frames += (it->type == CHUNK_FRAME);
+        if (queued_frames >= max_queued_)
+        {
+            dropped_frames_++;
+            SP_LOG_WARN_THROTTLE(5.0, "Frame log can not keep up, dropped frame " << frame.sequence);
+            return false;
+        }
+
+        // the clouds are shared, callers hand over clouds they do not modify afterwards
+        Job job;
+        job.type = CHUNK_FRAME;
+        job.frame = frame;
+        queue_.push_back(job);
+    }
+    wake_.notify_one();
+    return true;
+}
+
+void FrameLogWriter::writeTable(const pcl::PointCloud<PointT>::Ptr &table_corner_points)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!file_.is_open() || stop_)
+            return;
+        // never dropped, the frames after it would be replayed with the wrong table
+        Job job;
+        job.type = CHUNK_TABLE;
+        job.table = table_corner_points;
+        queue_.push_back(job);
+    }
+    wake_.notify_one();
+}
+
+unsigned long FrameLogWriter::getWrittenFrames() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return written_frames_;
+}
+
+unsigned long FrameLogWriter::getDroppedFrames() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return dropped_frames_;
+}
+
+void FrameLogWriter::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+        while (queue_.empty() && !stop_)
+            wake_.wait(lock);
+        if (queue_.empty())
+            return;
+
+        Job job = queue_.front();
+        queue_.pop_front();
+        lock.unlock();
+
+        // compression and disk writes happen outside the lock, the segmentation thread only ever waits for the queue
+        ByteWriter out;
+        if (job.type == CHUNK_FRAME)
+        {
+            putFrame(out, job.frame);
+            writeChunk(CHUNK_FRAME, out.data, job.frame.sequence, job.frame.stamp);
+        }
+        else
+        {
+            putCloud<PointT>(out, job.table);
+            writeChunk(CHUNK_TABLE, out.data, 0, 0);
+        }
+
+        lock.lock();
+        if (job.type == CHUNK_FRAME)
+            written_frames_++;
+    }
+}
+
+void FrameLogWriter::writeChunk(const FrameLogChunk &type, const std::string &payload, const uint64_t &sequence, const double &stamp)
+{
+    FrameLogIndexEntry entry;
+    entry.type = type;
+    entry.offset = file_.tellp();
+    entry.sequence = sequence;
+    entry.stamp = stamp;
+    if (type != CHUNK_INDEX)
+        index_.push_back(entry);
+
+    uint64_t size = payload.size();
+    file_.write(CHUNK_TAGS[type], 4);
+    file_.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    file_.write(payload.data(), payload.size());
+    if (!file_)
+        SP_LOG_THROTTLE(sp_log::LEVEL_ERROR, 5.0, "Failed writing frame log " << path_);
+}
+
+// ------------------------------------------------------------ READER ------------------------------------------------------------
+
+FrameLogReader::FrameLogReader() : file_size_(0), cached_table_(0)
+{}
+
+bool FrameLogReader::open(const std::string &path)
+{
+    path_ = path;
+    file_size_ = 0;
+    index_.clear();
+    frames_.clear();
+    parameters_.clear();
+    cached_table_ = 0;
+    cached_table_points_.reset();
+    file_.close();
+    file_.clear();
+    file_.open(path.c_str(), std::ios::binary);
+    if (!file_.is_open())
+    {
+        SP_LOG_ERROR("Failed to open frame log: " << path);
+        return false;
+    }
+    file_.seekg(0, std::ios::end);
+    file_size_ = file_.tellg();
+
+    char magic[sizeof(FILE_MAGIC)];
+    uint32_t version = 0;
+    file_.seekg(0);
+    file_.read(magic, sizeof(magic));
+    file_.read(reinterpret_cast<char *>(&version), sizeof(version));
+    if (!file_ || memcmp(magic, FILE_MAGIC, sizeof(magic)) != 0)
+    {
+        SP_LOG_ERROR(path << " is not a frame log");
+        return false;
+    }
+    if (version != FILE_VERSION)
+    {
+        SP_LOG_ERROR(path << " has frame log version " << version << ", expected " << FILE_VERSION);
+        return false;
+    }
+
+    if (!readIndex())
+    {
+        SP_LOG_WARN(path << " has no index, it was not closed properly. Scanning the chunks instead");
+        if (!scanChunks())
+            return false;
+    }
+
+    for (std::size_t i = 0; i < index_.size(); i++)
+    {
+        if (index_[i].type == CHUNK_FRAME)
+            frames_.push_back(i);
+        else if (index_[i].type == CHUNK_PARAMETERS && parameters_.empty())
+        {
+            std::string payload;
+            if (!readChunk(index_[i], payload))
+                return false;
+            ByteReader in(payload);
+            uint32_t count = in.get<uint32_t>();
+            for (uint32_t j = 0; j < count && in.ok(); j++)
+            {
+                std::string key = in.getString();
+                parameters_[key] = in.getString();
+            }
+        }
+    }
+    return true;
+}
+
+bool FrameLogReader::readFrame(const std::size_t &frame, LoggedFrame &result)
+{
+    std::string payload;
+    if (frame >= frames_.size() || !readChunk(index_[frames_[frame]], payload))
+        return false;
+    ByteReader in(payload);
+    if (!getFrame(in, result))
+    {
+        SP_LOG_ERROR("Corrupted frame " << frame << " in " << path_);
+        return false;
+    }
+    return true;
+}
+
+bool FrameLogReader::readTableForFrame(const std::size_t &frame, pcl::PointCloud<PointT>::Ptr &table_corner_points)
+{
+    if (frame >= frames_.size())
+        return false;
+    // chunks are in file order, the last table before the frame is the one it was segmented with
+    for (std::size_t i = frames_[frame]; i-- > 0;)
+    {
+        if (index_[i].type != CHUNK_TABLE)
+            continue;
+        if (cached_table_ != i || !cached_table_points_)
+        {
+            std::string payload;
+            if (!readChunk(index_[i], payload))
+                return false;
+            ByteReader in(payload);
+            if (!getCloud<PointT>(in, cached_table_points_) || !cached_table_points_)
+                return false;
+            cached_table_ = i;
+        }
+        table_corner_points = cached_table_points_;
+        return true;
+    }
+    return false;
+}
+
+bool FrameLogReader::readIndex()
+{
+    if (file_size_ < sizeof(FILE_MAGIC) + sizeof(FILE_VERSION) + CHUNK_HEADER_SIZE + TRAILER_SIZE)
+        return false;
+
+    uint64_t index_offset = 0;
+    char magic[sizeof(INDEX_MAGIC)];
+    file_.seekg(file_size_ - TRAILER_SIZE);
+    file_.read(reinterpret_cast<char *>(&index_offset), sizeof(index_offset));
+    file_.read(magic, sizeof(magic));
+    if (!file_ || memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0)
+    {
+        file_.clear();
+        return false;
+    }
+
+    FrameLogIndexEntry index_entry;
+    index_entry.type = CHUNK_INDEX;
+    index_entry.offset = index_offset;
+    std::string payload;
+    if (!readChunk(index_entry, payload))
+        return false;
+
+    ByteReader in(payload);
+    uint64_t count = in.get<uint64_t>();
+    for (uint64_t i = 0; i < count && in.ok(); i++)
+    {
+        FrameLogIndexEntry entry;
+        entry.type = FrameLogChunk(in.get<uint32_t>());
+        entry.offset = in.get<uint64_t>();
+        entry.sequence = in.get<uint64_t>();
+        entry.stamp = in.get<double>();
+        index_.push_back(entry);
+    }
+    if (!in.ok())
+        index_.clear();
+    return in.ok();
+}
+
+bool FrameLogReader::scanChunks()
+{
+    uint64_t offset = sizeof(FILE_MAGIC) + sizeof(FILE_VERSION);
+    while (offset + CHUNK_HEADER_SIZE <= file_size_)
+    {
+        char tag[4];
+        uint64_t size = 0;
+        file_.seekg(offset);
+        file_.read(tag, sizeof(tag));
+        file_.read(reinterpret_cast<char *>(&size), sizeof(size));
+
+        FrameLogIndexEntry entry;
+        if (!file_ || !parseTag(tag, entry.type) || offset + CHUNK_HEADER_SIZE + size > file_size_)
+            break;
+        entry.offset = offset;
+        entry.sequence = 0;
+        entry.stamp = 0;
+        if (entry.type == CHUNK_FRAME)
+        {
+            file_.read(reinterpret_cast<char *>(&entry.sequence), sizeof(entry.sequence));
+            file_.read(reinterpret_cast<char *>(&entry.stamp), sizeof(entry.stamp));
+        }
+        if (entry.type != CHUNK_INDEX)
+            index_.push_back(entry);
+        offset += CHUNK_HEADER_SIZE + size;
+    }
+    file_.clear();
+
+    if (offset < file_size_)
+        SP_LOG_WARN("Ignoring " << file_size_ - offset << " bytes of incomplete chunks at the end of " << path_);
+    return !index_.empty();
+}
+
+bool FrameLogReader::readChunk(const FrameLogIndexEntry &entry, std::string &payload)
+{
+    char tag[4];
+    uint64_t size = 0;
+    FrameLogChunk type;
+    file_.clear();
+    file_.seekg(entry.offset);
+    file_.read(tag, sizeof(tag));
+    file_.read(reinterpret_cast<char *>(&size), sizeof(size));
+    if (!file_ || !parseTag(tag, type) || type != entry.type || entry.offset + CHUNK_HEADER_SIZE + size > file_size_)
+    {
+        SP_LOG_ERROR("Invalid chunk at offset " << entry.offset << " in " << path_);
+        return false;
+    }
+    payload.resize(size);
+    if (size > 0)
+        file_.read(&payload[0], size);
+    return bool(file_);
+}
@@ -1,4 +1,7 @@
 #include "sp_segmenter/greedyObjRansac.h"
+#include "sp_segmenter/utility/profiler.h"
+#include "sp_segmenter/utility/logger.h"
+#include "sp_segmenter/utility/task_scheduler.h"
 
 //greedyObjRansac::greedyObjRansac(double pairWidth_, double voxelSize_) : objrec(pairWidth_, voxelSize_, 1.0)
 greedyObjRansac::greedyObjRansac(double pairWidth_, double voxelSize_, double relNumOfPairsInHashTable_) : objrec(pairWidth_, voxelSize_, relNumOfPairsInHashTable_)
@@ -91,40 +94,46 @@ poseT greedyObjRansac::recognizeOne(const pcl::PointCloud<myPointXYZ>::Ptr scene
 
 void greedyObjRansac::GreedyRecognize(const pcl::PointCloud<myPointXYZ>::Ptr scene_xyz, std::vector<poseT> &poses)
 {
+    SP_PROFILE_SCOPE("greedyObjRansac/GreedyRecognize");
+    SP_PROFILE_COUNT("greedyObjRansac/points", scene_xyz->size());
     poses.clear();
     pcl::PointCloud<myPointXYZ>::Ptr cur_scene = scene_xyz;
 
     int iter = 0;
     while(true)
     {
-        std::cerr<< "Recognizing Attempt --- " << iter << std::endl;
-        std::cerr << "Scene point cloud size: " << cur_scene->size() << std::endl;
+        SP_LOG_DEBUG("Recognizing Attempt --- " << iter);
+        SP_LOG_DEBUG("Scene point cloud size: " << cur_scene->size());
         pcl::PointCloud<myPointXYZ>::Ptr filtered_scene(new pcl::PointCloud<myPointXYZ>());
         poseT new_pose = recognizeOne(cur_scene, filtered_scene);
         
         if( filtered_scene->empty() == true )
         {
-            std::cerr << "Iteration #" << iter << ": No object detected anymore from this point cloud.\n";
+            SP_LOG_DEBUG("Iteration #" << iter << ": No object detected anymore from this point cloud.");
             break;
         }
 
         poses.push_back(new_pose);
         cur_scene = filtered_scene;
         iter++;
+        SP_PROFILE_COUNT("greedyObjRansac/hypotheses", 1);
 
     }
-    std::cerr<< "Recognizing Done!!!" << std::endl;
+    SP_LOG_DEBUG("Recognizing Done!!!");
 
 }
 
 void greedyObjRansac::StandardBest(const pcl::PointCloud<myPointXYZ>::Ptr scene_xyz, std::vector<poseT> &poses)
 {
+    SP_PROFILE_SCOPE("greedyObjRansac/StandardBest");
+    SP_PROFILE_COUNT("greedyObjRansac/points", scene_xyz->size());
     vtkSmartPointer<vtkPolyData> vtk_scene = PolyDataFromPointCloud(scene_xyz);
     vtkPoints* scene = vtk_scene->GetPoints();
     //vtkPoints* scene = PolyDataFromPointCloud(scene_xyz);
     //list<PointSetShape*> detectedObjects;
     list< boost::shared_ptr<PointSetShape> > detectedObjects;
     objrec.doRecognition(scene, successProbability, detectedObjects);
+    SP_PROFILE_COUNT("greedyObjRansac/hypotheses", detectedObjects.size());
     
     float max = -1000;
     boost::shared_ptr<PointSetShape> best_shape;
@@ -159,6 +168,8 @@ void greedyObjRansac::StandardBest(const pcl::PointCloud<myPointXYZ>::Ptr scene_
 
 void greedyObjRansac::StandardRecognize(const pcl::PointCloud<myPointXYZ>::Ptr scene_xyz, std::vector<poseT> &poses, double minConfidence)
 {
+    SP_PROFILE_SCOPE("greedyObjRansac/StandardRecognize");
+    SP_PROFILE_COUNT("greedyObjRansac/points", scene_xyz->size());
     vtkSmartPointer<vtkPolyData> vtk_scene = PolyDataFromPointCloud(scene_xyz);
     vtkPoints* scene = vtk_scene->GetPoints();
     //vtkPoints* scene = PolyDataFromPointCloud(scene_xyz);
@@ -166,6 +177,7 @@ void greedyObjRansac::StandardRecognize(const pcl::PointCloud<myPointXYZ>::Ptr s
     //list<PointSetShape*> detectedObjects;
     list< boost::shared_ptr<PointSetShape> > detectedObjects;
     objrec.doRecognition(scene, successProbability, detectedObjects);
+    SP_PROFILE_COUNT("greedyObjRansac/hypotheses", detectedObjects.size());
     
     for ( list< boost::shared_ptr<PointSetShape> >::iterator it = detectedObjects.begin() ; it != detectedObjects.end() ; ++it )
     {
@@ -173,10 +185,10 @@ void greedyObjRansac::StandardRecognize(const pcl::PointCloud<myPointXYZ>::Ptr s
 
         if (shape->getConfidence() < minConfidence){
             // printf("Skipping shape, confidence too low\n");
-            std::cerr << "Skipping shape: " << shape->getUserData()->getLabel() << " confidence: " << shape->getConfidence() <<" is too low\n";
+            SP_LOG_DEBUG("Skipping shape: " << shape->getUserData()->getLabel() << " confidence: " << shape->getConfidence() <<" is too low");
             continue;
         }
-    	else std::cerr << shape->getUserData()->getLabel() << " confidence: " << shape->getConfidence() << std::endl;
+    	else SP_LOG_DEBUG(shape->getUserData()->getLabel() << " confidence: " << shape->getConfidence());
         double **mat4x4 = mat_alloc(4, 4);
         shape->getHomogeneousRigidTransform(mat4x4);
         
@@ -222,7 +234,7 @@ void greedyObjRansac::AddModel(std::string name, std::string label)
     objrec.addModel(reader->GetOutput(), userData);
     objrec.setVisibility(visibility);
     objrec.setRelativeObjectSize(relativeObjSize);
-    objrec.setNumberOfThreads(8);
+    objrec.setNumberOfThreads(TaskScheduler::instance().getLibraryThreads(TASK_POSE));
     //delete userData;
     
     models.push_back(LoadMesh(name,label));
@@ -487,6 +499,7 @@ void greedyObjRansac::AdvancedRecognize(const pcl::PointCloud<PointT>::Ptr scene
     pcl::NormalEstimationOMP<myPointXYZ, NormalT> nest;
     pcl::search::KdTree<myPointXYZ>::Ptr tree(new pcl::search::KdTree<myPointXYZ>);
     nest.setSearchMethod (tree);
+    nest.setNumberOfThreads(TaskScheduler::instance().getLibraryThreads(TASK_POSE));
     nest.setSearchSurface(full_cloud);
     nest.setRadiusSearch(0.03);
     
@@ -498,15 +511,15 @@ void greedyObjRansac::AdvancedRecognize(const pcl::PointCloud<PointT>::Ptr scene
     nest.setInputCloud (down_node_cloud);
     nest.compute(*down_node_normals);
     
-    std::cerr << link_cloud->size() << " "<< node_cloud->size() << std::endl;
-    std::cerr << down_link_cloud->size() << " "<< down_node_cloud->size() << std::endl;
+    SP_LOG_DEBUG(link_cloud->size() << " "<< node_cloud->size());
+    SP_LOG_DEBUG(down_link_cloud->size() << " "<< down_node_cloud->size());
     
     list<ObjRecRANSAC::OrientedPair> PairFeas;
-    std::cerr << "Pair Features: " << PairFeas.size() << std::endl;
+    SP_LOG_DEBUG("Pair Features: " << PairFeas.size());
     getPairFeas(down_link_cloud, down_link_normals, PairFeas, pairWidth, down_link_cloud->size());
-    std::cerr << "Pair Features: " << PairFeas.size() << std::endl;
+    SP_LOG_DEBUG("Pair Features: " << PairFeas.size());
     getPairFeas(down_node_cloud, down_node_normals, PairFeas, pairWidth, down_node_cloud->size());
-    std::cerr << "Pair Features: " << PairFeas.size() << std::endl;
+    SP_LOG_DEBUG("Pair Features: " << PairFeas.size());
     
     vtkSmartPointer<vtkPolyData> vtk_scene = PolyDataFromPointCloud(full_cloud);
     vtkPoints* scene_ptr = vtk_scene->GetPoints();
@@ -518,7 +531,7 @@ void greedyObjRansac::AdvancedRecognize(const pcl::PointCloud<PointT>::Ptr scene
     {
         PointSetShape* shape = (*it);
         if ( shape->getUserData() )
-            printf("\t%s, confidence: %lf\n", shape->getUserData()->getLabel(), shape->getConfidence());
+            SP_LOG_DEBUG(shape->getUserData()->getLabel() << ", confidence: " << shape->getConfidence());
         
         double **mat4x4 = mat_alloc(4, 4);
         shape->getHomogeneousRigidTransform(mat4x4);
@@ -681,6 +694,7 @@ void greedyObjRansac::newRecognize(pcl::PointCloud<PointT>::Ptr scene, std::vect
     pcl::NormalEstimationOMP<PointT, NormalT> nest;
     pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT>);
     nest.setSearchMethod (tree);
+    nest.setNumberOfThreads(TaskScheduler::instance().getLibraryThreads(TASK_POSE));
     nest.setSearchSurface(scene);
     nest.setRadiusSearch(0.03);
     
@@ -689,7 +703,7 @@ void greedyObjRansac::newRecognize(pcl::PointCloud<PointT>::Ptr scene, std::vect
     
     while(true)
     {
-        std::cerr<< "Recognizing Attempt --- " << iter << std::endl;
+        SP_LOG_DEBUG("Recognizing Attempt --- " << iter);
         
         segT cur_seg = regionGrowing(cur_scene, confT);
         //viewer->addPointCloud(cur_seg.cloud, "cur_seg");
@@ -697,7 +711,7 @@ void greedyObjRansac::newRecognize(pcl::PointCloud<PointT>::Ptr scene, std::vect
         //viewer->spin();
         //viewer->removePointCloud("cur_seg");
         
-        std::cerr << "Seg: " << cur_seg.cloud->size() << std::endl;
+        SP_LOG_DEBUG("Seg: " << cur_seg.cloud->size());
         if( cur_seg.cloud->empty() == true )
             break;
         if( cur_seg.cloud->size() <= 100 )
@@ -718,7 +732,7 @@ void greedyObjRansac::newRecognize(pcl::PointCloud<PointT>::Ptr scene, std::vect
         
         sor.setInputCloud(cur_seg.cloud);
         sor.filter(*down_seg);
-        std::cerr << "Down-Seg: " << down_seg->size() << std::endl;
+        SP_LOG_DEBUG("Down-Seg: " << down_seg->size());
         
         pcl::PointCloud<NormalT>::Ptr down_seg_normals(new pcl::PointCloud<NormalT>());
         nest.setInputCloud(down_seg);
@@ -727,7 +741,7 @@ void greedyObjRansac::newRecognize(pcl::PointCloud<PointT>::Ptr scene, std::vect
         list<ObjRecRANSAC::OrientedPair> PairFeas;
         getAllPairFeas(down_seg, down_seg_normals, PairFeas, pairWidth);
         
-        std::cerr << "PairFea: " << PairFeas.size() << std::endl;
+        SP_LOG_DEBUG("PairFea: " << PairFeas.size());
         
         list<PointSetShape*> detectedObjects;
         objrec.doRecognition(scene_ptr, PairFeas, detectedObjects);
@@ -750,7 +764,7 @@ void greedyObjRansac::newRecognize(pcl::PointCloud<PointT>::Ptr scene, std::vect
             {
                 PointSetShape* shape = (*it);
                 if ( shape->getUserData() )
-                    printf("\t%s, confidence: %lf\n", shape->getUserData()->getLabel(), shape->getConfidence());
+                    SP_LOG_DEBUG(shape->getUserData()->getLabel() << ", confidence: " << shape->getConfidence());
 
                 double **mat4x4 = mat_alloc(4, 4);
                 shape->getHomogeneousRigidTransform(mat4x4);
@@ -770,7 +784,7 @@ void greedyObjRansac::newRecognize(pcl::PointCloud<PointT>::Ptr scene, std::vect
         }
         iter++;
     }
-    std::cerr<< "Recognizing Done!!!" << std::endl;
+    SP_LOG_DEBUG("Recognizing Done!!!");
     //viewer->removeAllPointClouds();
 }
 */
@@ -1,4 +1,5 @@
 #include <opencv2/core/core.hpp>
+#include <pcl/filters/voxel_grid.h>
 
 #include "sp_segmenter/features.h"
 #include "sp_segmenter/WKmeans.h"
@@ -331,23 +332,62 @@ std::vector<cv::KeyPoint> extSIFTKeys(const cv::Mat &cur_gray, const std::vector
 //    return 1;
 //}
 
-int main(int argc, char** argv)
+// Descriptors of one dictionary, kept in memory for HierKmeans or, with -minibatch,
+// streamed to disk shards and clustered with mini-batch kmeans
+class DictSamples
 {
-    int c1 = 0, c2 = UW_INST_MAX;
-    
-    std::string path("/home/chi/UW_RGBD/rgbd-dataset/");
-    std::string out_path("UW_new_sift_dict");
-    int maxnum = 30;
-    pcl::console::parse_argument(argc, argv, "--m", maxnum);
+public:
+    DictSamples(const std::string &out_path, const std::string &name, bool mini_batch, int shard_rows)
+    {
+        if( mini_batch )
+            shards = boost::shared_ptr<ShardWriter>(new ShardWriter(out_path + "/shards", name, shard_rows));
+    }
     
-    pcl::console::parse_argument(argc, argv, "--p", path);
-    pcl::console::parse_argument(argc, argv, "--o", out_path);
+    // not thread safe, call it from a critical section
+    void AddData(const cv::Mat &fea)
+    {
+        if( shards )
+            shards->AddData(fea);
+        else
+        {
+            int len = fea.rows;
+            for( int p = 0 ; p < len ; p++)
+                cluster.AddData(fea.row(p));
+        }
+    }
     
-    pcl::console::parse_argument(argc, argv, "--c1", c1);
-    pcl::console::parse_argument(argc, argv, "--c2", c2);
+    // call once every descriptor is added
+    void Finish(int batch_size, int epoch_num)
+    {
+        if( !shards )
+            return;
+        shards->Flush();
+        mb_cluster.setBatchSize(batch_size);
+        mb_cluster.setMaxIter(epoch_num);
+        // only the shards of this run, the directory may still hold shards of earlier runs
+        std::vector<std::string> shard_files = shards->getShards();
+        for( size_t k = 0 ; k < shard_files.size() ; k++ )
+            mb_cluster.AddShard(shard_files[k]);
+        std::cerr << "Shards: " << shard_files.size() << std::endl;
+    }
     
-    boost::filesystem::create_directories(out_path);
+    void Cluster(cv::Mat &centers, int K)
+    {
+        if( shards )
+            mb_cluster.W_Cluster(centers, K);
+        else
+            HierKmeans(cluster.proto_set, centers, K);
+    }
     
+private:
+    sparseK cluster;
+    boost::shared_ptr<ShardWriter> shards;
+    MiniBatchKmeans mb_cluster;
+};
+
+// SIFT dictionary from the UW RGB-D crops
+void buildSIFTDict(const std::string &path, int c1, int c2, int maxnum, DictSamples &sift_samples)
+{
     std::vector<cv::SiftFeatureDetector*> sift_det_vec;
     for( float sigma = 0.7 ; sigma <= 1.61 ; sigma += 0.1 )
     {	
@@ -368,9 +408,7 @@ int main(int argc, char** argv)
         exit(0);
     }
     
-    sparseK cluster_sift;
     int count = 0;
-//    std::vector<cv::Mat> sift_set;
     for( int b1 = 0 ; b1 < UW_INST_MAX ; b1++ )
     {
         std::string class_name;
@@ -418,161 +456,185 @@ int main(int argc, char** argv)
             
             #pragma omp critical
             {
-//                sift_set.push_back(sift_descr);
                 count++;
                 if( count % 100 == 0 )
                     std::cerr << count << " ";
                 
-                int len = sift_descr.rows;
-                for( int p = 0 ; p < len ; p++)
-                    cluster_sift.AddData(sift_descr.row(p));
+                sift_samples.AddData(sift_descr);
+            }
+        }
+    }
+}
+
+// depth and color SHOT dictionaries from the UW filtered clouds
+void buildSHOTDict(const std::string &path, int c1, int c2, int maxnum, float radius, DictSamples &depth_samples, DictSamples &color_samples)
+{
+    Hier_Pooler hie_producer(radius);
+    int count = 0;
+    for( int b1 = c1 ; b1 <= c2 ; b1++ )
+    {
+        ObjectSet train_objects, test_objects;
+        readUWInstWithImg(path, train_objects, test_objects, b1, b1, 1);
+        test_objects.clear();
+        
+        int num = train_objects[0].size();
+        #pragma omp parallel for schedule(dynamic, 1)
+        for( int j = 0 ; j < num ; j++ )
+        {
+            pcl::PointCloud<PointT>::Ptr cloud = train_objects[0][j].cloud;
+            pcl::PointCloud<NormalT>::Ptr cloud_normals(new pcl::PointCloud<NormalT>());
+            computeNormals(cloud, cloud_normals, radius);
+        
+            MulInfoT cur_data = convertPCD(cloud, cloud_normals);
+            
+            std::vector<cv::Mat> rawfea_L0 = hie_producer.getRawFea(cur_data, -1, maxnum);
+            #pragma omp critical
+            {
+                count++;
+                if( count % 100 == 0 )
+                    std::cerr << count << " ";
+                
+                depth_samples.AddData(rawfea_L0[0]);
+                color_samples.AddData(rawfea_L0[1]);
+            }
+        }
+    }
+}
+
+// FPFH dictionary from the UW filtered clouds
+void buildFPFHDict(const std::string &path, int c1, int c2, int maxnum, float radius, DictSamples &fpfh_samples)
+{
+    int count = 0;
+    for( int b1 = c1 ; b1 <= c2 ; b1++ )
+    {
+        ObjectSet train_objects, test_objects;
+        readUWInst(path, train_objects, test_objects, b1, b1, 2);
+        test_objects.clear();
+        
+        int num = train_objects[0].size();
+        #pragma omp parallel for schedule(dynamic, 1)
+        for( int j = 0 ; j < num ; j++ )
+        {
+            pcl::PointCloud<PointT>::Ptr cloud = train_objects[0][j].cloud;
+            pcl::PointCloud<NormalT>::Ptr cloud_normals(new pcl::PointCloud<NormalT>());
+            computeNormals(cloud, cloud_normals, radius);
+   
+            pcl::PointCloud<PointT>::Ptr down_cloud (new pcl::PointCloud<PointT>());
+            pcl::VoxelGrid<PointT> sor;
+            sor.setInputCloud(cloud);
+            sor.setLeafSize(0.005, 0.005, 0.005);
+            sor.filter(*down_cloud);
+            
+            pcl::PointCloud<PointT>::Ptr random_keys (new pcl::PointCloud<PointT>());
+            
+            if( maxnum > (int)down_cloud->size() )
+                random_keys = down_cloud;
+            else
+            {
+                std::vector<size_t> rand_idx;
+                GenRandSeq(rand_idx, down_cloud->size());
+                for( int i = 0 ; i < maxnum ; i++ )
+                    random_keys->push_back(down_cloud->at(rand_idx[i]));
+            }
+            cv::Mat fpfh = fpfh_cloud(cloud, random_keys, cloud_normals, radius, true);
+            
+            #pragma omp critical
+            {
+                count++;
+                if( count % 100 == 0 )
+                    std::cerr << count << " ";
+                
+                fpfh_samples.AddData(fpfh);
             }
         }
     }
+}
+
+int main(int argc, char** argv)
+{
+    // SIFT by default, -shot for the depth and color SHOT dictionaries, -fpfh for FPFH
+    bool shot = pcl::console::find_switch(argc, argv, "-shot");
+    bool fpfh = !shot && pcl::console::find_switch(argc, argv, "-fpfh");
     
-//    std::cerr << "Start Kmeans...";
-//    cv::Mat final_sift;
-//    cv::vconcat(sift_set, final_sift);
-//    std::cerr << final_sift.rows << std::endl;
-//    sift_set.clear();
+    int c1 = 0, c2 = UW_INST_MAX;
+    std::string path("/home/chi/UW_RGBD/rgbd-dataset/");
+    std::string out_path("UW_new_sift_dict");
+    int maxnum = 30;
+    float radius = 0.02;
+    if( shot || fpfh )
+    {
+        c2 = UW_INST_MAX - 1;
+        path = "/home/chi/UW_RGBD/filtered_pcd/";
+        out_path = shot ? "UW_shot_dict" : "UW_fpfh_dict";
+        maxnum = 25;
+    }
+    pcl::console::parse_argument(argc, argv, "--m", maxnum);
+    pcl::console::parse_argument(argc, argv, "--r", radius);
+    
+    pcl::console::parse_argument(argc, argv, "--p", path);
+    pcl::console::parse_argument(argc, argv, "--o", out_path);
+    
+    pcl::console::parse_argument(argc, argv, "--c1", c1);
+    pcl::console::parse_argument(argc, argv, "--c2", c2);
+    
+    // the SHOT dictionaries have a single size
+    int shot_K = 200;
+    pcl::console::parse_argument(argc, argv, "--K", shot_K);
+    
+    // -minibatch streams the descriptors to disk shards and learns the dictionary with
+    // mini-batch kmeans instead of keeping every descriptor in memory for HierKmeans
+    bool mini_batch = pcl::console::find_switch(argc, argv, "-minibatch");
+    int shard_rows = 100000, batch_size = 1024, epoch_num = 10;
+    pcl::console::parse_argument(argc, argv, "--shard", shard_rows);
+    pcl::console::parse_argument(argc, argv, "--batch", batch_size);
+    pcl::console::parse_argument(argc, argv, "--epoch", epoch_num);
+    
+    boost::filesystem::create_directories(out_path);
+    
+    if( shot )
+    {
+        DictSamples depth_samples(out_path, "depth", mini_batch, shard_rows);
+        DictSamples color_samples(out_path, "color", mini_batch, shard_rows);
+        buildSHOTDict(path, c1, c2, maxnum, radius, depth_samples, color_samples);
+        depth_samples.Finish(batch_size, epoch_num);
+        color_samples.Finish(batch_size, epoch_num);
+        
+        std::cerr << "Start Kmeans..." << std::endl;
+        cv::Mat center_depth, center_color;
+        depth_samples.Cluster(center_depth, shot_K);
+        color_samples.Cluster(center_color, shot_K);
+        
+        std::stringstream ss;
+        ss << shot_K;
+        saveMat(out_path + "/dict_depth_L0_"+ss.str()+".cvmat", center_depth);
+        saveMat(out_path + "/dict_color_L0_"+ss.str()+".cvmat", center_color);
+        return 1;
+    }
+    
+    std::string name = fpfh ? "fpfh" : "sift";
+    DictSamples samples(out_path, name, mini_batch, shard_rows);
+    if( fpfh )
+        buildFPFHDict(path, c1, c2, maxnum, radius, samples);
+    else
+        buildSIFTDict(path, c1, c2, maxnum, samples);
+    samples.Finish(batch_size, epoch_num);
     
     int KK[5] = {25, 50, 100, 200, 400};
     for( int i = 0 ; i < 5 ; i++ )
     {
-//        std::cerr << "Clustering "<< KK[i] << std::endl;
-//        cv::Mat center_sift, labels;
-//        cv::kmeans(final_sift, KK[i], labels, cv::TermCriteria(CV_TERMCRIT_ITER|CV_TERMCRIT_EPS, 500, 1e-6), 1, cv::KMEANS_PP_CENTERS, center_sift);
         std::cerr << "Clustering "<< KK[i] << std::endl;
-        cv::Mat center_sift;
-        HierKmeans(cluster_sift.proto_set, center_sift, KK[i]);
+        cv::Mat centers;
+        samples.Cluster(centers, KK[i]);
         
-        std::stringstream ss, ll;
+        std::stringstream ss;
         ss << KK[i];
 
-        saveMat(out_path + "/dict_sift_L0_"+ss.str()+".cvmat", center_sift);
+        saveMat(out_path + "/dict_" + name + "_L0_"+ss.str()+".cvmat", centers);
     }
     return 1;
 }
 
 
-//int main(int argc, char** argv)
-//{
-//    int c1 = 0, c2 = 299;
-//    
-//    float radius = 0.02;
-//    int maxnum = 25;
-//    std::string path("/home/chi/UW_RGBD/filtered_pcd/");
-//    std::string out_path("UW_fpfh_dict/");
-//    boost::filesystem::create_directories(out_path);
-//    
-//    pcl::console::parse_argument(argc, argv, "--p", path);
-//    pcl::console::parse_argument(argc, argv, "--o", out_path);
-//    pcl::console::parse_argument(argc, argv, "--m", maxnum);
-//    pcl::console::parse_argument(argc, argv, "--r", radius);
-//    
-////    cv::Mat tmp;
-////    readMat(out_path+"dict_color_L0_200.cvmat", tmp);
-////    for(int i = 0 ; i < tmp.rows ; i++ )
-////    {
-////        std::cerr << tmp.row(i) << std::endl;
-////        std::cerr << tmp.row(i).cols << " " << tmp.rows <<" " << cv::norm(tmp.row(i), cv::NORM_L2) << std::endl;
-////        std::cin.get();
-////    }
-////    return 1;
-////*
-//    
-//    int layer = -1;
-//
-//    int count = 0;
-////    std::vector<cv::Mat> fpfh_set;
-//    sparseK cluster_fpfh;
-//    
-//    for( int b1 = c1 ; b1 <= c2 ; b1++ )
-//    {
-//        ObjectSet train_objects, test_objects;
-//        readUWInst(path, train_objects, test_objects, b1, b1, 2);
-//        test_objects.clear();
-//        
-//        int num = train_objects[0].size();
-//        #pragma omp parallel for schedule(dynamic, 1)
-//        for( int j = 0 ; j < num ; j++ )
-//        {
-////            std::cerr << j << std::endl;
-//            pcl::PointCloud<PointT>::Ptr cloud = train_objects[0][j].cloud;
-//            pcl::PointCloud<NormalT>::Ptr cloud_normals(new pcl::PointCloud<NormalT>());
-//            computeNormals(cloud, cloud_normals, radius);
-//   
-//            pcl::PointCloud<PointT>::Ptr down_cloud (new pcl::PointCloud<PointT>());
-//            pcl::VoxelGrid<PointT> sor;
-//            sor.setInputCloud(cloud);
-//            sor.setLeafSize(0.005, 0.005, 0.005);
-//            sor.filter(*down_cloud);
-//            
-//            pcl::PointCloud<PointT>::Ptr random_keys (new pcl::PointCloud<PointT>());
-//            
-//            if( maxnum > (int)down_cloud->size() )
-//                random_keys = down_cloud;
-//            else
-//            {
-//                std::vector<size_t> rand_idx;
-//                GenRandSeq(rand_idx, down_cloud->size());
-//                for( int i = 0 ; i < maxnum ; i++ )
-//                    random_keys->push_back(down_cloud->at(rand_idx[i]));
-//            }
-////            std::cerr << random_keys->size() << std::endl;
-//            cv::Mat fpfh = fpfh_cloud(cloud, random_keys, cloud_normals, radius, true);
-//            
-//            
-//            #pragma omp critical
-//            {
-////                fpfh_set.push_back(fpfh);
-//                count++;
-//                if( count % 100 == 0 )
-//                    std::cerr << count << " ";
-//                
-//                int len = fpfh.rows;
-//                for( int p = 0 ; p < len ; p++)
-//                    cluster_fpfh.AddData(fpfh.row(p));
-//                    
-//            }
-//        }
-//    }
-//    
-//    std::cerr << "Start Kmeans..." << std::endl;
-//    
-//    int KK[5] = {25, 50, 100, 200, 400};
-//    for( int i = 0 ; i < 5 ; i++ )
-//    {
-//        std::cerr << "Clustering "<< KK[i] << std::endl;
-//        cv::Mat centers;
-//        HierKmeans(cluster_fpfh.proto_set, centers, KK[i]);
-//        
-//        std::stringstream ss;
-//        ss << KK[i];
-//        saveMat(out_path + "dict_fpfh_L0_"+ss.str()+".cvmat", centers);
-//    }
-//    
-//    
-////    cv::Mat final_fpfh;
-////    cv::vconcat(fpfh_set, final_fpfh);
-////    fpfh_set.clear();
-////    
-////    int KK[5] = {25, 50, 100, 200, 400};
-////    for( int i = 0 ; i < 5 ; i++ )
-////    {
-////        std::cerr << "Clustering "<< KK[i] << std::endl;
-////        cv::Mat center_depth, center_color, labels, center_joint, center_fpfh;
-////        cv::kmeans(final_fpfh, KK[i], labels, cv::TermCriteria(CV_TERMCRIT_ITER|CV_TERMCRIT_EPS, 500, 1e-6), 1, cv::KMEANS_PP_CENTERS, center_fpfh );
-////        
-////        std::stringstream ss, ll;
-////        ss << KK[i];
-////        saveMat(out_path + "dict_fpfh_L0_"+ss.str()+".cvmat", center_fpfh);
-////    }
-//
-//    return 1;
-//}
-
-
 //int main(int argc, char** argv)
 //{
 //    int c1 = 0, c2 = 9;
@@ -705,78 +767,6 @@ int main(int argc, char** argv)
 //    return 1;
 //}
 
-//int main(int argc, char** argv)
-//{
-//    int c1 = 0, c2 = 9;
-//    int KK = 200;
-//    
-//    float radius = 0.02;
-//    int maxnum = 25;
-//    std::string path("/home/chi/UW_RGBD/filtered_pcd/");
-//    std::string out_path("UW_shot_dict");
-//    boost::filesystem::create_directories(out_path);
-//    
-//    pcl::console::parse_argument(argc, argv, "--K", KK);
-//    pcl::console::parse_argument(argc, argv, "--p", path);
-//    pcl::console::parse_argument(argc, argv, "--o", out_path);
-//    pcl::console::parse_argument(argc, argv, "--m", maxnum);
-//    pcl::console::parse_argument(argc, argv, "--r", radius);
-//    
-////    pcl::console::parse_argument(argc, argv, "--c1", c1);
-////    pcl::console::parse_argument(argc, argv, "--c2", c2);
-//    
-//    sparseK cluster_depth, cluster_color;
-//    Hier_Pooler hie_producer(radius);
-//    int count = 0;
-//    for( int b1 = 0 ; b1 <= 299 ; b1++ )
-//    {
-//        ObjectSet train_objects, test_objects;
-//        readUWInstWithImg(path, train_objects, test_objects, b1, b1, 1);
-//        test_objects.clear();
-//        
-//        int num = train_objects[0].size();
-//        #pragma omp parallel for schedule(dynamic, 1)
-//        for( int j = 0 ; j < num ; j++ )
-//        {
-//            pcl::PointCloud<PointT>::Ptr cloud = train_objects[0][j].cloud;
-//            pcl::PointCloud<NormalT>::Ptr cloud_normals(new pcl::PointCloud<NormalT>());
-//            computeNormals(cloud, cloud_normals, radius);
-//        
-//            MulInfoT cur_data = convertPCD(cloud, cloud_normals);
-//            
-//            std::vector<cv::Mat> rawfea_L0 = hie_producer.getRawFea(cur_data, -1, maxnum);
-//            #pragma omp critical
-//            {
-//                count++;
-//                if( count % 100 == 0 )
-//                    std::cerr << count << " ";
-//                
-//                int len = rawfea_L0[0].rows;
-//                for( int p = 0 ; p < len ; p++)
-//                {
-//                    cluster_depth.AddData(rawfea_L0[0].row(p));
-//                    cluster_color.AddData(rawfea_L0[1].row(p));
-//                }
-//            }
-//        }
-//    }
-//    
-//    std::cerr << "Start Kmeans..." << std::endl;
-//    
-//    cv::Mat center_depth, center_color;
-//    HierKmeans(cluster_depth.proto_set, center_depth, KK);
-//    HierKmeans(cluster_color.proto_set, center_color, KK);
-//    
-//    std::stringstream ss, ll;
-//    ss << KK;
-////    ll << layer;
-//    
-//    saveMat(out_path + "/dict_depth_L0_"+ss.str()+".cvmat", center_depth);
-//    saveMat(out_path + "/dict_color_L0_"+ss.str()+".cvmat", center_color);
-//    
-//    return 1;
-//}
-
 //int main(int argc, char** argv)
 //{
 //    int c1 = 0, c2 = 9;
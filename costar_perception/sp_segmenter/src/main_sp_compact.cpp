@@ -44,6 +44,21 @@ int main(int argc, char** argv)
     bool train_multi_flag;
     bool skip_fea;
 
+    // existing svm directory to warm-start from. The last object in obj_names is registered as the new class
+    std::string incremental_svm_path;
+    double fine_tune_eps;
+
+    // add the false positives of the trained binary models on the background data and retrain
+    bool hard_negative_mining;
+    int hard_negative_num;
+
+    // save int8/int16 copies of the trained models and report their accuracy loss, 0 disables
+    int quantize_bits;
+
+    // reduce the pooled features before svm training: none, pca or random
+    std::string projection_type;
+    int projection_dim;
+
 #ifdef BUILD_ROS_BINDING
 // Getting the parameter from ros param.
     ros::init(argc,argv,"sp_compact_node");
@@ -69,6 +84,17 @@ int main(int argc, char** argv)
     nh.param("skip_fea",skip_fea,false);
     nh.param("train_bg_flag",train_bg_flag, true);
     nh.param("train_multi_flag",train_multi_flag, true);
+
+    nh.param("incremental_svm_path",incremental_svm_path,std::string(""));
+    nh.param("fine_tune_eps",fine_tune_eps, 0.1);
+
+    nh.param("hard_negative_mining",hard_negative_mining, false);
+    nh.param("hard_negative_num",hard_negative_num, 20000);
+
+    nh.param("quantize_bits",quantize_bits, 0);
+
+    nh.param("projection_type",projection_type,std::string("none"));
+    nh.param("projection_dim",projection_dim, 512);
 #else
 // Set the parameter manually,
     root_path = "data/training";
@@ -90,6 +116,17 @@ int main(int argc, char** argv)
     skip_fea = false;
     train_bg_flag  = true;
     train_multi_flag = true;
+
+    incremental_svm_path = "";
+    fine_tune_eps = 0.1;
+
+    hard_negative_mining = false;
+    hard_negative_num = 20000;
+
+    quantize_bits = 0;
+
+    projection_type = "none";
+    projection_dim = 512;
 #endif
 // ---------------------------------------------------------------------
 // Setting up the training parameters
@@ -121,8 +158,24 @@ int main(int argc, char** argv)
     training.setSkipFeaExtraction(skip_fea);
     training.setSkipBackgroundSVM(!train_bg_flag);
     training.setSkipMultiSVM(!train_multi_flag);
-
-    training.startTrainingSVM();
+    training.setProjection(projection_type, projection_dim);
+
+    if (incremental_svm_path.empty())
+        training.startTrainingSVM();
+    else
+    {
+        training.setFineTuneEps(fine_tune_eps);
+        training.startIncrementalTrainingSVM(incremental_svm_path);
+    }
+
+    if (hard_negative_mining)
+    {
+        training.setHardNegativeNumber(hard_negative_num);
+        training.startHardNegativeMining();
+    }
+
+    if (quantize_bits > 0)
+        training.calibrateQuantizedSVM(quantize_bits);
 
 #ifdef BUILD_ROS_BINDING
     ros::shutdown();
@@ -0,0 +1,387 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+#include <pcl/filters/filter.h>
+
+#include "sp_segmenter/features.h"
+
+// Times the innermost segmentation kernels in isolation and prints ns per point or per row as JSON,
+// so a regression in sp_segmenter_bench can be attributed to one kernel:
+//   sp_kernel_bench [--w 320] [--h 240] [--pcd frame.pcd] [--rows 20000] [--dim 1344] [--dict_len 200] [--K 20]
+//       [--dict dict_depth_L0_200.cvmat] [--svm svm_model] [--classes 3] [--svm_dim 3000] [--hsi_len 15] [--chunk 500]
+//       [--radius 0.02] [--normal_ss 0.02] [--ss 0.005] [--sp_level 1] [--threads 1,2,4,8] [--r 5] [--seed 0] [--o result.json]
+// Without --pcd a synthetic organized XYZRGB cloud of w x h points is used, without --dict and --svm random
+// dictionaries and linear models. computeNormals, cshot_cloud_ss and buildOneSPLevel run the PCL OMP estimators,
+// which pick their own thread count, so they are measured once and reported with "threads": 0.
+
+struct KernelResult
+{
+    std::string name, unit;
+    int threads;
+    std::size_t items;
+    double ns_mean, ns_min;
+};
+
+static void addResult(std::vector<KernelResult> &results, const std::string &name, const std::string &unit, int threads,
+    std::size_t items, const std::vector<double> &samples)
+{
+    KernelResult result;
+    result.name = name;
+    result.unit = unit;
+    result.threads = threads;
+    result.items = items;
+    result.ns_mean = 0;
+    result.ns_min = samples.empty() ? 0 : *std::min_element(samples.begin(), samples.end());
+    for (std::size_t i = 0; i < samples.size(); i++)
+        result.ns_mean += samples[i];
+    if (!samples.empty())
+        result.ns_mean /= samples.size();
+
+    // seconds per call -> ns per item
+    double scale = items > 0 ? 1e9 / items : 0;
+    result.ns_mean *= scale;
+    result.ns_min *= scale;
+    results.push_back(result);
+    std::cerr << name << " (" << threads << " threads): " << result.ns_mean << " ns/" << unit << std::endl;
+}
+
+static void setThreads(int threads)
+{
+#ifdef USE_OPENMP
+    omp_set_num_threads(threads);
+#endif
+}
+
+static pcl::PointCloud<PointT>::Ptr syntheticCloud(int width, int height)
+{
+    // organized view of a slightly wavy table top with colored patches, like a close range RGB-D frame
+    pcl::PointCloud<PointT>::Ptr cloud(new pcl::PointCloud<PointT>(width, height));
+    float scale = 640.0 / width;
+    for (int v = 0; v < height; v++)
+    {
+        for (int u = 0; u < width; u++)
+        {
+            PointT &pt = cloud->at(u, v);
+            float z = 0.8 + 0.02 * sin(u * 0.05) * cos(v * 0.05) + 0.0005 * (rand() % 100) / 100.0;
+            pt.x = (u * scale - CENTER_X) * z / FOCAL_X;
+            pt.y = (v * scale - CENTER_Y) * z / FOCAL_Y;
+            pt.z = z;
+            int patch = (u / 40) * 7 + (v / 40) * 13;
+            pt.r = (patch * 37) % 256;
+            pt.g = (patch * 91) % 256;
+            pt.b = (patch * 53) % 256;
+        }
+    }
+    cloud->is_dense = true;
+    return cloud;
+}
+
+static cv::Mat randomRows(int rows, int cols, float density)
+{
+    cv::Mat data = cv::Mat::zeros(rows, cols, CV_32FC1);
+    cv::Mat mask(rows, cols, CV_32FC1), values(rows, cols, CV_32FC1);
+    cv::randu(mask, 0, 1);
+    cv::randu(values, 0, 1);
+    values.copyTo(data, mask < density);
+    for (int i = 0; i < rows; i++)
+        cv::normalize(data.row(i), data.row(i), 1.0, 0.0, cv::NORM_L2);
+    return data;
+}
+
+static model *randomModel(int nr_class, int nr_feature)
+{
+    // malloc'ed like load_model, so free_and_destroy_model can release either
+    model *result = (model *)malloc(sizeof(model));
+    result->param.solver_type = L2R_L2LOSS_SVC_DUAL;
+    result->nr_class = nr_class;
+    result->nr_feature = nr_feature;
+    result->bias = 1;
+    int nr_w = nr_class == 2 ? 1 : nr_class;
+    result->w = (double *)malloc(sizeof(double) * (nr_feature + 1) * nr_w);
+    for (int i = 0; i < (nr_feature + 1) * nr_w; i++)
+        result->w[i] = (rand() % 2001 - 1000) / 1000.0;
+    result->label = (int *)malloc(sizeof(int) * nr_class);
+    for (int i = 0; i < nr_class; i++)
+        result->label[i] = i + 1;
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    int width = 320, height = 240, rows = 20000, dim = 1344, dict_len = 200, K = 20;
+    int nr_class = 3, svm_dim = 3000, hsi_len = 15, chunk = 500, sp_level = 1, repetitions = 5, seed = 0;
+    float radius = 0.02, normal_ss = 0.02, down_ss = 0.005;
+    std::string pcd_file, dict_file, svm_file, thread_list("1"), output_file;
+
+    pcl::console::parse_argument(argc, argv, "--w", width);
+    pcl::console::parse_argument(argc, argv, "--h", height);
+    pcl::console::parse_argument(argc, argv, "--pcd", pcd_file);
+    pcl::console::parse_argument(argc, argv, "--rows", rows);
+    pcl::console::parse_argument(argc, argv, "--dim", dim);
+    pcl::console::parse_argument(argc, argv, "--dict_len", dict_len);
+    pcl::console::parse_argument(argc, argv, "--K", K);
+    pcl::console::parse_argument(argc, argv, "--dict", dict_file);
+    pcl::console::parse_argument(argc, argv, "--svm", svm_file);
+    pcl::console::parse_argument(argc, argv, "--classes", nr_class);
+    pcl::console::parse_argument(argc, argv, "--svm_dim", svm_dim);
+    pcl::console::parse_argument(argc, argv, "--hsi_len", hsi_len);
+    pcl::console::parse_argument(argc, argv, "--chunk", chunk);
+    pcl::console::parse_argument(argc, argv, "--radius", radius);
+    pcl::console::parse_argument(argc, argv, "--normal_ss", normal_ss);
+    pcl::console::parse_argument(argc, argv, "--ss", down_ss);
+    pcl::console::parse_argument(argc, argv, "--sp_level", sp_level);
+    pcl::console::parse_argument(argc, argv, "--threads", thread_list);
+    pcl::console::parse_argument(argc, argv, "--r", repetitions);
+    pcl::console::parse_argument(argc, argv, "--seed", seed);
+    pcl::console::parse_argument(argc, argv, "--o", output_file);
+
+    srand(seed);
+    cv::theRNG().state = seed + 1;
+
+    std::vector<std::string> thread_tokens;
+    std::vector<int> thread_counts;
+    boost::split(thread_tokens, thread_list, boost::is_any_of(","));
+    for (std::size_t i = 0; i < thread_tokens.size(); i++)
+        if (!thread_tokens[i].empty())
+            thread_counts.push_back(boost::lexical_cast<int>(thread_tokens[i]));
+    if (thread_counts.empty() || repetitions < 1 || chunk < 1)
+    {
+        std::cerr << "Please give --threads as a comma separated list, and positive --r and --chunk\n";
+        return 1;
+    }
+#ifndef USE_OPENMP
+    if (thread_counts.size() > 1 || thread_counts[0] != 1)
+        std::cerr << "Built without OpenMP, all thread counts run on one thread\n";
+#endif
+
+// -------------------------------------------------------------------------
+// Inputs, all prepared before timing
+    pcl::PointCloud<PointT>::Ptr cloud;
+    if (pcd_file.empty())
+        cloud = syntheticCloud(width, height);
+    else
+    {
+        cloud = pcl::PointCloud<PointT>::Ptr(new pcl::PointCloud<PointT>());
+        if (pcl::io::loadPCDFile(pcd_file, *cloud) != 0)
+        {
+            std::cerr << "Failed to read: " << pcd_file << std::endl;
+            return 1;
+        }
+        std::vector<int> valid;
+        pcl::removeNaNFromPointCloud(*cloud, *cloud, valid);
+    }
+    std::size_t num_points = cloud->size();
+
+    cv::Mat dict;
+    if (dict_file.empty())
+        dict = randomRows(dict_len, dim, 0.3);
+    else
+    {
+        readMat(dict_file, dict);
+        dict_len = dict.rows;
+        dim = dict.cols;
+    }
+    cv::flann::Index tree;
+    cv::flann::KDTreeIndexParams indexParams;
+#ifdef opencv_miniflann_build_h
+    extFlannIndexBuild(tree, dict, indexParams);
+#else
+    tree.build(dict, indexParams);
+#endif
+    K = std::max(1, std::min(K, dict_len));
+    cv::Mat raw_fea = randomRows(rows, dim, 0.3);
+
+    // codes and HSI domain as they come out of KNNEncoder and the color conversion
+    cv::Mat codes = cv::Mat::zeros(rows, dict_len, CV_32FC1);
+    for (int i = 0; i < rows; i++)
+        KNNEncoder(raw_fea.row(i), tree, dict_len, K).copyTo(codes.row(i));
+    cv::Mat hsi(rows, 3, CV_32FC1);
+    cv::randu(hsi, 0, 1);
+    // one pooler per thread, Pooler_L0 keeps its flann index and is not copied
+    std::vector< boost::shared_ptr<Pooler_L0> > poolers;
+
+    model *svm_model = svm_file.empty() ? randomModel(nr_class, svm_dim) : load_model(svm_file.c_str());
+    if (svm_model == NULL)
+    {
+        std::cerr << "Failed to read: " << svm_file << std::endl;
+        return 1;
+    }
+    int nr_w = svm_model->nr_class == 2 ? 1 : svm_model->nr_class;
+    cv::Mat svm_fea = randomRows(rows, svm_model->nr_feature, 0.2);
+    std::vector<sparseVec> sparse_fea;
+    sparseCvMat(svm_fea, sparse_fea);
+    for (std::size_t i = 0; i < sparse_fea.size(); i++)
+    {
+        // liblinear indices start at 1, then the bias term and the terminator, as in spPooler::predictSP
+        for (std::size_t j = 0; j < sparse_fea[i].size(); j++)
+            sparse_fea[i][j].index++;
+        feature_node bias_term;
+        bias_term.index = svm_model->nr_feature + 1;
+        bias_term.value = svm_model->bias;
+        feature_node end_node;
+        end_node.index = -1;
+        end_node.value = 0;
+        sparse_fea[i].push_back(bias_term);
+        sparse_fea[i].push_back(end_node);
+    }
+
+    std::vector<KernelResult> results;
+
+// -------------------------------------------------------------------------
+// Row and point kernels, parallelized over rows the way HierFea and spPooler call them
+    for (std::size_t t = 0; t < thread_counts.size(); t++)
+    {
+        int threads = thread_counts[t];
+        setThreads(threads);
+        std::vector<double> samples;
+
+        // RGBToLab, per point
+        std::vector<float> lab(num_points * 3);
+        for (int r = 0; r < repetitions; r++)
+        {
+            double start = get_wall_time();
+            #pragma omp parallel for
+            for (int i = 0; i < (int)num_points; i++)
+            {
+                const PointT &pt = cloud->at(i);
+                int rgb[3] = {pt.r, pt.g, pt.b};
+                RGBToLab(rgb, &lab[i * 3]);
+            }
+            samples.push_back(get_wall_time() - start);
+        }
+        addResult(results, "RGBToLab", "point", threads, num_points, samples);
+
+        // KNNEncoder, per feature row
+        samples.clear();
+        std::vector<cv::Mat> code_vec(rows);
+        for (int r = 0; r < repetitions; r++)
+        {
+            double start = get_wall_time();
+            #pragma omp parallel for
+            for (int i = 0; i < rows; i++)
+                code_vec[i] = KNNEncoder(raw_fea.row(i), tree, dict_len, K);
+            samples.push_back(get_wall_time() - start);
+        }
+        addResult(results, "KNNEncoder", "row", threads, rows, samples);
+
+        // MaxOP, per code row
+        samples.clear();
+        cv::Mat pooled = cv::Mat::zeros(rows, dict_len, CV_32FC1);
+        for (int r = 0; r < repetitions; r++)
+        {
+            double start = get_wall_time();
+            #pragma omp parallel for
+            for (int i = 0; i < rows; i++)
+                MaxOP(pooled.row(i), codes.row(i));
+            samples.push_back(get_wall_time() - start);
+        }
+        addResult(results, "MaxOP", "row", threads, rows, samples);
+
+        // Pooler_L0::PoolOneDomain_Raw on HSI, one call per chunk of rows like one call per superpixel
+        samples.clear();
+        while ((int)poolers.size() < threads)
+            poolers.push_back(boost::shared_ptr<Pooler_L0>(new Pooler_L0(hsi_len)));
+        int num_chunks = (rows + chunk - 1) / chunk;
+        for (int r = 0; r < repetitions; r++)
+        {
+            double start = get_wall_time();
+            #pragma omp parallel for schedule(dynamic, 1)
+            for (int c = 0; c < num_chunks; c++)
+            {
+                int thread_id = 0;
+#ifdef USE_OPENMP
+                thread_id = omp_get_thread_num();
+#endif
+                cv::Range range(c * chunk, std::min(rows, (c + 1) * chunk));
+                poolers[thread_id]->PoolOneDomain_Raw(hsi.rowRange(range), codes.rowRange(range), 1, true);
+            }
+            samples.push_back(get_wall_time() - start);
+        }
+        addResult(results, "PoolOneDomain_Raw", "row", threads, rows, samples);
+
+        // liblinear predict_values, per feature row
+        samples.clear();
+        std::vector<double> dec_values(rows * nr_w);
+        for (int r = 0; r < repetitions; r++)
+        {
+            double start = get_wall_time();
+            #pragma omp parallel for
+            for (int i = 0; i < rows; i++)
+                predict_values(svm_model, &sparse_fea[i][0], &dec_values[i * nr_w]);
+            samples.push_back(get_wall_time() - start);
+        }
+        addResult(results, "predict_values", "row", threads, rows, samples);
+    }
+
+// -------------------------------------------------------------------------
+// PCL based kernels
+    setThreads(*std::max_element(thread_counts.begin(), thread_counts.end()));
+    std::vector<double> samples;
+
+    // computeNormals, per point
+    pcl::PointCloud<NormalT>::Ptr cloud_normals;
+    for (int r = 0; r < repetitions; r++)
+    {
+        double start = get_wall_time();
+        computeNormals(cloud, cloud_normals, normal_ss);
+        samples.push_back(get_wall_time() - start);
+    }
+    addResult(results, "computeNormals", "point", 0, num_points, samples);
+
+    // cshot_cloud_ss, per keypoint, keypoints downsampled once up front so only the descriptor is timed
+    samples.clear();
+    pcl::PointCloud<PointT>::Ptr keypoints(new pcl::PointCloud<PointT>());
+    pcl::VoxelGrid<PointT> sor;
+    sor.setInputCloud(cloud);
+    sor.setLeafSize(down_ss, down_ss, down_ss);
+    sor.filter(*keypoints);
+    pcl::PointCloud<pcl::ReferenceFrame>::Ptr lrf(new pcl::PointCloud<pcl::ReferenceFrame>());
+    for (int r = 0; r < repetitions; r++)
+    {
+        double start = get_wall_time();
+        cshot_cloud_ss(cloud, cloud_normals, lrf, keypoints, radius, down_ss);
+        samples.push_back(get_wall_time() - start);
+    }
+    addResult(results, "cshot_cloud_ss", "keypoint", 0, keypoints->size(), samples);
+
+    // spExt::buildOneSPLevel, reached through getSPIdx on a freshly loaded cloud, per downsampled point
+    samples.clear();
+    spExt sp_ext(down_ss);
+    for (int r = 0; r < repetitions; r++)
+    {
+        sp_ext.clear();
+        sp_ext.LoadPointCloud(cloud);
+        double start = get_wall_time();
+        sp_ext.getSPIdx(sp_level);
+        samples.push_back(get_wall_time() - start);
+    }
+    addResult(results, "buildOneSPLevel", "point", 0, sp_ext.getCloud()->size(), samples);
+
+    free_and_destroy_model(&svm_model);
+
+    std::stringstream result;
+    result << "{\n  \"points\": " << num_points << ",\n  \"rows\": " << rows << ",\n  \"dim\": " << dim
+        << ",\n  \"dict_len\": " << dict_len << ",\n  \"K\": " << K << ",\n  \"kernels\": [\n";
+    for (std::size_t i = 0; i < results.size(); i++)
+    {
+        const KernelResult &k = results[i];
+        result << "    {\"name\": \"" << k.name << "\", \"unit\": \"" << k.unit << "\", \"threads\": " << k.threads
+            << ", \"items\": " << k.items << ", \"ns_mean\": " << k.ns_mean << ", \"ns_min\": " << k.ns_min << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    result << "  ]\n}\n";
+
+    if (output_file.empty())
+        std::cout << result.str();
+    else
+    {
+        std::ofstream out(output_file.c_str());
+        out << result.str();
+        std::cerr << "Wrote " << output_file << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,194 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <sys/resource.h>
+#include <boost/filesystem.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include "sp_segmenter/semantic_segmentation.h"
+#include "sp_segmenter/utility/latency_summary.h"
+
+// Replays a directory of PCD files through SemanticSegmentation and prints per stage latency as JSON.
+// Runs without ROS, so two releases can be compared on the same machine:
+//   sp_segmenter_bench --pcd ./sample_pcd_data/frames --data ./data --svm link_node_svm --models link_uniform,node_uniform
+//       [--shot UW_shot_dict] [--ss 0.003] [--rt 0.1] [--binary] [--pose] [--cuda] [--pw 0.1] [--vs 0.004]
+//       [--crop 0.35] [--crop_pose tx,ty,tz,qw,qx,qy,qz] [--table table.pcd] [--r 1] [--warmup 1] [--o result.json]
+
+int main(int argc, char** argv)
+{
+    std::string pcd_path, data_path("./data"), svm_name("link_node_svm"), shot_name("UW_shot_dict");
+    std::string model_list, table_pcd, output_file;
+    float down_ss = 0.003, ratio = 0.1;
+    double pair_width = 0.1, voxel_size = 0.004, crop_size = 0;
+    int repetitions = 1, warmup = 1;
+    std::vector<double> crop_pose;
+
+    pcl::console::parse_argument(argc, argv, "--pcd", pcd_path);
+    pcl::console::parse_argument(argc, argv, "--data", data_path);
+    pcl::console::parse_argument(argc, argv, "--svm", svm_name);
+    pcl::console::parse_argument(argc, argv, "--shot", shot_name);
+    pcl::console::parse_argument(argc, argv, "--models", model_list);
+    pcl::console::parse_argument(argc, argv, "--ss", down_ss);
+    pcl::console::parse_argument(argc, argv, "--rt", ratio);
+    pcl::console::parse_argument(argc, argv, "--pw", pair_width);
+    pcl::console::parse_argument(argc, argv, "--vs", voxel_size);
+    pcl::console::parse_argument(argc, argv, "--crop", crop_size);
+    pcl::console::parse_x_arguments(argc, argv, "--crop_pose", crop_pose);
+    pcl::console::parse_argument(argc, argv, "--table", table_pcd);
+    pcl::console::parse_argument(argc, argv, "--r", repetitions);
+    pcl::console::parse_argument(argc, argv, "--warmup", warmup);
+    pcl::console::parse_argument(argc, argv, "--o", output_file);
+    bool use_binary = pcl::console::find_switch(argc, argv, "--binary");
+    bool compute_pose = pcl::console::find_switch(argc, argv, "--pose");
+    bool use_cuda = pcl::console::find_switch(argc, argv, "--cuda");
+
+    if (pcd_path.empty() || !boost::filesystem::is_directory(pcd_path))
+    {
+        std::cerr << "Please give a directory of PCD files with --pcd\n";
+        return 1;
+    }
+
+    std::vector<std::string> pcd_files;
+    for (boost::filesystem::directory_iterator it(pcd_path); it != boost::filesystem::directory_iterator(); ++it)
+    {
+        if (it->path().extension() == ".pcd")
+            pcd_files.push_back(it->path().string());
+    }
+    std::sort(pcd_files.begin(), pcd_files.end());
+    if (pcd_files.empty())
+    {
+        std::cerr << "No PCD files in: " << pcd_path << std::endl;
+        return 1;
+    }
+
+    // load all frames first, so disk reads are not part of the measured latency
+    std::vector<pcl::PointCloud<PointT>::Ptr> frames;
+    pcl::PCDReader reader;
+    for (std::size_t i = 0; i < pcd_files.size(); i++)
+    {
+        pcl::PointCloud<PointT>::Ptr cloud(new pcl::PointCloud<PointT>);
+        if (reader.read(pcd_files[i], *cloud) == 0)
+            frames.push_back(cloud);
+        else
+            std::cerr << "Failed to read: " << pcd_files[i] << std::endl;
+    }
+
+// -------------------------------------------------------------------------
+// Setting up segmenter's parameters the same way as sample_semantic_segmenter, without visualization
+    if (data_path.back() != '/')
+        data_path += "/";
+
+    SemanticSegmentation segmenter;
+    segmenter.setDirectorySHOT(data_path + shot_name);
+    segmenter.setUseMultiClassSVM(!use_binary);
+    segmenter.setUseBinarySVM(use_binary);
+    segmenter.setDirectorySVM(data_path + svm_name);
+    segmenter.setPointCloudDownsampleValue(down_ss);
+    segmenter.setHierFeaRatio(ratio);
+    segmenter.setUseVisualization(false);
+
+    if (crop_size > 0)
+    {
+        if (crop_pose.size() != 7)
+        {
+            std::cerr << "--crop needs --crop_pose tx,ty,tz,qw,qx,qy,qz\n";
+            return 1;
+        }
+        segmenter.setUseCropBox(true);
+        segmenter.setCropBoxSize(crop_size, crop_size, crop_size);
+        Eigen::Quaternionf rotation(crop_pose[3], crop_pose[4], crop_pose[5], crop_pose[6]);
+        Eigen::Affine3f pose = Eigen::Translation3f(crop_pose[0], crop_pose[1], crop_pose[2]) * rotation;
+        segmenter.setCropBoxPose(pose);
+    }
+
+    if (!table_pcd.empty())
+    {
+        segmenter.setCropAboveTableBoundary(0.01, 0.5);
+        segmenter.loadTableFromFile(table_pcd);
+    }
+
+#ifdef USE_OBJRECRANSAC
+    std::vector<std::string> models;
+    if (!model_list.empty())
+        boost::split(models, model_list, boost::is_any_of(","));
+    if (compute_pose)
+    {
+        segmenter.setUseComputePose(true);
+        segmenter.setUseCuda(use_cuda);
+        segmenter.setModeObjRecRANSAC(STANDARD_RECOGNIZE);
+        segmenter.setUseObjectPersistence(false);
+        for (std::size_t i = 0; i < models.size(); i++)
+            segmenter.addModel(data_path + "mesh", models[i], ModelObjRecRANSACParameter(pair_width, voxel_size));
+    }
+#else
+    if (compute_pose)
+        std::cerr << "Built without ObjRecRANSAC, --pose is ignored\n";
+    compute_pose = false;
+#endif
+
+    segmenter.initializeSemanticSegmentation();
+
+// -------------------------------------------------------------------------
+// Replay
+    std::vector<std::vector<double> > stage_samples(NUM_SEGMENTATION_STAGES);
+    std::vector<double> total_samples;
+    std::size_t failed_frames = 0;
+    double replay_time = 0;
+
+    for (int r = -warmup; r < repetitions; r++)
+    {
+        double start = get_wall_time();
+        for (std::size_t i = 0; i < frames.size(); i++)
+        {
+            double frame_start = get_wall_time();
+            pcl::PointCloud<PointLT>::Ptr labels;
+            bool success = segmenter.segmentPointCloud(frames[i], labels);
+#ifdef USE_OBJRECRANSAC
+            if (success && compute_pose)
+                segmenter.calculateObjTransform(labels);
+#endif
+            double frame_time = get_wall_time() - frame_start;
+
+            // warmup runs fill the caches and are not reported
+            if (r < 0)
+                continue;
+            if (!success)
+            {
+                failed_frames++;
+                continue;
+            }
+            total_samples.push_back(frame_time);
+            for (int s = 0; s < NUM_SEGMENTATION_STAGES; s++)
+                stage_samples[s].push_back(segmenter.getLastStageTime(SegmentationStage(s)));
+        }
+        if (r >= 0)
+            replay_time += get_wall_time() - start;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    std::stringstream result;
+    result << "{\n  \"frames\": " << total_samples.size() << ",\n  \"failed_frames\": " << failed_frames
+        << ",\n  \"throughput_fps\": " << (replay_time > 0 ? (total_samples.size() + failed_frames) / replay_time : 0)
+        << ",\n  \"peak_rss_kb\": " << usage.ru_maxrss
+        << ",\n  \"latency_ms\": {\n";
+    for (int s = 0; s < NUM_SEGMENTATION_STAGES; s++)
+    {
+        writeSummary(result, SemanticSegmentation::getStageName(SegmentationStage(s)), stage_samples[s]);
+        result << ",\n";
+    }
+    writeSummary(result, "total", total_samples);
+    result << "\n  }\n}\n";
+
+    if (output_file.empty())
+        std::cout << result.str();
+    else
+    {
+        std::ofstream out(output_file.c_str());
+        out << result.str();
+        std::cerr << "Wrote " << output_file << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,282 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include "sp_segmenter/frame_log.h"
+#include "sp_segmenter/utility/latency_summary.h"
+
+// Replays a frame log recorded by SPSegmenterServer (recordFile parameter) through SemanticSegmentation, with the
+// recorded parameters, table, crop box and preferred orientation of every frame. Prints latency and how many
+// frames differ from the recording as JSON:
+//   sp_segmenter_replay --log session.splog [--speed max|recorded] [--r 1] [--warmup 0] [--no_pose]
+//       [--set svm_path=/other/data/link_node_svm] [--set use_cuda=false] [--o result.json]
+// --speed recorded feeds the frames with the recorded spacing and counts the frames that were not done before the
+// next one arrived, which is a throughput test without a camera. Parameters given with --set replace the
+// recorded ones, e.g. when the data directory moved.
+
+// recorded values come from boost::lexical_cast, booleans given with --set may also be true or false
+template <typename T>
+static T getParameter(const FrameLogParameters &parameters, const std::string &name, const T &default_value)
+{
+    FrameLogParameters::const_iterator it = parameters.find(name);
+    if (it == parameters.end())
+        return default_value;
+    try
+    {
+        return boost::lexical_cast<T>(it->second);
+    }
+    catch (const boost::bad_lexical_cast &)
+    {
+        std::cerr << "Invalid value for " << name << ": " << it->second << std::endl;
+        return default_value;
+    }
+}
+
+template <>
+bool getParameter<bool>(const FrameLogParameters &parameters, const std::string &name, const bool &default_value)
+{
+    FrameLogParameters::const_iterator it = parameters.find(name);
+    if (it == parameters.end())
+        return default_value;
+    return it->second == "1" || it->second == "true";
+}
+
+// the same settings RosSemanticSegmentation::initializeSemanticSegmentationFromRosParam makes, with the same defaults
+static void configureSegmenter(SemanticSegmentation &segmenter, const FrameLogParameters &parameters, const bool &compute_pose)
+{
+    std::string log_level = getParameter<std::string>(parameters, "logLevel", "info");
+    if (getenv("SP_SEGMENTER_LOG_LEVEL") == NULL)
+        sp_log::setLevel(log_level);
+
+    segmenter.setDirectorySHOT(getParameter<std::string>(parameters, "shot_path", "data/UW_shot_dict/"));
+    segmenter.setUseBinarySVM(getParameter(parameters, "useBinarySVM", false));
+    segmenter.setUseMultiClassSVM(getParameter(parameters, "useMultiClassSVM", true));
+    segmenter.setQuantizedSVMBits(getParameter(parameters, "quantizedSVMBits", 0));
+    segmenter.setDirectorySVM(getParameter<std::string>(parameters, "svm_path", "data/UR5_drill_svm/"));
+
+    // the table itself comes from the log
+    segmenter.setUseTableSegmentation(getParameter(parameters, "useTableSegmentation", true));
+    segmenter.setCropAboveTableBoundary(getParameter(parameters, "aboveTableMin", 0.01), getParameter(parameters, "aboveTableMax", 0.25));
+    segmenter.setTableSegmentationParameters(getParameter(parameters, "tableDistanceThreshold", 0.02),
+        getParameter(parameters, "tableAngularThreshold", 2.0), getParameter(parameters, "tableMinimalInliers", 5000.0));
+    segmenter.setUseVisualization(false);
+
+#ifdef USE_OBJRECRANSAC
+    segmenter.setUseComputePose(compute_pose);
+    segmenter.setUseCuda(getParameter(parameters, "use_cuda", true));
+    segmenter.setMinConfidenceObjRecRANSAC(getParameter(parameters, "minConfidence", 0.0));
+    segmenter.setUseObjectPersistence(getParameter(parameters, "useObjectPersistence", false));
+    segmenter.setUsePreferredOrientation(getParameter(parameters, "setObjectOrientation", false));
+
+    std::string mesh_path = getParameter<std::string>(parameters, "mesh_path", "data/mesh/");
+    std::string model_list = getParameter<std::string>(parameters, "cur_name", "drill");
+    std::vector<std::string> cur_name;
+    boost::split(cur_name, model_list, boost::is_any_of(","));
+    std::map<std::string, objectSymmetry> object_dict;
+    for (std::size_t i = 0; i < cur_name.size() && compute_pose; i++)
+    {
+        const std::string &name = cur_name[i];
+        object_dict[name] = objectSymmetry(getParameter(parameters, name + "/x", 360.0), getParameter(parameters, name + "/y", 360.0),
+            getParameter(parameters, name + "/z", 360.0), getParameter<std::string>(parameters, name + "/preferred_axis", "z"),
+            getParameter(parameters, name + "/preferred_step", 360.0));
+        segmenter.addModel(mesh_path, name, ModelObjRecRANSACParameter(getParameter(parameters, name + "/pair_width", 0.005),
+            getParameter(parameters, name + "/voxel_size", 0.004), getParameter(parameters, name + "/scene_visibility", 0.1),
+            getParameter(parameters, name + "/object_visibility", 0.1)));
+    }
+    segmenter.addModelSymmetricProperty(object_dict);
+#endif
+
+    segmenter.initializeSemanticSegmentation();
+}
+
+// number of points whose label differs, or all points if the clouds do not match up
+static std::size_t countLabelDifferences(const pcl::PointCloud<PointLT>::Ptr &recorded, const pcl::PointCloud<PointLT>::Ptr &replayed)
+{
+    if (!recorded || !replayed)
+        return (recorded ? recorded->size() : 0) + (replayed ? replayed->size() : 0);
+    if (recorded->size() != replayed->size())
+        return std::max(recorded->size(), replayed->size());
+
+    std::size_t differences = 0;
+    for (std::size_t i = 0; i < recorded->size(); i++)
+        differences += (recorded->points[i].label != replayed->points[i].label);
+    return differences;
+}
+
+int main(int argc, char** argv)
+{
+    std::string log_path, speed("max"), output_file;
+    int repetitions = 1, warmup = 0;
+    std::vector<std::string> overrides;
+
+    pcl::console::parse_argument(argc, argv, "--log", log_path);
+    pcl::console::parse_argument(argc, argv, "--speed", speed);
+    pcl::console::parse_argument(argc, argv, "--r", repetitions);
+    pcl::console::parse_argument(argc, argv, "--warmup", warmup);
+    pcl::console::parse_argument(argc, argv, "--o", output_file);
+    // --set may be given several times
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (std::string(argv[i]) == "--set")
+            overrides.push_back(argv[++i]);
+    }
+    bool no_pose = pcl::console::find_switch(argc, argv, "--no_pose");
+
+    if (log_path.empty())
+    {
+        std::cerr << "Please give a frame log with --log\n";
+        return 1;
+    }
+    if (speed != "max" && speed != "recorded")
+    {
+        std::cerr << "--speed is max or recorded\n";
+        return 1;
+    }
+
+    FrameLogReader reader;
+    if (!reader.open(log_path))
+        return 1;
+    if (reader.getNumberOfFrames() == 0)
+    {
+        std::cerr << "No frames in: " << log_path << std::endl;
+        return 1;
+    }
+
+    FrameLogParameters parameters = reader.getParameters();
+    for (std::size_t i = 0; i < overrides.size(); i++)
+    {
+        std::size_t separator = overrides[i].find('=');
+        if (separator == std::string::npos)
+        {
+            std::cerr << "--set needs key=value: " << overrides[i] << std::endl;
+            return 1;
+        }
+        parameters[overrides[i].substr(0, separator)] = overrides[i].substr(separator + 1);
+    }
+
+    bool compute_pose = getParameter(parameters, "compute_pose", true) && !no_pose;
+#ifdef USE_OBJRECRANSAC
+    if (compute_pose && !getParameter(parameters, "compiled_with_objrecransac", true))
+        std::cerr << "The log was recorded without ObjRecRANSAC, it has no poses to compare with\n";
+#else
+    if (compute_pose)
+        std::cerr << "Built without ObjRecRANSAC, poses are not computed\n";
+    compute_pose = false;
+#endif
+
+// -------------------------------------------------------------------------
+// Replay
+    std::vector<std::vector<double> > stage_samples(NUM_SEGMENTATION_STAGES);
+    std::vector<double> total_samples, recorded_samples;
+    std::size_t failed_frames = 0, late_frames = 0, label_mismatch_frames = 0, pose_mismatch_frames = 0, success_mismatch_frames = 0;
+    double replay_time = 0;
+
+    for (int r = -warmup; r < repetitions; r++)
+    {
+        // object persistence and the table depend on the earlier frames, so every repetition starts from the same state
+        boost::shared_ptr<SemanticSegmentation> segmenter(new SemanticSegmentation());
+        configureSegmenter(*segmenter, parameters, compute_pose);
+
+        double start = get_wall_time();
+        double first_stamp = reader.getFrameEntry(0).stamp;
+        pcl::PointCloud<PointT>::Ptr current_table;
+        for (std::size_t i = 0; i < reader.getNumberOfFrames(); i++)
+        {
+            LoggedFrame frame;
+            if (!reader.readFrame(i, frame) || !frame.cloud)
+                continue;
+
+            pcl::PointCloud<PointT>::Ptr table;
+            if (reader.readTableForFrame(i, table) && table != current_table)
+            {
+                segmenter->setTableCornerPoints(table);
+                current_table = table;
+            }
+            segmenter->setUseCropBox(frame.use_crop_box);
+            segmenter->setCropBoxSize(frame.crop_box_size);
+            segmenter->setCropBoxPose(frame.crop_box_pose);
+#ifdef USE_OBJRECRANSAC
+            segmenter->setModeObjRecRANSAC(frame.objrecransac_mode);
+            if (frame.use_preferred_orientation)
+                segmenter->setPreferredOrientation(frame.preferred_orientation);
+#endif
+
+            if (speed == "recorded")
+            {
+                double due = start + (frame.stamp - first_stamp);
+                double now = get_wall_time();
+                if (now > due + 1e-3)
+                    late_frames += (r >= 0);
+                else if (now < due)
+                    std::this_thread::sleep_for(std::chrono::duration<double>(due - now));
+            }
+
+            double frame_start = get_wall_time();
+            pcl::PointCloud<PointLT>::Ptr labels;
+            std::vector<objectTransformInformation> poses;
+            bool success = segmenter->segmentPointCloud(frame.cloud, labels);
+#ifdef USE_OBJRECRANSAC
+            if (success && compute_pose)
+                poses = segmenter->calculateObjTransform(labels);
+#endif
+            double frame_time = get_wall_time() - frame_start;
+
+            // warmup runs fill the caches and are not reported
+            if (r < 0)
+                continue;
+            recorded_samples.push_back(frame.segmentation_time);
+            success_mismatch_frames += (success != frame.success);
+            if (!success)
+            {
+                failed_frames++;
+                continue;
+            }
+            total_samples.push_back(frame_time);
+            for (int s = 0; s < NUM_SEGMENTATION_STAGES; s++)
+                stage_samples[s].push_back(segmenter->getLastStageTime(SegmentationStage(s)));
+
+            std::size_t label_differences = countLabelDifferences(frame.labels, labels);
+            label_mismatch_frames += (label_differences > 0);
+            if (label_differences > 0)
+                SP_LOG_DEBUG("Frame " << frame.sequence << ": " << label_differences << " labels differ from the recording");
+            // ObjRecRANSAC is randomized, only the number of objects is expected to match
+            pose_mismatch_frames += (compute_pose && poses.size() != frame.poses.size());
+        }
+        if (r >= 0)
+            replay_time += get_wall_time() - start;
+    }
+
+    std::stringstream result;
+    result << "{\n  \"log\": \"" << log_path << "\",\n  \"speed\": \"" << speed << "\""
+        << ",\n  \"frames\": " << total_samples.size() << ",\n  \"failed_frames\": " << failed_frames
+        << ",\n  \"late_frames\": " << late_frames
+        << ",\n  \"success_mismatch_frames\": " << success_mismatch_frames
+        << ",\n  \"label_mismatch_frames\": " << label_mismatch_frames
+        << ",\n  \"pose_count_mismatch_frames\": " << pose_mismatch_frames
+        << ",\n  \"throughput_fps\": " << (replay_time > 0 ? (total_samples.size() + failed_frames) / replay_time : 0)
+        << ",\n  \"latency_ms\": {\n";
+    for (int s = 0; s < NUM_SEGMENTATION_STAGES; s++)
+    {
+        writeSummary(result, SemanticSegmentation::getStageName(SegmentationStage(s)), stage_samples[s]);
+        result << ",\n";
+    }
+    writeSummary(result, "total", total_samples);
+    result << ",\n";
+    writeSummary(result, "recorded", recorded_samples);
+    result << "\n  }\n}\n";
+
+    if (output_file.empty())
+        std::cout << result.str();
+    else
+    {
+        std::ofstream out(output_file.c_str());
+        out << result.str();
+        std::cerr << "Wrote " << output_file << std::endl;
+    }
+    return 0;
+}
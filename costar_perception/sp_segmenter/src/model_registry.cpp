@@ -0,0 +1,227 @@
+#include "sp_segmenter/model_registry.h"
+#include "sp_segmenter/utility/logger.h"
+
+#ifdef USE_OBJRECRANSAC
+#include "sp_segmenter/greedyObjRansac.h"
+#endif
+
+SVMModelSet::SVMModelSet() : loaded(false), binary_models(3, NULL), multi_models(3, NULL), binary_qmodels(3), multi_qmodels(3),
+    binary_projections(3), multi_projections(3)
+{
+}
+
+SVMModelSet::~SVMModelSet()
+{
+    for( int ll = 0 ; ll < 3 ; ll++ )
+    {
+        if (binary_models[ll] != NULL)
+            free_and_destroy_model(&binary_models[ll]);
+        if (multi_models[ll] != NULL)
+            free_and_destroy_model(&multi_models[ll]);
+    }
+}
+
+ModelRegistry &ModelRegistry::instance()
+{
+    static ModelRegistry registry;
+    return registry;
+}
+
+template <typename T>
+boost::shared_ptr<T> ModelRegistry::find(const std::string &key)
+{
+    std::map<std::string, boost::weak_ptr<void> >::iterator it = entries_.find(key);
+    if (it == entries_.end())
+        return boost::shared_ptr<T>();
+    return boost::static_pointer_cast<T>(it->second.lock());
+}
+
+template <typename T>
+void ModelRegistry::insert(const std::string &key, const boost::shared_ptr<T> &value)
+{
+    // forget the models nobody uses anymore
+    for (std::map<std::string, boost::weak_ptr<void> >::iterator it = entries_.begin(); it != entries_.end(); )
+    {
+        if (it->second.expired())
+            entries_.erase(it++);
+        else
+            ++it;
+    }
+    entries_[key] = value;
+}
+
+std::size_t ModelRegistry::size()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::size_t alive = 0;
+    for (std::map<std::string, boost::weak_ptr<void> >::const_iterator it = entries_.begin(); it != entries_.end(); ++it)
+        if (!it->second.expired())
+            alive++;
+    return alive;
+}
+
+boost::shared_ptr<const Hier_Pooler> ModelRegistry::getSHOTDictionary(const std::string &shot_path, const float &radius, const float &ratio)
+{
+    std::ostringstream key;
+    key << "shot:" << shot_path << ":" << radius << ":" << ratio;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    boost::shared_ptr<Hier_Pooler> result = find<Hier_Pooler>(key.str());
+    if (result)
+    {
+        SP_LOG_INFO("Sharing the SHOT dictionary loaded from " << shot_path);
+        return result;
+    }
+
+    result = boost::shared_ptr<Hier_Pooler>(new Hier_Pooler(radius));
+    result->LoadDict_L0(shot_path, "200", "200");
+    result->setRatio(ratio);
+    insert(key.str(), result);
+    return result;
+}
+
+boost::shared_ptr<const PoolerSet> ModelRegistry::getSeedPoolerSet(const std::string &seed_file)
+{
+    std::string key = "seeds:" + seed_file;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    boost::shared_ptr<PoolerSet> result = find<PoolerSet>(key);
+    if (result)
+    {
+        SP_LOG_INFO("Sharing the dictionary loaded from " << seed_file);
+        return result;
+    }
+
+    result = boost::shared_ptr<PoolerSet>(new PoolerSet(2));
+    (*result)[1] = boost::shared_ptr<Pooler_L0>(new Pooler_L0(-1));
+    (*result)[1]->LoadSeedsPool(seed_file);
+    insert(key, result);
+    return result;
+}
+
+boost::shared_ptr<const PoolerSet> ModelRegistry::getLabPoolerSet()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    boost::shared_ptr<PoolerSet> result = find<PoolerSet>("lab");
+    if (result)
+        return result;
+
+    result = boost::shared_ptr<PoolerSet>(new PoolerSet(6));
+    for( size_t i = 1 ; i < result->size() ; i++ )
+    {
+        boost::shared_ptr<Pooler_L0> cur_pooler(new Pooler_L0);
+        cur_pooler->setHSIPoolingParams(i);
+        (*result)[i] = cur_pooler;
+    }
+    insert("lab", result);
+    return result;
+}
+
+// use the calibrated .qmodel saved by sp_compact when it matches, otherwise quantize the loaded model
+static void loadQuantizedSVM(const model *full_model, const std::string &qmodel_name, const int &bits, QuantizedSVM &result)
+{
+    if (exists_test(qmodel_name) && result.load(qmodel_name) && result.getBits() == bits &&
+        result.getNumClass() == full_model->nr_class && result.getNumFeature() == full_model->nr_feature - 1)
+        return;
+    result.quantize(full_model, bits);
+}
+
+boost::shared_ptr<const SVMModelSet> ModelRegistry::getSVMModels(const std::string &svm_path, const bool &use_binary_svm, const bool &use_multi_class_svm,
+    const int &quantized_svm_bits)
+{
+    std::ostringstream key;
+    key << "svm:" << svm_path << ":" << use_binary_svm << ":" << use_multi_class_svm << ":" << quantized_svm_bits;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    boost::shared_ptr<SVMModelSet> result = find<SVMModelSet>(key.str());
+    if (result)
+    {
+        SP_LOG_INFO("Sharing the SVM models loaded from " << svm_path);
+        return result;
+    }
+
+    result = boost::shared_ptr<SVMModelSet>(new SVMModelSet);
+    result->loaded = true;
+    for( int ll = 0 ; ll < 3 ; ll++ )
+    {
+        std::stringstream ss;
+        ss << ll;
+
+        if (use_binary_svm)
+        {
+            result->binary_models[ll] = load_model((svm_path+"binary_L"+ss.str()+"_f.model").c_str());
+            if (result->binary_models[ll] == NULL)
+            {
+                // null pointer exception
+                SP_LOG_ERROR("Failed to load file: " << (svm_path+"binary_L"+ss.str()+"_f.model").c_str());
+                result->loaded = false;
+            }
+            else if (quantized_svm_bits > 0)
+                loadQuantizedSVM(result->binary_models[ll], svm_path+"binary_L"+ss.str()+"_f.qmodel", quantized_svm_bits, result->binary_qmodels[ll]);
+            // models trained on reduced features come with their projection
+            if (exists_test(svm_path+"binary_L"+ss.str()+"_f.proj"))
+                result->binary_projections[ll].load(svm_path+"binary_L"+ss.str()+"_f.proj");
+        }
+        if (use_multi_class_svm)
+        {
+            result->multi_models[ll] = load_model((svm_path+"multi_L"+ss.str()+"_f.model").c_str());
+            if (result->multi_models[ll] == NULL)
+            {
+                // null pointer exception
+                SP_LOG_ERROR("Failed to load file: " << (svm_path+"multi_L"+ss.str()+"_f.model").c_str());
+                result->loaded = false;
+            }
+            else if (quantized_svm_bits > 0)
+                loadQuantizedSVM(result->multi_models[ll], svm_path+"multi_L"+ss.str()+"_f.qmodel", quantized_svm_bits, result->multi_qmodels[ll]);
+            if (exists_test(svm_path+"multi_L"+ss.str()+"_f.proj"))
+                result->multi_projections[ll].load(svm_path+"multi_L"+ss.str()+"_f.proj");
+        }
+    }
+
+    // a set that failed to load is not shared, the next segmenter tries again
+    if (result->loaded)
+        insert(key.str(), result);
+    return result;
+}
+
+boost::shared_ptr<const ModelT> ModelRegistry::getMesh(const std::string &model_file, const std::string &model_name)
+{
+    std::string key = "mesh:" + model_file + ":" + model_name;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    boost::shared_ptr<ModelT> result = find<ModelT>(key);
+    if (result)
+        return result;
+
+    result = boost::shared_ptr<ModelT>(new ModelT(LoadMesh(model_file, model_name)));
+    insert(key, result);
+    return result;
+}
+
+#ifdef USE_OBJRECRANSAC
+boost::shared_ptr<SharedObjRecRANSAC> ModelRegistry::getObjRecRANSAC(const std::vector<std::string> &model_files, const std::vector<std::string> &model_names,
+    const double &pair_width, const double &voxel_size, const double &object_visibility, const double &scene_visibility, const bool &use_cuda)
+{
+    std::ostringstream key;
+    key << "objrecransac:" << pair_width << ":" << voxel_size << ":" << object_visibility << ":" << scene_visibility << ":" << use_cuda;
+    for (std::size_t i = 0; i < model_files.size(); i++)
+        key << ":" << model_files[i] << ":" << model_names[i];
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    boost::shared_ptr<SharedObjRecRANSAC> result = find<SharedObjRecRANSAC>(key.str());
+    if (result)
+    {
+        SP_LOG_INFO("Sharing the ObjRecRANSAC model library of " << model_names.size() << " model(s)");
+        return result;
+    }
+
+    result = boost::shared_ptr<SharedObjRecRANSAC>(new SharedObjRecRANSAC);
+    result->detector = boost::shared_ptr<greedyObjRansac>(new greedyObjRansac(pair_width, voxel_size));
+    result->detector->setParams(object_visibility, scene_visibility);
+    result->detector->setUseCUDA(use_cuda);
+    for (std::size_t i = 0; i < model_files.size(); i++)
+        result->detector->AddModel(model_files[i], model_names[i]);
+    insert(key.str(), result);
+    return result;
+}
+#endif
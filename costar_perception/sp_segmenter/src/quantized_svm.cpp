@@ -0,0 +1,165 @@
+#include <fstream>
+#include <cmath>
+#include <algorithm>
+
+#include "sp_segmenter/quantized_svm.h"
+
+template<typename T>
+static float sparseDotRow(const T *w, const std::vector<int> &idx, const std::vector<float> &val)
+{
+    float sum = 0;
+    for( std::size_t k = 0 ; k < idx.size() ; k++ )
+        sum += w[idx[k]] * val[k];
+    return sum;
+}
+
+template<typename T>
+static void quantizeRows(const model *full_model, const int &nr_w, const int &nr_feature, const std::vector<float> &scale, std::vector<T> &q)
+{
+    q.resize((std::size_t)nr_w * nr_feature);
+    for( int i = 0 ; i < nr_w ; i++ )
+        for( int j = 0 ; j < nr_feature ; j++ )
+            q[(std::size_t)i*nr_feature+j] = (T)std::floor(full_model->w[j*nr_w+i] / scale[i] + 0.5);
+}
+
+bool QuantizedSVM::quantize(const model *full_model, const int &bits)
+{
+    if( full_model == NULL || (bits != 8 && bits != 16) || full_model->nr_feature < 2 )
+        return false;
+
+    nr_class_ = full_model->nr_class;
+    nr_w_ = (nr_class_ == 2 && full_model->param.solver_type != MCSVM_CS) ? 1 : nr_class_;
+    // the last feature is the constant bias term appended in FormFeaSparseMat and spPooler::InputSemantics
+    nr_feature_ = full_model->nr_feature - 1;
+    bits_ = bits;
+    label_.assign(full_model->label, full_model->label + nr_class_);
+
+    float max_q = bits == 8 ? 127.0 : 32767.0;
+    scale_.assign(nr_w_, 1.0);
+    offset_.assign(nr_w_, 0.0);
+    for( int i = 0 ; i < nr_w_ ; i++ )
+    {
+        double max_w = 0;
+        for( int j = 0 ; j < nr_feature_ ; j++ )
+            max_w = std::max(max_w, std::fabs(full_model->w[j*nr_w_+i]));
+        if( max_w > 0 )
+            scale_[i] = max_w / max_q;
+        offset_[i] = full_model->w[nr_feature_*nr_w_+i] * full_model->bias;
+    }
+
+    w8_.clear();
+    w16_.clear();
+    if( bits == 8 )
+        quantizeRows(full_model, nr_w_, nr_feature_, scale_, w8_);
+    else
+        quantizeRows(full_model, nr_w_, nr_feature_, scale_, w16_);
+    return true;
+}
+
+std::size_t QuantizedSVM::getWeightBytes() const
+{
+    return w8_.size() * sizeof(int8_t) + w16_.size() * sizeof(int16_t) + (scale_.size() + offset_.size()) * sizeof(float);
+}
+
+double QuantizedSVM::predictValues(const cv::Mat &fea, double *dec_values) const
+{
+    if( fea.cols != nr_feature_ || fea.type() != CV_32FC1 )
+    {
+        std::cerr << "QuantizedSVM: fea.cols != nr_feature" << std::endl;
+        exit(0);
+    }
+    // pooled features are mostly zero, the weights are only read at the non-zero entries
+    const float *x = fea.ptr<float>(0);
+    std::vector<int> idx;
+    std::vector<float> val;
+    for( int j = 0 ; j < nr_feature_ ; j++ )
+    {
+        if( x[j] != 0 )
+        {
+            idx.push_back(j);
+            val.push_back(x[j]);
+        }
+    }
+    for( int i = 0 ; i < nr_w_ ; i++ )
+    {
+        float dot = bits_ == 8 ? sparseDotRow(&w8_[(std::size_t)i*nr_feature_], idx, val)
+                               : sparseDotRow(&w16_[(std::size_t)i*nr_feature_], idx, val);
+        dec_values[i] = scale_[i] * dot + offset_[i];
+    }
+
+    if( nr_class_ == 2 )
+        return dec_values[0] > 0 ? label_[0] : label_[1];
+
+    int dec_max_idx = 0;
+    for( int i = 1 ; i < nr_class_ ; i++ )
+        if( dec_values[i] > dec_values[dec_max_idx] )
+            dec_max_idx = i;
+    return label_[dec_max_idx];
+}
+
+bool QuantizedSVM::save(const std::string &filename) const
+{
+    if( empty() == true )
+        return false;
+    std::ofstream out(filename.c_str(), std::ios::out|std::ios::binary);
+    if( out.is_open() == false )
+        return false;
+
+    // Write header
+    out.write((char*)&bits_, sizeof(int));
+    out.write((char*)&nr_class_, sizeof(int));
+    out.write((char*)&nr_w_, sizeof(int));
+    out.write((char*)&nr_feature_, sizeof(int));
+    out.write((char*)&label_[0], sizeof(int)*nr_class_);
+    out.write((char*)&scale_[0], sizeof(float)*nr_w_);
+    out.write((char*)&offset_[0], sizeof(float)*nr_w_);
+    if( bits_ == 8 )
+        out.write((char*)&w8_[0], sizeof(int8_t)*w8_.size());
+    else
+        out.write((char*)&w16_[0], sizeof(int16_t)*w16_.size());
+    out.close();
+    return true;
+}
+
+bool QuantizedSVM::load(const std::string &filename)
+{
+    std::ifstream in(filename.c_str(), std::ios::in|std::ios::binary);
+    if( in.is_open() == false )
+        return false;
+
+    in.read((char*)&bits_, sizeof(int));
+    in.read((char*)&nr_class_, sizeof(int));
+    in.read((char*)&nr_w_, sizeof(int));
+    in.read((char*)&nr_feature_, sizeof(int));
+    if( !in || (bits_ != 8 && bits_ != 16) || nr_class_ < 2 || nr_w_ < 1 || nr_feature_ < 1 )
+    {
+        std::cerr << "Invalid quantized model: " << filename << std::endl;
+        nr_w_ = 0;
+        return false;
+    }
+    label_.resize(nr_class_);
+    scale_.resize(nr_w_);
+    offset_.resize(nr_w_);
+    in.read((char*)&label_[0], sizeof(int)*nr_class_);
+    in.read((char*)&scale_[0], sizeof(float)*nr_w_);
+    in.read((char*)&offset_[0], sizeof(float)*nr_w_);
+    w8_.clear();
+    w16_.clear();
+    if( bits_ == 8 )
+    {
+        w8_.resize((std::size_t)nr_w_ * nr_feature_);
+        in.read((char*)&w8_[0], sizeof(int8_t)*w8_.size());
+    }
+    else
+    {
+        w16_.resize((std::size_t)nr_w_ * nr_feature_);
+        in.read((char*)&w16_[0], sizeof(int16_t)*w16_.size());
+    }
+    if( !in )
+    {
+        std::cerr << "Truncated quantized model: " << filename << std::endl;
+        nr_w_ = 0;
+        return false;
+    }
+    return true;
+}
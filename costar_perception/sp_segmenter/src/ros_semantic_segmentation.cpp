@@ -2,6 +2,15 @@
 #include <pcl/filters/crop_box.h>
 #include <tf_conversions/tf_eigen.h>
 #include "sp_segmenter/stringVectorArgsReader.h"
+#include "sp_segmenter/utility/profiler.h"
+#include "sp_segmenter/utility/logger.h"
+#include "sp_segmenter/utility/task_scheduler.h"
+#include <boost/algorithm/string/join.hpp>
+
+#ifdef SP_SEGMENTER_PROFILING
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <boost/lexical_cast.hpp>
+#endif
 
 segmentedObjectTF::segmentedObjectTF()
 {
@@ -27,9 +36,9 @@ tf::StampedTransform segmentedObjectTF::generateStampedTransform(const std::stri
 std::map<std::string, objectSymmetry> fillObjectPropertyDictionary(const ros::NodeHandle &nh, const std::vector<std::string> &cur_name)
 {
     std::map<std::string, objectSymmetry> objectDict;
-    std::cerr << "LOADING IN OBJECTS\n";
+    SP_LOG_INFO("LOADING IN OBJECTS");
     for (unsigned int i = 0; i < cur_name.size(); i++) {
-        std::cerr << "Name of obj: " << cur_name[i] << "\n";
+        SP_LOG_INFO("Name of obj: " << cur_name[i]);
 
         double r, p, y, step;
         std::string preferred_axis;
@@ -45,10 +54,11 @@ std::map<std::string, objectSymmetry> fillObjectPropertyDictionary(const ros::No
 }
 
 // Load in parameters for objects from ROS namespace
-std::map<std::string, objectSymmetry> fillObjectPropertyDictionary(std::map<std::string, ModelObjRecRANSACParameter> &modelObjRecRansacParamDict,const ros::NodeHandle &nh, const std::vector<std::string> &cur_name)
+std::map<std::string, objectSymmetry> fillObjectPropertyDictionary(std::map<std::string, ModelObjRecRANSACParameter> &modelObjRecRansacParamDict,const ros::NodeHandle &nh, const std::vector<std::string> &cur_name,
+    FrameLogParameters &recorded_parameters)
 {
     std::map<std::string, objectSymmetry> objectDict;
-    std::cerr << "LOADING IN OBJECTS\n";
+    SP_LOG_INFO("LOADING IN OBJECTS");
 
     double default_pair_width, default_voxel_size, default_scene_visibility, default_object_visibility;
     nh.param("default_object_param/pair_width", default_pair_width, 0.005);
@@ -57,7 +67,7 @@ std::map<std::string, objectSymmetry> fillObjectPropertyDictionary(std::map<std:
     nh.param("default_object_param/object_visibility", default_object_visibility, 0.1);
 
     for (unsigned int i = 0; i < cur_name.size(); i++) {
-        std::cerr << "Name of obj: " << cur_name[i] << "\n";
+        SP_LOG_INFO("Name of obj: " << cur_name[i]);
 
         double r, p, y, step;
         std::string preferred_axis;
@@ -74,6 +84,17 @@ std::map<std::string, objectSymmetry> fillObjectPropertyDictionary(std::map<std:
         nh.param(cur_name.at(i)+"/scene_visibility", scene_visibility, default_scene_visibility);
         nh.param(cur_name.at(i)+"/object_visibility", object_visibility, default_object_visibility);
         modelObjRecRansacParamDict[cur_name.at(i)] = ModelObjRecRANSACParameter(pair_width, voxel_size, scene_visibility, object_visibility);
+
+        const std::string &name = cur_name.at(i);
+        recorded_parameters[name+"/x"] = boost::lexical_cast<std::string>(r);
+        recorded_parameters[name+"/y"] = boost::lexical_cast<std::string>(p);
+        recorded_parameters[name+"/z"] = boost::lexical_cast<std::string>(y);
+        recorded_parameters[name+"/preferred_step"] = boost::lexical_cast<std::string>(step);
+        recorded_parameters[name+"/preferred_axis"] = preferred_axis;
+        recorded_parameters[name+"/pair_width"] = boost::lexical_cast<std::string>(pair_width);
+        recorded_parameters[name+"/voxel_size"] = boost::lexical_cast<std::string>(voxel_size);
+        recorded_parameters[name+"/scene_visibility"] = boost::lexical_cast<std::string>(scene_visibility);
+        recorded_parameters[name+"/object_visibility"] = boost::lexical_cast<std::string>(object_visibility);
     }
     return objectDict;
 }
@@ -95,65 +116,85 @@ RosSemanticSegmentation::RosSemanticSegmentation(const ros::NodeHandle &nh) : ha
 
 void RosSemanticSegmentation::initializeSemanticSegmentationFromRosParam()
 {
+    // verbosity of the segmenter itself: debug, info, warn, error or none
+    std::string log_level;
+    this->readParam("logLevel", log_level, std::string("info"));
+    if (!sp_log::setLevel(log_level))
+        ROS_WARN("Unknown logLevel '%s', use debug, info, warn, error or none", log_level.c_str());
+
+    // threads each stage may use at once, e.g. features=4,pose=2. Empty keeps SP_SEGMENTER_STAGE_THREADS
+    std::string stage_threads;
+    this->readParam("stageThreads", stage_threads, std::string(""));
+    if (!stage_threads.empty() && !TaskScheduler::instance().setStageLimits(stage_threads))
+        ROS_WARN("Unknown stageThreads '%s', use comma separated stage=threads with the stages features, pooling, classify and pose", stage_threads.c_str());
+
+    // seconds one segmentation may take before it degrades, 0 disables the budget
+    double latency_budget;
+    this->readParam("latencyBudget", latency_budget, 0.0);
+    this->setLatencyBudget(latency_budget);
+
     // ------------------- SETTING UP SEMANTIC SEGMENTATION --------------------
     // Setting up svm and shot
     std::string svm_path, shot_path;
     bool useBinarySVM, useMultiClassSVM;
-    this->nh.param("useBinarySVM",useBinarySVM,false);
-    this->nh.param("useMultiClassSVM",useMultiClassSVM,true);
-    this->nh.param("svm_path", svm_path,std::string("data/UR5_drill_svm/"));
-    this->nh.param("shot_path", shot_path,std::string("data/UW_shot_dict/"));
+    this->readParam("useBinarySVM",useBinarySVM,false);
+    this->readParam("useMultiClassSVM",useMultiClassSVM,true);
+    this->readParam("svm_path", svm_path,std::string("data/UR5_drill_svm/"));
+    this->readParam("shot_path", shot_path,std::string("data/UW_shot_dict/"));
     this->setDirectorySHOT(shot_path);
     this->setUseBinarySVM(useBinarySVM);
     this->setUseMultiClassSVM(useMultiClassSVM);
+    int quantizedSVMBits;
+    this->readParam("quantizedSVMBits",quantizedSVMBits,0);
+    this->setQuantizedSVMBits(quantizedSVMBits);
     this->setDirectorySVM(svm_path);
 
-    this->nh.param("useCropBox",this->use_crop_box_,true);
+    this->readParam("useCropBox",this->use_crop_box_,true);
     
     double cropBoxX, cropBoxY, cropBoxZ;
-    this->nh.param("cropBoxX",cropBoxX,1.0);
-    this->nh.param("cropBoxY",cropBoxY,1.0);
-    this->nh.param("cropBoxZ",cropBoxZ,1.0);
+    this->readParam("cropBoxX",cropBoxX,1.0);
+    this->readParam("cropBoxY",cropBoxY,1.0);
+    this->readParam("cropBoxZ",cropBoxZ,1.0);
     this->crop_box_size = Eigen::Vector3f(cropBoxX,cropBoxY,cropBoxZ);
-    this->nh.param("cropBoxGripperX",cropBoxX,1.0);
-    this->nh.param("cropBoxGripperY",cropBoxY,1.0);
-    this->nh.param("cropBoxGripperZ",cropBoxZ,1.0);
+    this->readParam("cropBoxGripperX",cropBoxX,1.0);
+    this->readParam("cropBoxGripperY",cropBoxY,1.0);
+    this->readParam("cropBoxGripperZ",cropBoxZ,1.0);
     this->crop_box_gripper_size = Eigen::Vector3f(cropBoxX, cropBoxY, cropBoxZ);
 
     // setting up table segmentation parameters
     bool loadTable, useTableSegmentation;
     double aboveTableMin, aboveTableMax, tableDistanceThreshold,tableAngularThreshold, tableMinimalInliers;
-    this->nh.param("useTableSegmentation",useTableSegmentation,true);
-    this->nh.param("aboveTableMin", aboveTableMin, 0.01);
-    this->nh.param("aboveTableMax", aboveTableMax, 0.25);
-    this->nh.param("loadTable",loadTable, false);
-    this->nh.param("tableDistanceThreshold",tableDistanceThreshold,0.02);
-    this->nh.param("tableAngularThreshold",tableAngularThreshold,2.0);
-    this->nh.param("tableMinimalInliers",tableMinimalInliers,5000.0);
+    this->readParam("useTableSegmentation",useTableSegmentation,true);
+    this->readParam("aboveTableMin", aboveTableMin, 0.01);
+    this->readParam("aboveTableMax", aboveTableMax, 0.25);
+    this->readParam("loadTable",loadTable, false);
+    this->readParam("tableDistanceThreshold",tableDistanceThreshold,0.02);
+    this->readParam("tableAngularThreshold",tableAngularThreshold,2.0);
+    this->readParam("tableMinimalInliers",tableMinimalInliers,5000.0);
     this->setUseTableSegmentation(useTableSegmentation);
     this->setCropAboveTableBoundary(aboveTableMin,aboveTableMax);
     if(loadTable && useTableSegmentation)
     {
         std::string load_directory;
-        nh.param("saveTable_directory",load_directory,std::string("./data"));
+        this->readParam("saveTable_directory",load_directory,std::string("./data"));
         this->loadTableFromFile(load_directory+"/table.pcd");
     }
     this->setTableSegmentationParameters(tableDistanceThreshold,tableAngularThreshold,tableMinimalInliers);
 
     // Setting up visualization
     bool visualization;
-    this->nh.param("visualization",visualization,true);
+    this->readParam("visualization",visualization,true);
     this->setUseVisualization(visualization);
 
     // Setting up ObjRecRANSAC
     bool compute_pose, use_cuda, useObjectPersistence;
     double  minConfidence;
     std::string objRecRANSACdetector;
-    this->nh.param("compute_pose",compute_pose,true);
-    this->nh.param("use_cuda", use_cuda,true);
-    this->nh.param("objRecRANSACdetector", objRecRANSACdetector, std::string("StandardRecognize"));
-    this->nh.param("minConfidence", minConfidence, 0.0);
-    this->nh.param("useObjectPersistence",useObjectPersistence,false);
+    this->readParam("compute_pose",compute_pose,true);
+    this->readParam("use_cuda", use_cuda,true);
+    this->readParam("objRecRANSACdetector", objRecRANSACdetector, std::string("StandardRecognize"));
+    this->readParam("minConfidence", minConfidence, 0.0);
+    this->readParam("useObjectPersistence",useObjectPersistence,false);
 #ifdef USE_OBJRECRANSAC
     this->setUseComputePose(compute_pose);
     this->setUseCuda(use_cuda);
@@ -166,11 +207,12 @@ void RosSemanticSegmentation::initializeSemanticSegmentationFromRosParam()
 
     std::string mesh_path;
     //get parameter for mesh path and cur_name
-    nh.param("mesh_path", mesh_path,std::string("data/mesh/"));
+    this->readParam("mesh_path", mesh_path,std::string("data/mesh/"));
     std::vector<std::string> cur_name = stringVectorArgsReader(nh, "cur_name", std::string("drill"));
+    this->recorded_parameters_["cur_name"] = boost::algorithm::join(cur_name, ",");
     //get object parameters
     std::map<std::string, ModelObjRecRANSACParameter> model_obj_ransac_parameter;
-    std::map<std::string, objectSymmetry> objectDict = fillObjectPropertyDictionary(model_obj_ransac_parameter, nh, cur_name);
+    std::map<std::string, objectSymmetry> objectDict = fillObjectPropertyDictionary(model_obj_ransac_parameter, nh, cur_name, recorded_parameters_);
     // Add model to the semantic segmentation
     for (std::vector<std::string>::const_iterator it = cur_name.begin(); it != cur_name.end(); ++it)
     {
@@ -179,12 +221,12 @@ void RosSemanticSegmentation::initializeSemanticSegmentationFromRosParam()
     }
     this->addModelSymmetricProperty(objectDict);
 #else
-    std::cerr << "WARNING. Could not compute pose because the library is not compiled with USE_OBJRECRANSAC = ON.\n";
-    std::cerr << "This class will only publish the segmented cloud.\n";
+    SP_LOG_WARN("Could not compute pose because the library is not compiled with USE_OBJRECRANSAC = ON.");
+    SP_LOG_WARN("This class will only publish the segmented cloud.");
 #endif
 
 #ifdef USE_TRACKING
-    this->nh.param("enableTracking",use_tracking_,false);
+    this->readParam("enableTracking",use_tracking_,false);
     if (use_tracking_)
     {
         tracker_ = boost::shared_ptr<Tracker>(new Tracker());
@@ -193,7 +235,7 @@ void RosSemanticSegmentation::initializeSemanticSegmentationFromRosParam()
         {
             if(!tracker_->addTracker(model))
             {
-                std::cout << "Warning: tried to add duplicate model name to tracker" << std::endl;
+                SP_LOG_WARN("Tried to add duplicate model name to tracker");
             }
         }
     }
@@ -204,13 +246,13 @@ void RosSemanticSegmentation::initializeSemanticSegmentationFromRosParam()
     // ---------------------- SETTING UP ROS SPECIFIC PARAMETERS --------------------------------------
     // Ros specific parameters
     bool setObjectOrientation;
-    this->nh.param("useTF",useTFinsteadOfPoses,true);
-    this->nh.param("GripperTF",gripperTF,std::string("endpoint_marker"));
-    this->nh.param("useMedianFilter",use_median_filter,true);
-    this->nh.param("setObjectOrientation",setObjectOrientation,false);
-    this->nh.param("preferredOrientation",targetNormalObjectTF,std::string("/world"));
-    this->nh.param("POINTS_IN", POINTS_IN,std::string("/camera/depth_registered/points"));
-    this->nh.param("POINTS_OUT", POINTS_OUT,std::string("points_out"));
+    this->readParam("useTF",useTFinsteadOfPoses,true);
+    this->readParam("GripperTF",gripperTF,std::string("endpoint_marker"));
+    this->readParam("useMedianFilter",use_median_filter,true);
+    this->readParam("setObjectOrientation",setObjectOrientation,false);
+    this->readParam("preferredOrientation",targetNormalObjectTF,std::string("/world"));
+    this->readParam("POINTS_IN", POINTS_IN,std::string("/camera/depth_registered/points"));
+    this->readParam("POINTS_OUT", POINTS_OUT,std::string("points_out"));
     listener = new (tf::TransformListener);
 
     if (useTableSegmentation)
@@ -220,13 +262,13 @@ void RosSemanticSegmentation::initializeSemanticSegmentationFromRosParam()
 
     if (!useTFinsteadOfPoses)
     {
-        std::cerr << "Node publish pose array.\n";
+        SP_LOG_INFO("Node publish pose array.");
         pose_pub = nh.advertise<geometry_msgs::PoseArray>(POSES_OUT,1000);
         pc_sub = nh.subscribe(POINTS_IN,1,&RosSemanticSegmentation::callbackPoses,this);
     }
     else
     {
-        std::cerr << "Node publish TF.\n";
+        SP_LOG_INFO("Node publish TF.");
         spSegmenter = this->nh.advertiseService("SPSegmenter",&RosSemanticSegmentation::serviceCallback,this);
 #ifdef COSTAR
         segmentGripper = this->nh.advertiseService("segmentInGripper",&RosSemanticSegmentation::serviceCallbackGripper,this);
@@ -236,7 +278,11 @@ void RosSemanticSegmentation::initializeSemanticSegmentationFromRosParam()
 #ifdef COSTAR
     detected_object_pub = nh.advertise<costar_objrec_msgs::DetectedObjectList>("detected_object_list",1);
 #endif
-    this->nh.param("maxFrames",maxframes,15);
+#ifdef SP_SEGMENTER_PROFILING
+    diagnostics_pub = nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics",10);
+    number_of_profiled_frames = 0;
+#endif
+    this->readParam("maxFrames",maxframes,15);
     cur_frame_idx = 0;
     cloud_ready = false;
     cloud_vec.clear();
@@ -246,6 +292,23 @@ void RosSemanticSegmentation::initializeSemanticSegmentationFromRosParam()
     this->need_preferred_tf_ = setObjectOrientation;
     this->setUsePreferredOrientation(setObjectOrientation);
 
+    // Frame log, everything the segmenter gets and produces from now on is written to recordFile
+    std::string record_file;
+    this->nh.param("recordFile", record_file, std::string(""));
+    this->number_of_recorded_frames_ = 0;
+    if (!record_file.empty())
+    {
+        this->recorded_parameters_["compiled_with_objrecransac"] =
+#ifdef USE_OBJRECRANSAC
+            "1";
+#else
+            "0";
+#endif
+        frame_log_.reset(new FrameLogWriter());
+        if (!frame_log_->open(record_file, this->recorded_parameters_))
+            frame_log_.reset();
+    }
+
 }
 
 void RosSemanticSegmentation::callbackPoses(const sensor_msgs::PointCloud2 &inputCloud)
@@ -269,7 +332,11 @@ void RosSemanticSegmentation::callbackPoses(const sensor_msgs::PointCloud2 &inpu
 #ifdef USE_OBJRECRANSAC
     std::vector<objectTransformInformation> object_transform_result;
     // returns true if the segmentation is successful
-    if (this->segmentAndCalculateObjTransform(full_cloud,labelled_point_cloud_result,object_transform_result))
+    double segmentation_start = get_wall_time();
+    bool segmentation_success = this->segmentAndCalculateObjTransform(full_cloud,labelled_point_cloud_result,object_transform_result);
+    recordFrame(inputCloud.header.stamp, full_cloud, labelled_point_cloud_result, object_transform_result, segmentation_success, get_wall_time() - segmentation_start);
+    warnDegradation();
+    if (segmentation_success)
     {
         pcl::PointCloud<PointT>::Ptr segmented_cloud;
         this->convertPointCloudLabelToRGBA(labelled_point_cloud_result,segmented_cloud);
@@ -299,7 +366,11 @@ void RosSemanticSegmentation::callbackPoses(const sensor_msgs::PointCloud2 &inpu
         pose_pub.publish(msg);
     }
 #else
-    if (this->segmentPointCloud(full_cloud,labelled_point_cloud_result))
+    double segmentation_start = get_wall_time();
+    bool segmentation_success = this->segmentPointCloud(full_cloud,labelled_point_cloud_result);
+    recordFrame(inputCloud.header.stamp, full_cloud, labelled_point_cloud_result, std::vector<objectTransformInformation>(), segmentation_success, get_wall_time() - segmentation_start);
+    warnDegradation();
+    if (segmentation_success)
     {
         pcl::PointCloud<PointT>::Ptr segmented_cloud;
         this->convertPointCloudLabelToRGBA(labelled_point_cloud_result,segmented_cloud);
@@ -311,7 +382,7 @@ void RosSemanticSegmentation::callbackPoses(const sensor_msgs::PointCloud2 &inpu
         pc_pub.publish(output_msg);
     }
 #endif
-
+    publishDiagnostics();
 }
 
 bool RosSemanticSegmentation::getAndSaveTable (const sensor_msgs::PointCloud2 &pc)
@@ -363,21 +434,21 @@ void RosSemanticSegmentation::updateCloudData (const sensor_msgs::PointCloud2 &p
         nh.param("tableTF", tableTFname,std::string("/tableTF"));
         
         tableTFparent = pc.header.frame_id;
-        std::cerr << "Getting Table TF with name: '" << tableTFname << " and parent frame: " << tableTFparent << std::endl;
+        SP_LOG_INFO("Getting Table TF with name: '" << tableTFname << " and parent frame: " << tableTFparent);
         if (listener->waitForTransform(tableTFparent,tableTFname,ros::Time::now(),ros::Duration(1.5)))
         {
-            std::cerr << "Table TF found\n";
+            SP_LOG_INFO("Table TF found");
             listener->lookupTransform(tableTFparent,tableTFname,ros::Time(0),table_transform);
             tf::transformTFToEigen(table_transform, this->crop_box_pose_table_);
             Eigen::Quaterniond q(this->crop_box_pose_table_.rotation());
             Eigen::Vector3d t(this->crop_box_pose_table_.translation());
-            printf("Q: %f %f %f %f\tT: %f %f %f\n", q.w(), q.x(), q.y(), q.z(), t.x(), t.y(), t.z());
+            SP_LOG_INFO("Q: " << q.w() << " " << q.x() << " " << q.y() << " " << q.z() << "\tT: " << t.x() << " " << t.y() << " " << t.z());
             this->has_crop_box_pose_table_ = true;
             this->setUseCropBox(true);
             ROS_INFO("Crop Box activated");
         }
         else
-            std::cerr << "Fail to find table TF.\n";
+            SP_LOG_WARN("Fail to find table TF.");
     }
 
     if (this->use_table_segmentation_)
@@ -471,9 +542,7 @@ pcl::PointCloud<PointT>::Ptr MedianPointCloud(const std::vector<pcl::PointCloud<
     full_cloud->width = cloud_vec[0]->width;
     full_cloud->height = cloud_vec[0]->height;
 
-    #pragma omp parallel for
-    for( size_t i = 0 ; i < full_cloud->size() ; i++ )
-    {
+    TaskScheduler::instance().parallelFor(TASK_FEATURES, 0, int(full_cloud->size()), 256, [&](int i) {
         int count = 0;
         std::vector<float> x_vec, y_vec, z_vec;
         for( size_t j = 0 ; j < cloud_vec.size() ; j++ )
@@ -504,7 +573,7 @@ pcl::PointCloud<PointT>::Ptr MedianPointCloud(const std::vector<pcl::PointCloud<
             full_cloud->at(i).y = std::numeric_limits<float>::quiet_NaN();
             full_cloud->at(i).z = std::numeric_limits<float>::quiet_NaN();
         }
-    }
+    });
     return full_cloud;
 }
 
@@ -521,9 +590,9 @@ bool RosSemanticSegmentation::serviceCallback (std_srvs::Empty::Request& request
         fromROSMsg(inputCloud,*full_cloud);
     else if(cloud_ready == true )
     {
-        std::cerr << "Averaging point clouds" << std::endl;
+        SP_LOG_DEBUG("Averaging point clouds");
         full_cloud = MedianPointCloud(cloud_vec);
-        std::cerr << "Averaging point clouds Done" << std::endl;
+        SP_LOG_DEBUG("Averaging point clouds Done");
     }
     else
     {
@@ -537,7 +606,11 @@ bool RosSemanticSegmentation::serviceCallback (std_srvs::Empty::Request& request
     pcl::PointCloud<PointLT>::Ptr labelled_point_cloud_result;
 #ifdef USE_OBJRECRANSAC
     std::vector<objectTransformInformation> object_transform_result;
+    double segmentation_start = get_wall_time();
     bool segmentation_success = segmentAndCalculateObjTransform(full_cloud, labelled_point_cloud_result, object_transform_result);
+    recordFrame(inputCloud.header.stamp, full_cloud, labelled_point_cloud_result, object_transform_result, segmentation_success, get_wall_time() - segmentation_start);
+    warnDegradation();
+    publishDiagnostics();
     if (segmentation_success)
     {
         pcl::PointCloud<PointT>::Ptr segmented_cloud;
@@ -575,7 +648,12 @@ bool RosSemanticSegmentation::serviceCallback (std_srvs::Empty::Request& request
     else
         return false;
 #else
-    if (this->segmentPointCloud(full_cloud,labelled_point_cloud_result))
+    double segmentation_start = get_wall_time();
+    bool segmentation_success = this->segmentPointCloud(full_cloud,labelled_point_cloud_result);
+    recordFrame(inputCloud.header.stamp, full_cloud, labelled_point_cloud_result, std::vector<objectTransformInformation>(), segmentation_success, get_wall_time() - segmentation_start);
+    warnDegradation();
+    publishDiagnostics();
+    if (segmentation_success)
     {
         pcl::PointCloud<PointT>::Ptr segmented_cloud;
         this->convertPointCloudLabelToRGBA(labelled_point_cloud_result,segmented_cloud);
@@ -624,6 +702,7 @@ bool RosSemanticSegmentation::serviceCallbackGripper (sp_segmenter::SegmentInGri
         fromROSMsg(inputCloud,*full_cloud);
         pcl::PointCloud<PointLT>::Ptr labelled_point_cloud;
 
+        double segmentation_start = get_wall_time();
         if (segmentPointCloud(full_cloud, labelled_point_cloud))
         {
             pcl::PointCloud<PointT>::Ptr segmented_cloud;
@@ -635,20 +714,26 @@ bool RosSemanticSegmentation::serviceCallbackGripper (sp_segmenter::SegmentInGri
             output_msg.header.frame_id = inputCloud.header.frame_id;
             pc_pub.publish(output_msg);
 
+            std::vector<objectTransformInformation> object_transform_result;
 #ifdef USE_OBJRECRANSAC
-            std::vector<objectTransformInformation> object_transform_result = getUpdateOnOneObjTransform(labelled_point_cloud, target_tf_to_update, object_class);
+            object_transform_result = getUpdateOnOneObjTransform(labelled_point_cloud, target_tf_to_update, object_class);
             this->populateTFMap(object_transform_result);
             hasTF = true;
 #endif
+            recordFrame(inputCloud.header.stamp, full_cloud, labelled_point_cloud, object_transform_result, true, get_wall_time() - segmentation_start);
+            warnDegradation();
+            publishDiagnostics();
             this->setModeObjRecRANSAC(objRecRANSAC_mode_original);
             this->setUseCropBox(use_crop_box_);
             ROS_INFO("Object In gripper segmentation done.");
             return true;
         }
+        recordFrame(inputCloud.header.stamp, full_cloud, labelled_point_cloud, std::vector<objectTransformInformation>(), false, get_wall_time() - segmentation_start);
+        warnDegradation();
     }
     else
     {
-        std::cerr << "Fail to get transform between: "<< gripperTF << " and "<< inputCloud.header.frame_id << std::endl;
+        SP_LOG_ERROR("Fail to get transform between: "<< gripperTF << " and "<< inputCloud.header.frame_id);
         response.result = segmentFail;
     }
     this->setModeObjRecRANSAC(objRecRANSAC_mode_original);
@@ -657,6 +742,75 @@ bool RosSemanticSegmentation::serviceCallbackGripper (sp_segmenter::SegmentInGri
 }
 #endif
 
+void RosSemanticSegmentation::recordFrame(const ros::Time &stamp, const pcl::PointCloud<PointT>::Ptr &cloud, const pcl::PointCloud<PointLT>::Ptr &labels,
+    const std::vector<objectTransformInformation> &poses, const bool &success, const double &segmentation_time)
+{
+    if (!frame_log_)
+        return;
+
+    // a new table is only written when it changes, before the first frame that uses it
+    if (this->have_table_ && this->table_corner_points_ != this->recorded_table_)
+    {
+        frame_log_->writeTable(this->table_corner_points_);
+        this->recorded_table_ = this->table_corner_points_;
+    }
+
+    // the state the callbacks set right before segmenting. use_crop_box_ is shadowed by the ROS parameter
+    LoggedFrame frame;
+    frame.sequence = this->number_of_recorded_frames_++;
+    frame.stamp = stamp.toSec();
+    frame.segmentation_time = segmentation_time;
+    frame.success = success;
+    frame.use_crop_box = SemanticSegmentation::use_crop_box_;
+    frame.crop_box_size = this->crop_box_size_;
+    frame.crop_box_pose = this->crop_box_target_pose_;
+    frame.objrecransac_mode = this->objRecRANSAC_mode_;
+    frame.use_preferred_orientation = this->use_preferred_orientation_;
+    frame.preferred_orientation = this->base_rotation_;
+    frame.cloud = cloud;
+    frame.labels = labels;
+    frame.poses = poses;
+    frame_log_->writeFrame(frame);
+}
+
+void RosSemanticSegmentation::warnDegradation()
+{
+    unsigned int rungs = this->getLastDegradation();
+    if (rungs != 0)
+        ROS_WARN_THROTTLE(5.0, "Segmentation degraded to meet the %.3f s latency budget: %s", this->getLatencyBudget(), getDegradationNames(rungs).c_str());
+}
+
+void RosSemanticSegmentation::publishDiagnostics()
+{
+#ifdef SP_SEGMENTER_PROFILING
+    // the profile of the last segmentPointCloud and calculateObjTransform, one key per probe
+    diagnostic_msgs::DiagnosticArray msg;
+    msg.header.stamp = ros::Time::now();
+    diagnostic_msgs::DiagnosticStatus status;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = ros::this_node::getName() + ": segmentation profile";
+    status.hardware_id = ros::this_node::getName();
+    status.message = "Frame " + boost::lexical_cast<std::string>(this->number_of_profiled_frames++);
+
+    std::vector<ProfileEntry> report = sp_profiler::frameReport();
+    for (std::size_t i = 0; i < report.size(); i++)
+    {
+        diagnostic_msgs::KeyValue value;
+        value.key = report[i].name;
+        if (report[i].is_timer)
+        {
+            value.key += " (ms)";
+            value.value = boost::lexical_cast<std::string>(report[i].total_ms);
+        }
+        else
+            value.value = boost::lexical_cast<std::string>(report[i].value);
+        status.values.push_back(value);
+    }
+    msg.status.push_back(status);
+    diagnostics_pub.publish(msg);
+#endif
+}
+
 void RosSemanticSegmentation::publishTF()
 {
     if (!useTFinsteadOfPoses) return; // do nothing
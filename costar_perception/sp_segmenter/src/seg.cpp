@@ -1,4 +1,7 @@
 #include "sp_segmenter/seg.h"
+#include "sp_segmenter/utility/task_scheduler.h"
+
+#include <mutex>
 
 void setObjID(std::map<std::string, int> &model_name_map)
 {
@@ -173,20 +176,17 @@ pcl::PointCloud<myPointXYZ>::Ptr FilterCloud(const pcl::PointCloud<myPointXYZ>::
     pcl::PointCloud<myPointXYZ>::Ptr filtered_scene(new pcl::PointCloud<myPointXYZ>());
     int num = scene->size();
     
-    #pragma omp parallel for
-    for(int i = 0 ; i < num ; i++ )
-    {
+    std::mutex filtered_mutex;
+    TaskScheduler::instance().parallelFor(TASK_POSE, 0, num, 256, [&](int i) {
         std::vector<int> indices (1);
         std::vector<float> sqr_dist (1);
         int nres = tree.nearestKSearch(scene->at(i), 1, indices, sqr_dist);
         if ( sqr_dist[0] > sqrT )
         {
-            #pragma omp critical
-            {
-                filtered_scene->push_back(scene->at(i));
-            }
+            std::lock_guard<std::mutex> lock(filtered_mutex);
+            filtered_scene->push_back(scene->at(i));
         }
-    }
+    });
     return filtered_scene;
 }
 
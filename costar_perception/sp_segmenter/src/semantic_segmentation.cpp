@@ -1,4 +1,7 @@
 #include "sp_segmenter/semantic_segmentation.h"
+#include "sp_segmenter/utility/profiler.h"
+#include "sp_segmenter/utility/worker_pool.h"
+#include "sp_segmenter/utility/task_scheduler.h"
 
 void ModelObjRecRANSACParameter::setPairWidth(const double &pair_width)
 {
@@ -43,7 +46,7 @@ bool objectTransformInformation::operator==(const objectTransformInformation& ot
 SemanticSegmentation::SemanticSegmentation() : class_ready_(false), visualizer_flag_(false), use_crop_box_(false), 
     use_binary_svm_(true), use_multi_class_svm_(false), number_of_added_models_(0), use_table_segmentation_(false), 
     pcl_downsample_(0.003), hier_ratio_(0.1), compute_pose_(false), use_combined_objRecRANSAC_(false), use_cuda_(false),
-    use_shot_(true), use_fpfh_(false), use_sift_(false)
+    use_shot_(true), use_fpfh_(false), use_sift_(false), quantized_svm_bits_(0)
 {
     uchar color_label_tmp[11][3] =
     { 
@@ -74,6 +77,10 @@ SemanticSegmentation::SemanticSegmentation() : class_ready_(false), visualizer_f
     this->table_distance_threshold_ = 0.02;
     this->table_angular_threshold_ =  2.0;
     this->table_minimal_inliers_ =  5000;
+    std::fill(stage_time_, stage_time_ + NUM_SEGMENTATION_STAGES, 0.0);
+    this->latency_budget_ = 0;
+    this->last_degradation_ = 0;
+    std::fill(expected_stage_time_, expected_stage_time_ + NUM_SEGMENTATION_STAGES, 0.0);
 }
 
 void SemanticSegmentation::setDirectorySHOT(const std::string &path_to_shot_directory)
@@ -81,21 +88,19 @@ void SemanticSegmentation::setDirectorySHOT(const std::string &path_to_shot_dire
     bool success = checkFolderExist(path_to_shot_directory);
     if (!success)
     {
-        std::cerr << "setDirectorySHOT failed" << std::endl;
+        SP_LOG_ERROR("setDirectorySHOT failed");
         this->shot_loaded_ = false;
         return;
     }
     this->shot_loaded_ = true;
-    std::cerr << "Loading SHOT...\n";
+    SP_LOG_INFO("Loading SHOT...");
 
     std::string shot_path = path_to_shot_directory;
     if (shot_path.back() != '/')
         shot_path += "/";
 
-    hie_producer = boost::shared_ptr<Hier_Pooler> (new Hier_Pooler(hier_radius_));
-    hie_producer->LoadDict_L0(shot_path, "200", "200");
-    hie_producer->setRatio(hier_ratio_);
-    std::cerr << "Done.\n";
+    hie_producer = ModelRegistry::instance().getSHOTDictionary(shot_path, hier_radius_, hier_ratio_);
+    SP_LOG_INFO("Done.");
 }
 
 void SemanticSegmentation::setDirectoryFPFH(const std::string &path_to_fpfh_directory)
@@ -103,22 +108,19 @@ void SemanticSegmentation::setDirectoryFPFH(const std::string &path_to_fpfh_dire
     bool success = checkFolderExist(path_to_fpfh_directory);
     if (!success)
     {
-        std::cerr << "setDirectoryFPFH failed" << std::endl;
+        SP_LOG_ERROR("setDirectoryFPFH failed");
         this->fpfh_loaded_ = false;
         return;
     }
     this->fpfh_loaded_ = true;
-    std::cerr << "Loading FPFH...\n";
+    SP_LOG_INFO("Loading FPFH...");
 
     std::string fpfh_path = path_to_fpfh_directory;
     if (fpfh_path.back() != '/')
         fpfh_path += "/";
 
-    fpfh_pooler_set.clear();
-    fpfh_pooler_set.resize(2);
-    fpfh_pooler_set[1] = boost::shared_ptr<Pooler_L0> (new Pooler_L0(-1));
-    fpfh_pooler_set[1]->LoadSeedsPool(fpfh_path+"dict_fpfh_L0_400.cvmat");
-    std::cerr << "Done.\n";
+    fpfh_pooler_set = ModelRegistry::instance().getSeedPoolerSet(fpfh_path+"dict_fpfh_L0_400.cvmat");
+    SP_LOG_INFO("Done.");
 }
 
 void SemanticSegmentation::setDirectorySIFT(const std::string &path_to_sift_directory)
@@ -126,21 +128,18 @@ void SemanticSegmentation::setDirectorySIFT(const std::string &path_to_sift_dire
     bool success = checkFolderExist(path_to_sift_directory);
     if (!success)
     {
-        std::cerr << "setDirectorySIFT failed" << std::endl;
+        SP_LOG_ERROR("setDirectorySIFT failed");
         this->sift_loaded_ = false;
         return;
     }
     this->sift_loaded_ = true;
-    std::cerr << "Loading SIFT...\n";
+    SP_LOG_INFO("Loading SIFT...");
 
     std::string sift_path = path_to_sift_directory;
     if (sift_path.back() != '/')
         sift_path += "/";
 
-    sift_pooler_set.clear();
-    sift_pooler_set.resize(2);
-    sift_pooler_set[1] = boost::shared_ptr<Pooler_L0> (new Pooler_L0(-1));
-    sift_pooler_set[1]->LoadSeedsPool(sift_path+"dict_sift_L0_400.cvmat"); 
+    sift_pooler_set = ModelRegistry::instance().getSeedPoolerSet(sift_path+"dict_sift_L0_400.cvmat");
     
     // sift paramters can be fixed like this, it won't change too much, to 
     // speed up you can reduce the range like [0.7, 1.6] to [0.8, 0.9]
@@ -155,7 +154,7 @@ void SemanticSegmentation::setDirectorySIFT(const std::string &path_to_sift_dire
             );
         sift_det_vec.push_back(sift_det);   
     }
-    std::cerr << "Done.\n";
+    SP_LOG_INFO("Done.");
 }
 
 
@@ -169,61 +168,44 @@ void SemanticSegmentation::setUseBinarySVM(const bool &use_binary_svm)
     this->use_binary_svm_ = use_binary_svm;
 }
 
+void SemanticSegmentation::setQuantizedSVMBits(const int &bits)
+{
+    if (bits != 0 && bits != 8 && bits != 16)
+    {
+        SP_LOG_ERROR("Quantized SVM bits must be 0 (full precision), 8 or 16");
+        return;
+    }
+    this->quantized_svm_bits_ = bits;
+}
+
 void SemanticSegmentation::setDirectorySVM(const std::string &path_to_svm_directory)
 {
     bool success = checkFolderExist(path_to_svm_directory);
     if (!success)
     {
-        std::cerr << "setDirectorySVM failed" << std::endl;
+        SP_LOG_ERROR("setDirectorySVM failed");
         this->svm_loaded_ = false;
         return;
     }
     else if ((use_binary_svm_ || use_multi_class_svm_) == false)
     {
-        std::cerr << "Both setUseMultiClassSVM and setUseBinarySVM is false.\nsetDirectorySVM needs at least one of them to be true\n";
+        SP_LOG_ERROR("Both setUseMultiClassSVM and setUseBinarySVM is false. setDirectorySVM needs at least one of them to be true");
         return;
     }
-    this->svm_loaded_ = true;
-
-    binary_models_.resize(3);
-    multi_models_.resize(3);
 
-    std::cerr << "Loading SVM...\n";
-    std::cerr << "Use Multi Class SVM = " << use_multi_class_svm_ << std::endl;
-    std::cerr << "Use Background Foreground SVM = " << use_binary_svm_ << std::endl;
+    SP_LOG_INFO("Loading SVM...");
+    SP_LOG_INFO("Use Multi Class SVM = " << use_multi_class_svm_);
+    SP_LOG_INFO("Use Background Foreground SVM = " << use_binary_svm_);
+    SP_LOG_INFO("Quantized SVM bits = " << quantized_svm_bits_);
 
     std::string svm_path = path_to_svm_directory;
     if (svm_path.back() != '/')
         svm_path += "/";
 
-    for( int ll = 0 ; ll < 3 ; ll++ )
-    {
-        std::stringstream ss;
-        ss << ll;
-        
-        if (use_binary_svm_)
-        {
-            this->binary_models_[ll] = load_model((svm_path+"binary_L"+ss.str()+"_f.model").c_str());
-            if (binary_models_[ll] == NULL)
-            {
-                // null pointer exception
-                std::cerr << "Failed to load file: " << (svm_path+"binary_L"+ss.str()+"_f.model").c_str() << std::endl;
-                this->svm_loaded_ = false;
-            }
-        }
-        if (use_multi_class_svm_)
-        {
-            this->multi_models_[ll] = load_model((svm_path+"multi_L"+ss.str()+"_f.model").c_str());
-            if (multi_models_[ll] == NULL)
-            {
-                // null pointer exception
-                std::cerr << "Failed to load file: " << (svm_path+"multi_L"+ss.str()+"_f.model").c_str() << std::endl;
-                this->svm_loaded_ = false;
-            }
-        }
-    }
+    svm_models_ = ModelRegistry::instance().getSVMModels(svm_path, use_binary_svm_, use_multi_class_svm_, quantized_svm_bits_);
+    this->svm_loaded_ = svm_models_->loaded;
 
-    std::cerr << "Done.\n";
+    SP_LOG_INFO("Done.");
 }
 
 void SemanticSegmentation::setDirectorySVM(const std::string &path_to_svm_directory, const bool &use_binary_svm, const bool &use_multi_class_svm)
@@ -260,98 +242,95 @@ void SemanticSegmentation::loadTableFromFile(const std::string &table_pcd_path)
 {
     pcl::PCDReader reader;
     if( reader.read (table_pcd_path, *table_corner_points_) == 0){
-        std::cerr << "Table load successfully\n";
+        SP_LOG_INFO("Table load successfully");
         this->have_table_ = true;
         this->setUseTableSegmentation(true);
     }
     else {
         this->have_table_ = false;
-        std::cerr << "Failed to load table. Remove all objects, put the ar_tag marker in the center of the table and it will get anew table data\n";
+        SP_LOG_ERROR("Failed to load table. Remove all objects, put the ar_tag marker in the center of the table and it will get anew table data");
     }
 }
 
+void SemanticSegmentation::setTableCornerPoints(const pcl::PointCloud<PointT>::Ptr &table_corner_points)
+{
+    this->table_corner_points_ = table_corner_points;
+    this->have_table_ = table_corner_points && table_corner_points->size() >= 3;
+    if (this->have_table_)
+        this->setUseTableSegmentation(true);
+}
+
 void SemanticSegmentation::initializeSemanticSegmentation()
 {
     if (this->svm_loaded_)
-        std::cerr << "SVM loaded\n";
+        SP_LOG_INFO("SVM loaded");
     else
-        std::cerr << "Please set the SVM directory\n";
+        SP_LOG_ERROR("Please set the SVM directory");
 
     if (this->shot_loaded_)
-        std::cerr << "SHOT loaded\n";
+        SP_LOG_INFO("SHOT loaded");
     else
-        std::cerr << "Please set the SHOT directory\n";
+        SP_LOG_ERROR("Please set the SHOT directory");
 
     if (this->compute_pose_)
     {
-        std::cerr << "Number of loaded model = " << this->number_of_added_models_ << std::endl;
+        SP_LOG_INFO("Number of loaded model = " << this->number_of_added_models_);
         if (this->number_of_added_models_ == 0)
-            std::cerr << "No model has been loaded. Please add at least 1 model.\n";
+            SP_LOG_ERROR("No model has been loaded. Please add at least 1 model.");
         this->class_ready_ = (this->number_of_added_models_ > 0 && this->svm_loaded_ && this->shot_loaded_);
     }
     else
         this->class_ready_ = (this->svm_loaded_ && this->shot_loaded_);
 
     if (this->class_ready_)
-        std::cerr << "Semantic segmentation has initialized properly\n";
+        SP_LOG_INFO("Semantic segmentation has initialized properly");
     else
     {
-        std::cerr << "Please resolve the problems before initializing semantic segmentation.\n";
+        SP_LOG_ERROR("Please resolve the problems before initializing semantic segmentation.");
         return;
     }
 
     if (!use_table_segmentation_) {
-      std::cerr << "WARNING: not using table segmentation!\n";
+      SP_LOG_WARN("Not using table segmentation!");
     }
 
     if (this->compute_pose_)
     {
-        std::cerr << "Semantic Segmentation is running with objRecRANSACdetector: ";
         switch (objRecRANSAC_mode_)
         {
             case STANDARD_BEST:
-                std::cerr << "STANDARD_BEST \n";
+                SP_LOG_INFO("Semantic Segmentation is running with objRecRANSACdetector: STANDARD_BEST");
                 break;
             case STANDARD_RECOGNIZE:
-                std::cerr << "STANDARD_RECOGNIZE \n";
+                SP_LOG_INFO("Semantic Segmentation is running with objRecRANSACdetector: STANDARD_RECOGNIZE");
                 break;
             case GREEDY_RECOGNIZE:
-                std::cerr << "GREEDY_RECOGNIZE \n";
+                SP_LOG_INFO("Semantic Segmentation is running with objRecRANSACdetector: GREEDY_RECOGNIZE");
                 break;
         }
     }
 
     // Initialize lab pooler
-    lab_pooler_set.resize(6);
-    for( size_t i = 1 ; i < lab_pooler_set.size() ; i++ )
-    {
-        boost::shared_ptr<Pooler_L0> cur_pooler(new Pooler_L0);
-        cur_pooler->setHSIPoolingParams(i);
-        lab_pooler_set[i] = cur_pooler;
-    }
+    lab_pooler_set = ModelRegistry::instance().getLabPoolerSet();
+
+#ifdef USE_OBJRECRANSAC
+    this->loadCombinedObjRecRANSAC();
+#endif
 
-    std::cerr << "Hier Feature Ratio = " << hier_ratio_ << std::endl;
-    std::cerr << "Hier Feature Downsample = " << pcl_downsample_ << std::endl;
+    SP_LOG_INFO("Hier Feature Ratio = " << hier_ratio_);
+    SP_LOG_INFO("Hier Feature Downsample = " << pcl_downsample_);
 }
 
 SemanticSegmentation::~SemanticSegmentation()
 {
-    if (this->svm_loaded_)
-    {
-        for( int ll = 0 ; ll < 3 ; ll++ )
-        {
-            free_and_destroy_model(&binary_models_[ll]);
-            if (use_multi_class_svm_)
-                free_and_destroy_model(&multi_models_[ll]);
-        }
-    }
+    // the shared models are released with the last segmenter using them
 }
 
 bool SemanticSegmentation::getTableSurfaceFromPointCloud(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &input_cloud, const bool &save_table_pcd, const std::string &save_directory_path)
 {
     if (!this->use_table_segmentation_)
     {
-        std::cerr << "use_table_segmentation is set to false. Please enable it first before trying to do table segmentation.\n";
+        SP_LOG_ERROR("use_table_segmentation is set to false. Please enable it first before trying to do table segmentation.");
         return false;
     }
 
@@ -374,7 +353,7 @@ bool SemanticSegmentation::getTableSurfaceFromPointCloud(const pcl::PointCloud<p
 
     table_corner_points_ = getTableConvexHull(full_cloud, viewer, table_distance_threshold_, table_angular_threshold_,table_minimal_inliers_);
     if (table_corner_points_->size() < 3) {
-        std::cerr << "Failed segmenting the table. Please check the input point cloud and the table segmentation parameters.\n";
+        SP_LOG_ERROR("Failed segmenting the table. Please check the input point cloud and the table segmentation parameters.");
         return false;
     }
     
@@ -386,35 +365,52 @@ bool SemanticSegmentation::getTableSurfaceFromPointCloud(const pcl::PointCloud<p
                 save_table_directory+= '/';
             pcl::PCDWriter writer;
             writer.write<PointT> (save_table_directory+"table.pcd", *table_corner_points_, true);
-            std::cerr << "Saved table point cloud in : " << save_table_directory <<"table.pcd\n";
+            SP_LOG_INFO("Saved table point cloud in : " << save_table_directory <<"table.pcd");
         }
         else
         {
-            std::cerr << "Failed saving table corner pointcloud in "<< save_table_directory << std::endl;
+            SP_LOG_ERROR("Failed saving table corner pointcloud in "<< save_table_directory);
         }
     }
-    std::cerr << "Sucessfully segment the table.\n";
+    SP_LOG_INFO("Sucessfully segment the table.");
     this->have_table_ = true;
     return true;
 }
 
 bool SemanticSegmentation::segmentPointCloud(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &input_cloud, pcl::PointCloud<pcl::PointXYZL>::Ptr &result)
+{
+    SP_PROFILE_BEGIN_FRAME();
+    LatencyBudget budget = startLatencyBudget(false);
+    bool segmentation_successful = segmentCloud(input_cloud, result, stage_time_, budget);
+    last_degradation_ = budget.rungs;
+    return segmentation_successful;
+}
+
+bool SemanticSegmentation::segmentCloud(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &input_cloud, pcl::PointCloud<pcl::PointXYZL>::Ptr &result,
+    double *stage_time, LatencyBudget &budget)
 {
     if (!this->class_ready_)
     {
-        std::cerr << "Please initialize semantic segmentation first before doing point cloud segmentation\n";
+        SP_LOG_ERROR("Please initialize semantic segmentation first before doing point cloud segmentation");
         return false;
     }
     
+    SP_PROFILE_SCOPE("segmentPointCloud");
+    std::fill(stage_time, stage_time + NUM_SEGMENTATION_STAGES, 0.0);
+    double stage_start = get_wall_time();
+
     pcl::PointCloud<PointT>::Ptr full_cloud(new pcl::PointCloud<PointT>());
     *full_cloud = *input_cloud;
+    SP_PROFILE_COUNT("points/in", full_cloud->size());
 
     if(use_crop_box_) {
       cropPointCloud(full_cloud, crop_box_target_pose_.inverse(), crop_box_size_);
     }
+    stage_time[STAGE_CROP] = get_wall_time() - stage_start;
+    SP_PROFILE_COUNT("points/after_crop", full_cloud->size());
 
     if (full_cloud->size() < 1){
-        std::cerr << "No cloud available after using crop box.\n";
+        SP_LOG_WARN("No cloud available after using crop box.");
         return false;
     }
     
@@ -432,17 +428,20 @@ bool SemanticSegmentation::segmentPointCloud(const pcl::PointCloud<pcl::PointXYZ
     {
         if (!have_table_)
         {
-            std::cerr << "Error. Does not has any table data yet, but use_table_segmentation_ flag is set to true\n."; 
-            std::cerr << "Please do table segmentation first, or disable use_table_segmentation_\n.";
+            SP_LOG_ERROR("Error. Does not has any table data yet, but use_table_segmentation_ flag is set to true"); 
+            SP_LOG_ERROR("Please do table segmentation first, or disable use_table_segmentation_");
             return false;
         }
         else
         {
+            stage_start = get_wall_time();
             segmentCloudAboveTable(full_cloud, table_corner_points_, above_table_min, above_table_max);
+            stage_time[STAGE_TABLE] = get_wall_time() - stage_start;
+            SP_PROFILE_COUNT("points/after_table", full_cloud->size());
 
             if (full_cloud->size() < 1)
             {
-                std::cerr << "No cloud available after removing all object outside the table. Put some objects above the table. \n";
+                SP_LOG_WARN("No cloud available after removing all object outside the table. Put some objects above the table.");
                 return false;
             }
 
@@ -457,14 +456,38 @@ bool SemanticSegmentation::segmentPointCloud(const pcl::PointCloud<pcl::PointXYZ
         }
     }
 
+    // time the pose estimation of this request is expected to need after the segmentation
+    const double pose_time = budget.with_pose ? expectedStageTime(STAGE_POSE, budget.rungs) : 0.0;
+    float downsample = pcl_downsample_;
+    if (budget.deadline > 0 && expectedStageTime(STAGE_POOLER, budget.rungs) + expectedStageTime(STAGE_SVM, budget.rungs) + pose_time
+        > budget.deadline - get_wall_time())
+    {
+        SP_LOG_DEBUG("Latency budget: pooling at downsample " << downsample * 2);
+        budget.rungs |= DEGRADE_COARSE_DOWNSAMPLE;
+        downsample *= 2;
+    }
+
+    stage_start = get_wall_time();
     spPooler triple_pooler;
-    if (sift_loaded_  && use_sift_) triple_pooler.init(full_cloud, *hie_producer, hier_radius_, pcl_downsample_);
-    else triple_pooler.lightInit(full_cloud, *hie_producer, hier_radius_, pcl_downsample_);
+    if (sift_loaded_  && use_sift_) triple_pooler.init(full_cloud, *hie_producer, hier_radius_, downsample);
+    else triple_pooler.lightInit(full_cloud, *hie_producer, hier_radius_, downsample);
     
-    std::cerr << "LAB Pooling!" << std::endl;
-    if (shot_loaded_ && use_shot_) triple_pooler.build_SP_LAB(lab_pooler_set, false);
-    if (fpfh_loaded_ && use_fpfh_) triple_pooler.build_SP_FPFH(fpfh_pooler_set, hier_radius_, false);
-    if (sift_loaded_ && use_sift_) triple_pooler.build_SP_SIFT(sift_pooler_set, *hie_producer, sift_det_vec, false);
+    SP_LOG_DEBUG("LAB Pooling!");
+    if (shot_loaded_ && use_shot_) triple_pooler.build_SP_LAB(*lab_pooler_set, false);
+    if (fpfh_loaded_ && use_fpfh_) triple_pooler.build_SP_FPFH(*fpfh_pooler_set, hier_radius_, false);
+    if (sift_loaded_ && use_sift_) triple_pooler.build_SP_SIFT(*sift_pooler_set, *hie_producer, sift_det_vec, false);
+    stage_time[STAGE_POOLER] = get_wall_time() - stage_start;
+    if (!(budget.rungs & DEGRADE_COARSE_DOWNSAMPLE))
+        updateExpectedStageTime(STAGE_POOLER, stage_time[STAGE_POOLER]);
+
+    if (budget.deadline > 0 && expectedStageTime(STAGE_SVM, budget.rungs) + pose_time > budget.deadline - get_wall_time())
+    {
+        SP_LOG_DEBUG("Latency budget: classifying order 0 superpixels only");
+        budget.rungs |= DEGRADE_SKIP_LEVEL1_SUPERPIXELS;
+    }
+    // highest superpixel order classified
+    const int max_order = (budget.rungs & DEGRADE_SKIP_LEVEL1_SUPERPIXELS) ? 0 : 1;
+    stage_start = get_wall_time();
 
     if(use_binary_svm_)
     {
@@ -472,12 +495,16 @@ bool SemanticSegmentation::segmentPointCloud(const pcl::PointCloud<pcl::PointXYZ
         // right now I only provide ll=0,1 for classification, 
         // the larger order you use will increase the running time of semantic segmentation
         // recommend to use 1 by default for foreground-background classification
-        for( int ll = 0 ; ll <= 1 ; ll++ )
+        for( int ll = 0 ; ll <= max_order ; ll++ )
         {
             bool reset_flag = ll == 0 ? true : false;
             if( ll >= 0 )
                 triple_pooler.extractForeground(false);
-            triple_pooler.InputSemantics(binary_models_[ll], ll, reset_flag, false);
+            const FeatureProjection *projection = svm_models_->binary_projections[ll].empty() ? NULL : &svm_models_->binary_projections[ll];
+            if (quantized_svm_bits_ > 0)
+                triple_pooler.InputSemantics(&svm_models_->binary_qmodels[ll], ll, reset_flag, false, projection);
+            else
+                triple_pooler.InputSemantics(svm_models_->binary_models[ll], ll, reset_flag, false, projection);
         }
 
         triple_pooler.extractForeground(true);
@@ -492,21 +519,29 @@ bool SemanticSegmentation::segmentPointCloud(const pcl::PointCloud<pcl::PointXYZ
         // the larger order you use will increase the running time of semantic segmentation
         // recommend to use 1 by default for link-node-sander classification
         // recommend to use 0 by default for link-node classification
-        int sll = 1, ell = 1;
+        int sll = max_order, ell = max_order;
         for( int ll = sll ; ll <= ell ; ll++ )
         {
            bool reset_flag = ll == sll ? true : false;
-           triple_pooler.InputSemantics(multi_models_[ll], ll, reset_flag, false);
+           const FeatureProjection *projection = svm_models_->multi_projections[ll].empty() ? NULL : &svm_models_->multi_projections[ll];
+           if (quantized_svm_bits_ > 0)
+               triple_pooler.InputSemantics(&svm_models_->multi_qmodels[ll], ll, reset_flag, false, projection);
+           else
+               triple_pooler.InputSemantics(svm_models_->multi_models[ll], ll, reset_flag, false, projection);
         }
     }
 
     pcl::PointCloud<pcl::PointXYZL>::Ptr label_cloud(new pcl::PointCloud<pcl::PointXYZL>());
     label_cloud = triple_pooler.getSemanticLabels();
+    SP_PROFILE_COUNT("points/labeled", label_cloud->size());
     triple_pooler.reset();
+    stage_time[STAGE_SVM] = get_wall_time() - stage_start;
+    if (!(budget.rungs & (DEGRADE_COARSE_DOWNSAMPLE | DEGRADE_SKIP_LEVEL1_SUPERPIXELS)))
+        updateExpectedStageTime(STAGE_SVM, stage_time[STAGE_SVM]);
     
     if( viewer )
     {
-        std::cerr<<"Visualize after segmentation"<<std::endl;
+        SP_LOG_DEBUG("Visualize after segmentation");
         visualizeLabels(label_cloud, viewer, color_label);
         viewer->spin();
         viewer->removePointCloud("label_cloud");
@@ -516,6 +551,84 @@ bool SemanticSegmentation::segmentPointCloud(const pcl::PointCloud<pcl::PointXYZ
     return true;
 }
 
+double SemanticSegmentation::getLastStageTime(const SegmentationStage &stage) const
+{
+    return stage_time_[stage];
+}
+
+const char* SemanticSegmentation::getStageName(const SegmentationStage &stage)
+{
+    static const char* names[NUM_SEGMENTATION_STAGES] = {"crop", "table", "pooler", "svm", "pose"};
+    return names[stage];
+}
+
+// rough share of the full stage time a rung leaves, to predict whether it brings a request within its budget
+static const double COARSE_DOWNSAMPLE_SHARE = 0.35;  // about a quarter of the points, plus the fixed costs
+static const double SKIP_LEVEL1_SHARE = 0.5;
+static const double FEWER_RANSAC_SHARE = 0.5;
+// weight of the newest stage time in the expectation
+static const double EXPECTED_TIME_UPDATE = 0.3;
+
+void SemanticSegmentation::setLatencyBudget(const double &seconds)
+{
+    this->latency_budget_ = std::max(0.0, seconds);
+}
+
+std::string SemanticSegmentation::getDegradationNames(const unsigned int &rungs)
+{
+    static const char* names[NUM_DEGRADATION_RUNGS] = {"coarse_downsample", "skip_level1_superpixels", "fewer_ransac_iterations", "skip_pose"};
+    std::string result;
+    for (int i = 0; i < NUM_DEGRADATION_RUNGS; i++)
+    {
+        if (!(rungs & (1u << i)))
+            continue;
+        if (!result.empty())
+            result += ",";
+        result += names[i];
+    }
+    return result;
+}
+
+LatencyBudget SemanticSegmentation::startLatencyBudget(const bool &with_pose) const
+{
+    LatencyBudget budget;
+    budget.with_pose = with_pose;
+    if (latency_budget_ > 0)
+        budget.deadline = get_wall_time() + latency_budget_;
+    return budget;
+}
+
+double SemanticSegmentation::expectedStageTime(const SegmentationStage &stage, const unsigned int &rungs)
+{
+    double expected;
+    {
+        std::lock_guard<std::mutex> lock(expected_stage_time_mutex_);
+        expected = expected_stage_time_[stage];
+    }
+    if (stage == STAGE_POOLER || stage == STAGE_SVM)
+    {
+        if (rungs & DEGRADE_COARSE_DOWNSAMPLE)
+            expected *= COARSE_DOWNSAMPLE_SHARE;
+        if (stage == STAGE_SVM && (rungs & DEGRADE_SKIP_LEVEL1_SUPERPIXELS))
+            expected *= SKIP_LEVEL1_SHARE;
+    }
+    else if (stage == STAGE_POSE)
+    {
+        if (rungs & DEGRADE_SKIP_POSE)
+            expected = 0;
+        else if (rungs & DEGRADE_FEWER_RANSAC_ITERATIONS)
+            expected *= FEWER_RANSAC_SHARE;
+    }
+    return expected;
+}
+
+void SemanticSegmentation::updateExpectedStageTime(const SegmentationStage &stage, const double &seconds)
+{
+    std::lock_guard<std::mutex> lock(expected_stage_time_mutex_);
+    double &expected = expected_stage_time_[stage];
+    expected = expected > 0 ? (1 - EXPECTED_TIME_UPDATE) * expected + EXPECTED_TIME_UPDATE * seconds : seconds;
+}
+
 void SemanticSegmentation::convertPointCloudLabelToRGBA(const pcl::PointCloud<pcl::PointXYZL>::Ptr &input, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &output) const
 {
     pcl::PointCloud<pcl::PointXYZRGBA>::Ptr result(new pcl::PointCloud<pcl::PointXYZRGBA>);
@@ -556,7 +669,7 @@ void SemanticSegmentation::addModel(const std::string &path_to_model_directory,
     bool success = checkFolderExist(path_to_model_directory);
     if (!success)
     {
-        std::cerr << "addModel failed" << std::endl;
+        SP_LOG_ERROR("addModel failed");
         return;
     }
     std::string model_path = path_to_model_directory;
@@ -565,32 +678,38 @@ void SemanticSegmentation::addModel(const std::string &path_to_model_directory,
 
     if (use_combined_objRecRANSAC_ || !use_multi_class_svm_)
     {
-        std::cerr << "Using combined ObjRecRANSAC.\n";
-        if (combined_ObjRecRANSAC_ == NULL)
-        {
-            combined_ObjRecRANSAC_ = boost::shared_ptr<greedyObjRansac>(new greedyObjRansac(parameter.pair_width_, parameter.voxel_size_));
-            combined_ObjRecRANSAC_->setParams(parameter.object_visibility_,parameter.scene_visibility_);
-            combined_ObjRecRANSAC_->setUseCUDA(use_cuda_);
-        }
-        combined_ObjRecRANSAC_->AddModel(model_path + model_name, model_name);
+        SP_LOG_INFO("Using combined ObjRecRANSAC.");
+        // the detector parameters come from the first model
+        if (combined_model_files_.empty())
+            combined_parameter_ = parameter;
+        combined_model_files_.push_back(model_path + model_name);
+        combined_model_names_.push_back(model_name);
         this->number_of_added_models_++;
+        // the detector is built by initializeSemanticSegmentation, a model added after that needs a new one
+        if (this->class_ready_)
+            this->loadCombinedObjRecRANSAC();
     }
     else
     {
-        std::cerr << "Using individual ObjRecRANSAC for each model.\n";
-        individual_ObjRecRANSAC_.push_back(boost::shared_ptr<greedyObjRansac>(new greedyObjRansac(parameter.pair_width_, parameter.voxel_size_)));
-        individual_ObjRecRANSAC_[number_of_added_models_]->setParams(parameter.object_visibility_,parameter.scene_visibility_);
-        individual_ObjRecRANSAC_[number_of_added_models_]->setUseCUDA(use_cuda_);
-        individual_ObjRecRANSAC_[number_of_added_models_]->AddModel(model_path + model_name, model_name);
+        SP_LOG_INFO("Using individual ObjRecRANSAC for each model.");
+        individual_ObjRecRANSAC_.push_back(ModelRegistry::instance().getObjRecRANSAC(std::vector<std::string>(1, model_path + model_name),
+            std::vector<std::string>(1, model_name), parameter.pair_width_, parameter.voxel_size_, parameter.object_visibility_, parameter.scene_visibility_, use_cuda_));
         model_name_map_[model_name] = number_of_added_models_;
         this->number_of_added_models_++;
     }
-    ModelT mesh_buf = LoadMesh(model_path + model_name, model_name);  
-    mesh_set_.push_back(mesh_buf);
+    mesh_set_.push_back(*ModelRegistry::instance().getMesh(model_path + model_name, model_name));
     object_class_transform_index_[model_name] = 0;
 }
 
 
+void SemanticSegmentation::loadCombinedObjRecRANSAC()
+{
+    if (combined_model_files_.empty())
+        return;
+    combined_ObjRecRANSAC_ = ModelRegistry::instance().getObjRecRANSAC(combined_model_files_, combined_model_names_, combined_parameter_.pair_width_,
+        combined_parameter_.voxel_size_, combined_parameter_.object_visibility_, combined_parameter_.scene_visibility_, use_cuda_);
+}
+
 void SemanticSegmentation::addModelSymmetricProperty(const std::map<std::string, objectSymmetry> &object_dict)
 {
     this->object_dict_ = object_dict;
@@ -619,18 +738,57 @@ void SemanticSegmentation::setUseObjectPersistence(const bool &use_object_persis
 }
 
 std::vector<objectTransformInformation> SemanticSegmentation::calculateObjTransform(const pcl::PointCloud<pcl::PointXYZL>::Ptr &labelled_point_cloud)
+{
+    LatencyBudget budget = startLatencyBudget(true);
+    std::vector<objectTransformInformation> result = calculateObjTransform(labelled_point_cloud, budget);
+    last_degradation_ = budget.rungs;
+    return result;
+}
+
+std::vector<objectTransformInformation> SemanticSegmentation::calculateObjTransform(const pcl::PointCloud<pcl::PointXYZL>::Ptr &labelled_point_cloud,
+    LatencyBudget &budget)
 {
     if (!this->class_ready_ || !this->compute_pose_)
     {
-        std::cerr << "Please set compute pose to true and initialize semantic segmentation before calculating obj transform\n";
+        SP_LOG_ERROR("Please set compute pose to true and initialize semantic segmentation before calculating obj transform");
         return std::vector<objectTransformInformation>();
     }
 
+    SP_PROFILE_SCOPE("calculateObjTransform");
+    stage_time_[STAGE_POSE] = 0;
+    double stage_start = get_wall_time();
+    std::vector<poseT> all_poses = recognizePoses(labelled_point_cloud, budget);
+    std::vector<objectTransformInformation> result = updateObjectTransforms(all_poses, budget);
+    stage_time_[STAGE_POSE] = get_wall_time() - stage_start;
+    return result;
+}
+
+// ObjRecRANSAC success probability of the full and the degraded pose estimation, the iterations grow with -log(1 - p)
+static const double FULL_SUCCESS_PROBABILITY = 0.99;
+static const double DEGRADED_SUCCESS_PROBABILITY = 0.9;
+
+std::vector<poseT> SemanticSegmentation::recognizePoses(const pcl::PointCloud<pcl::PointXYZL>::Ptr &labelled_point_cloud, LatencyBudget &budget)
+{
     std::vector<poseT> all_poses;
 
+    if (budget.deadline > 0)
+    {
+        double remaining = budget.deadline - get_wall_time();
+        if (expectedStageTime(STAGE_POSE, budget.rungs) > remaining)
+            budget.rungs |= DEGRADE_FEWER_RANSAC_ITERATIONS;
+        if (remaining <= 0 || expectedStageTime(STAGE_POSE, budget.rungs) > remaining)
+        {
+            SP_LOG_DEBUG("Latency budget: skipping pose estimation, " << remaining << " s left");
+            budget.rungs |= DEGRADE_SKIP_POSE;
+            return all_poses;
+        }
+    }
+    const double success_probability = (budget.rungs & DEGRADE_FEWER_RANSAC_ITERATIONS) ? DEGRADED_SUCCESS_PROBABILITY : FULL_SUCCESS_PROBABILITY;
+    double pose_start = get_wall_time();
+
     if( viewer )
     {
-        std::cerr<<"Visualize after pose computation"<<std::endl;
+        SP_LOG_DEBUG("Visualize after pose computation");
         viewer->setWindowName("Computed Pose");
         viewer->removeAllPointClouds();
         visualizeLabels(labelled_point_cloud, viewer, color_label);
@@ -642,51 +800,55 @@ std::vector<objectTransformInformation> SemanticSegmentation::calculateObjTransf
         std::vector< pcl::PointCloud<pcl::PointXYZ>::Ptr > cloud_set(number_of_added_models_+1);
         for( size_t j = 0 ; j < cloud_set.size() ; j++ )
             cloud_set[j] = pcl::PointCloud<pcl::PointXYZ>::Ptr (new pcl::PointCloud<pcl::PointXYZ>()); // object cloud starts from 1
-        std::cerr<<"Split cloud after segmentation"<<std::endl;
+        SP_LOG_DEBUG("Split cloud after segmentation");
         splitCloud(labelled_point_cloud, cloud_set);
 
-        std::cerr<<"Calculate poses"<<std::endl;
+        SP_LOG_DEBUG("Calculate poses");
 
         // loop over all segmented object clouds
-        #pragma omp parallel for schedule(dynamic, 1)
-        for(size_t j = 1 ; j <= number_of_added_models_; j++ )
-        {
+        std::mutex poses_mutex;
+        TaskScheduler::instance().parallelFor(TASK_POSE, 1, number_of_added_models_ + 1, 1, [&](int j) {
             if( cloud_set[j]->empty() == false )
             {
-                std::cerr << "cloud set " << j << " size: " << cloud_set[j]->size() << std::endl;
+                SP_LOG_DEBUG("cloud set " << j << " size: " << cloud_set[j]->size());
                 std::vector<poseT> tmp_poses;
+                // the detector may be shared with other segmenters
+                std::lock_guard<std::mutex> lock(individual_ObjRecRANSAC_[j-1]->mutex);
+                individual_ObjRecRANSAC_[j-1]->detector->setNumberOfThreads(TaskScheduler::instance().getLibraryThreads(TASK_POSE));
+                individual_ObjRecRANSAC_[j-1]->detector->setSuccessProbability(success_probability);
                 switch (objRecRANSAC_mode_)
                 {
                     case STANDARD_BEST:
-                        individual_ObjRecRANSAC_[j-1]->StandardBest(cloud_set[j], tmp_poses);
+                        individual_ObjRecRANSAC_[j-1]->detector->StandardBest(cloud_set[j], tmp_poses);
                         break;
                     case STANDARD_RECOGNIZE:
-                        individual_ObjRecRANSAC_[j-1]->StandardRecognize(cloud_set[j], tmp_poses, min_objrecransac_confidence);
+                        individual_ObjRecRANSAC_[j-1]->detector->StandardRecognize(cloud_set[j], tmp_poses, min_objrecransac_confidence);
                         break;
                     case GREEDY_RECOGNIZE:
-                        individual_ObjRecRANSAC_[j-1]->GreedyRecognize(cloud_set[j], tmp_poses);
+                        individual_ObjRecRANSAC_[j-1]->detector->GreedyRecognize(cloud_set[j], tmp_poses);
                         break;
                     default:
-                        std::cerr << "Unsupported objRecRANSACdetector!\n";
+                        SP_LOG_ERROR("Unsupported objRecRANSACdetector!");
                 }
 
                 if (viewer)
                 {
-                    individual_ObjRecRANSAC_[j-1]->visualize(viewer, tmp_poses, color_label[j]);
+                    individual_ObjRecRANSAC_[j-1]->detector->visualize(viewer, tmp_poses, color_label[j]);
                 }
 
-                #pragma omp critical
-                {
-                    all_poses.insert(all_poses.end(), tmp_poses.begin(), tmp_poses.end());
-                }
+                std::lock_guard<std::mutex> poses_lock(poses_mutex);
+                all_poses.insert(all_poses.end(), tmp_poses.begin(), tmp_poses.end());
             }
-        }
+        });
 
         if (viewer)
         {
             viewer->spin();
             for(size_t j = 1 ; j <= number_of_added_models_; j++ )
-                individual_ObjRecRANSAC_[j-1]->clearMesh(viewer, all_poses);
+            {
+                std::lock_guard<std::mutex> lock(individual_ObjRecRANSAC_[j-1]->mutex);
+                individual_ObjRecRANSAC_[j-1]->detector->clearMesh(viewer, all_poses);
+            }
             viewer->removeAllPointClouds();
         }
     }
@@ -694,42 +856,55 @@ std::vector<objectTransformInformation> SemanticSegmentation::calculateObjTransf
     {
         pcl::PointCloud<pcl::PointXYZ>::Ptr scene_xyz(new pcl::PointCloud<pcl::PointXYZ>());
         pcl::copyPointCloud(*labelled_point_cloud,*scene_xyz);
+        // the detector may be shared with other segmenters
+        std::lock_guard<std::mutex> lock(combined_ObjRecRANSAC_->mutex);
+        combined_ObjRecRANSAC_->detector->setNumberOfThreads(TaskScheduler::instance().getLibraryThreads(TASK_POSE));
+        combined_ObjRecRANSAC_->detector->setSuccessProbability(success_probability);
         switch (objRecRANSAC_mode_)
         {
             case STANDARD_BEST:
-                combined_ObjRecRANSAC_->StandardBest(scene_xyz, all_poses);
+                combined_ObjRecRANSAC_->detector->StandardBest(scene_xyz, all_poses);
                 break;
             case STANDARD_RECOGNIZE:
-                combined_ObjRecRANSAC_->StandardRecognize(scene_xyz, all_poses, min_objrecransac_confidence);
+                combined_ObjRecRANSAC_->detector->StandardRecognize(scene_xyz, all_poses, min_objrecransac_confidence);
                 break;
             case GREEDY_RECOGNIZE:
-                combined_ObjRecRANSAC_->GreedyRecognize(scene_xyz, all_poses);
+                combined_ObjRecRANSAC_->detector->GreedyRecognize(scene_xyz, all_poses);
                 break;
             default:
-                std::cerr << "Unsupported objRecRANSACdetector!\n";
+                SP_LOG_ERROR("Unsupported objRecRANSACdetector!");
         }
 
         if (viewer)
         {
-            combined_ObjRecRANSAC_->visualize_m(viewer, all_poses, model_name_map_, color_label);
+            combined_ObjRecRANSAC_->detector->visualize_m(viewer, all_poses, model_name_map_, color_label);
             viewer->spin();
-            combined_ObjRecRANSAC_->clearMesh(viewer, all_poses);
+            combined_ObjRecRANSAC_->detector->clearMesh(viewer, all_poses);
             viewer->removeAllPointClouds();
         }
     }
+    SP_PROFILE_COUNT("poses/found", all_poses.size());
+    // the viewer waits for the user
+    if (!(budget.rungs & DEGRADE_FEWER_RANSAC_ITERATIONS) && !viewer)
+        updateExpectedStageTime(STAGE_POSE, get_wall_time() - pose_start);
+    return all_poses;
+}
 
+std::vector<objectTransformInformation> SemanticSegmentation::updateObjectTransforms(std::vector<poseT> all_poses)
+{
+    std::lock_guard<std::mutex> lock(object_tree_mutex_);
     std::map<std::string, unsigned int> object_class_transform_index_no_persistence = object_class_transform_index_;
     std::map<std::string, unsigned int> &tmpTFIndex = object_class_transform_index_;
     double current_time = time(0);
     if (segmented_object_tree_.size() == 0 || !use_object_persistence_)
     {
-        std::cerr << "create tree\n";
+        SP_LOG_DEBUG("create tree");
         // this will create tree and normalize the orientation to the base_rotation_
         createTree(segmented_object_tree_, object_dict_, all_poses, current_time, tmpTFIndex, base_rotation_);
     }
     else
     {
-        std::cerr << "update tree\n";
+        SP_LOG_DEBUG("update tree");
         updateTree(segmented_object_tree_, object_dict_, all_poses, current_time, tmpTFIndex, base_rotation_);
     }
 
@@ -740,12 +915,22 @@ std::vector<objectTransformInformation> SemanticSegmentation::calculateObjTransf
     return result;
 }
 
+std::vector<objectTransformInformation> SemanticSegmentation::updateObjectTransforms(const std::vector<poseT> &all_poses, const LatencyBudget &budget)
+{
+    if (!(budget.rungs & DEGRADE_SKIP_POSE))
+        return updateObjectTransforms(all_poses);
+
+    // no pose estimation is not an empty scene, keep the objects known so far
+    std::lock_guard<std::mutex> lock(object_tree_mutex_);
+    return this->getTransformInformationFromTree();
+}
+
 std::vector<objectTransformInformation> SemanticSegmentation::getTransformInformationFromTree()  const
 {
     std::vector<objectTransformInformation> result;
     std::vector<value> sp_segmenter_detected_poses = getAllNodes(segmented_object_tree_);
 
-    std::cerr << "detected poses: " << sp_segmenter_detected_poses.size() << "\n";
+    SP_LOG_INFO("detected poses: " << sp_segmenter_detected_poses.size());
     for (std::size_t i = 0; i < sp_segmenter_detected_poses.size(); i++)
     {
         const value &v = sp_segmenter_detected_poses.at(i);
@@ -763,7 +948,7 @@ std::vector<objectTransformInformation> SemanticSegmentation::getUpdateOnOneObjT
 {
     if (!this->class_ready_)
     {
-        std::cerr << "Please initialize semantic segmentation first before updating one obj transform\n";
+        SP_LOG_ERROR("Please initialize semantic segmentation first before updating one obj transform");
         return std::vector<objectTransformInformation>();
     }    
     std::vector<poseT> all_poses;
@@ -773,29 +958,32 @@ std::vector<objectTransformInformation> SemanticSegmentation::getUpdateOnOneObjT
         std::vector< pcl::PointCloud<pcl::PointXYZ>::Ptr > cloud_set(number_of_added_models_+1);
         for( size_t j = 0 ; j < cloud_set.size() ; j++ )
             cloud_set[j] = pcl::PointCloud<pcl::PointXYZ>::Ptr (new pcl::PointCloud<pcl::PointXYZ>()); // object cloud starts from 1
-        std::cerr<<"Split cloud after segmentation"<<std::endl;
+        SP_LOG_DEBUG("Split cloud after segmentation");
         splitCloud(labelled_point_cloud, cloud_set);
 
-        std::cerr<<"Calculate poses"<<std::endl;
+        SP_LOG_DEBUG("Calculate poses");
         std::vector<poseT> tmp_poses;
         std::size_t objrec_index = model_name_map_[object_type];
 
         if( cloud_set[objrec_index + 1]->empty() == false )
         {
             std::vector<poseT> tmp_poses;
+            std::lock_guard<std::mutex> lock(individual_ObjRecRANSAC_[objrec_index]->mutex);
+            individual_ObjRecRANSAC_[objrec_index]->detector->setNumberOfThreads(TaskScheduler::instance().getLibraryThreads(TASK_POSE));
+            individual_ObjRecRANSAC_[objrec_index]->detector->setSuccessProbability(FULL_SUCCESS_PROBABILITY);
             switch (objRecRANSAC_mode_)
             {
                 case STANDARD_BEST:
-                    individual_ObjRecRANSAC_[objrec_index]->StandardBest(cloud_set[objrec_index + 1], tmp_poses);
+                    individual_ObjRecRANSAC_[objrec_index]->detector->StandardBest(cloud_set[objrec_index + 1], tmp_poses);
                     break;
                 case STANDARD_RECOGNIZE:
-                    individual_ObjRecRANSAC_[objrec_index]->StandardRecognize(cloud_set[objrec_index + 1], tmp_poses, min_objrecransac_confidence);
+                    individual_ObjRecRANSAC_[objrec_index]->detector->StandardRecognize(cloud_set[objrec_index + 1], tmp_poses, min_objrecransac_confidence);
                     break;
                 case GREEDY_RECOGNIZE:
-                    individual_ObjRecRANSAC_[objrec_index]->GreedyRecognize(cloud_set[objrec_index + 1], tmp_poses);
+                    individual_ObjRecRANSAC_[objrec_index]->detector->GreedyRecognize(cloud_set[objrec_index + 1], tmp_poses);
                     break;
                 default:
-                    std::cerr << "Unsupported objRecRANSACdetector!\n";
+                    SP_LOG_ERROR("Unsupported objRecRANSACdetector!");
             }
             all_poses.insert(all_poses.end(), tmp_poses.begin(), tmp_poses.end());
         }
@@ -805,26 +993,30 @@ std::vector<objectTransformInformation> SemanticSegmentation::getUpdateOnOneObjT
         pcl::PointCloud<pcl::PointXYZ>::Ptr scene_xyz(new pcl::PointCloud<pcl::PointXYZ>());
         pcl::copyPointCloud(*labelled_point_cloud,*scene_xyz);
         std::vector<poseT> tmp_poses;
+        std::lock_guard<std::mutex> lock(combined_ObjRecRANSAC_->mutex);
+        combined_ObjRecRANSAC_->detector->setNumberOfThreads(TaskScheduler::instance().getLibraryThreads(TASK_POSE));
+        combined_ObjRecRANSAC_->detector->setSuccessProbability(FULL_SUCCESS_PROBABILITY);
         switch (objRecRANSAC_mode_)
         {
             case STANDARD_BEST:
-                combined_ObjRecRANSAC_->StandardBest(scene_xyz, all_poses);
+                combined_ObjRecRANSAC_->detector->StandardBest(scene_xyz, all_poses);
                 break;
             case STANDARD_RECOGNIZE:
-                combined_ObjRecRANSAC_->StandardRecognize(scene_xyz, all_poses, min_objrecransac_confidence);
+                combined_ObjRecRANSAC_->detector->StandardRecognize(scene_xyz, all_poses, min_objrecransac_confidence);
                 break;
             case GREEDY_RECOGNIZE:
-                combined_ObjRecRANSAC_->GreedyRecognize(scene_xyz, all_poses);
+                combined_ObjRecRANSAC_->detector->GreedyRecognize(scene_xyz, all_poses);
                 break;
             default:
-                std::cerr << "Unsupported objRecRANSACdetector!\n";
+                SP_LOG_ERROR("Unsupported objRecRANSACdetector!");
         }
     }
 
+    std::lock_guard<std::mutex> lock(object_tree_mutex_);
     std::map<std::string, unsigned int> object_class_transform_index_no_persistence = object_class_transform_index_;
     std::map<std::string, unsigned int> &tmpTFIndex = object_class_transform_index_;
     double current_time = time(0);
-    std::cerr << "update one value on tree\n";
+    SP_LOG_DEBUG("update one value on tree");
     updateOneValue(segmented_object_tree_, transform_name, object_dict_, all_poses, current_time, tmpTFIndex, base_rotation_);
 
     std::vector<objectTransformInformation> result = this->getTransformInformationFromTree();
@@ -837,13 +1029,193 @@ std::vector<objectTransformInformation> SemanticSegmentation::getUpdateOnOneObjT
 bool SemanticSegmentation::segmentAndCalculateObjTransform(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &input_cloud, 
     pcl::PointCloud<pcl::PointXYZL>::Ptr &labelled_point_cloud_result, std::vector<objectTransformInformation> &object_transform_result)
 {
-    bool segmentation_successful = this->segmentPointCloud(input_cloud, labelled_point_cloud_result);
+    SP_PROFILE_BEGIN_FRAME();
+    // one budget for both, the segmentation leaves the time the pose estimation is expected to need
+    LatencyBudget budget = startLatencyBudget(true);
+    bool segmentation_successful = this->segmentCloud(input_cloud, labelled_point_cloud_result, stage_time_, budget);
     if (segmentation_successful)
-        object_transform_result = this->calculateObjTransform(labelled_point_cloud_result);
+        object_transform_result = this->calculateObjTransform(labelled_point_cloud_result, budget);
+    last_degradation_ = budget.rungs;
     
-    return (segmentation_successful && object_transform_result.size() > 0);
+    // a frame without pose estimation still has its labelled cloud
+    return (segmentation_successful && (object_transform_result.size() > 0 || (budget.rungs & DEGRADE_SKIP_POSE)));
+}
+
+#endif
+
+// a future that is ready already, for the calls that run on the calling thread
+template <typename Result>
+static std::future<Result> readyFuture(const Result &result)
+{
+    std::promise<Result> promise;
+    promise.set_value(result);
+    return promise.get_future();
+}
+
+std::size_t SemanticSegmentation::segmentPointClouds(const std::vector<pcl::PointCloud<pcl::PointXYZRGBA>::Ptr> &input_clouds,
+    std::vector<pcl::PointCloud<pcl::PointXYZL>::Ptr> &results)
+{
+    SP_PROFILE_BEGIN_FRAME();
+    // every cloud of the batch has the same deadline
+    std::vector<LatencyBudget> budgets(input_clouds.size(), startLatencyBudget(false));
+    std::size_t succeeded = segmentClouds(input_clouds, results, budgets);
+    last_degradation_ = 0;
+    for (std::size_t i = 0; i < budgets.size(); i++)
+        last_degradation_ |= budgets[i].rungs;
+    return succeeded;
 }
 
+std::size_t SemanticSegmentation::segmentClouds(const std::vector<pcl::PointCloud<pcl::PointXYZRGBA>::Ptr> &input_clouds,
+    std::vector<pcl::PointCloud<pcl::PointXYZL>::Ptr> &results, std::vector<LatencyBudget> &budgets)
+{
+    SP_PROFILE_SCOPE("segmentPointClouds");
+    results.assign(input_clouds.size(), pcl::PointCloud<pcl::PointXYZL>::Ptr());
+    std::vector<double> stage_time(input_clouds.size() * NUM_SEGMENTATION_STAGES, 0.0);
+    std::vector<char> success(input_clouds.size(), false);
+
+    if (viewer)
+    {
+        // the visualizer blocks in spin() and has to stay on this thread
+        for (std::size_t i = 0; i < input_clouds.size(); i++)
+            success[i] = segmentCloud(input_clouds[i], results[i], &stage_time[i * NUM_SEGMENTATION_STAGES], budgets[i]);
+    }
+    else
+    {
+        std::vector<std::future<bool> > done;
+        for (std::size_t i = 0; i < input_clouds.size(); i++)
+        {
+            done.push_back(WorkerPool::shared().submit([this, &input_clouds, &results, &stage_time, &budgets, i]() {
+                return segmentCloud(input_clouds[i], results[i], &stage_time[i * NUM_SEGMENTATION_STAGES], budgets[i]);
+            }));
+        }
+        // every task uses the vectors above, wait for all of them before an exception can leave this scope
+        for (std::size_t i = 0; i < done.size(); i++)
+            done[i].wait();
+        for (std::size_t i = 0; i < done.size(); i++)
+            success[i] = done[i].get();
+    }
+
+    std::fill(stage_time_, stage_time_ + NUM_SEGMENTATION_STAGES, 0.0);
+    std::size_t succeeded = 0;
+    for (std::size_t i = 0; i < input_clouds.size(); i++)
+    {
+        for (int stage = 0; stage < NUM_SEGMENTATION_STAGES; stage++)
+            stage_time_[stage] += stage_time[i * NUM_SEGMENTATION_STAGES + stage];
+        if (success[i])
+            succeeded++;
+        else
+            results[i].reset();
+    }
+    return succeeded;
+}
+
+std::future<SegmentationResult> SemanticSegmentation::segmentPointCloudAsync(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &input_cloud)
+{
+    // the deadline starts with the call, waiting for a worker counts
+    const LatencyBudget start = startLatencyBudget(false);
+    // the lambda keeps its own reference to the cloud
+    std::function<SegmentationResult()> task = [this, input_cloud, start]() {
+        // a request of its own, not part of the caller's profile
+        SP_PROFILE_BEGIN_FRAME();
+        LatencyBudget budget = start;
+        SegmentationResult result;
+        result.success = segmentCloud(input_cloud, result.labelled_cloud, result.stage_time, budget);
+        result.degradation = budget.rungs;
+        return result;
+    };
+
+    if (viewer)
+        return readyFuture(task());
+    return WorkerPool::shared().submit(task);
+}
+
+#ifdef USE_OBJRECRANSAC
+std::size_t SemanticSegmentation::segmentAndCalculateObjTransforms(const std::vector<pcl::PointCloud<pcl::PointXYZRGBA>::Ptr> &input_clouds,
+    std::vector<pcl::PointCloud<pcl::PointXYZL>::Ptr> &labelled_point_cloud_results, std::vector<std::vector<objectTransformInformation> > &object_transform_results)
+{
+    SP_PROFILE_BEGIN_FRAME();
+    object_transform_results.assign(input_clouds.size(), std::vector<objectTransformInformation>());
+    std::vector<LatencyBudget> budgets(input_clouds.size(), startLatencyBudget(true));
+    this->segmentClouds(input_clouds, labelled_point_cloud_results, budgets);
+    last_degradation_ = 0;
+    for (std::size_t i = 0; i < budgets.size(); i++)
+        last_degradation_ |= budgets[i].rungs;
+    if (!this->class_ready_ || !this->compute_pose_)
+    {
+        SP_LOG_ERROR("Please set compute pose to true and initialize semantic segmentation before calculating obj transform");
+        return 0;
+    }
+
+    SP_PROFILE_SCOPE("calculateObjTransforms");
+    double stage_start = get_wall_time();
+    std::vector<std::vector<poseT> > poses(input_clouds.size());
+    if (viewer)
+    {
+        for (std::size_t i = 0; i < input_clouds.size(); i++)
+            if (labelled_point_cloud_results[i])
+                poses[i] = recognizePoses(labelled_point_cloud_results[i], budgets[i]);
+    }
+    else
+    {
+        std::vector<std::future<void> > done;
+        for (std::size_t i = 0; i < input_clouds.size(); i++)
+        {
+            if (!labelled_point_cloud_results[i])
+                continue;
+            done.push_back(WorkerPool::shared().submit([this, &labelled_point_cloud_results, &poses, &budgets, i]() {
+                poses[i] = recognizePoses(labelled_point_cloud_results[i], budgets[i]);
+            }));
+        }
+        for (std::size_t i = 0; i < done.size(); i++)
+            done[i].wait();
+        for (std::size_t i = 0; i < done.size(); i++)
+            done[i].get();
+    }
+
+    // the object tree is updated in input order, poses of later views refine the earlier ones
+    std::size_t with_poses = 0;
+    for (std::size_t i = 0; i < input_clouds.size(); i++)
+    {
+        if (!labelled_point_cloud_results[i])
+            continue;
+        object_transform_results[i] = updateObjectTransforms(poses[i], budgets[i]);
+        if (!object_transform_results[i].empty())
+            with_poses++;
+        last_degradation_ |= budgets[i].rungs;
+    }
+    stage_time_[STAGE_POSE] = get_wall_time() - stage_start;
+    return with_poses;
+}
+
+std::future<SegmentationResult> SemanticSegmentation::segmentAndCalculateObjTransformAsync(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &input_cloud)
+{
+    if (!this->compute_pose_)
+    {
+        SP_LOG_ERROR("Please set compute pose to true and initialize semantic segmentation before calculating obj transform");
+        return readyFuture(SegmentationResult());
+    }
+
+    const LatencyBudget start = startLatencyBudget(true);
+    std::function<SegmentationResult()> task = [this, input_cloud, start]() {
+        SP_PROFILE_BEGIN_FRAME();
+        LatencyBudget budget = start;
+        SegmentationResult result;
+        if (segmentCloud(input_cloud, result.labelled_cloud, result.stage_time, budget))
+        {
+            double stage_start = get_wall_time();
+            std::vector<poseT> all_poses = recognizePoses(result.labelled_cloud, budget);
+            result.poses = updateObjectTransforms(all_poses, budget);
+            result.stage_time[STAGE_POSE] = get_wall_time() - stage_start;
+            result.success = !result.poses.empty() || (budget.rungs & DEGRADE_SKIP_POSE);
+        }
+        result.degradation = budget.rungs;
+        return result;
+    };
+
+    if (viewer)
+        return readyFuture(task());
+    return WorkerPool::shared().submit(task);
+}
 #endif
 
 void SemanticSegmentation::cropPointCloud(pcl::PointCloud<PointT>::Ptr &cloud_input, 
@@ -866,7 +1238,7 @@ bool SemanticSegmentation::checkFolderExist(const std::string &directory_path) c
     bool result = boost::filesystem::is_directory(directory_path);
     if (!result)
     {
-        std::cerr << "Folder: " << directory_path << " does not exist.\n";
+        SP_LOG_ERROR("Folder: " << directory_path << " does not exist.");
     }
     return result;
 }
\ No newline at end of file
@@ -2,6 +2,9 @@
 #include <opencv2/highgui/highgui.hpp>
 
 #include "sp_segmenter/features.h"
+#include "sp_segmenter/utility/profiler.h"
+#include "sp_segmenter/utility/logger.h"
+#include "sp_segmenter/utility/task_scheduler.h"
 
 /************************************************************************************************************************************/
 
@@ -66,7 +69,7 @@ void spExt::buildOneSPLevel(int level)
 {
     if( level < 0 || down_cloud->empty() == true )
     {
-        std::cerr << "Input Argument to buildOneSPLevel is wrong OR No cloud available!" << std::endl;
+        SP_LOG_ERROR("Input Argument to buildOneSPLevel is wrong OR No cloud available!");
         return;
     }
     else if( level == 0 )
@@ -153,12 +156,12 @@ void spExt::setSPFlags(const std::vector<int> &sp_flags_, bool constrained_flag)
 {
     if( sp_level_idx.empty() == true )
     {
-        std::cerr << "SP Flags Set Failed! Please call buildOneSPLevel(0) first!" << std::endl;
+        SP_LOG_ERROR("SP Flags Set Failed! Please call buildOneSPLevel(0) first!");
         return;
     }
     if( sp_flags_.size() != sp_flags.size() )
     {
-        std::cerr << "SP Flags Set Failed! sp_flags_.size() != low_seg_num!" << std::endl;
+        SP_LOG_ERROR("SP Flags Set Failed! sp_flags_.size() != low_seg_num!");
         return;
     }
     if( constrained_flag == true )
@@ -260,13 +263,17 @@ void spPooler::reset()
     ext_sp.clear();
 }
 
-void spPooler::lightInit(const pcl::PointCloud<PointT>::Ptr cloud, Hier_Pooler& cshot_producer, float radius, float down_ss)
+void spPooler::lightInit(const pcl::PointCloud<PointT>::Ptr cloud, const Hier_Pooler& cshot_producer, float radius, float down_ss)
 {
     // If not use SIFT pooling!!! Use this light version.
+    SP_PROFILE_SCOPE("spPooler/init");
     reset();
     
     pcl::PointCloud<NormalT>::Ptr cloud_normals(new pcl::PointCloud<NormalT>());
-    computeNormals(cloud, cloud_normals, radius);
+    {
+        SP_PROFILE_SCOPE("spPooler/normals");
+        computeNormals(cloud, cloud_normals, radius);
+    }
     data = convertPCD(cloud, cloud_normals);
     
     // ext_sp is for superpixel extraction from the segmented point cloud
@@ -276,15 +283,20 @@ void spPooler::lightInit(const pcl::PointCloud<PointT>::Ptr cloud, Hier_Pooler&
     ext_sp.LoadPointCloud(cloud);
     data.down_cloud  = ext_sp.getCloud();
     
-    std::vector< pcl::PointCloud<PointT>::Ptr > segs = ext_sp.getSPCloud(0);
+    std::vector< pcl::PointCloud<PointT>::Ptr > segs;
+    {
+        SP_PROFILE_SCOPE("spPooler/superpixels");
+        segs = ext_sp.getSPCloud(0);
+    }
     segs_to_cloud = ext_sp.getSegsToCloud();
     
     sp_num = segs_to_cloud.size();
+    SP_PROFILE_COUNT("superpixels", sp_num);
     segs_label.resize(sp_num, 1);
     segs_max_score.resize(sp_num, -1000.0);
     class_responses.resize(sp_num);
     
-    std::cerr << "CSHOT Extraction..." << std::endl;
+    SP_LOG_DEBUG("CSHOT Extraction...");
     std::vector<cv::Mat> main_fea = cshot_producer.getHierFea(data, 0);
     int depth_len = main_fea[0].cols;
     int color_len = main_fea[1].cols;
@@ -318,19 +330,23 @@ void spPooler::lightInit(const pcl::PointCloud<PointT>::Ptr cloud, Hier_Pooler&
 }
 
 
-void spPooler::init(const pcl::PointCloud<PointT>::Ptr full_cloud_, Hier_Pooler& cshot_producer, float radius, float down_ss)
+void spPooler::init(const pcl::PointCloud<PointT>::Ptr full_cloud_, const Hier_Pooler& cshot_producer, float radius, float down_ss)
 {
+    SP_PROFILE_SCOPE("spPooler/init");
     reset();
     full_cloud = full_cloud_;
     if( full_cloud->isOrganized() == false )
     {
-        std::cerr << "data.cloud->isOrganized() == false" << std::endl;
+        SP_LOG_ERROR("data.cloud->isOrganized() == false");
         exit(0);
     }
     pcl::PointCloud<PointT>::Ptr cloud = refineScene(full_cloud);
     
     pcl::PointCloud<NormalT>::Ptr cloud_normals(new pcl::PointCloud<NormalT>());
-    computeNormals(cloud, cloud_normals, radius);
+    {
+        SP_PROFILE_SCOPE("spPooler/normals");
+        computeNormals(cloud, cloud_normals, radius);
+    }
     data = convertPCD(cloud, cloud_normals);
     data.img = getFullImage(full_cloud);
     
@@ -339,7 +355,11 @@ void spPooler::init(const pcl::PointCloud<PointT>::Ptr full_cloud_, Hier_Pooler&
     ext_sp.LoadPointCloud(cloud);
     data.down_cloud  = ext_sp.getCloud();
     
-    std::vector< pcl::PointCloud<PointT>::Ptr > segs = ext_sp.getSPCloud(0);
+    std::vector< pcl::PointCloud<PointT>::Ptr > segs;
+    {
+        SP_PROFILE_SCOPE("spPooler/superpixels");
+        segs = ext_sp.getSPCloud(0);
+    }
     
 //    for(int i = 0 ; i < segs.size() ; i++ )
 //    {
@@ -350,6 +370,7 @@ void spPooler::init(const pcl::PointCloud<PointT>::Ptr full_cloud_, Hier_Pooler&
     segs_to_cloud = ext_sp.getSegsToCloud();
     
     sp_num = segs_to_cloud.size();
+    SP_PROFILE_COUNT("superpixels", sp_num);
     segs_label.resize(sp_num, 1);
     segs_max_score.resize(sp_num, -1000.0);
     class_responses.resize(sp_num);
@@ -364,14 +385,12 @@ void spPooler::init(const pcl::PointCloud<PointT>::Ptr full_cloud_, Hier_Pooler&
 //    std::vector<int> tmp_idx(1);
 //    std::vector<float> sqr_dist(1);
     
-    #pragma omp parallel for schedule(dynamic, 1)
-    for(size_t i = 0 ; i < sp_num ; i++ )
-    {
+    TaskScheduler::instance().parallelFor(TASK_POOLING, 0, int(sp_num), 1, [&](int i) {
         size_t cur_seg_size = segs_to_cloud[i].size();
         raw_data_seg[i] = convertPCD(cloud, cloud_normals);
         
         if( cur_seg_size <= 0 )
-            continue;
+            return;
         raw_depth_fea[i] = cv::Mat::zeros(cur_seg_size, depth_len, CV_32FC1);
         raw_color_fea[i] = cv::Mat::zeros(cur_seg_size, color_len, CV_32FC1);
         
@@ -395,22 +414,21 @@ void spPooler::init(const pcl::PointCloud<PointT>::Ptr full_cloud_, Hier_Pooler&
             down_ptr->push_back(data.down_cloud->at(cur_idx));
         }
 //        std::cerr << raw_data_seg[i].down_cloud->size() << std::endl;
-    }   
+    });
     
 }
 
 
 void spPooler::build_SP_LAB(const std::vector<boost::shared_ptr<Pooler_L0> >& lab_pooler_set, bool max_pool_flag)
 {
+    SP_PROFILE_SCOPE("spPooler/build_SP_LAB");
     int pooler_num = lab_pooler_set.size();
     raw_sp_lab.clear();
     raw_sp_lab.resize(sp_num);
     
-    #pragma omp parallel for schedule(dynamic, 1)
-    for(size_t i = 0 ; i < sp_num ; i++ )
-    {
+    TaskScheduler::instance().parallelFor(TASK_POOLING, 0, int(sp_num), 1, [&](int i) {
         if( raw_data_seg[i].down_cloud->empty() == true )
-            continue;
+            return;
         
         PreCloud(raw_data_seg[i], -1, true);
         for( int k = 1 ; k < pooler_num ; k++ )
@@ -420,22 +438,21 @@ void spPooler::build_SP_LAB(const std::vector<boost::shared_ptr<Pooler_L0> >& la
             raw_sp_lab[i].insert(raw_sp_lab[i].end(), temp_fea1.begin(), temp_fea1.end());
             raw_sp_lab[i].insert(raw_sp_lab[i].end(), temp_fea2.begin(), temp_fea2.end());
         }
-    }
+    });
 }
 
 void spPooler::build_SP_FPFH(const std::vector< boost::shared_ptr<Pooler_L0> > &fpfh_pooler_set, float radius, bool max_pool_flag)
 {
 //    cv::Mat fpfh = fpfh_cloud(data.cloud, data.down_cloud, data.cloud_normals, radius, true);
+    SP_PROFILE_SCOPE("spPooler/build_SP_FPFH");
     int pooler_num = fpfh_pooler_set.size();
     raw_sp_fpfh.clear();
     raw_sp_fpfh.resize(sp_num);
     
 //    int count = 0;
-    #pragma omp parallel for schedule(dynamic, 1)
-    for(size_t i = 0 ; i < sp_num ; i++ )
-    {
+    TaskScheduler::instance().parallelFor(TASK_POOLING, 0, int(sp_num), 1, [&](int i) {
         if( segs_label[i] <= 0 || raw_data_seg[i].down_cloud->empty() == true )
-            continue;
+            return;
 //        count++;
 //        size_t cur_seg_size = segs_to_cloud[i].size();
 //        cv::Mat cur_fpfh = cv::Mat::zeros(cur_seg_size, fpfh.cols, CV_32FC1);
@@ -450,11 +467,11 @@ void spPooler::build_SP_FPFH(const std::vector< boost::shared_ptr<Pooler_L0> > &
             raw_sp_fpfh[i].insert(raw_sp_fpfh[i].end(), temp_fea1.begin(), temp_fea1.end());
             raw_sp_fpfh[i].insert(raw_sp_fpfh[i].end(), temp_fea2.begin(), temp_fea2.end());
         }
-    }
+    });
 //    std::cerr << count << " " << sp_num << std::endl;
 }
 
-void spPooler::build_SP_SIFT(const std::vector< boost::shared_ptr<Pooler_L0> > &sift_pooler_set, Hier_Pooler &cshot_producer, const std::vector<cv::SiftFeatureDetector*> &sift_det_vec, bool max_pool_flag)
+void spPooler::build_SP_SIFT(const std::vector< boost::shared_ptr<Pooler_L0> > &sift_pooler_set, const Hier_Pooler &cshot_producer, const std::vector<cv::SiftFeatureDetector*> &sift_det_vec, bool max_pool_flag)
 {
     // cv::SiftFeatureDetector *sift_det = new cv::SiftFeatureDetector(
     //    0, // nFeatures
@@ -520,11 +537,9 @@ void spPooler::build_SP_SIFT(const std::vector< boost::shared_ptr<Pooler_L0> > &
     raw_sp_sift.resize(sp_num);
     
     // int count = 0;
-    #pragma omp parallel for schedule(dynamic, 1)
-    for( size_t k = 0 ; k < sp_num ; k++ )
-    {
+    TaskScheduler::instance().parallelFor(TASK_POOLING, 0, int(sp_num), 1, [&](int k) {
         if( in_sift_keys[k].empty() == true )
-            continue;
+            return;
         
         // count++;
         cv::Mat cur_sift_descr;
@@ -541,7 +556,7 @@ void spPooler::build_SP_SIFT(const std::vector< boost::shared_ptr<Pooler_L0> > &
             raw_sp_sift[k].insert(raw_sp_sift[k].end(), temp_fea2.begin(), temp_fea2.end());
     	}
         
-    }
+    });
     // std::cerr << count << " " << sp_num << std::endl;
     delete sift_ext;
 }
@@ -628,7 +643,7 @@ std::vector<cv::Mat> spPooler::combineRaw(const std::vector< std::vector<cv::Mat
     
     if( pool_num < 0 || dim_per_pool <= 0)
     {
-        std::cerr << "Error in combineRaw()!" << std::endl;
+        SP_LOG_ERROR("Error in combineRaw()!");
         return fea_set;
     }
     
@@ -673,64 +688,161 @@ std::vector<cv::Mat> spPooler::combineRaw(const std::vector< std::vector<cv::Mat
     return fea_set;
 }
 
-std::vector<cv::Mat> spPooler::gethardNegtive(const model *cur_model, int level, bool max_pool)
+int spPooler::predictSP(const model *cur_model, const std::vector<int> &sp_idx, bool max_pool, const FeatureProjection *projection, 
+    cv::Mat &sp_fea, float &score)
 {
     int model_num = cur_model->nr_class;
-    IDXSET idx_set = ext_sp.getSPIdx(level);
-//    std::vector<cv::Mat> sp_fea = getSPFea(idx_set, max_pool);
+    IDXSET tmp;
+    tmp.push_back(sp_idx);
+    std::vector<cv::Mat> tmp_fea = getSPFea(tmp, max_pool); 
+    if( tmp_fea.empty() == true )
+        return -1;
+    
+    sp_fea = tmp_fea[0];
+    cv::Mat svm_fea = projection == NULL ? sp_fea : projection->project(sp_fea);
+    if( svm_fea.cols != cur_model->nr_feature - 1)
+    {
+        SP_LOG_ERROR("sp_fea[j].cols != cur_model->nr_feature - 1");
+        exit(0);
+    }
     
+    sparseVec sparse_fea;
+    CvMatToFeatureNode(svm_fea, sparse_fea);
     feature_node bias_term;
     bias_term.index = cur_model->nr_feature;
     bias_term.value = cur_model->bias;
     feature_node end_node;
     end_node.index = -1;
     end_node.value = 0;
+    sparse_fea.push_back(bias_term);
+    sparse_fea.push_back(end_node);
+    
+    std::vector<double> dec_values(model_num);
+    double tmp_label = predict_values(cur_model, &sparse_fea[0], &dec_values[0]);
+    int cur_label = floor(tmp_label+0.0001-1);
+    score = model_num <= 2 ? fabs(dec_values[0]) : dec_values[cur_label-1];
+    return cur_label;
+}
+
+int spPooler::predictSP(const QuantizedSVM *cur_model, const std::vector<int> &sp_idx, bool max_pool, const FeatureProjection *projection, 
+    cv::Mat &sp_fea, float &score)
+{
+    int model_num = cur_model->getNumClass();
+    IDXSET tmp;
+    tmp.push_back(sp_idx);
+    std::vector<cv::Mat> tmp_fea = getSPFea(tmp, max_pool); 
+    if( tmp_fea.empty() == true )
+        return -1;
+    
+    sp_fea = tmp_fea[0];
+    cv::Mat svm_fea = projection == NULL ? sp_fea : projection->project(sp_fea);
+    if( svm_fea.cols != cur_model->getNumFeature() )
+    {
+        SP_LOG_ERROR("sp_fea[j].cols != cur_model->getNumFeature()");
+        exit(0);
+    }
     
-    std::vector<cv::Mat> hard_negative_vec;
+    // the pooled row is scored directly, no feature_node conversion
+    std::vector<double> dec_values(model_num);
+    double tmp_label = cur_model->predictValues(svm_fea, &dec_values[0]);
+    int cur_label = floor(tmp_label+0.0001-1);
+    score = model_num <= 2 ? fabs(dec_values[0]) : dec_values[cur_label-1];
+    return cur_label;
+}
+
+void spPooler::predictLevel(const model *cur_model, int level, std::vector<int> &labels, std::vector<float> &scores, bool max_pool, 
+    const FeatureProjection *projection)
+{
+    SP_PROFILE_SCOPE("spPooler/predictLevel");
+    IDXSET idx_set = ext_sp.getSPIdx(level);
+    int num = idx_set.size();
+    SP_PROFILE_COUNT("superpixels/classified", num);
+    labels.assign(num, -1);
+    scores.assign(num, -1000.0);
+    
+    // superpixels are pooled and classified independently, getSPFea only reads the raw pooled features
+    TaskScheduler::instance().parallelFor(TASK_CLASSIFY, 0, num, 8, [&](int j) {
+        cv::Mat sp_fea;
+        labels[j] = predictSP(cur_model, idx_set[j], max_pool, projection, sp_fea, scores[j]);
+    });
+}
+
+void spPooler::predictLevel(const QuantizedSVM *cur_model, int level, std::vector<int> &labels, std::vector<float> &scores, bool max_pool, 
+    const FeatureProjection *projection)
+{
+    SP_PROFILE_SCOPE("spPooler/predictLevel");
+    IDXSET idx_set = ext_sp.getSPIdx(level);
+    int num = idx_set.size();
+    SP_PROFILE_COUNT("superpixels/classified", num);
+    labels.assign(num, -1);
+    scores.assign(num, -1000.0);
+    
+    TaskScheduler::instance().parallelFor(TASK_CLASSIFY, 0, num, 8, [&](int j) {
+        cv::Mat sp_fea;
+        labels[j] = predictSP(cur_model, idx_set[j], max_pool, projection, sp_fea, scores[j]);
+    });
+}
+
+std::vector<cv::Mat> spPooler::gethardNegtive(const model *cur_model, int level, bool max_pool)
+{
+    std::vector<float> scores;
+    return gethardNegtive(cur_model, level, scores, max_pool);
+}
+
+std::vector<cv::Mat> spPooler::gethardNegtive(const model *cur_model, int level, std::vector<float> &scores, bool max_pool, 
+    const FeatureProjection *projection)
+{
+    IDXSET idx_set = ext_sp.getSPIdx(level);
     int num = idx_set.size();
+    
+    std::vector<cv::Mat> sp_fea(num);
+    std::vector<float> sp_score(num, -1000.0);
+    std::vector<int> sp_label(num, -1);
+    TaskScheduler::instance().parallelFor(TASK_CLASSIFY, 0, num, 8, [&](int j) {
+        sp_label[j] = predictSP(cur_model, idx_set[j], max_pool, projection, sp_fea[j], sp_score[j]);
+    });
+    
+    // any superpixel classified as foreground in the background data is a hard negative
+    std::vector<cv::Mat> hard_negative_vec;
+    scores.clear();
     for( int j = 0 ; j < num ; j++ )
     {
-        IDXSET tmp;
-        tmp.push_back(idx_set[j]);
-        std::vector<cv::Mat> tmp_fea = getSPFea(tmp, max_pool); 
-        if( tmp_fea.empty() == true )
-            continue;
-        
-        if( tmp_fea[0].cols != cur_model->nr_feature - 1)
+        // predictSP returns the liblinear label - 1, multi-class labels are compared as predicted here
+        int cur_label = sp_label[j];
+        if( cur_label >= 0 && cur_model->nr_class > 2 )
+            cur_label++;
+        if( cur_label >= 1 )
         {
-            std::cerr << "sp_fea[j].cols != cur_model->nr_feature - 1" << std::endl;
-            exit(0);
+            hard_negative_vec.push_back(sp_fea[j]);
+            scores.push_back(sp_score[j]);
         }
-        sparseVec sparse_fea;
-        CvMatToFeatureNode(tmp_fea[0], sparse_fea);
-        sparse_fea.push_back(bias_term);
-        sparse_fea.push_back(end_node);
-        
-        feature_node *cur_fea = new feature_node[sparse_fea.size()];
-        std::copy(sparse_fea.begin(), sparse_fea.end(), cur_fea);
-        
-        double *dec_values = new double[cur_model->nr_class];
-        double tmp_label = predict_values(cur_model, cur_fea, dec_values);
-        int cur_label = model_num <= 2 ? floor(tmp_label+0.0001-1) : floor(tmp_label+0.0001);
-//        float cur_score = model_num <= 2 ? fabs(dec_values[0]) : dec_values[cur_label-1];
-        
-        if( cur_label >= 1 )
-            hard_negative_vec.push_back(tmp_fea[0]);
-        
-        delete[] cur_fea;
-        delete[] dec_values;
     }
 //    std::cerr << "Hard Num: " << hard_negative_vec.size() << std::endl;
     
     return hard_negative_vec;
 }
 
-void spPooler::InputSemantics(const model *cur_model, int level, bool reset, bool max_pool)
+void spPooler::InputSemantics(const model *cur_model, int level, bool reset, bool max_pool, const FeatureProjection *projection)
+{
+    std::vector<int> sp_label;
+    std::vector<float> sp_score;
+    predictLevel(cur_model, level, sp_label, sp_score, max_pool, projection);
+    accumulateSemantics(cur_model->nr_class, level, reset, sp_label, sp_score);
+}
+
+void spPooler::InputSemantics(const QuantizedSVM *cur_model, int level, bool reset, bool max_pool, const FeatureProjection *projection)
+{
+    std::vector<int> sp_label;
+    std::vector<float> sp_score;
+    predictLevel(cur_model, level, sp_label, sp_score, max_pool, projection);
+    accumulateSemantics(cur_model->getNumClass(), level, reset, sp_label, sp_score);
+}
+
+void spPooler::accumulateSemantics(int model_num, int level, bool reset, const std::vector<int> &sp_label, const std::vector<float> &sp_score)
 {
-    int model_num = cur_model->nr_class;
     if( class_responses.empty() == true )
     {
-        std::cerr << "class_responses.empty() == true" << std::endl;
+        SP_LOG_ERROR("class_responses.empty() == true");
         exit(0);
     }
     if( class_responses[0].empty() == true || reset )
@@ -750,42 +862,13 @@ void spPooler::InputSemantics(const model *cur_model, int level, bool reset, boo
     }
     
     IDXSET idx_set = ext_sp.getSPIdx(level);
-//    std::vector<cv::Mat> sp_fea = getSPFea(idx_set, max_pool);
-    
-    feature_node bias_term;
-    bias_term.index = cur_model->nr_feature;
-    bias_term.value = cur_model->bias;
-    feature_node end_node;
-    end_node.index = -1;
-    end_node.value = 0;
-    
-//    int num = sp_fea.size();
     int num = idx_set.size();
     for( int j = 0 ; j < num ; j++ )
     {
-        IDXSET tmp;
-        tmp.push_back(idx_set[j]);
-        std::vector<cv::Mat> tmp_fea = getSPFea(tmp, max_pool); 
-        if( tmp_fea.empty() == true )
+        if( sp_label[j] < 0 )
             continue;
-        
-        if( tmp_fea[0].cols != cur_model->nr_feature - 1)
-        {
-            std::cerr << "sp_fea[j].cols != cur_model->nr_feature - 1" << std::endl;
-            exit(0);
-        }
-        sparseVec sparse_fea;
-        CvMatToFeatureNode(tmp_fea[0], sparse_fea);
-        sparse_fea.push_back(bias_term);
-        sparse_fea.push_back(end_node);
-        
-        feature_node *cur_fea = new feature_node[sparse_fea.size()];
-        std::copy(sparse_fea.begin(), sparse_fea.end(), cur_fea);
-        
-        double *dec_values = new double[cur_model->nr_class];
-        double tmp_label = predict_values(cur_model, cur_fea, dec_values);
-        int cur_label = model_num <= 2 ? floor(tmp_label+0.0001-1) : floor(tmp_label+0.0001-1);
-        float cur_score = model_num <= 2 ? fabs(dec_values[0]) : dec_values[cur_label-1];
+        int cur_label = sp_label[j];
+        float cur_score = sp_score[j];
         
         for( std::vector<int>::iterator it = idx_set[j].begin() ; it < idx_set[j].end() ; it++ ){
             if( class_responses[*it][cur_label] < cur_score )
@@ -798,8 +881,6 @@ void spPooler::InputSemantics(const model *cur_model, int level, bool reset, boo
                 }
             }
         }
-        delete[] cur_fea;
-        delete[] dec_values;
     }
     
 }
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <set>
+
 #include "sp_segmenter/sp_compact.h"
 
 feaExtractor::feaExtractor(const std::string &shot_path, const std::string &sift_path, const std::string &fpfh_path) : radius_(0.02), 
@@ -163,6 +166,88 @@ int feaExtractor::computeFeature(std::string in_path, std::vector< std::vector<s
     return train_dim;
 }
 
+// keeps the weakest hard negative at the front of the heap
+static bool scoredFeaGreater(const ScoredFea &a, const ScoredFea &b)
+{
+    return a.score > b.score;
+}
+
+// a row as saveCvMatSparse stores it, float values without the near zero ones
+static std::vector< std::pair<int, float> > storedRow(const sparseVec &fea)
+{
+    std::vector< std::pair<int, float> > row;
+    for( sparseVec::const_iterator it = fea.begin() ; it < fea.end() ; it++ )
+        if( it->index >= 0 && fabs(it->value) >= 1e-6 )
+            row.push_back(std::pair<int, float>(it->index, (float)it->value));
+    return row;
+}
+
+int feaExtractor::computeHardNegative(std::string in_path, const std::vector<model*> &binary_models, const std::vector<FeatureProjection> &projections, 
+    std::vector< std::vector<ScoredFea> > &hard_fea, std::size_t max_num)
+{
+    std::vector<std::string> file_names = readData(in_path);
+    int train_num = file_names.size();
+    int train_dim = -1;
+    int max_level = std::min<int>(order_, binary_models.size() - 1);
+    
+    if( hard_fea.size() < binary_models.size() )
+        hard_fea.resize(binary_models.size());
+    // the models are loaded once and only read by predict_values, so the scenes can be scored in parallel
+    #pragma omp parallel for schedule(dynamic, 1)
+    for( int j = 0 ; j < train_num ; j++ )
+    {
+        pcl::PointCloud<PointT>::Ptr full_cloud(new pcl::PointCloud<PointT>());
+        pcl::io::loadPCDFile(file_names[j], *full_cloud);
+        if( full_cloud->size() <= 30 )
+            continue;
+        std::cerr << "Mining (" << j + 1 << "/" << train_num <<")\n";
+        
+        spPooler triple_pooler;
+        if (use_sift_) triple_pooler.init(full_cloud, *hie_producer, radius_, down_ss_);
+        else triple_pooler.lightInit(full_cloud, *hie_producer, radius_, down_ss_);
+        
+        if (use_shot_) triple_pooler.build_SP_LAB(lab_pooler_set, false);
+        if (use_fpfh_) triple_pooler.build_SP_FPFH(fpfh_pooler_set, radius_, false);
+        if (use_sift_) triple_pooler.build_SP_SIFT(sift_pooler_set, *hie_producer, sift_det_vec, false);
+        
+        for( int ll = 0 ; ll <= max_level ; ll++ )
+        {
+            if( binary_models[ll] == NULL )
+                continue;
+            std::vector<float> scores;
+            const FeatureProjection *projection = ll < projections.size() && projections[ll].empty() == false ? &projections[ll] : NULL;
+            // the mined features are kept before projection, like the rest of the training features
+            std::vector<cv::Mat> sp_fea = triple_pooler.gethardNegtive(binary_models[ll], ll, scores, false, projection);
+            for( size_t k = 0 ; k < sp_fea.size() ; k++ )
+            {
+                ScoredFea cur;
+                cur.score = scores[k];
+                std::vector< sparseVec> this_sparse;
+                sparseCvMat(sp_fea[k], this_sparse);
+                cur.fea = this_sparse[0];
+                #pragma omp critical
+                {
+                    train_dim = sp_fea[k].cols;
+                    std::vector<ScoredFea> &heap = hard_fea[ll];
+                    if( heap.size() < max_num )
+                    {
+                        heap.push_back(cur);
+                        std::push_heap(heap.begin(), heap.end(), scoredFeaGreater);
+                    }
+                    else if( max_num > 0 && heap.front().score < cur.score )
+                    {
+                        std::pop_heap(heap.begin(), heap.end(), scoredFeaGreater);
+                        heap.back() = cur;
+                        std::push_heap(heap.begin(), heap.end(), scoredFeaGreater);
+                    }
+                }
+            }
+        }
+    }
+    
+    return train_dim;
+}
+
 bool SpCompact::setInputPathSIFT(const std::string &directory_path)
 {
     bool success = checkFolderExist(directory_path);
@@ -248,6 +333,22 @@ void SpCompact::setCurOrderMax(unsigned int cur_order)
     cur_order_max_ = cur_order;
 }
 
+void SpCompact::setHardNegativeNumber(const unsigned int number_of_hard_negative)
+{
+    hard_negative_num_ = number_of_hard_negative;
+}
+
+void SpCompact::setProjection(const std::string &projection_type, const unsigned int projection_dim)
+{
+    if( projection_type != "none" && projection_type != "pca" && projection_type != "random" )
+    {
+        std::cerr << "Unknown projection type " << projection_type << ", use none, pca or random" << std::endl;
+        return;
+    }
+    projection_type_ = projection_type;
+    projection_dim_ = projection_dim;
+}
+
 void SpCompact::setSkipFeaExtraction(const bool &flag)
 {
     skip_fea_ = flag;
@@ -284,43 +385,128 @@ void SpCompact::startTrainingSVM()
     std::cerr<<std::endl<<"Training complete"<<std::endl;
 }
 
-
-void SpCompact::extractFea()
+void SpCompact::startHardNegativeMining()
 {
-    feaExtractor object_ext(shot_directory_, sift_directory_, fpfh_directory_);
+    std::vector<model*> binary_models(cur_order_max_, NULL);
+    std::vector<FeatureProjection> projections(cur_order_max_);
+    bool has_model = false;
+    for( int ll = 0 ; ll < cur_order_max_ ; ll++ )
+    {
+        std::stringstream mm;
+        mm << ll;
+        std::string model_name = svm_out_directory_ + "/binary_L" + mm.str() + "_f.model";
+        if( exists_test(model_name) == false )
+            continue;
+        binary_models[ll] = load_model(model_name.c_str());
+        has_model = has_model || binary_models[ll] != NULL;
+        std::string proj_name = svm_out_directory_ + "/binary_L" + mm.str() + "_f.proj";
+        if( exists_test(proj_name) == true )
+            projections[ll].load(proj_name);
+    }
+    if( has_model == false )
+    {
+        std::cerr << "No binary model in " << svm_out_directory_ << ", train the svm before mining hard negatives" << std::endl;
+        return;
+    }
+    
     feaExtractor background_ext(shot_directory_, sift_directory_, fpfh_directory_);
+    setupExtractor(background_ext);
     
-    object_ext.setFeaOrder(cur_order_max_ - 1);
-    background_ext.setFeaOrder(cur_order_max_ - 1);
-
-    object_ext.setUseSHOT(use_shot_);
-    object_ext.setUseFPFH(use_fpfh_);
-    object_ext.setUseSIFT(use_sift_);
-
-    background_ext.setUseSHOT(use_shot_);
-    background_ext.setUseFPFH(use_fpfh_);
-    background_ext.setUseSIFT(use_sift_);
-
-    for( size_t i = 0 ; i < object_names_.size() ; i++ )
+    std::vector< std::vector<ScoredFea> > hard_fea;
+    int bg_dim = -1;
+    for( size_t i = 0 ; i < background_names_.size() ; ++i )
     {
-        std::stringstream ss;
-        ss << i+1;
-        
-        std::vector< std::vector<sparseVec> > final_fea;
-        std::cerr << "Processing object: " << trainining_directory_+"/"+object_names_[i]+"/" << endl;
-        int train_dim = object_ext.computeFeature(trainining_directory_+"/"+object_names_[i]+"/", final_fea, foreground_sample_num_);
-        
-        for( size_t ll = 0 ; ll < final_fea.size(); ++ll )
+        std::cerr << "Mining background: " << trainining_directory_+"/"+background_names_[i]+"/" << endl;
+        int cur_dim = background_ext.computeHardNegative(trainining_directory_+"/"+background_names_[i]+"/", binary_models, projections, hard_fea, hard_negative_num_);
+        if( cur_dim > 0 )
+            bg_dim = cur_dim;
+    }
+    
+    for( size_t ll = 0 ; ll < hard_fea.size() ; ll++ )
+    {
+        if( hard_fea[ll].empty() == true )
+            continue;
+        std::stringstream mm;
+        mm << ll;
+        // hard negatives join the background class index 0
+        std::string train_name = fea_out_directory_ + "/train_0_L" + mm.str() + ".smat";
+        std::vector<sparseVec> bg_fea;
+        if( exists_test(train_name) == true )
         {
-            if( final_fea[ll].empty() == true )
+            std::vector< std::pair<int, int> > piece_inds;
+            readSoluSparse_piecewise(train_name, bg_fea, piece_inds);
+            // the smat reader returns svm indices starting from 1
+            for( size_t i = 0 ; i < bg_fea.size() ; i++ )
+                for( sparseVec::iterator it = bg_fea[i].begin() ; it < bg_fea[i].end() ; it++ )
+                    it->index--;
+        }
+        // mining again finds the same negatives, keep one copy of each row
+        std::set< std::vector< std::pair<int, float> > > stored_rows;
+        for( size_t i = 0 ; i < bg_fea.size() ; i++ )
+            stored_rows.insert(storedRow(bg_fea[i]));
+        size_t added = 0;
+        for( std::vector<ScoredFea>::iterator it = hard_fea[ll].begin() ; it < hard_fea[ll].end() ; it++ )
+        {
+            if( stored_rows.insert(storedRow(it->fea)).second == false )
                 continue;
-            std::stringstream mm;
-
-            mm << ll;
-            saveCvMatSparse(fea_out_directory_ + "/train_" + ss.str() + "_L" + mm.str() + ".smat", final_fea[ll], train_dim);
-            final_fea[ll].clear();
+            bg_fea.push_back(it->fea);
+            added++;
         }
+        saveCvMatSparse(train_name, bg_fea, bg_dim);
+        std::cerr << "Added " << added << " of " << hard_fea[ll].size() << " hard negatives to " << train_name << std::endl;
+        hard_fea[ll].clear();
+    }
+    
+    for( size_t ll = 0 ; ll < binary_models.size() ; ll++ )
+        if( binary_models[ll] != NULL )
+            free_and_destroy_model(&binary_models[ll]);
+    std::cerr << "Hard Negative Mining Done!" << std::endl;
+    
+    if (!skip_background_)
+    {
+        this->doSVM(true);
+    }
+}
+
+void SpCompact::setupExtractor(feaExtractor &ext) const
+{
+    ext.setFeaOrder(cur_order_max_ - 1);
+    ext.setUseSHOT(use_shot_);
+    ext.setUseFPFH(use_fpfh_);
+    ext.setUseSIFT(use_sift_);
+}
+
+void SpCompact::extractObjectFea(feaExtractor &object_ext, const std::size_t &object_idx)
+{
+    std::stringstream ss;
+    ss << object_idx+1;
+    
+    std::vector< std::vector<sparseVec> > final_fea;
+    std::cerr << "Processing object: " << trainining_directory_+"/"+object_names_[object_idx]+"/" << endl;
+    int train_dim = object_ext.computeFeature(trainining_directory_+"/"+object_names_[object_idx]+"/", final_fea, foreground_sample_num_);
+    
+    for( size_t ll = 0 ; ll < final_fea.size(); ++ll )
+    {
+        if( final_fea[ll].empty() == true )
+            continue;
+        std::stringstream mm;
+
+        mm << ll;
+        saveCvMatSparse(fea_out_directory_ + "/train_" + ss.str() + "_L" + mm.str() + ".smat", final_fea[ll], train_dim);
+        final_fea[ll].clear();
     }
+}
+
+void SpCompact::extractFea()
+{
+    feaExtractor object_ext(shot_directory_, sift_directory_, fpfh_directory_);
+    feaExtractor background_ext(shot_directory_, sift_directory_, fpfh_directory_);
+    
+    setupExtractor(object_ext);
+    setupExtractor(background_ext);
+
+    for( size_t i = 0 ; i < object_names_.size() ; i++ )
+        extractObjectFea(object_ext, i);
     std::cerr << "Object Feature Extraction Done!" << std::endl;
     
     // extracting features for background class
@@ -345,56 +531,416 @@ void SpCompact::extractFea()
     std::cerr << "Background Feature Extraction Done!" << std::endl;
 }
 
+bool SpCompact::loadTrainingProblem(const int &level, const bool &is_background_svm, problem &train_prob) const
+{
+    std::vector< std::pair<int, int> > piece_inds;
+    std::stringstream mm;
+    mm << level;
+    std::vector<problem> train_prob_set;
+    // looping over all classes including background classes
+    for( size_t i = is_background_svm ? 0 : 1 ; i <= object_names_.size()  ; ++i )
+    {
+        std::stringstream ss;
+        ss << i;
+        
+        std::string train_name = fea_out_directory_ + "train_"+ss.str()+"_L"+mm.str()+".smat";
+        if( exists_test(train_name) == false )
+            continue;
+        
+        std::cerr << "Reading: " << train_name << std::endl;
+        std::vector<SparseDataOneClass> cur_data(1);
+        
+        int fea_dim = readSoluSparse_piecewise(train_name, cur_data[0].fea_vec, piece_inds);
+        if (is_background_svm)
+            cur_data[0].label = i > 0 ? 2 : 1; 
+        else
+            cur_data[0].label = i + 1; // label below 1 = background, so object label must be > 1
+        problem tmp;
+        FormFeaSparseMat(cur_data, tmp, cur_data[0].fea_vec.size(), fea_dim);
+        train_prob_set.push_back(tmp);
+    }
+    train_prob.l = 0;
+    mergeProbs(train_prob_set, train_prob);
+    for( size_t i = 0 ; i < train_prob_set.size() ; i++ )
+    {
+        // the feature nodes are now owned by train_prob, mergeProbs already released the labels
+        delete[] train_prob_set[i].x;
+    }
+    return train_prob.l > 0;
+}
+
+void SpCompact::freeTrainingProblem(problem &train_prob) const
+{
+    for( int i = 0 ; i < train_prob.l ; i++ )
+        delete[] train_prob.x[i];
+    delete[] train_prob.x;
+    delete[] train_prob.y;
+    train_prob.l = 0;
+}
+
 void SpCompact::doSVM(const bool &is_background_svm)
 {
      // weight of incorrectly classified examples (false positive cost)
      // CC = [1, 0.1, 0.01, 0.001, 0.0001]
     float CC = is_background_svm ? binary_cc_ : multi_cc_;
-    std::vector< std::pair<int, int> > piece_inds;
     for( int ll = 0 ; ll < cur_order_max_ ; ll++ )
     {
         std::stringstream mm;
         mm << ll;
-        std::vector<problem> train_prob_set;
-        // looping over all classes including background classes
-        for( size_t i = is_background_svm ? 0 : 1 ; i <= object_names_.size()  ; ++i )
+        problem train_prob;
+        if( loadTrainingProblem(ll, is_background_svm, train_prob) == false )
+            continue;
+        std::string svm_type = is_background_svm ? "binary_L" : "multi_L";
+
+        std::string proj_name = svm_out_directory_ + "/" + svm_type + mm.str() + "_f.proj";
+        FeatureProjection projection;
+        if( trainProjection(train_prob, projection) == true )
         {
-            std::stringstream ss;
-            ss << i;
-            
-            std::string train_name = fea_out_directory_ + "train_"+ss.str()+"_L"+mm.str()+".smat";
-            if( exists_test(train_name) == false )
-                continue;
-            
-            std::cerr << "Reading: " << train_name << std::endl;
-            std::vector<SparseDataOneClass> cur_data(1);
-            
-            int fea_dim = readSoluSparse_piecewise(train_name, cur_data[0].fea_vec, piece_inds);
-            if (is_background_svm)
-                cur_data[0].label = i > 0 ? 2 : 1; 
-            else
-                cur_data[0].label = i + 1; // label below 1 = background, so object label must be > 1
-            problem tmp;
-            FormFeaSparseMat(cur_data, tmp, cur_data[0].fea_vec.size(), fea_dim);
-            train_prob_set.push_back(tmp);
+            projectTrainingProblem(projection, train_prob);
+            projection.save(proj_name);
+            std::cerr << "Saved: " << proj_name << std::endl;
         }
-        problem train_prob;
-        train_prob.l = 0;
-        mergeProbs(train_prob_set, train_prob);
+        else if( exists_test(proj_name) == true )
+            boost::filesystem::remove(proj_name); // it would not match the new model
 
         parameter param;
         GenSVMParamter(param, CC);
         std::cerr<<std::endl<<"Starting Liblinear Training..."<<std::endl;
 
         model* cur_model = train(&train_prob, &param);
-        std::string svm_type = is_background_svm ? "binary_L" : "multi_L";
 
         save_model((svm_out_directory_ +"/" + svm_type+mm.str()+"_f.model").c_str(), cur_model);
         std::cerr << "Saved: " << svm_out_directory_ << "/" << svm_type+mm.str() << "_f.model" << std::endl;
+        free_and_destroy_model(&cur_model);
         destroy_param(&param);
-        free(train_prob.y);
+        freeTrainingProblem(train_prob);
+    }
+}
+
+/**************************************** Incremental Training ****************************************/
+
+// weights of old_model oriented so that a positive decision value means class_label, NULL if the class is unknown
+static double *getOneVsRestWeights(const model *old_model, const int &class_label, const int &w_size)
+{
+    if( old_model == NULL || old_model->nr_feature != w_size )
+        return NULL;
+    int nr_w = old_model->nr_class == 2 ? 1 : old_model->nr_class;
+    for( int i = 0 ; i < old_model->nr_class ; i++ )
+    {
+        if( old_model->label[i] != class_label )
+            continue;
+        double *w = (double*)malloc(sizeof(double) * w_size);
+        // binary models only store the weights of label[0]
+        double sign = (nr_w == 1 && i == 1) ? -1.0 : 1.0;
+        int col = nr_w == 1 ? 0 : i;
+        for( int j = 0 ; j < w_size ; j++ )
+            w[j] = sign * old_model->w[j*nr_w+col];
+        return w;
+    }
+    return NULL;
+}
+
+// class_label against all other samples in train_prob. init_w is taken over by liblinear
+static double *trainOneVsRest(const problem &train_prob, const int &class_label, double *init_w, const double &CC, const double &eps)
+{
+    problem sub_prob = train_prob;
+    sub_prob.y = new double[train_prob.l];
+    for( int i = 0 ; i < train_prob.l ; i++ )
+        sub_prob.y[i] = train_prob.y[i] == class_label ? 1 : -1;
+
+    parameter param;
+    GenSVMParamter(param, CC);
+    // warm-start is only supported by the primal solvers, L2R_L2LOSS_SVC has the same objective as the default dual solver
+    param.solver_type = L2R_L2LOSS_SVC;
+    param.eps = eps;
+    param.init_sol = init_w;
+
+    // liblinear keeps +1 as the positive class for -1/+1 labelled problems
+    model *cur_model = train(&sub_prob, &param);
+    double *w = (double*)malloc(sizeof(double) * train_prob.n);
+    double sign = cur_model->label[0] == 1 ? 1.0 : -1.0;
+    for( int j = 0 ; j < train_prob.n ; j++ )
+        w[j] = sign * cur_model->w[j];
+
+    free_and_destroy_model(&cur_model);
+    destroy_param(&param);
+    delete[] sub_prob.y;
+    return w;
+}
+
+void SpCompact::startIncrementalTrainingSVM(const std::string &base_svm_directory)
+{
+    if( object_names_.empty() == true || checkFolderExist(base_svm_directory) == false )
+    {
+        std::cerr << "Incremental training needs at least one object and an existing svm directory" << std::endl;
+        return;
+    }
+    if (!skip_fea_)
+    {
+        feaExtractor object_ext(shot_directory_, sift_directory_, fpfh_directory_);
+        setupExtractor(object_ext);
+        extractObjectFea(object_ext, object_names_.size() - 1);
+        std::cerr << "New Object Feature Extraction Done!" << std::endl;
+    }
+
+    if (!skip_background_)
+    {
+        this->doIncrementalSVM(true, base_svm_directory);
+    }
+
+    if (!skip_multi_ && object_names_.size() > 1)
+    {
+        this->doIncrementalSVM(false, base_svm_directory);
+    }
+
+    std::cerr<<std::endl<<"Incremental training complete"<<std::endl;
+}
+
+void SpCompact::doIncrementalSVM(const bool &is_background_svm, const std::string &base_svm_directory)
+{
+    float CC = is_background_svm ? binary_cc_ : multi_cc_;
+    const double full_eps = 0.01;
+    std::string svm_type = is_background_svm ? "binary_L" : "multi_L";
+    // label of the new class, see loadTrainingProblem
+    int new_label = is_background_svm ? 2 : object_names_.size() + 1;
+    for( int ll = 0 ; ll < cur_order_max_ ; ll++ )
+    {
+        std::stringstream mm;
+        mm << ll;
+        problem train_prob;
+        if( loadTrainingProblem(ll, is_background_svm, train_prob) == false )
+            continue;
+
+        // the base models may have been trained on projected features, keep their projection
+        FeatureProjection projection;
+        std::string base_proj_name = base_svm_directory + "/" + svm_type + mm.str() + "_f.proj";
+        std::string proj_name = svm_out_directory_ + "/" + svm_type + mm.str() + "_f.proj";
+        if( exists_test(base_proj_name) == true && projection.load(base_proj_name) == true )
+        {
+            projectTrainingProblem(projection, train_prob);
+            projection.save(proj_name);
+        }
+        else if( exists_test(proj_name) == true )
+            boost::filesystem::remove(proj_name);
+
+        std::string old_model_name = base_svm_directory + "/" + svm_type + mm.str() + "_f.model";
+        model *old_model = load_model(old_model_name.c_str());
+        if( old_model == NULL )
+            std::cerr << "No base model " << old_model_name << ", training all classes from scratch" << std::endl;
+
+        // class labels in the order of their first appearance, as liblinear does
+        std::vector<int> labels;
         for( int i = 0 ; i < train_prob.l ; i++ )
-            free(train_prob.x[i]);
-        free(train_prob.x);
+            if( std::find(labels.begin(), labels.end(), (int)train_prob.y[i]) == labels.end() )
+                labels.push_back(train_prob.y[i]);
+        if( labels.size() < 2 )
+        {
+            std::cerr << "Only one class in " << svm_type << mm.str() << ", skipped" << std::endl;
+            if( old_model != NULL )
+                free_and_destroy_model(&old_model);
+            freeTrainingProblem(train_prob);
+            continue;
+        }
+
+        int w_size = train_prob.n;
+        int nr_class = labels.size();
+        int nr_w = nr_class == 2 ? 1 : nr_class;
+        model *new_model = (model*)malloc(sizeof(model));
+        GenSVMParamter(new_model->param, CC);
+        new_model->param.solver_type = L2R_L2LOSS_SVC;
+        new_model->nr_class = nr_class;
+        new_model->nr_feature = train_prob.bias >= 0 ? w_size - 1 : w_size;
+        new_model->bias = train_prob.bias;
+        new_model->label = (int*)malloc(sizeof(int) * nr_class);
+        new_model->w = (double*)malloc(sizeof(double) * w_size * nr_w);
+        std::copy(labels.begin(), labels.end(), new_model->label);
+
+        for( int i = 0 ; i < nr_w ; i++ )
+        {
+            double *init_w = getOneVsRestWeights(old_model, labels[i], w_size);
+            // the binary foreground class always exists in the base model, but its data changed
+            bool fine_tune = init_w != NULL && (labels[i] != new_label || is_background_svm);
+            std::cerr << (fine_tune ? "Fine-tuning " : "Training ") << svm_type << mm.str() << " class " << labels[i] << std::endl;
+
+            double *w = trainOneVsRest(train_prob, labels[i], init_w, CC, fine_tune ? fine_tune_eps_ : full_eps);
+            for( int j = 0 ; j < w_size ; j++ )
+                new_model->w[j*nr_w+i] = w[j];
+            free(w);
+        }
+
+        save_model((svm_out_directory_ +"/" + svm_type+mm.str()+"_f.model").c_str(), new_model);
+        std::cerr << "Saved: " << svm_out_directory_ << "/" << svm_type+mm.str() << "_f.model" << std::endl;
+        free_and_destroy_model(&new_model);
+        if( old_model != NULL )
+            free_and_destroy_model(&old_model);
+        freeTrainingProblem(train_prob);
+    }
+}
+
+/**************************************** Quantized Models ****************************************/
+
+// back to the dense row spPooler produces, the constant bias node is left out
+static cv::Mat problemRowToMat(const feature_node *x, const int &fea_dim)
+{
+    cv::Mat fea = cv::Mat::zeros(1, fea_dim, CV_32FC1);
+    for( const feature_node *it = x ; it->index != -1 ; it++ )
+        if( it->index <= fea_dim )
+            fea.at<float>(0, it->index-1) = it->value;
+    return fea;
+}
+
+void SpCompact::calibrateQuantizedSVM(const int &bits)
+{
+    if( bits != 8 && bits != 16 )
+    {
+        std::cerr << "Quantized SVM bits must be 8 or 16" << std::endl;
+        return;
+    }
+    if (!skip_background_)
+    {
+        this->doQuantizeSVM(true, bits);
+    }
+    if (!skip_multi_ && object_names_.size() > 1)
+    {
+        this->doQuantizeSVM(false, bits);
+    }
+    std::cerr<<std::endl<<"Quantization complete"<<std::endl;
+}
+
+void SpCompact::doQuantizeSVM(const bool &is_background_svm, const int &bits)
+{
+    std::string svm_type = is_background_svm ? "binary_L" : "multi_L";
+    for( int ll = 0 ; ll < cur_order_max_ ; ll++ )
+    {
+        std::stringstream mm;
+        mm << ll;
+        std::string model_name = svm_out_directory_ + "/" + svm_type + mm.str() + "_f.model";
+        if( exists_test(model_name) == false )
+            continue;
+        model *full_model = load_model(model_name.c_str());
+        QuantizedSVM quantized_model;
+        if( quantized_model.quantize(full_model, bits) == false )
+        {
+            std::cerr << "Failed to quantize " << model_name << std::endl;
+            if( full_model != NULL )
+                free_and_destroy_model(&full_model);
+            continue;
+        }
+
+        problem train_prob;
+        if( loadTrainingProblem(ll, is_background_svm, train_prob) == true )
+        {
+            FeatureProjection projection;
+            std::string proj_name = svm_out_directory_ + "/" + svm_type + mm.str() + "_f.proj";
+            if( exists_test(proj_name) == true && projection.load(proj_name) == true )
+                projectTrainingProblem(projection, train_prob);
+
+            int fea_dim = quantized_model.getNumFeature();
+            int nr_class = full_model->nr_class;
+            int nr_w = nr_class == 2 && full_model->param.solver_type != MCSVM_CS ? 1 : nr_class;
+            int full_correct = 0, quantized_correct = 0, agree = 0;
+            // largest error over the decision values of all classes, averaged and maxed over the samples
+            double dec_error = 0, max_dec_error = 0;
+            #pragma omp parallel for schedule(dynamic, 64) reduction(+:full_correct,quantized_correct,agree,dec_error) reduction(max:max_dec_error)
+            for( int i = 0 ; i < train_prob.l ; i++ )
+            {
+                cv::Mat fea = problemRowToMat(train_prob.x[i], fea_dim);
+
+                std::vector<double> full_dec(nr_class), quantized_dec(nr_class);
+                double full_label = predict_values(full_model, train_prob.x[i], &full_dec[0]);
+                double quantized_label = quantized_model.predictValues(fea, &quantized_dec[0]);
+                full_correct += full_label == train_prob.y[i];
+                quantized_correct += quantized_label == train_prob.y[i];
+                agree += full_label == quantized_label;
+                double cur_error = 0;
+                for( int k = 0 ; k < nr_w ; k++ )
+                    cur_error = std::max(cur_error, fabs(full_dec[k] - quantized_dec[k]));
+                dec_error += cur_error;
+                max_dec_error = std::max(max_dec_error, cur_error);
+            }
+            std::cerr << svm_type << mm.str() << " int" << bits << ": accuracy " << (full_correct+0.0) / train_prob.l 
+                << " -> " << (quantized_correct+0.0) / train_prob.l << ", agreement " << (agree+0.0) / train_prob.l 
+                << ", decision error mean " << dec_error / train_prob.l << " max " << max_dec_error << std::endl;
+            freeTrainingProblem(train_prob);
+        }
+        else
+            std::cerr << "No training features for " << svm_type << mm.str() << ", accuracy is not measured" << std::endl;
+
+        int nr_w = full_model->nr_class == 2 && full_model->param.solver_type != MCSVM_CS ? 1 : full_model->nr_class;
+        std::cerr << "Weights: " << sizeof(double) * nr_w * full_model->nr_feature << " bytes -> " 
+            << quantized_model.getWeightBytes() << " bytes" << std::endl;
+
+        std::string qmodel_name = svm_out_directory_ + "/" + svm_type + mm.str() + "_f.qmodel";
+        quantized_model.save(qmodel_name);
+        std::cerr << "Saved: " << qmodel_name << std::endl;
+        free_and_destroy_model(&full_model);
+    }
+}
+
+/**************************************** Feature Projection ****************************************/
+
+bool SpCompact::trainProjection(const problem &train_prob, FeatureProjection &projection) const
+{
+    int fea_dim = train_prob.n - 1;
+    if( projection_type_ == "none" || projection_dim_ == 0 || (int)projection_dim_ >= fea_dim )
+        return false;
+
+    std::cerr << "Training " << projection_type_ << " projection " << fea_dim << " -> " << projection_dim_ << std::endl;
+    if( projection_type_ == "random" )
+    {
+        projection.trainRandom(fea_dim, projection_dim_);
+        return true;
+    }
+
+    // PCA on a random subset keeps the sample covariance small for the wide pooled features
+    const int max_sample_num = 4000;
+    std::vector<int> sample_idx(train_prob.l);
+    for( int i = 0 ; i < train_prob.l ; i++ )
+        sample_idx[i] = i;
+    cv::RNG rng;
+    for( int i = train_prob.l - 1 ; i > 0 ; i-- )
+        std::swap(sample_idx[i], sample_idx[rng.uniform(0, i+1)]);
+    int sample_num = std::min(max_sample_num, train_prob.l);
+
+    cv::Mat data(sample_num, fea_dim, CV_32FC1);
+    for( int i = 0 ; i < sample_num ; i++ )
+        problemRowToMat(train_prob.x[sample_idx[i]], fea_dim).copyTo(data.row(i));
+    projection.trainPCA(data, projection_dim_);
+    return true;
+}
+
+void SpCompact::projectTrainingProblem(const FeatureProjection &projection, problem &train_prob) const
+{
+    int fea_dim = projection.getInputDim();
+    int out_dim = projection.getOutputDim();
+    if( train_prob.n - 1 != fea_dim )
+    {
+        std::cerr << "Projection input dimension " << fea_dim << " != feature dimension " << train_prob.n - 1 << std::endl;
+        exit(0);
+    }
+    feature_node bias_term;
+    bias_term.index = out_dim+1;
+    bias_term.value = train_prob.bias;
+    feature_node end_node;
+    end_node.index = -1;
+    end_node.value = 0;
+
+    #pragma omp parallel for schedule(dynamic, 64)
+    for( int i = 0 ; i < train_prob.l ; i++ )
+    {
+        cv::Mat fea = projection.project(problemRowToMat(train_prob.x[i], fea_dim));
+        std::vector<sparseVec> this_sparse;
+        sparseCvMat(fea, this_sparse);
+        sparseVec &cur_fea = this_sparse[0];
+        // sparseCvMat indices start from 0, liblinear from 1
+        for( sparseVec::iterator it = cur_fea.begin() ; it < cur_fea.end() ; it++ )
+            it->index++;
+        cur_fea.push_back(bias_term);
+        cur_fea.push_back(end_node);
+
+        delete[] train_prob.x[i];
+        train_prob.x[i] = new feature_node[cur_fea.size()];
+        std::copy(cur_fea.begin(), cur_fea.end(), train_prob.x[i]);
     }
+    train_prob.n = out_dim + 1;
 }
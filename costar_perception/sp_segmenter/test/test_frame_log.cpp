@@ -0,0 +1,262 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+#include "sp_segmenter/frame_log.h"
+
+namespace
+{
+    // written to the working directory of the test, ctest runs it in the build directory
+    const std::string LOG_PATH = "test_frame_log.splog";
+    const std::string CUT_PATH = "test_frame_log_cut.splog";
+
+    pcl::PointCloud<PointT>::Ptr makeCloud(const std::size_t &n, const float &offset)
+    {
+        pcl::PointCloud<PointT>::Ptr cloud(new pcl::PointCloud<PointT>());
+        for (std::size_t i = 0; i < n; i++)
+        {
+            PointT p;
+            p.x = offset + 0.001f * i;
+            p.y = offset - 0.002f * i;
+            p.z = 1.0f + 0.0005f * (i % 17);
+            p.rgba = 0xff000000u | (i * 2654435761u >> 8);
+            cloud->push_back(p);
+        }
+        return cloud;
+    }
+
+    LoggedFrame makeFrame(const uint64_t &sequence, const std::size_t &n)
+    {
+        LoggedFrame frame;
+        frame.sequence = sequence;
+        frame.stamp = 1000.25 + sequence;
+        frame.segmentation_time = 0.125;
+        frame.success = true;
+        frame.use_crop_box = true;
+        frame.crop_box_size = Eigen::Vector3f(1.0f, 0.5f, 0.25f);
+        frame.crop_box_pose = Eigen::Translation3f(0.1f, -0.2f, 0.3f) * Eigen::Quaternionf(Eigen::AngleAxisf(0.5f, Eigen::Vector3f::UnitZ()));
+        frame.objrecransac_mode = GREEDY_RECOGNIZE;
+        frame.use_preferred_orientation = true;
+        frame.preferred_orientation = Eigen::Quaterniond(Eigen::AngleAxisd(0.25, Eigen::Vector3d::UnitX()));
+
+        frame.cloud = makeCloud(n, 0.1f * sequence);
+        frame.labels.reset(new pcl::PointCloud<PointLT>());
+        for (std::size_t i = 0; i < n; i += 2)
+        {
+            PointLT p;
+            p.x = frame.cloud->points[i].x;
+            p.y = frame.cloud->points[i].y;
+            p.z = frame.cloud->points[i].z;
+            p.label = i % 3;
+            frame.labels->push_back(p);
+        }
+
+        objectTransformInformation pose;
+        pose.transform_name_ = "obj_link_0";
+        pose.model_name_ = "link_uniform";
+        pose.model_index_ = 2;
+        pose.origin_ = Eigen::Vector3f(0.4f, 0.5f, 0.6f);
+        pose.rotation_ = Eigen::Quaternionf(Eigen::AngleAxisf(1.0f, Eigen::Vector3f::UnitY()));
+        pose.confidence_ = 0.75;
+        frame.poses.push_back(pose);
+        pose.transform_name_ = "obj_node_0";
+        pose.model_name_ = "node_uniform";
+        pose.confidence_ = 0.5;
+        frame.poses.push_back(pose);
+        return frame;
+    }
+
+    template <typename PointType>
+    void expectSameCloud(const typename pcl::PointCloud<PointType>::Ptr &expected, const typename pcl::PointCloud<PointType>::Ptr &actual)
+    {
+        ASSERT_TRUE(bool(actual));
+        EXPECT_EQ(expected->width, actual->width);
+        EXPECT_EQ(expected->height, actual->height);
+        EXPECT_EQ(expected->is_dense, actual->is_dense);
+        ASSERT_EQ(expected->size(), actual->size());
+        for (std::size_t i = 0; i < expected->size(); i++)
+        {
+            EXPECT_EQ(expected->points[i].x, actual->points[i].x);
+            EXPECT_EQ(expected->points[i].y, actual->points[i].y);
+            EXPECT_EQ(expected->points[i].z, actual->points[i].z);
+        }
+    }
+
+    void expectSameFrame(const LoggedFrame &expected, const LoggedFrame &actual)
+    {
+        EXPECT_EQ(expected.sequence, actual.sequence);
+        EXPECT_EQ(expected.stamp, actual.stamp);
+        EXPECT_EQ(expected.segmentation_time, actual.segmentation_time);
+        EXPECT_EQ(expected.success, actual.success);
+        EXPECT_EQ(expected.use_crop_box, actual.use_crop_box);
+        EXPECT_TRUE(expected.crop_box_size.isApprox(actual.crop_box_size));
+        EXPECT_TRUE(expected.crop_box_pose.matrix().isApprox(actual.crop_box_pose.matrix(), 1e-5f));
+        EXPECT_EQ(expected.objrecransac_mode, actual.objrecransac_mode);
+        EXPECT_EQ(expected.use_preferred_orientation, actual.use_preferred_orientation);
+        EXPECT_TRUE(expected.preferred_orientation.isApprox(actual.preferred_orientation));
+
+        expectSameCloud<PointT>(expected.cloud, actual.cloud);
+        for (std::size_t i = 0; i < expected.cloud->size() && i < actual.cloud->size(); i++)
+            EXPECT_EQ(expected.cloud->points[i].rgba, actual.cloud->points[i].rgba);
+        if (expected.labels)
+        {
+            expectSameCloud<PointLT>(expected.labels, actual.labels);
+            for (std::size_t i = 0; i < expected.labels->size() && i < actual.labels->size(); i++)
+                EXPECT_EQ(expected.labels->points[i].label, actual.labels->points[i].label);
+        }
+        else
+            EXPECT_FALSE(bool(actual.labels));
+
+        ASSERT_EQ(expected.poses.size(), actual.poses.size());
+        for (std::size_t i = 0; i < expected.poses.size(); i++)
+        {
+            EXPECT_EQ(expected.poses[i].transform_name_, actual.poses[i].transform_name_);
+            EXPECT_EQ(expected.poses[i].model_name_, actual.poses[i].model_name_);
+            EXPECT_EQ(expected.poses[i].model_index_, actual.poses[i].model_index_);
+            EXPECT_TRUE(expected.poses[i].origin_.isApprox(actual.poses[i].origin_));
+            EXPECT_TRUE(expected.poses[i].rotation_.isApprox(actual.poses[i].rotation_));
+            EXPECT_EQ(expected.poses[i].confidence_, actual.poses[i].confidence_);
+        }
+    }
+
+    // copies the first size bytes of LOG_PATH to CUT_PATH, as a recorder that crashed would leave it
+    void writeCutCopy(const std::size_t &size)
+    {
+        std::ifstream in(LOG_PATH.c_str(), std::ios::binary);
+        std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        ASSERT_LE(size, data.size());
+        std::ofstream out(CUT_PATH.c_str(), std::ios::binary | std::ios::trunc);
+        out.write(data.data(), size);
+    }
+
+    std::size_t fileSize(const std::string &path)
+    {
+        std::ifstream in(path.c_str(), std::ios::binary | std::ios::ate);
+        return in.tellg();
+    }
+
+    class FrameLogTest : public ::testing::Test
+    {
+    protected:
+        virtual void SetUp()
+        {
+            parameters["pcl_downsample"] = "0.003";
+            parameters["svm_path"] = "data/UR5_svm";
+            frames.push_back(makeFrame(7, 500));
+            frames.push_back(makeFrame(8, 1000));
+            frames.push_back(makeFrame(9, 3));
+            // a frame without labels, the segmentation failed
+            frames.back().labels.reset();
+            frames.back().poses.clear();
+            frames.back().success = false;
+            tables.push_back(makeCloud(4, 2.0f));
+            tables.push_back(makeCloud(6, 3.0f));
+
+            // tables[0] for frames 0 and 1, tables[1] for frame 2
+            FrameLogWriter writer(frames.size());
+            ASSERT_TRUE(writer.open(LOG_PATH, parameters));
+            writer.writeTable(tables[0]);
+            EXPECT_TRUE(writer.writeFrame(frames[0]));
+            EXPECT_TRUE(writer.writeFrame(frames[1]));
+            writer.writeTable(tables[1]);
+            EXPECT_TRUE(writer.writeFrame(frames[2]));
+            writer.close();
+            EXPECT_EQ(frames.size(), writer.getWrittenFrames());
+            EXPECT_EQ(0u, writer.getDroppedFrames());
+        }
+
+        virtual void TearDown()
+        {
+            std::remove(LOG_PATH.c_str());
+            std::remove(CUT_PATH.c_str());
+        }
+
+        void expectFrames(FrameLogReader &reader, const std::size_t &number_of_frames)
+        {
+            EXPECT_EQ(parameters, reader.getParameters());
+            ASSERT_EQ(number_of_frames, reader.getNumberOfFrames());
+            for (std::size_t i = 0; i < number_of_frames; i++)
+            {
+                EXPECT_EQ(frames[i].sequence, reader.getFrameEntry(i).sequence);
+                EXPECT_EQ(frames[i].stamp, reader.getFrameEntry(i).stamp);
+                LoggedFrame frame;
+                ASSERT_TRUE(reader.readFrame(i, frame));
+                expectSameFrame(frames[i], frame);
+
+                pcl::PointCloud<PointT>::Ptr table;
+                ASSERT_TRUE(reader.readTableForFrame(i, table));
+                expectSameCloud<PointT>(tables[i < 2 ? 0 : 1], table);
+            }
+            LoggedFrame frame;
+            EXPECT_FALSE(reader.readFrame(number_of_frames, frame));
+        }
+
+        FrameLogParameters parameters;
+        std::vector<LoggedFrame, Eigen::aligned_allocator<LoggedFrame> > frames;
+        std::vector<pcl::PointCloud<PointT>::Ptr> tables;
+    };
+}
+
+TEST_F(FrameLogTest, RoundTrip)
+{
+    FrameLogReader reader;
+    ASSERT_TRUE(reader.open(LOG_PATH));
+    expectFrames(reader, frames.size());
+
+    // frames that share a table get the same cloud
+    pcl::PointCloud<PointT>::Ptr first, second;
+    ASSERT_TRUE(reader.readTableForFrame(0, first));
+    ASSERT_TRUE(reader.readTableForFrame(1, second));
+    EXPECT_EQ(first.get(), second.get());
+}
+
+TEST_F(FrameLogTest, Reopen)
+{
+    FrameLogReader reader;
+    ASSERT_TRUE(reader.open(LOG_PATH));
+    ASSERT_TRUE(reader.open(LOG_PATH));
+    expectFrames(reader, frames.size());
+}
+
+TEST_F(FrameLogTest, WithoutIndex)
+{
+    // the index and its trailer are missing, the chunks are scanned instead
+    FrameLogReader reader;
+    ASSERT_TRUE(reader.open(LOG_PATH));
+    writeCutCopy(reader.getFrameEntry(frames.size() - 1).offset);
+    ASSERT_TRUE(reader.open(CUT_PATH));
+    // the cut falls right before the last frame, the table written before it is still there
+    expectFrames(reader, frames.size() - 1);
+}
+
+TEST_F(FrameLogTest, IncompleteLastFrame)
+{
+    FrameLogReader reader;
+    ASSERT_TRUE(reader.open(LOG_PATH));
+    writeCutCopy(reader.getFrameEntry(1).offset + 100);
+    ASSERT_TRUE(reader.open(CUT_PATH));
+    expectFrames(reader, 1);
+}
+
+TEST_F(FrameLogTest, TrailerOnlyMissing)
+{
+    writeCutCopy(fileSize(LOG_PATH) - 16);
+    FrameLogReader reader;
+    ASSERT_TRUE(reader.open(CUT_PATH));
+    expectFrames(reader, frames.size());
+}
+
+TEST(FrameLog, RejectsOtherFiles)
+{
+    {
+        std::ofstream out(CUT_PATH.c_str(), std::ios::binary | std::ios::trunc);
+        out << "# .PCD v0.7 - Point Cloud Data file format\n";
+    }
+    FrameLogReader reader;
+    EXPECT_FALSE(reader.open(CUT_PATH));
+    EXPECT_FALSE(reader.open("does_not_exist.splog"));
+    EXPECT_EQ(0u, reader.getNumberOfFrames());
+    std::remove(CUT_PATH.c_str());
+}
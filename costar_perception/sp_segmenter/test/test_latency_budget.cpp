@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+#include "sp_segmenter/semantic_segmentation.h"
+
+namespace
+{
+    // opens the budget bookkeeping of SemanticSegmentation to the tests
+    class BudgetSegmentation : public SemanticSegmentation
+    {
+    public:
+        using SemanticSegmentation::startLatencyBudget;
+        using SemanticSegmentation::expectedStageTime;
+        using SemanticSegmentation::updateExpectedStageTime;
+#ifdef USE_OBJRECRANSAC
+        using SemanticSegmentation::recognizePoses;
+        using SemanticSegmentation::updateObjectTransforms;
+#endif
+    };
+}
+
+TEST(LatencyBudget, DegradationNames)
+{
+    EXPECT_EQ("", SemanticSegmentation::getDegradationNames(0));
+    EXPECT_EQ("coarse_downsample", SemanticSegmentation::getDegradationNames(DEGRADE_COARSE_DOWNSAMPLE));
+    EXPECT_EQ("skip_level1_superpixels,skip_pose",
+        SemanticSegmentation::getDegradationNames(DEGRADE_SKIP_LEVEL1_SUPERPIXELS | DEGRADE_SKIP_POSE));
+    // in ladder order whatever order the flags are given in
+    EXPECT_EQ("coarse_downsample,skip_level1_superpixels,fewer_ransac_iterations,skip_pose",
+        SemanticSegmentation::getDegradationNames(DEGRADE_SKIP_POSE | DEGRADE_FEWER_RANSAC_ITERATIONS |
+            DEGRADE_SKIP_LEVEL1_SUPERPIXELS | DEGRADE_COARSE_DOWNSAMPLE));
+    // bits past the last rung are not rungs
+    EXPECT_EQ("fewer_ransac_iterations", SemanticSegmentation::getDegradationNames(DEGRADE_FEWER_RANSAC_ITERATIONS | (1u << NUM_DEGRADATION_RUNGS)));
+}
+
+TEST(LatencyBudget, Disabled)
+{
+    BudgetSegmentation segmenter;
+    EXPECT_EQ(0, segmenter.getLatencyBudget());
+    EXPECT_EQ(0u, segmenter.getLastDegradation());
+
+    LatencyBudget budget = segmenter.startLatencyBudget(true);
+    EXPECT_EQ(0, budget.deadline);
+    EXPECT_TRUE(budget.with_pose);
+    EXPECT_EQ(0u, budget.rungs);
+
+    // negative budgets disable it as well
+    segmenter.setLatencyBudget(-1.0);
+    EXPECT_EQ(0, segmenter.getLatencyBudget());
+    EXPECT_EQ(0, segmenter.startLatencyBudget(false).deadline);
+}
+
+TEST(LatencyBudget, Deadline)
+{
+    BudgetSegmentation segmenter;
+    segmenter.setLatencyBudget(0.25);
+    EXPECT_EQ(0.25, segmenter.getLatencyBudget());
+
+    double before = get_wall_time();
+    LatencyBudget budget = segmenter.startLatencyBudget(false);
+    double after = get_wall_time();
+    EXPECT_FALSE(budget.with_pose);
+    EXPECT_EQ(0u, budget.rungs);
+    EXPECT_GE(budget.deadline, before + 0.25);
+    EXPECT_LE(budget.deadline, after + 0.25);
+}
+
+TEST(LatencyBudget, ExpectedStageTime)
+{
+    BudgetSegmentation segmenter;
+    // no history, every stage is expected to be free and no request degrades
+    for (int stage = 0; stage < NUM_SEGMENTATION_STAGES; stage++)
+        EXPECT_EQ(0, segmenter.expectedStageTime(SegmentationStage(stage), 0));
+
+    segmenter.updateExpectedStageTime(STAGE_POOLER, 1.0);
+    EXPECT_EQ(1.0, segmenter.expectedStageTime(STAGE_POOLER, 0));
+    EXPECT_EQ(0, segmenter.expectedStageTime(STAGE_SVM, 0));
+
+    // a moving average afterwards
+    segmenter.updateExpectedStageTime(STAGE_POOLER, 2.0);
+    double pooler = segmenter.expectedStageTime(STAGE_POOLER, 0);
+    EXPECT_GT(pooler, 1.0);
+    EXPECT_LT(pooler, 2.0);
+}
+
+TEST(LatencyBudget, RungsLowerTheExpectedTime)
+{
+    BudgetSegmentation segmenter;
+    segmenter.updateExpectedStageTime(STAGE_POOLER, 1.0);
+    segmenter.updateExpectedStageTime(STAGE_SVM, 1.0);
+    segmenter.updateExpectedStageTime(STAGE_POSE, 1.0);
+
+    // every rung only applies to the stages it changes
+    double coarse_pooler = segmenter.expectedStageTime(STAGE_POOLER, DEGRADE_COARSE_DOWNSAMPLE);
+    EXPECT_GT(coarse_pooler, 0);
+    EXPECT_LT(coarse_pooler, 1.0);
+    EXPECT_EQ(1.0, segmenter.expectedStageTime(STAGE_POOLER, DEGRADE_SKIP_LEVEL1_SUPERPIXELS));
+    EXPECT_EQ(1.0, segmenter.expectedStageTime(STAGE_POSE, DEGRADE_COARSE_DOWNSAMPLE | DEGRADE_SKIP_LEVEL1_SUPERPIXELS));
+
+    double coarse_svm = segmenter.expectedStageTime(STAGE_SVM, DEGRADE_COARSE_DOWNSAMPLE);
+    double level0_svm = segmenter.expectedStageTime(STAGE_SVM, DEGRADE_SKIP_LEVEL1_SUPERPIXELS);
+    EXPECT_LT(coarse_svm, 1.0);
+    EXPECT_LT(level0_svm, 1.0);
+    EXPECT_LT(segmenter.expectedStageTime(STAGE_SVM, DEGRADE_COARSE_DOWNSAMPLE | DEGRADE_SKIP_LEVEL1_SUPERPIXELS), std::min(coarse_svm, level0_svm));
+
+    double fewer_pose = segmenter.expectedStageTime(STAGE_POSE, DEGRADE_FEWER_RANSAC_ITERATIONS);
+    EXPECT_GT(fewer_pose, 0);
+    EXPECT_LT(fewer_pose, 1.0);
+    EXPECT_EQ(0, segmenter.expectedStageTime(STAGE_POSE, DEGRADE_SKIP_POSE));
+    EXPECT_EQ(0, segmenter.expectedStageTime(STAGE_POSE, DEGRADE_FEWER_RANSAC_ITERATIONS | DEGRADE_SKIP_POSE));
+}
+
+#ifdef USE_OBJRECRANSAC
+TEST(LatencyBudget, ExpiredBudgetSkipsThePoses)
+{
+    BudgetSegmentation segmenter;
+    segmenter.updateExpectedStageTime(STAGE_POSE, 1.0);
+
+    LatencyBudget budget;
+    budget.with_pose = true;
+    budget.deadline = get_wall_time() - 0.1;
+    pcl::PointCloud<pcl::PointXYZL>::Ptr labelled(new pcl::PointCloud<pcl::PointXYZL>());
+    EXPECT_TRUE(segmenter.recognizePoses(labelled, budget).empty());
+    EXPECT_TRUE(budget.rungs & DEGRADE_FEWER_RANSAC_ITERATIONS);
+    EXPECT_TRUE(budget.rungs & DEGRADE_SKIP_POSE);
+    EXPECT_EQ("fewer_ransac_iterations,skip_pose", SemanticSegmentation::getDegradationNames(budget.rungs));
+}
+
+TEST(LatencyBudget, SkippedPosesLeaveTheObjectTree)
+{
+    BudgetSegmentation segmenter;
+    poseT pose;
+    pose.model_name = "link_uniform";
+    pose.shift = Eigen::Vector3f(0.1f, 0.2f, 0.3f);
+    pose.rotation = Eigen::Quaternionf::Identity();
+    pose.confidence = 0.5;
+
+    // the poses of a skipped estimation never reach the tree
+    LatencyBudget budget;
+    budget.rungs = DEGRADE_SKIP_POSE;
+    EXPECT_TRUE(segmenter.updateObjectTransforms(std::vector<poseT>(1, pose), budget).empty());
+}
+#endif
@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+
+#include <future>
+#include <string>
+#include <vector>
+
+#include "sp_segmenter/utility/profiler.h"
+#include "sp_segmenter/utility/task_scheduler.h"
+#include "sp_segmenter/utility/worker_pool.h"
+
+#ifdef SP_SEGMENTER_PROFILING
+namespace
+{
+    // value of counter name in the current frame, -1 if it was never updated
+    int64_t counterValue(const std::string &name)
+    {
+        std::vector<ProfileEntry> report = sp_profiler::frameReport();
+        for (std::size_t i = 0; i < report.size(); i++)
+        {
+            if (report[i].name == name)
+                return report[i].value;
+        }
+        return -1;
+    }
+}
+
+TEST(Profiler, CountsIntoCurrentFrame)
+{
+    SP_PROFILE_BEGIN_FRAME();
+    for (int i = 0; i < 10; i++)
+        SP_PROFILE_COUNT("test/local", 2);
+    EXPECT_EQ(20, counterValue("test/local"));
+
+    // a new frame starts empty, the counts of the old one stay with it
+    sp_profiler::FramePtr old_frame = sp_profiler::currentFrame();
+    SP_PROFILE_BEGIN_FRAME();
+    EXPECT_EQ(-1, counterValue("test/local"));
+    {
+        sp_profiler::ScopedFrame scope(old_frame);
+        EXPECT_EQ(20, counterValue("test/local"));
+    }
+}
+
+TEST(Profiler, MergesPoolTasksBeforeTheirFuture)
+{
+    WorkerPool pool(3);
+    SP_PROFILE_BEGIN_FRAME();
+    std::vector<std::future<void> > done;
+    for (int t = 0; t < 30; t++)
+        done.push_back(pool.submit([]() { SP_PROFILE_COUNT("test/tasks", 1); }));
+    for (std::size_t t = 0; t < done.size(); t++)
+        done[t].get();
+    EXPECT_EQ(30, counterValue("test/tasks"));
+}
+
+TEST(Profiler, MergesParallelForHelpers)
+{
+    SP_PROFILE_BEGIN_FRAME();
+    TaskScheduler::instance().parallelFor(TASK_FEATURES, 0, 1000, 1, [](int) { SP_PROFILE_COUNT("test/loop", 1); });
+    EXPECT_EQ(1000, counterValue("test/loop"));
+}
+#else
+TEST(Profiler, DisabledReportIsEmpty)
+{
+    SP_PROFILE_BEGIN_FRAME();
+    SP_PROFILE_COUNT("test/local", 1);
+    EXPECT_TRUE(sp_profiler::frameReport().empty());
+}
+#endif
@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <stdexcept>
+
+#include "sp_segmenter/utility/task_scheduler.h"
+#include "sp_segmenter/utility/worker_pool.h"
+
+namespace
+{
+    // restores the limit of a stage at the end of a test
+    class StageLimitGuard
+    {
+    public:
+        explicit StageLimitGuard(const TaskStage &stage) : stage_(stage), limit_(TaskScheduler::instance().getStageLimit(stage)) {}
+        ~StageLimitGuard() { TaskScheduler::instance().setStageLimit(stage_, limit_); }
+    private:
+        TaskStage stage_;
+        int limit_;
+    };
+}
+
+TEST(TaskScheduler, RunsEveryIterationOnce)
+{
+    const int grains[] = {1, 3, 7, 100, 0};
+    for (int g = 0; g < 5; g++)
+    {
+        std::vector<std::atomic<int> > counts(250);
+        for (std::size_t i = 0; i < counts.size(); i++)
+            counts[i] = 0;
+        TaskScheduler::instance().parallelFor(TASK_CLASSIFY, 0, counts.size(), grains[g], [&](int i) { counts[i]++; });
+        for (std::size_t i = 0; i < counts.size(); i++)
+            EXPECT_EQ(1, counts[i].load()) << "grain " << grains[g] << ", iteration " << i;
+    }
+}
+
+TEST(TaskScheduler, EmptyRange)
+{
+    int calls = 0;
+    TaskScheduler::instance().parallelFor(TASK_CLASSIFY, 5, 5, 1, [&](int) { calls++; });
+    TaskScheduler::instance().parallelFor(TASK_CLASSIFY, 5, 2, 1, [&](int) { calls++; });
+    EXPECT_EQ(0, calls);
+}
+
+TEST(TaskScheduler, NestedLoops)
+{
+    const int outer = 16, inner = 64;
+    std::vector<std::atomic<int> > counts(outer * inner);
+    for (std::size_t i = 0; i < counts.size(); i++)
+        counts[i] = 0;
+
+    // every pool thread may be inside an outer iteration waiting for its inner loop
+    TaskScheduler::instance().parallelFor(TASK_FEATURES, 0, outer, 1, [&](int i) {
+        EXPECT_EQ(1, TaskScheduler::instance().getLibraryThreads(TASK_POSE));
+        TaskScheduler::instance().parallelFor(TASK_POOLING, 0, inner, 4, [&](int j) { counts[i * inner + j]++; });
+    });
+    for (std::size_t i = 0; i < counts.size(); i++)
+        EXPECT_EQ(1, counts[i].load()) << "iteration " << i;
+}
+
+TEST(TaskScheduler, RethrowsTheFirstException)
+{
+    std::atomic<int> calls(0);
+    EXPECT_THROW(TaskScheduler::instance().parallelFor(TASK_CLASSIFY, 0, 1000, 1, [&](int i) {
+        calls++;
+        if (i == 10)
+            throw std::runtime_error("iteration 10");
+    }), std::runtime_error);
+    EXPECT_GE(calls.load(), 1);
+
+    // the scheduler is usable after a failed loop, and the stage is no longer counted as active
+    std::atomic<int> after(0);
+    TaskScheduler::instance().parallelFor(TASK_CLASSIFY, 0, 100, 1, [&](int) { after++; });
+    EXPECT_EQ(100, after.load());
+}
+
+TEST(TaskScheduler, ExceptionInNestedLoop)
+{
+    EXPECT_THROW(TaskScheduler::instance().parallelFor(TASK_FEATURES, 0, 8, 1, [&](int i) {
+        TaskScheduler::instance().parallelFor(TASK_POOLING, 0, 8, 1, [&](int j) {
+            if (i == 3 && j == 5)
+                throw std::logic_error("inner");
+        });
+    }), std::logic_error);
+}
+
+TEST(TaskScheduler, StageLimit)
+{
+    StageLimitGuard guard(TASK_POSE);
+    const int limits[] = {1, 2};
+    for (int l = 0; l < 2; l++)
+    {
+        TaskScheduler::instance().setStageLimit(TASK_POSE, limits[l]);
+        EXPECT_EQ(limits[l], TaskScheduler::instance().getStageLimit(TASK_POSE));
+
+        std::atomic<int> running(0), most(0);
+        TaskScheduler::instance().parallelFor(TASK_POSE, 0, 64, 1, [&](int) {
+            int now = ++running;
+            int seen = most.load();
+            while (now > seen && !most.compare_exchange_weak(seen, now));
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            running--;
+        });
+        EXPECT_LE(most.load(), limits[l]);
+    }
+}
+
+TEST(TaskScheduler, StageLimitOneRunsOnTheCaller)
+{
+    StageLimitGuard guard(TASK_POSE);
+    TaskScheduler::instance().setStageLimit(TASK_POSE, 1);
+    const std::thread::id caller = std::this_thread::get_id();
+    std::atomic<int> elsewhere(0);
+    TaskScheduler::instance().parallelFor(TASK_POSE, 0, 100, 1, [&](int) {
+        if (std::this_thread::get_id() != caller)
+            elsewhere++;
+    });
+    EXPECT_EQ(0, elsewhere.load());
+    EXPECT_EQ(1, TaskScheduler::instance().getLibraryThreads(TASK_POSE));
+}
+
+TEST(TaskScheduler, SetStageLimits)
+{
+    StageLimitGuard features(TASK_FEATURES), pose(TASK_POSE);
+    TaskScheduler &scheduler = TaskScheduler::instance();
+
+    EXPECT_TRUE(scheduler.setStageLimits("features=4,pose=2"));
+    EXPECT_EQ(4, scheduler.getStageLimit(TASK_FEATURES));
+    EXPECT_EQ(2, scheduler.getStageLimit(TASK_POSE));
+
+    // errors change nothing
+    EXPECT_FALSE(scheduler.setStageLimits("features=1,unknown=3"));
+    EXPECT_FALSE(scheduler.setStageLimits("features=1,pose=-1"));
+    EXPECT_FALSE(scheduler.setStageLimits("features=1,pose"));
+    EXPECT_FALSE(scheduler.setStageLimits("features=1x"));
+    EXPECT_EQ(4, scheduler.getStageLimit(TASK_FEATURES));
+    EXPECT_EQ(2, scheduler.getStageLimit(TASK_POSE));
+
+    EXPECT_TRUE(scheduler.setStageLimits("pose=0"));
+    EXPECT_EQ(0, scheduler.getStageLimit(TASK_POSE));
+    EXPECT_STREQ("pose", TaskScheduler::getStageName(TASK_POSE));
+}
+
+TEST(TaskScheduler, LibraryThreads)
+{
+    StageLimitGuard guard(TASK_POSE);
+    TaskScheduler &scheduler = TaskScheduler::instance();
+    const int all = int(WorkerPool::shared().size()) + 1;
+
+    scheduler.setStageLimit(TASK_POSE, 0);
+    EXPECT_EQ(all, scheduler.getLibraryThreads(TASK_POSE));
+    scheduler.setStageLimit(TASK_POSE, 1);
+    EXPECT_EQ(1, scheduler.getLibraryThreads(TASK_POSE));
+    scheduler.setStageLimit(TASK_POSE, all + 10);
+    EXPECT_EQ(all, scheduler.getLibraryThreads(TASK_POSE));
+
+    // a pool thread leaves the other cores to the other tasks
+    scheduler.setStageLimit(TASK_POSE, 0);
+    EXPECT_EQ(1, WorkerPool::shared().submit([&scheduler]() { return scheduler.getLibraryThreads(TASK_POSE); }).get());
+}
@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+
+#include <future>
+#include <vector>
+#include <stdexcept>
+
+#include "sp_segmenter/utility/worker_pool.h"
+
+static std::vector<int> cpuList(const std::string &list)
+{
+    std::vector<int> cpus;
+    EXPECT_TRUE(WorkerPool::parseCPUList(list, cpus)) << list;
+    return cpus;
+}
+
+TEST(WorkerPool, ParseCPUList)
+{
+    EXPECT_EQ(std::vector<int>({0}), cpuList("0"));
+    EXPECT_EQ(std::vector<int>({0, 1, 2, 3, 8, 10, 11}), cpuList("0-3,8,10-11"));
+    EXPECT_EQ(std::vector<int>({5}), cpuList("5-5"));
+    // sorted, every cpu once
+    EXPECT_EQ(std::vector<int>({1, 2, 3}), cpuList("3,1-2,2"));
+}
+
+TEST(WorkerPool, ParseCPUListErrors)
+{
+    const char *invalid[] = {"", ",", "a", "1,,2", "3-1", "1-", "-1", "1-2-3", "1 2", "1,x"};
+    for (std::size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+    {
+        // the list is left alone on errors
+        std::vector<int> cpus(1, 42);
+        EXPECT_FALSE(WorkerPool::parseCPUList(invalid[i], cpus)) << "'" << invalid[i] << "'";
+        EXPECT_EQ(std::vector<int>(1, 42), cpus) << "'" << invalid[i] << "'";
+    }
+}
+
+TEST(WorkerPool, RunsTasks)
+{
+    WorkerPool pool(3);
+    EXPECT_EQ(3u, pool.size());
+    EXPECT_FALSE(WorkerPool::isWorkerThread());
+
+    std::vector<std::future<int> > results;
+    for (int i = 0; i < 20; i++)
+        results.push_back(pool.submit([i]() { return i * i; }));
+    for (int i = 0; i < 20; i++)
+        EXPECT_EQ(i * i, results[i].get());
+
+    EXPECT_TRUE(pool.submit([]() { return WorkerPool::isWorkerThread(); }).get());
+}
+
+TEST(WorkerPool, ExceptionReachesTheFuture)
+{
+    WorkerPool pool(1);
+    std::future<int> failed = pool.submit([]() -> int { throw std::runtime_error("task"); });
+    EXPECT_THROW(failed.get(), std::runtime_error);
+    // the thread survives the task
+    EXPECT_EQ(7, pool.submit([]() { return 7; }).get());
+}
+
+TEST(WorkerPool, DestructorRunsQueuedTasks)
+{
+    std::atomic<int> done(0);
+    {
+        WorkerPool pool(1);
+        for (int i = 0; i < 10; i++)
+            pool.submit([&done]() { done++; });
+    }
+    EXPECT_EQ(10, done.load());
+}
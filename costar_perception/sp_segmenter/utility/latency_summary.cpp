@@ -0,0 +1,28 @@
+#include "sp_segmenter/utility/latency_summary.h"
+
+#include <algorithm>
+
+LatencySummary summarize(std::vector<double> samples)
+{
+    LatencySummary result = {0, 0, 0, 0, 0};
+    if (samples.empty())
+        return result;
+
+    std::sort(samples.begin(), samples.end());
+    for (std::size_t i = 0; i < samples.size(); i++)
+        result.mean += samples[i];
+    result.mean /= samples.size();
+    result.p50 = samples[(samples.size() - 1) * 50 / 100];
+    result.p90 = samples[(samples.size() - 1) * 90 / 100];
+    result.p99 = samples[(samples.size() - 1) * 99 / 100];
+    result.max = samples.back();
+    return result;
+}
+
+void writeSummary(std::ostream &os, const std::string &name, const std::vector<double> &samples)
+{
+    // milliseconds
+    LatencySummary s = summarize(samples);
+    os << "    \"" << name << "\": {\"mean\": " << s.mean * 1000 << ", \"p50\": " << s.p50 * 1000
+        << ", \"p90\": " << s.p90 * 1000 << ", \"p99\": " << s.p99 * 1000 << ", \"max\": " << s.max * 1000 << "}";
+}
@@ -0,0 +1,190 @@
+#include "sp_segmenter/utility/logger.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+
+namespace sp_log
+{
+    namespace
+    {
+        const char *LEVEL_NAMES[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+        // lines waiting for the writer. Beyond this the oldest are dropped and counted instead of blocking the caller
+        const std::size_t MAX_QUEUED = 4096;
+
+        bool parseLevel(const std::string &name, Level &level)
+        {
+            const char *names[] = {"debug", "info", "warn", "error", "none"};
+            for (int i = LEVEL_DEBUG; i <= LEVEL_NONE; i++)
+            {
+                if (name == names[i])
+                {
+                    level = Level(i);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        class Writer
+        {
+        public:
+            Writer() : level_(LEVEL_INFO), dropped_(0), written_(0), queued_(0)
+            {
+                const char *env = getenv("SP_SEGMENTER_LOG_LEVEL");
+                Level level;
+                if (env != NULL && parseLevel(env, level))
+                    level_.store(level);
+                std::thread(&Writer::run, this).detach();
+            }
+
+            void push(Level level, const std::string &message)
+            {
+                unsigned long ticket;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (queue_.size() >= MAX_QUEUED)
+                    {
+                        queue_.pop_front();
+                        dropped_++;
+                        written_++;
+                    }
+                    queue_.push_back(std::string("[") + LEVEL_NAMES[level] + "] " + message);
+                    ticket = ++queued_;
+                }
+                wake_.notify_one();
+                if (level >= LEVEL_ERROR)
+                    waitFor(ticket);
+            }
+
+            void flush()
+            {
+                unsigned long ticket;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    ticket = queued_;
+                }
+                waitFor(ticket);
+            }
+
+            std::atomic<int> level_;
+
+        private:
+            void waitFor(unsigned long ticket)
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                while (written_ < ticket)
+                    done_.wait(lock);
+            }
+
+            void run()
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                while (true)
+                {
+                    while (queue_.empty())
+                        wake_.wait(lock);
+
+                    // write the whole batch outside the lock with one flush
+                    std::deque<std::string> batch;
+                    batch.swap(queue_);
+                    unsigned long dropped = dropped_;
+                    dropped_ = 0;
+                    lock.unlock();
+
+                    if (dropped > 0)
+                        fprintf(stderr, "[WARN] %lu log messages dropped\n", dropped);
+                    for (std::size_t i = 0; i < batch.size(); i++)
+                    {
+                        fputs(batch[i].c_str(), stderr);
+                        fputc('\n', stderr);
+                    }
+                    fflush(stderr);
+
+                    lock.lock();
+                    written_ += batch.size();
+                    done_.notify_all();
+                }
+            }
+
+            std::mutex mutex_;
+            std::condition_variable wake_, done_;
+            std::deque<std::string> queue_;
+            unsigned long dropped_, written_, queued_;
+        };
+
+        void flushAtExit();
+
+        // never destroyed, so static destructors running after main can still log. Whatever is queued at exit
+        // is written by flushAtExit
+        Writer &writer()
+        {
+            static Writer *instance = NULL;
+            static std::once_flag created;
+            std::call_once(created, []() {
+                instance = new Writer();
+                atexit(flushAtExit);
+            });
+            return *instance;
+        }
+
+        void flushAtExit()
+        {
+            writer().flush();
+        }
+
+        double now()
+        {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    }
+
+    void setLevel(Level level)
+    {
+        writer().level_.store(level);
+    }
+
+    Level getLevel()
+    {
+        return Level(writer().level_.load(std::memory_order_relaxed));
+    }
+
+    bool setLevel(const std::string &level)
+    {
+        Level parsed;
+        if (!parseLevel(level, parsed))
+            return false;
+        setLevel(parsed);
+        return true;
+    }
+
+    void write(Level level, const std::string &message)
+    {
+        if (level >= LEVEL_NONE)
+            return;
+        writer().push(level, message);
+    }
+
+    void flush()
+    {
+        writer().flush();
+    }
+
+    bool Throttle::allow(double period, unsigned int &suppressed)
+    {
+        double current = now();
+        double last = last_.load(std::memory_order_relaxed);
+        if (current - last < period || !last_.compare_exchange_strong(last, current))
+        {
+            suppressed_++;
+            return false;
+        }
+        suppressed = suppressed_.exchange(0);
+        return true;
+    }
+}
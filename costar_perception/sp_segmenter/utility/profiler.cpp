@@ -0,0 +1,224 @@
+#include "sp_segmenter/utility/profiler.h"
+
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+#ifdef SP_SEGMENTER_PROFILING
+#include <chrono>
+#include <mutex>
+
+namespace sp_profiler
+{
+    namespace
+    {
+        const int MAX_PROBES = 128;
+
+        struct Slot
+        {
+            uint64_t calls;
+            int64_t total;
+            int64_t max;
+        };
+
+        // frame the calling thread records into
+        thread_local FramePtr current_frame;
+
+        std::mutex probe_mutex;
+        std::vector<std::string> probe_names;
+        std::vector<bool> probe_is_timer;
+
+        int64_t nowNs()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    }
+
+    // the merged slots of one request, written by flush() of its threads and read by frameReport while they may still run
+    class Frame
+    {
+    public:
+        Frame()
+        {
+            for (int i = 0; i < MAX_PROBES; i++)
+            {
+                slots[i].calls = 0;
+                slots[i].total = 0;
+                slots[i].max = 0;
+            }
+        }
+
+        std::mutex mutex;
+        Slot slots[MAX_PROBES];
+    };
+
+    namespace
+    {
+        // what the calling thread recorded into frame since its last flush, touched lists the probes to merge
+        struct LocalSlots
+        {
+            LocalSlots()
+            {
+                for (int i = 0; i < MAX_PROBES; i++)
+                {
+                    slots[i].calls = 0;
+                    slots[i].total = 0;
+                    slots[i].max = 0;
+                }
+            }
+
+            ~LocalSlots()
+            {
+                merge();
+            }
+
+            void merge()
+            {
+                if (!frame || touched.empty())
+                    return;
+                std::lock_guard<std::mutex> lock(frame->mutex);
+                for (std::size_t k = 0; k < touched.size(); k++)
+                {
+                    Slot &local = slots[touched[k]];
+                    Slot &shared = frame->slots[touched[k]];
+                    shared.calls += local.calls;
+                    shared.total += local.total;
+                    shared.max = std::max(shared.max, local.max);
+                    local.calls = 0;
+                    local.total = 0;
+                    local.max = 0;
+                }
+                touched.clear();
+            }
+
+            FramePtr frame;
+            Slot slots[MAX_PROBES];
+            std::vector<int> touched;
+        };
+
+        thread_local LocalSlots local_slots;
+    }
+
+    int registerProbe(const char *name, bool is_timer)
+    {
+        std::lock_guard<std::mutex> lock(probe_mutex);
+        for (std::size_t i = 0; i < probe_names.size(); i++)
+        {
+            if (probe_names[i] == name)
+                return i;
+        }
+        if (probe_names.size() >= (std::size_t)MAX_PROBES)
+        {
+            std::cerr << "Too many profiler probes, ignoring: " << name << std::endl;
+            return -1;
+        }
+        probe_names.push_back(name);
+        probe_is_timer.push_back(is_timer);
+        return probe_names.size() - 1;
+    }
+
+    void record(int probe, int64_t value)
+    {
+        if (probe < 0)
+            return;
+        if (!current_frame)
+            current_frame = FramePtr(new Frame());
+        if (local_slots.frame != current_frame)
+        {
+            local_slots.merge();
+            local_slots.frame = current_frame;
+        }
+
+        Slot &slot = local_slots.slots[probe];
+        if (slot.calls == 0)
+            local_slots.touched.push_back(probe);
+        slot.calls++;
+        slot.total += value;
+        slot.max = std::max(slot.max, value);
+    }
+
+    void flush()
+    {
+        local_slots.merge();
+    }
+
+    void beginFrame()
+    {
+        flush();
+        current_frame = FramePtr(new Frame());
+    }
+
+    FramePtr currentFrame()
+    {
+        return current_frame;
+    }
+
+    ScopedFrame::ScopedFrame(const FramePtr &frame) : previous_(current_frame)
+    {
+        flush();
+        current_frame = frame;
+    }
+
+    ScopedFrame::~ScopedFrame()
+    {
+        flush();
+        current_frame = previous_;
+    }
+
+    std::vector<ProfileEntry> frameReport()
+    {
+        std::vector<ProfileEntry> result;
+        FramePtr frame = current_frame;
+        if (!frame)
+            return result;
+        flush();
+
+        std::lock_guard<std::mutex> lock(probe_mutex);
+        std::lock_guard<std::mutex> frame_lock(frame->mutex);
+        for (std::size_t i = 0; i < probe_names.size(); i++)
+        {
+            const Slot &slot = frame->slots[i];
+            if (slot.calls == 0)
+                continue;
+            ProfileEntry entry;
+            entry.name = probe_names[i];
+            entry.is_timer = probe_is_timer[i];
+            entry.calls = slot.calls;
+            entry.total_ms = entry.is_timer ? slot.total / 1e6 : 0;
+            entry.max_ms = entry.is_timer ? slot.max / 1e6 : 0;
+            entry.value = entry.is_timer ? 0 : slot.total;
+            result.push_back(entry);
+        }
+        return result;
+    }
+
+    ScopedTimer::ScopedTimer(int probe) : probe_(probe), start_(nowNs())
+    {
+    }
+
+    ScopedTimer::~ScopedTimer()
+    {
+        record(probe_, nowNs() - start_);
+    }
+}
+#endif // SP_SEGMENTER_PROFILING
+
+namespace sp_profiler
+{
+    std::string formatReport(const std::vector<ProfileEntry> &report)
+    {
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(3);
+        for (std::size_t i = 0; i < report.size(); i++)
+        {
+            const ProfileEntry &entry = report[i];
+            if (entry.is_timer)
+                ss << entry.name << ": " << entry.total_ms << " ms in " << entry.calls << " calls, max " << entry.max_ms << " ms\n";
+            else
+                ss << entry.name << ": " << entry.value << "\n";
+        }
+        return ss.str();
+    }
+}
@@ -0,0 +1,196 @@
+#include "sp_segmenter/utility/task_scheduler.h"
+#include "sp_segmenter/utility/worker_pool.h"
+#include "sp_segmenter/utility/logger.h"
+
+#include <cstdlib>
+#include <sstream>
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace
+{
+    // one parallelFor call, shared with its helpers. A helper starting after the loop is done only finds next
+    // past the end and never touches body
+    struct LoopState
+    {
+        LoopState(const int &begin, const int &end, const int &grain, const std::function<void(int)> &body)
+            : next(begin), end(end), grain(grain), remaining(end - begin), failed(false), body(&body) {}
+
+        std::atomic<int> next;
+        const int end, grain;
+        int remaining;
+        bool failed;
+        std::exception_ptr error;
+        const std::function<void(int)> *body;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+
+    // loops the current thread is running iterations of
+    thread_local int loop_depth = 0;
+
+    void runChunks(LoopState &state)
+    {
+        loop_depth++;
+        while (true)
+        {
+            int start = state.next.fetch_add(state.grain);
+            if (start >= state.end)
+                break;
+            int stop = std::min(state.end, start + state.grain);
+            bool skip;
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                skip = state.failed;
+            }
+            if (!skip)
+            {
+                try
+                {
+                    for (int i = start; i < stop; i++)
+                        (*state.body)(i);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(state.mutex);
+                    if (!state.failed)
+                        state.error = std::current_exception();
+                    state.failed = true;
+                }
+            }
+            // the caller may read its profile as soon as the last chunk is counted
+            SP_PROFILE_FLUSH();
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.remaining -= stop - start;
+            if (state.remaining == 0)
+                state.done.notify_all();
+        }
+        loop_depth--;
+    }
+
+    const char *stage_names[NUM_TASK_STAGES] = {"features", "pooling", "classify", "pose"};
+}
+
+TaskScheduler::TaskScheduler()
+{
+    for (int stage = 0; stage < NUM_TASK_STAGES; stage++)
+    {
+        limits_[stage] = 0;
+        active_[stage] = 0;
+    }
+    const char *limits = getenv("SP_SEGMENTER_STAGE_THREADS");
+    if (limits != NULL && !setStageLimits(limits))
+        SP_LOG_WARN("Ignoring SP_SEGMENTER_STAGE_THREADS='" << limits << "', expected e.g. features=4,pooling=8,classify=8,pose=2");
+}
+
+TaskScheduler &TaskScheduler::instance()
+{
+    static TaskScheduler scheduler;
+    return scheduler;
+}
+
+void TaskScheduler::setStageLimit(const TaskStage &stage, const int &threads)
+{
+    limits_[stage] = std::max(0, threads);
+}
+
+int TaskScheduler::getStageLimit(const TaskStage &stage) const
+{
+    return limits_[stage];
+}
+
+bool TaskScheduler::setStageLimits(const std::string &limits)
+{
+    int parsed[NUM_TASK_STAGES];
+    for (int stage = 0; stage < NUM_TASK_STAGES; stage++)
+        parsed[stage] = limits_[stage];
+
+    std::stringstream ss(limits);
+    std::string pair;
+    while (std::getline(ss, pair, ','))
+    {
+        std::size_t equal = pair.find('=');
+        if (equal == std::string::npos)
+            return false;
+        std::string name = pair.substr(0, equal);
+        char *end = NULL;
+        long threads = strtol(pair.c_str() + equal + 1, &end, 10);
+        if (end == pair.c_str() + equal + 1 || *end != '\0' || threads < 0)
+            return false;
+        int stage = 0;
+        while (stage < NUM_TASK_STAGES && name != stage_names[stage])
+            stage++;
+        if (stage == NUM_TASK_STAGES)
+            return false;
+        parsed[stage] = threads;
+    }
+
+    for (int stage = 0; stage < NUM_TASK_STAGES; stage++)
+        limits_[stage] = parsed[stage];
+    return true;
+}
+
+const char *TaskScheduler::getStageName(const TaskStage &stage)
+{
+    return stage_names[stage];
+}
+
+int TaskScheduler::getLibraryThreads(const TaskStage &stage) const
+{
+    if (loop_depth > 0 || WorkerPool::isWorkerThread())
+        return 1;
+#ifdef _OPENMP
+    if (omp_in_parallel())
+        return 1;
+#endif
+    int limit = limits_[stage];
+    // the caller and every pool thread
+    int all = int(WorkerPool::shared().size()) + 1;
+    return limit > 0 ? std::min(limit, all) : all;
+}
+
+void TaskScheduler::parallelFor(const TaskStage &stage, const int &begin, const int &end, const int &grain,
+    const std::function<void(int)> &body)
+{
+    if (end <= begin)
+        return;
+    const int step = std::max(1, grain);
+    const int chunks = (end - begin + step - 1) / step;
+    const int limit = limits_[stage];
+    WorkerPool &pool = WorkerPool::shared();
+    int helpers = std::min(chunks - 1, limit > 0 ? limit - 1 : int(pool.size()));
+
+    std::shared_ptr<LoopState> state(new LoopState(begin, end, step, body));
+    active_[stage]++;
+    for (int i = 0; i < helpers; i++)
+    {
+        std::atomic<int> *active = &active_[stage];
+        pool.submit([state, active, limit]() {
+            // joins only while the stage is below its limit
+            int running = active->load();
+            do
+            {
+                if (limit > 0 && running >= limit)
+                    return;
+            } while (!active->compare_exchange_weak(running, running + 1));
+            runChunks(*state);
+            (*active)--;
+        });
+    }
+
+    runChunks(*state);
+    active_[stage]--;
+    {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->done.wait(lock, [&state]() { return state->remaining == 0; });
+    }
+    if (state->error)
+        std::rethrow_exception(state->error);
+}
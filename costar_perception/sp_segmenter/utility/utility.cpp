@@ -1,4 +1,5 @@
 #include "sp_segmenter/utility/utility.h"
+#include "sp_segmenter/utility/task_scheduler.h"
 
 double get_wall_time(){
     struct timeval time;
@@ -239,6 +240,7 @@ void computeNormals(const pcl::PointCloud<PointT>::Ptr cloud, pcl::PointCloud<No
     pcl::NormalEstimationOMP<PointT, NormalT> normal_estimation;
     pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT>);
     normal_estimation.setSearchMethod (tree);
+    normal_estimation.setNumberOfThreads(TaskScheduler::instance().getLibraryThreads(TASK_FEATURES));
     normal_estimation.setRadiusSearch(normal_ss);
     normal_estimation.setInputCloud (cloud);
     normal_estimation.compute (*cloud_normals);
@@ -251,7 +253,7 @@ void computeKeyNormals(pcl::PointCloud<myPointXYZ>::Ptr keypoints, pcl::PointClo
     pcl::NormalEstimationOMP<myPointXYZ, NormalT> normal_estimation;
     pcl::search::KdTree<myPointXYZ>::Ptr tree(new pcl::search::KdTree<myPointXYZ>);
     normal_estimation.setSearchMethod (tree);
-    //normal_estimation.setNumberOfThreads(16);
+    normal_estimation.setNumberOfThreads(TaskScheduler::instance().getLibraryThreads(TASK_FEATURES));
     normal_estimation.setRadiusSearch(normal_ss);
     normal_estimation.setInputCloud (keypoints);
     normal_estimation.setSearchSurface (surface);
@@ -333,7 +335,7 @@ cv::Mat fpfh_cloud(const pcl::PointCloud<PointT>::Ptr cloud, const pcl::PointClo
     pcl::search::KdTree<PointT>::Ptr tree (new pcl::search::KdTree<PointT> ());
     pcl::FPFHEstimationOMP<PointT, NormalT, pcl::FPFHSignature33> fpfh;
     fpfh.setInputCloud(keys);
-    //fpfh.setNumberOfThreads(16);
+    fpfh.setNumberOfThreads(TaskScheduler::instance().getLibraryThreads(TASK_FEATURES));
     fpfh.setSearchSurface(cloud);
     fpfh.setInputNormals (cloud_normals);
     fpfh.setSearchMethod (tree);
@@ -381,7 +383,7 @@ cv::Mat shot_cloud(const pcl::PointCloud<PointT>::Ptr cloud, const pcl::PointClo
     
     // SHOT estimation object.
     pcl::SHOTEstimationOMP<PointT, pcl::Normal, pcl::SHOT352> shot;
-    //shot.setNumberOfThreads(16);
+    shot.setNumberOfThreads(TaskScheduler::instance().getLibraryThreads(TASK_FEATURES));
     shot.setInputCloud(cloud);
     shot.setInputNormals(cloud_normals);
     // The radius that defines which of the keypoint's neighbors are described.
@@ -456,7 +458,7 @@ cv::Mat shot_cloud_ss(const pcl::PointCloud<PointT>::Ptr cloud, const pcl::Point
 
     // SHOT estimation object.
     pcl::SHOTEstimationOMP<PointT, pcl::Normal, pcl::SHOT352> shot;
-    //shot.setNumberOfThreads(40);
+    shot.setNumberOfThreads(TaskScheduler::instance().getLibraryThreads(TASK_FEATURES));
     shot.setInputCloud(down_cloud);
     if( lrf->empty() == false )
         shot.setInputReferenceFrames(lrf);
@@ -504,7 +506,7 @@ cv::Mat cshot_cloud_ss(const pcl::PointCloud<PointT>::Ptr cloud, const pcl::Poin
     // SHOT estimation object.
     pcl::SHOTColorEstimationOMP<PointT, pcl::Normal, pcl::SHOT1344> cshot;
     
-    //cshot.setNumberOfThreads(8);
+    cshot.setNumberOfThreads(TaskScheduler::instance().getLibraryThreads(TASK_FEATURES));
     if( lrf->empty() == false )
         cshot.setInputReferenceFrames(lrf);
     cshot.setInputCloud(down_cloud);
@@ -517,14 +519,12 @@ cv::Mat cshot_cloud_ss(const pcl::PointCloud<PointT>::Ptr cloud, const pcl::Poin
     int num = descriptors->size();
     cv::Mat fea = cv::Mat::zeros(num, 1344, CV_32FC1);
     
-    #pragma omp parallel for schedule(dynamic, 50)
-    for( int i = 0 ; i < num ; i++ )
-    {
+    TaskScheduler::instance().parallelFor(TASK_FEATURES, 0, num, 50, [&](int i) {
         float *ptr = (float *)fea.row(i).data;
         float temp = descriptors->at(i).descriptor[0];  // check whether descriptor is valid
         if( temp == temp )
             memcpy(ptr, descriptors->at(i).descriptor, sizeof(float)*1344);
-    }
+    });
     return fea;
 }
 
@@ -563,6 +563,7 @@ cv::Mat cshot_cloud_uni(const pcl::PointCloud<PointT>::Ptr cloud, const pcl::Poi
 
     // SHOT estimation object.
     pcl::SHOTColorEstimationOMP<PointT, pcl::Normal, pcl::SHOT1344> shot;
+    shot.setNumberOfThreads(TaskScheduler::instance().getLibraryThreads(TASK_FEATURES));
     shot.setInputCloud(down_cloud);
     shot.setSearchSurface(cloud);
     shot.setInputNormals(cloud_normals);
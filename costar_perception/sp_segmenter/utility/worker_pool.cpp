@@ -0,0 +1,121 @@
+#include "sp_segmenter/utility/worker_pool.h"
+#include "sp_segmenter/utility/logger.h"
+
+#include <cstdlib>
+#include <sstream>
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+static thread_local bool on_worker_thread = false;
+
+WorkerPool::WorkerPool(const std::size_t &threads, const std::vector<int> &cpus, const bool &pin_threads) : stop_(false)
+{
+    std::size_t count = threads > 0 ? threads : (cpus.empty() ? std::thread::hardware_concurrency() : cpus.size());
+    if (count == 0)
+        count = 1;
+    for (std::size_t i = 0; i < count; i++)
+    {
+        workers_.push_back(std::thread(&WorkerPool::run, this));
+        if (cpus.empty())
+            continue;
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (pin_threads)
+            CPU_SET(cpus[i % cpus.size()], &set);
+        else
+            for (std::size_t c = 0; c < cpus.size(); c++)
+                CPU_SET(cpus[c], &set);
+        if (pthread_setaffinity_np(workers_.back().native_handle(), sizeof(set), &set) != 0)
+            SP_LOG_WARN("Failed to set the cpu affinity of worker thread " << i);
+#else
+        if (i == 0)
+            SP_LOG_WARN("Worker thread cpu affinity is only supported on linux");
+#endif
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::size_t i = 0; i < workers_.size(); i++)
+        workers_[i].join();
+}
+
+WorkerPool &WorkerPool::shared()
+{
+    static WorkerPool pool(getenv("SP_SEGMENTER_WORKERS") != NULL ? std::max(0, atoi(getenv("SP_SEGMENTER_WORKERS"))) : 0,
+        sharedCPUs(), getenv("SP_SEGMENTER_PIN_THREADS") != NULL && atoi(getenv("SP_SEGMENTER_PIN_THREADS")) != 0);
+    return pool;
+}
+
+std::vector<int> WorkerPool::sharedCPUs()
+{
+    std::vector<int> cpus;
+    const char *list = getenv("SP_SEGMENTER_CPUS");
+    if (list != NULL && !parseCPUList(list, cpus))
+    {
+        SP_LOG_WARN("Ignoring SP_SEGMENTER_CPUS='" << list << "', expected a list like 0-7,12");
+        cpus.clear();
+    }
+    return cpus;
+}
+
+bool WorkerPool::isWorkerThread()
+{
+    return on_worker_thread;
+}
+
+bool WorkerPool::parseCPUList(const std::string &list, std::vector<int> &cpus)
+{
+    std::vector<int> result;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ','))
+    {
+        int first, last;
+        char dash, rest;
+        std::istringstream rs(range);
+        if (!(rs >> first) || first < 0)
+            return false;
+        last = first;
+        if (rs >> dash && (dash != '-' || !(rs >> last) || last < first))
+            return false;
+        if (rs >> rest)
+            return false;
+        for (int cpu = first; cpu <= last; cpu++)
+            result.push_back(cpu);
+    }
+    if (result.empty())
+        return false;
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    cpus.swap(result);
+    return true;
+}
+
+void WorkerPool::run()
+{
+    on_worker_thread = true;
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+            if (queue_.empty())
+                return;
+            task = queue_.front();
+            queue_.pop_front();
+        }
+        task();
+    }
+}
@@ -75,6 +75,7 @@ int main (int argc, char **argv) {
   int world_only; // only show collisions to the world
   int verbosity; // how much nonsense should we print out
   double padding; // how much padding do we give robot links?
+  int max_contacts; // contact budget of each collision check
 
   ros::init(argc, argv, "predicator_robot_collision_node");
 
@@ -92,6 +93,7 @@ int main (int argc, char **argv) {
   nh_tilde.param("world_collisions_only", world_only, 1);
   nh_tilde.param("verbosity", verbosity, 0);
   nh_tilde.param("padding", padding, 0.01);
+  nh_tilde.param("max_contacts", max_contacts, 1000);
 
   ros::Subscriber js_sub = nh.subscribe("/joint_states", 1000, joint_state_callback);
   ros::Subscriber ps_sub = nh.subscribe("/planning_scene", 1000, planning_scene_callback);
@@ -142,7 +144,7 @@ int main (int argc, char **argv) {
     collision_request.verbose = false;
   }
   collision_request.cost = true;
-  collision_request.max_contacts = 1000;
+  collision_request.max_contacts = max_contacts;
 
   // ignore all self collisions
   collision_detection::AllowedCollisionMatrix acm = scene->getAllowedCollisionMatrix();
@@ -10,6 +10,7 @@
 // stl
 #include <vector>
 #include <set>
+#include <algorithm>
 
 // MoveIt!
 #include <moveit/collision_detection/collision_robot.h>
@@ -70,6 +71,7 @@ void cleanup() {
 int main(int argc, char **argv) {
 
   double padding; // how much padding do we give robot links?
+  int max_contacts; // contact budget of each collision check
   int verbosity; // how much should get printed for debugging purposes
   std::map<std::string, std::string> floating_frames;
   std::string world_frame;
@@ -85,6 +87,7 @@ int main(int argc, char **argv) {
 
   nh_tilde.param("verbosity", verbosity, 0);
   nh_tilde.param("padding", padding, 0.01);
+  nh_tilde.param("max_contacts", max_contacts, 1000);
   nh_tilde.param("world_frame", world_frame, std::string("/world"));
 
   ros::Publisher pub = nh.advertise<predicator_msgs::PredicateList>("/predicator/input", 1000);
@@ -283,17 +286,34 @@ int main(int argc, char **argv) {
 
         collision_detection::CollisionRobotConstPtr robot2 = (*it2)->getCollisionRobot();
 
-        collision_detection::CollisionRequest req;
-        collision_detection::CollisionResult res;
-        req.contacts = true;
-        req.max_contacts = 1000;
-
         // force an update
         // source: https://groups.google.com/forum/#!topic/moveit-users/O9CEef6sxbE
         states[i]->update(true);
         states[j]->update(true);
-        robot1->checkOtherCollision(req, res, *states[i], *robot2, *states[j]);
+
+        // a positive distance proves there is nothing to collide, so separated pairs take a single narrow phase walk
+        collision_detection::CollisionResult res;
         double dist = robot1->distanceOther(*states[i], *robot2, *states[j]);
+        if (dist <= 0) {
+          collision_detection::CollisionRequest req;
+          // a collision needs at least one contact for its penetration depth
+          req.contacts = true;
+          req.max_contacts = std::max(max_contacts, 1);
+          robot1->checkOtherCollision(req, res, *states[i], *robot2, *states[j]);
+
+          // report the deepest penetration
+          if (res.collision) {
+            dist = 0;
+            for(collision_detection::CollisionResult::ContactMap::const_iterator cit = res.contacts.begin();
+                cit != res.contacts.end();
+                ++cit)
+            {
+              for (unsigned int k = 0; k < cit->second.size(); ++k) {
+                dist = std::min(dist, -1.0 * cit->second[k].depth);
+              }
+            }
+          }
+        }
 
         // write distance predicate
         predicator_msgs::PredicateStatement ps_dist;
@@ -313,9 +333,9 @@ int main(int argc, char **argv) {
         ps_dist2.params[1] = robot2->getRobotModel()->getName();
         output.statements.push_back(ps_dist2);
 
-        // iterate over all collisions
+        // iterate over all collisions, there are no link level predicates without a contact budget
         for(collision_detection::CollisionResult::ContactMap::const_iterator cit = res.contacts.begin(); 
-            cit != res.contacts.end(); 
+            max_contacts > 0 && cit != res.contacts.end(); 
             ++cit)
         {
           // write the correct predicate
@@ -1,63 +1,499 @@
 #include <ros/ros.h>
 #include <unordered_map>
+#include <unordered_set>
 #include <predicator_msgs/PredicateStatement.h>
 #include <predicator_msgs/PredicateSet.h>
 #include <predicator_msgs/PredicateList.h>
+#include <predicator_msgs/PredicateDelta.h>
 #include <predicator_msgs/PredicateAssignment.h>
+#include <predicator_msgs/ValidPredicates.h>
+#include <predicator_msgs/UpdateParam.h>
+#include <predicator_msgs/TestPredicate.h>
+#include <predicator_msgs/GetAssignment.h>
+#include <predicator_msgs/GetList.h>
+#include <predicator_msgs/GetTypedList.h>
+#include <predicator_msgs/GetLength.h>
+#include <predicator_msgs/GetAllPredicates.h>
+#include <predicator_msgs/Query.h>
+#include "predicate_store.h"
 #include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <algorithm>
 #include <functional>
 
 using std::string;
 using std::unordered_map;
 using namespace predicator_msgs;
 
-namespace std {
+/**
+  predicator_core
+  Native version of core.py. Merges the predicate lists of all sources into one interned store,
+  answers the core services from indices and publishes the changes as predicator/delta.
+  Values of statements that stay true are only sent once they move more than value_tolerance.
+  The full predicator/list and predicator/all messages are only sent when something changed,
+  and at most every full_period seconds.
+ **/
+namespace predicator_core {
 
-  struct Hash {
+  // source name used for statements added through predicator/update_param
+  static const std::string STORED_PARAMS = "~stored_params";
 
-    std::hash<std::string> hash_str;
+  /**
+   * Core
+   * ROS interface of the store, same topics and services as core.py plus predicator/delta
+   */
+  class Core {
+  public:
 
-    Hash() : hash_str() {}
+    Core() : nh(), nh_tilde("~"), dirty(true), delta_seq(0) {
+      nh_tilde.param("verbosity", verbosity, 0);
+      nh_tilde.param("full_period", full_period, 1.0);
+      double value_tolerance;
+      nh_tilde.param("value_tolerance", value_tolerance, 0.01);
+      store.setValueTolerance(value_tolerance);
 
-    size_t operator()(const PredicateStatement &msg) {
+      input_sub = nh.subscribe("predicator/input", 1000, &Core::inputCallback, this);
+      valid_sub = nh.subscribe("predicator/valid_input", 1000, &Core::validCallback, this);
+      param_sub = nh.subscribe("predicator/update_param", 1000, &Core::updateCallback, this);
 
-      size_t res = hash_str(msg.predicate);
+      set_pub = nh.advertise<PredicateSet>("predicator/all", 1000);
+      list_pub = nh.advertise<PredicateList>("predicator/list", 1000);
+      delta_pub = nh.advertise<PredicateDelta>("predicator/delta", 1000);
 
-      for (unsigned int i = 0; i < msg.num_params; ++i) {
-        res += hash_str(msg.params[i]) << (3*i);
+      services.push_back(nh.advertiseService("predicator/test_predicate", &Core::testPredicate, this));
+      services.push_back(nh.advertiseService("predicator/get_assignment", &Core::getAssignment, this));
+      services.push_back(nh.advertiseService("predicator/get_value_predicates", &Core::getValuePredicates, this));
+      services.push_back(nh.advertiseService("predicator/get_predicates", &Core::getPredicates, this));
+      services.push_back(nh.advertiseService("predicator/get_possible_assignment", &Core::getAssignments, this));
+      services.push_back(nh.advertiseService("predicator/get_predicate_names_by_source", &Core::getPredicatesBySource, this));
+      services.push_back(nh.advertiseService("predicator/get_assignment_names_by_source", &Core::getAssignmentsBySource, this));
+      services.push_back(nh.advertiseService("predicator/get_sources", &Core::getSources, this));
+      services.push_back(nh.advertiseService("predicator/get_all_predicates_by_source", &Core::getAllBySource, this));
+      services.push_back(nh.advertiseService("predicator/get_predicate_names_by_assignment", &Core::getPredicatesByAssignment, this));
+      services.push_back(nh.advertiseService("predicator/get_assignment_length", &Core::getLength, this));
+      services.push_back(nh.advertiseService("predicator/match_AND", &Core::matchAnd, this));
+      services.push_back(nh.advertiseService("predicator/match_OR", &Core::matchOr, this));
+    }
+
+    /*
+     * publish()
+     * Send the delta since the last call, and the full messages if they are due
+     */
+    void publish() {
+      std::vector<unsigned int> added, removed, updated;
+      store.takeDelta(added, removed, updated);
+
+      if (added.size() > 0 || removed.size() > 0 || updated.size() > 0) {
+        PredicateDelta delta;
+        delta.header.seq = delta_seq++;
+        delta.header.stamp = ros::Time::now();
+        delta.pheader.source = ros::this_node::getName();
+        for (unsigned int i = 0; i < added.size(); ++i) {
+          delta.added.push_back(store.statement(added[i]));
+        }
+        for (unsigned int i = 0; i < removed.size(); ++i) {
+          delta.removed.push_back(store.statement(removed[i]));
+        }
+        for (unsigned int i = 0; i < updated.size(); ++i) {
+          delta.updated.push_back(store.statement(updated[i]));
+        }
+        delta_pub.publish(delta);
+        dirty = true;
+
+        if (verbosity > 0) {
+          ROS_INFO("%lu added, %lu removed, %lu updated", added.size(), removed.size(), updated.size());
+        }
       }
 
-      return res;
+      ros::Time now = ros::Time::now();
+      if (dirty && (now - last_full).toSec() >= full_period) {
+        publishFull();
+        last_full = now;
+        dirty = false;
+      }
+    }
+
+  private:
+
+    /*
+     * publishFull()
+     * predicator/list with every true statement, and predicator/all with the same assignment keys as core.py
+     */
+    void publishFull() {
+      std::vector<unsigned int> ids;
+      store.all(ids);
+
+      PredicateList list;
+      list.pheader.source = ros::this_node::getName();
+      for (unsigned int i = 0; i < ids.size(); ++i) {
+        list.statements.push_back(store.statement(ids[i]));
+      }
+      list_pub.publish(list);
+
+      // every statement is listed under its own key, under one key per parameter replaced by "*",
+      // and under the key of its predicate with no parameters
+      std::map<std::vector<std::string>, unsigned int> assignment_idx;
+      PredicateSet set;
+      set.pheader.source = ros::this_node::getName();
+      for (unsigned int i = 0; i < list.statements.size(); ++i) {
+        const PredicateStatement &ps = list.statements[i];
+        addAssignment(set, assignment_idx, ps, -1, false);
+        for (int j = 0; j < ps.num_params && j < 3; ++j) {
+          addAssignment(set, assignment_idx, ps, j, false);
+        }
+        if (ps.num_params > 1) {
+          addAssignment(set, assignment_idx, ps, -1, true);
+        }
+      }
+      set_pub.publish(set);
     }
-  };
 
-  struct Equals {
-    bool operator()(const PredicateStatement &msg1,
-                    const PredicateStatement &msg2)
+    static void addAssignment(PredicateSet &set, std::map<std::vector<std::string>, unsigned int> &assignment_idx,
+                              const PredicateStatement &ps, int free_param, bool no_params)
     {
-      return msg1.predicate == msg2.predicate &&
-        msg1.num_params == msg2.num_params &&
-        msg1.params[0] == msg2.params[0] &&
-        msg1.params[1] == msg2.params[1] &&
-        msg1.params[2] == msg2.params[2] &&
-        msg1.params[3] == msg2.params[3];
+      PredicateStatement key_ps;
+      key_ps.predicate = ps.predicate;
+      key_ps.num_params = ps.num_params;
+      for (int i = 0; i < 3 && !no_params; ++i) {
+        key_ps.params[i] = i == free_param ? std::string("*") : ps.params[i];
+      }
+
+      std::vector<std::string> key;
+      key.push_back(key_ps.predicate);
+      key.insert(key.end(), key_ps.params.begin(), key_ps.params.end());
+
+      std::map<std::vector<std::string>, unsigned int>::iterator it = assignment_idx.find(key);
+      if (it == assignment_idx.end()) {
+        PredicateAssignment pa;
+        pa.statement = key_ps;
+        it = assignment_idx.insert(std::make_pair(key, (unsigned int)set.assignments.size())).first;
+        set.assignments.push_back(pa);
+      }
+
+      // only the exact key has no values, same as core.py
+      if (free_param >= 0 || no_params) {
+        set.assignments[it->second].values.push_back(ps);
+      }
     }
-  };
-}
 
-// store incoming messages
-std::unordered_map<string, PredicateList> recvd_lists;
+    /*
+     * inputCallback()
+     * read in predicate messages and record their source
+     */
+    void inputCallback(const PredicateList::ConstPtr &msg) {
+      if (msg->pheader.source.size() == 0) {
+        if (msg->statements.size() > 0) {
+          ROS_ERROR("Could not recognize sender of predicate \"%s\", was source provided?", msg->statements[0].predicate.c_str());
+        } else {
+          ROS_ERROR("Could not recognize sender of empty predicate list, was source provided?");
+        }
+      }
+
+      const std::set<std::string> &valid = predicates_by_source[msg->pheader.source];
 
-// store predicates that are true
-std::unordered_map<PredicateStatement, std::vector<PredicateStatement>, std::Hash, std::Equals > preds;
+      std::vector<unsigned int> ids;
+      ids.reserve(msg->statements.size());
+      for (unsigned int i = 0; i < msg->statements.size(); ++i) {
+        const PredicateStatement &ps = msg->statements[i];
+        if (valid.find(ps.predicate) == valid.end()) {
+          ROS_ERROR_THROTTLE(1.0, "Predicate %s not defined for source %s!", ps.predicate.c_str(), msg->pheader.source.c_str());
+          continue;
+        }
+        ids.push_back(store.intern(ps));
+      }
 
-//ros::Subscriber sub;
-//ros::Publisher pub;
+      store.setSource(msg->pheader.source, ids);
+    }
+
+    /*
+     * validCallback()
+     * read in sets of valid predicates from various sources
+     */
+    void validCallback(const ValidPredicates::ConstPtr &msg) {
+      if (msg->pheader.source.size() == 0) {
+        ROS_ERROR("empty source field in valid predicates list!");
+      }
+
+      all_predicates.insert(msg->predicates.begin(), msg->predicates.end());
+      all_value_predicates.insert(msg->value_predicates.begin(), msg->value_predicates.end());
+      all_assignments.insert(msg->assignments.begin(), msg->assignments.end());
+      sources.insert(msg->pheader.source);
+
+      std::vector<std::string> names(msg->predicates);
+      names.insert(names.end(), msg->value_predicates.begin(), msg->value_predicates.end());
+
+      predicate_names_by_source[msg->pheader.source] = names;
+      predicates_by_source[msg->pheader.source] = std::set<std::string>(names.begin(), names.end());
+      assignments_by_source[msg->pheader.source] = msg->assignments;
+      for (unsigned int i = 0; i < msg->assignments.size(); ++i) {
+        predicates_by_assignment[msg->assignments[i]] = names;
+      }
+      for (unsigned int i = 0; i < msg->predicate_length.size() && i < msg->predicates.size(); ++i) {
+        lengths[msg->predicates[i]] = msg->predicate_length[i];
+      }
+    }
+
+    /*
+     * updateCallback()
+     * update the set of parameters we have stored to predicator
+     */
+    void updateCallback(const UpdateParam::ConstPtr &msg) {
+      unsigned int id;
+      if (msg->operation == UpdateParam::PUBLISH_PREDICATE) {
+        if (verbosity > 0) {
+          ROS_INFO("Adding parameter %s", msg->statement.predicate.c_str());
+        }
+        stored_params.insert(store.intern(msg->statement));
+      } else if (msg->operation == UpdateParam::REMOVE_PREDICATE) {
+        if (verbosity > 0) {
+          ROS_INFO("Removing parameter %s", msg->statement.predicate.c_str());
+        }
+        if (store.find(msg->statement, id)) {
+          stored_params.erase(id);
+        }
+      }
+      store.setSource(STORED_PARAMS, std::vector<unsigned int>(stored_params.begin(), stored_params.end()));
+    }
+
+    bool testPredicate(TestPredicate::Request &req, TestPredicate::Response &res) {
+      std::vector<unsigned int> ids;
+      store.match(req.statement, ids);
+      res.found = ids.size() > 0;
+      return true;
+    }
+
+    bool getAssignment(GetAssignment::Request &req, GetAssignment::Response &res) {
+      std::vector<unsigned int> ids;
+      store.match(req.statement, ids);
+      for (unsigned int i = 0; i < ids.size(); ++i) {
+        PredicateStatement ps = store.statement(ids[i]);
+        ps.num_params = req.statement.num_params;
+        res.values.push_back(ps);
+      }
+      res.found = ids.size() > 0;
+      return true;
+    }
+
+    bool getValuePredicates(GetList::Request &req, GetList::Response &res) {
+      res.data.assign(all_value_predicates.begin(), all_value_predicates.end());
+      return true;
+    }
+
+    bool getPredicates(GetList::Request &req, GetList::Response &res) {
+      res.data.assign(all_predicates.begin(), all_predicates.end());
+      return true;
+    }
+
+    bool getSources(GetList::Request &req, GetList::Response &res) {
+      res.data.assign(sources.begin(), sources.end());
+      return true;
+    }
 
-void input_callback(const PredicateStatement::ConstPtr msg) {
-  
+    bool getLength(GetLength::Request &req, GetLength::Response &res) {
+      std::map<std::string, int>::const_iterator it = lengths.find(req.predicate);
+      res.length = it == lengths.end() ? -1 : it->second;
+      return true;
+    }
+
+    bool getPredicatesBySource(GetTypedList::Request &req, GetTypedList::Response &res) {
+      lookupList(predicate_names_by_source, req.id, res.data);
+      return true;
+    }
+
+    bool getAssignmentsBySource(GetTypedList::Request &req, GetTypedList::Response &res) {
+      lookupList(assignments_by_source, req.id, res.data);
+      return true;
+    }
+
+    bool getPredicatesByAssignment(GetTypedList::Request &req, GetTypedList::Response &res) {
+      lookupList(predicates_by_assignment, req.id, res.data);
+      return true;
+    }
+
+    /*
+     * getAssignments()
+     * get the possible list of assignments to a 1-param predicate (class predicate)
+     */
+    bool getAssignments(GetTypedList::Request &req, GetTypedList::Response &res) {
+      if (req.id.size() == 0) {
+        res.data.assign(all_assignments.begin(), all_assignments.end());
+        return true;
+      }
+
+      PredicateStatement query;
+      query.predicate = req.id;
+      query.params[0] = "*";
+      std::vector<unsigned int> ids;
+      store.match(query, ids);
+      for (unsigned int i = 0; i < ids.size(); ++i) {
+        res.data.push_back(store.param(ids[i], 0));
+      }
+      return true;
+    }
+
+    /*
+     * getAllBySource()
+     * every statement a source could produce from its assignments, and whether it is true
+     */
+    bool getAllBySource(GetAllPredicates::Request &req, GetAllPredicates::Response &res) {
+      const std::vector<std::string> &names = predicate_names_by_source[req.id];
+      const std::vector<std::string> &assignments = assignments_by_source[req.id];
+
+      for (unsigned int n = 0; n < names.size(); ++n) {
+        std::map<std::string, int>::const_iterator len = lengths.find(names[n]);
+        if (len == lengths.end()) {
+          ROS_WARN("Could not find declared predicate lengths; returning current true predicates instead.");
+          continue;
+        }
+
+        std::vector<PredicateStatement> statements(1);
+        statements[0].predicate = names[n];
+        for (int i = 0; i < std::min(len->second, 3); ++i) {
+          std::vector<PredicateStatement> next;
+          for (unsigned int s = 0; s < statements.size(); ++s) {
+            for (unsigned int a = 0; a < assignments.size(); ++a) {
+              PredicateStatement ps = statements[s];
+              ps.params[i] = assignments[a];
+              next.push_back(ps);
+            }
+          }
+          statements.swap(next);
+        }
+        res.predicates.insert(res.predicates.end(), statements.begin(), statements.end());
+      }
+
+      for (unsigned int i = 0; i < res.predicates.size(); ++i) {
+        std::vector<unsigned int> ids;
+        store.match(res.predicates[i], ids);
+        res.is_true.push_back(ids.size() > 0);
+      }
+      return true;
+    }
+
+    /*
+     * matchAnd()
+     * assignments of the "*" parameter that make every query predicate true
+     */
+    bool matchAnd(Query::Request &req, Query::Response &res) {
+      std::vector<std::string> vals;
+      for (unsigned int p = 0; p < req.predicates.size(); ++p) {
+        std::vector<std::string> pred_vals;
+        if (!freeValues(req.predicates[p], pred_vals)) {
+          return true;
+        }
+
+        if (pred_vals.size() == 0) {
+          vals.clear();
+          break;
+        } else if (p == 0) {
+          vals = pred_vals;
+        } else {
+          std::set<std::string> lookup(pred_vals.begin(), pred_vals.end());
+          std::vector<std::string> kept;
+          for (unsigned int i = 0; i < vals.size(); ++i) {
+            if (lookup.find(vals[i]) != lookup.end()) {
+              kept.push_back(vals[i]);
+            }
+          }
+          vals.swap(kept);
+        }
+      }
+
+      res.matching = vals;
+      res.found = vals.size() > 0;
+      return true;
+    }
+
+    /*
+     * matchOr()
+     * assignments of the "*" parameter that make any query predicate true
+     */
+    bool matchOr(Query::Request &req, Query::Response &res) {
+      for (unsigned int p = 0; p < req.predicates.size(); ++p) {
+        std::vector<std::string> pred_vals;
+        if (!freeValues(req.predicates[p], pred_vals)) {
+          return true;
+        }
+        res.matching.insert(res.matching.end(), pred_vals.begin(), pred_vals.end());
+      }
+      res.found = res.matching.size() > 0;
+      return true;
+    }
+
+    // values of the "*" parameter over the matching statements
+    bool freeValues(const PredicateStatement &query, std::vector<std::string> &vals) const {
+      int free_param = -1;
+      for (int i = 0; i < 3 && free_param < 0; ++i) {
+        if (query.params[i] == "*") {
+          free_param = i;
+        }
+      }
+      if (free_param < 0) {
+        ROS_ERROR("Query with no open parameters! Include exactly one \"*\" field!");
+        return false;
+      }
+
+      std::vector<unsigned int> ids;
+      store.match(query, ids);
+      for (unsigned int i = 0; i < ids.size(); ++i) {
+        vals.push_back(store.param(ids[i], free_param));
+      }
+      return true;
+    }
+
+    static void lookupList(const std::map<std::string, std::vector<std::string> > &lists, const std::string &id,
+                           std::vector<std::string> &out)
+    {
+      std::map<std::string, std::vector<std::string> >::const_iterator it = lists.find(id);
+      if (it != lists.end()) {
+        out = it->second;
+      }
+    }
+
+    ros::NodeHandle nh;
+    ros::NodeHandle nh_tilde;
+    ros::Subscriber input_sub, valid_sub, param_sub;
+    ros::Publisher set_pub, list_pub, delta_pub;
+    std::vector<ros::ServiceServer> services;
+
+    int verbosity;
+    double full_period; // minimum time between two full messages
+    bool dirty; // something changed since the last full messages
+    unsigned int delta_seq; // lets subscribers detect a missed delta
+    ros::Time last_full;
+
+    PredicateStore store;
+    std::set<unsigned int> stored_params;
+
+    std::set<std::string> all_predicates;
+    std::set<std::string> all_value_predicates;
+    std::set<std::string> all_assignments;
+    std::set<std::string> sources;
+    std::map<std::string, std::set<std::string> > predicates_by_source;
+    std::map<std::string, std::vector<std::string> > predicate_names_by_source;
+    std::map<std::string, std::vector<std::string> > assignments_by_source;
+    std::map<std::string, std::vector<std::string> > predicates_by_assignment;
+    std::map<std::string, int> lengths;
+  };
 }
 
 int main(int argc, char **argv) {
-  
+  ros::init(argc, argv, "predicator_core");
+
+  ros::NodeHandle nh_tilde("~");
+  double spin_rate;
+  nh_tilde.param("rate", spin_rate, 10.0);
+
+  predicator_core::Core core;
+  ros::Rate rate(spin_rate);
+
+  while (ros::ok()) {
+    ros::spinOnce();
+    core.publish();
+    rate.sleep();
+  }
+
+  return 0;
 }
@@ -0,0 +1,357 @@
+#ifndef PREDICATOR_CORE_PREDICATE_STORE_H
+#define PREDICATOR_CORE_PREDICATE_STORE_H
+
+#include <unordered_map>
+#include <unordered_set>
+#include <predicator_msgs/PredicateStatement.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+/**
+  PredicateStore
+  Interned statement store of predicator_core, kept apart from the ROS node so it can be tested on its own.
+ **/
+namespace predicator_core {
+
+  using std::unordered_map;
+  using predicator_msgs::PredicateStatement;
+
+  /**
+   * SymbolTable
+   * Interns predicate names and parameters as dense integer ids.
+   * Id 0 is always the empty string, which is used for unset parameters.
+   */
+  class SymbolTable {
+  public:
+    SymbolTable() {
+      intern(std::string());
+    }
+
+    unsigned int intern(const std::string &name) {
+      unordered_map<std::string, unsigned int>::const_iterator it = ids.find(name);
+      if (it != ids.end()) {
+        return it->second;
+      }
+      unsigned int id = names.size();
+      ids[name] = id;
+      names.push_back(name);
+      return id;
+    }
+
+    // returns false if name was never interned
+    bool find(const std::string &name, unsigned int &id) const {
+      unordered_map<std::string, unsigned int>::const_iterator it = ids.find(name);
+      if (it == ids.end()) {
+        return false;
+      }
+      id = it->second;
+      return true;
+    }
+
+    const std::string &name(unsigned int id) const {
+      return names[id];
+    }
+
+  private:
+    unordered_map<std::string, unsigned int> ids;
+    std::vector<std::string> names;
+  };
+
+  /**
+   * Key
+   * A predicate statement with all of its strings replaced by symbol ids
+   */
+  struct Key {
+    unsigned int predicate;
+    unsigned int params[3];
+
+    bool operator==(const Key &other) const {
+      return predicate == other.predicate &&
+        params[0] == other.params[0] &&
+        params[1] == other.params[1] &&
+        params[2] == other.params[2];
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key &key) const {
+      size_t res = key.predicate;
+      for (unsigned int i = 0; i < 3; ++i) {
+        res = res * 31 + key.params[i];
+      }
+      return res;
+    }
+  };
+
+  typedef std::unordered_set<unsigned int> id_set_t;
+
+  /**
+   * PredicateStore
+   * Every statement the core has seen gets a dense id.
+   * A statement is true while at least one source asserts it; the by-predicate and by-parameter indices only hold true statements.
+   * A statement has one value shared by all sources, the last one interned wins.
+   * Deltas report truth changes apart from value updates, and only values that moved more than value_tolerance
+   * from the last reported one, so noisy values of statements that stay true produce no deltas.
+   */
+  class PredicateStore {
+  public:
+
+    PredicateStore() : value_tolerance(0) {
+      wildcard = symbols.intern("*");
+    }
+
+    void setValueTolerance(double tolerance) {
+      value_tolerance = tolerance;
+    }
+
+    /*
+     * intern()
+     * Id of the statement, with its value set to the one of ps
+     */
+    unsigned int intern(const PredicateStatement &ps) {
+      Key key;
+      key.predicate = symbols.intern(ps.predicate);
+      for (unsigned int i = 0; i < 3; ++i) {
+        key.params[i] = symbols.intern(ps.params[i]);
+      }
+
+      unordered_map<Key, unsigned int, KeyHash>::const_iterator it = ids.find(key);
+      if (it != ids.end()) {
+        unsigned int id = it->second;
+        values[id] = ps.value;
+        if (std::fabs(ps.value - published_values[id]) > value_tolerance) {
+          markChanged(id);
+        }
+        return id;
+      }
+
+      unsigned int id = keys.size();
+      ids[key] = id;
+      keys.push_back(key);
+      num_params.push_back(ps.num_params);
+      values.push_back(ps.value);
+      counts.push_back(0);
+      published.push_back(0);
+      published_values.push_back(ps.value);
+      is_changed.push_back(0);
+      return id;
+    }
+
+    // returns false if the statement was never interned, leaves its value alone
+    bool find(const PredicateStatement &ps, unsigned int &id) const {
+      Key key;
+      if (!symbols.find(ps.predicate, key.predicate)) {
+        return false;
+      }
+      for (unsigned int i = 0; i < 3; ++i) {
+        if (!symbols.find(ps.params[i], key.params[i])) {
+          return false;
+        }
+      }
+      unordered_map<Key, unsigned int, KeyHash>::const_iterator it = ids.find(key);
+      if (it == ids.end()) {
+        return false;
+      }
+      id = it->second;
+      return true;
+    }
+
+    /*
+     * setSource()
+     * Replace everything asserted by source with ids
+     */
+    void setSource(const std::string &source, std::vector<unsigned int> ids) {
+      std::sort(ids.begin(), ids.end());
+      ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+      std::vector<unsigned int> &old_ids = by_source[source];
+
+      // both lists are sorted, so one merge finds what was added and removed
+      std::vector<unsigned int>::const_iterator a = old_ids.begin();
+      std::vector<unsigned int>::const_iterator b = ids.begin();
+      while (a != old_ids.end() || b != ids.end()) {
+        if (b == ids.end() || (a != old_ids.end() && *a < *b)) {
+          release(*a++);
+        } else if (a == old_ids.end() || *b < *a) {
+          acquire(*b++);
+        } else {
+          ++a;
+          ++b;
+        }
+      }
+
+      old_ids.swap(ids);
+    }
+
+    bool isTrue(unsigned int id) const {
+      return counts[id] > 0;
+    }
+
+    /*
+     * match()
+     * True statements matching query. A "*" parameter matches anything,
+     * a query with no parameters at all matches every statement of the predicate.
+     */
+    void match(const PredicateStatement &query, std::vector<unsigned int> &out) const {
+      out.clear();
+
+      unsigned int predicate;
+      if (!symbols.find(query.predicate, predicate)) {
+        return;
+      }
+
+      bool any = true;
+      unsigned int params[3];
+      for (unsigned int i = 0; i < 3; ++i) {
+        if (!symbols.find(query.params[i], params[i])) {
+          return;
+        }
+        any = any && params[i] == 0;
+      }
+
+      // scan the smallest index that constrains the query
+      const id_set_t *candidates = find(by_predicate, predicate);
+      for (unsigned int i = 0; i < 3 && !any && candidates != NULL; ++i) {
+        if (params[i] == wildcard || params[i] == 0) {
+          continue;
+        }
+        const id_set_t *param_set = find(by_param, params[i]);
+        if (param_set == NULL) {
+          candidates = NULL;
+        } else if (param_set->size() < candidates->size()) {
+          candidates = param_set;
+        }
+      }
+      if (candidates == NULL) {
+        return;
+      }
+
+      for (id_set_t::const_iterator it = candidates->begin(); it != candidates->end(); ++it) {
+        const Key &key = keys[*it];
+        bool matches = key.predicate == predicate;
+        for (unsigned int i = 0; i < 3 && matches && !any; ++i) {
+          matches = params[i] == wildcard || params[i] == key.params[i];
+        }
+        if (matches) {
+          out.push_back(*it);
+        }
+      }
+      std::sort(out.begin(), out.end());
+    }
+
+    // all true statements
+    void all(std::vector<unsigned int> &out) const {
+      out.clear();
+      for (unordered_map<unsigned int, id_set_t>::const_iterator it = by_predicate.begin(); it != by_predicate.end(); ++it) {
+        out.insert(out.end(), it->second.begin(), it->second.end());
+      }
+      std::sort(out.begin(), out.end());
+    }
+
+    /*
+     * takeDelta()
+     * What became true or false since the last call, and in updated the statements that stayed true
+     * with a value more than value_tolerance away from the one last reported.
+     */
+    void takeDelta(std::vector<unsigned int> &added, std::vector<unsigned int> &removed, std::vector<unsigned int> &updated) {
+      added.clear();
+      removed.clear();
+      updated.clear();
+      for (unsigned int i = 0; i < changed.size(); ++i) {
+        unsigned int id = changed[i];
+        is_changed[id] = 0;
+        if (isTrue(id) && !published[id]) {
+          added.push_back(id);
+          published_values[id] = values[id];
+        } else if (!isTrue(id) && published[id]) {
+          removed.push_back(id);
+        } else if (isTrue(id) && std::fabs(values[id] - published_values[id]) > value_tolerance) {
+          updated.push_back(id);
+          published_values[id] = values[id];
+        }
+        published[id] = isTrue(id);
+      }
+      changed.clear();
+    }
+
+    PredicateStatement statement(unsigned int id) const {
+      const Key &key = keys[id];
+      PredicateStatement ps;
+      ps.predicate = symbols.name(key.predicate);
+      for (unsigned int i = 0; i < 3; ++i) {
+        ps.params[i] = symbols.name(key.params[i]);
+      }
+      ps.num_params = num_params[id];
+      ps.value = values[id];
+      return ps;
+    }
+
+    const std::string &param(unsigned int id, unsigned int i) const {
+      return symbols.name(keys[id].params[i]);
+    }
+
+  private:
+
+    static const id_set_t *find(const unordered_map<unsigned int, id_set_t> &index, unsigned int symbol) {
+      unordered_map<unsigned int, id_set_t>::const_iterator it = index.find(symbol);
+      return it == index.end() ? NULL : &it->second;
+    }
+
+    void markChanged(unsigned int id) {
+      if (!is_changed[id]) {
+        is_changed[id] = 1;
+        changed.push_back(id);
+      }
+    }
+
+    // one more source asserts id
+    void acquire(unsigned int id) {
+      if (counts[id]++ == 0) {
+        const Key &key = keys[id];
+        by_predicate[key.predicate].insert(id);
+        for (unsigned int i = 0; i < 3; ++i) {
+          if (key.params[i] != 0) {
+            by_param[key.params[i]].insert(id);
+          }
+        }
+        markChanged(id);
+      }
+    }
+
+    // one less source asserts id
+    void release(unsigned int id) {
+      if (--counts[id] == 0) {
+        const Key &key = keys[id];
+        by_predicate[key.predicate].erase(id);
+        for (unsigned int i = 0; i < 3; ++i) {
+          if (key.params[i] != 0) {
+            by_param[key.params[i]].erase(id);
+          }
+        }
+        markChanged(id);
+      }
+    }
+
+    SymbolTable symbols;
+    unsigned int wildcard;
+
+    unordered_map<Key, unsigned int, KeyHash> ids;
+    std::vector<Key> keys;
+    std::vector<int> num_params;
+    std::vector<double> values;
+    std::vector<unsigned int> counts; // number of sources asserting each statement
+    std::vector<char> published; // true as of the last delta
+    std::vector<double> published_values; // value as of the last delta that added or updated the statement
+    std::vector<char> is_changed;
+    std::vector<unsigned int> changed;
+
+    unordered_map<unsigned int, id_set_t> by_predicate;
+    unordered_map<unsigned int, id_set_t> by_param;
+    unordered_map<std::string, std::vector<unsigned int> > by_source; // sorted
+    double value_tolerance;
+  };
+}
+
+#endif // PREDICATOR_CORE_PREDICATE_STORE_H
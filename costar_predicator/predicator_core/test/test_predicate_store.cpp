@@ -0,0 +1,224 @@
+#include <gtest/gtest.h>
+
+#include "../src/predicator_core/predicate_store.h"
+
+using predicator_core::PredicateStore;
+using predicator_msgs::PredicateStatement;
+
+namespace {
+
+  PredicateStatement statement(const std::string &predicate, const std::string &a,
+                               const std::string &b = std::string(), double value = 1.0) {
+    PredicateStatement ps;
+    ps.predicate = predicate;
+    ps.params[0] = a;
+    ps.params[1] = b;
+    ps.num_params = b.empty() ? 1 : 2;
+    ps.value = value;
+    return ps;
+  }
+
+  std::vector<unsigned int> ids(unsigned int a) {
+    return std::vector<unsigned int>(1, a);
+  }
+
+  std::vector<unsigned int> ids(unsigned int a, unsigned int b) {
+    std::vector<unsigned int> res(1, a);
+    res.push_back(b);
+    return res;
+  }
+}
+
+TEST(PredicateStore, AddAndRemove) {
+  PredicateStore store;
+  unsigned int left = store.intern(statement("left_of", "a", "b"));
+  unsigned int near = store.intern(statement("near", "a", "b"));
+  std::vector<unsigned int> added, removed, updated;
+
+  // interning alone asserts nothing
+  store.takeDelta(added, removed, updated);
+  EXPECT_TRUE(added.empty());
+  EXPECT_TRUE(removed.empty());
+
+  store.setSource("geometry", ids(near, left));
+  store.takeDelta(added, removed, updated);
+  std::sort(added.begin(), added.end());
+  EXPECT_EQ(ids(left, near), added);
+  EXPECT_TRUE(removed.empty());
+
+  store.setSource("geometry", ids(near));
+  store.takeDelta(added, removed, updated);
+  EXPECT_TRUE(added.empty());
+  EXPECT_EQ(ids(left), removed);
+  EXPECT_FALSE(store.isTrue(left));
+  EXPECT_TRUE(store.isTrue(near));
+}
+
+TEST(PredicateStore, NoDeltaWithoutChanges) {
+  PredicateStore store;
+  unsigned int near = store.intern(statement("near", "a", "b"));
+  std::vector<unsigned int> added, removed, updated;
+  store.setSource("geometry", ids(near));
+  store.takeDelta(added, removed, updated);
+
+  // the same list again, and the same value again
+  store.setSource("geometry", ids(near));
+  EXPECT_EQ(near, store.intern(statement("near", "a", "b")));
+  store.takeDelta(added, removed, updated);
+  EXPECT_TRUE(added.empty());
+  EXPECT_TRUE(removed.empty());
+
+  // added and removed again before the next delta
+  store.setSource("geometry", std::vector<unsigned int>());
+  store.setSource("geometry", ids(near));
+  store.takeDelta(added, removed, updated);
+  EXPECT_TRUE(added.empty());
+  EXPECT_TRUE(removed.empty());
+}
+
+TEST(PredicateStore, SharedBetweenSources) {
+  PredicateStore store;
+  unsigned int near = store.intern(statement("near", "a", "b"));
+  std::vector<unsigned int> added, removed, updated;
+
+  store.setSource("geometry", ids(near));
+  store.setSource("vision", ids(near));
+  store.takeDelta(added, removed, updated);
+  EXPECT_EQ(ids(near), added);
+
+  // true until both sources drop it
+  store.setSource("geometry", std::vector<unsigned int>());
+  store.takeDelta(added, removed, updated);
+  EXPECT_TRUE(store.isTrue(near));
+  EXPECT_TRUE(added.empty());
+  EXPECT_TRUE(removed.empty());
+
+  store.setSource("vision", std::vector<unsigned int>());
+  store.takeDelta(added, removed, updated);
+  EXPECT_FALSE(store.isTrue(near));
+  EXPECT_EQ(ids(near), removed);
+}
+
+TEST(PredicateStore, ValueChange) {
+  PredicateStore store;
+  unsigned int near = store.intern(statement("near", "a", "b", 0.5));
+  std::vector<unsigned int> added, removed, updated;
+  store.setSource("geometry", ids(near));
+  store.takeDelta(added, removed, updated);
+  EXPECT_EQ(ids(near), added);
+  EXPECT_TRUE(updated.empty());
+
+  // a statement that stays true with a new value is an update, not a truth change
+  EXPECT_EQ(near, store.intern(statement("near", "a", "b", 0.25)));
+  store.setSource("geometry", ids(near));
+  store.takeDelta(added, removed, updated);
+  EXPECT_TRUE(added.empty());
+  EXPECT_TRUE(removed.empty());
+  EXPECT_EQ(ids(near), updated);
+  EXPECT_EQ(0.25, store.statement(near).value);
+
+  store.takeDelta(added, removed, updated);
+  EXPECT_TRUE(added.empty());
+  EXPECT_TRUE(updated.empty());
+
+  // a new value of a false statement is not a delta
+  store.setSource("geometry", std::vector<unsigned int>());
+  store.takeDelta(added, removed, updated);
+  store.intern(statement("near", "a", "b", 0.75));
+  store.takeDelta(added, removed, updated);
+  EXPECT_TRUE(added.empty());
+  EXPECT_TRUE(removed.empty());
+  EXPECT_TRUE(updated.empty());
+
+  // it is added with the value it has when it becomes true
+  store.setSource("geometry", ids(near));
+  store.takeDelta(added, removed, updated);
+  EXPECT_EQ(ids(near), added);
+  EXPECT_EQ(0.75, store.statement(near).value);
+}
+
+TEST(PredicateStore, ValueTolerance) {
+  PredicateStore store;
+  store.setValueTolerance(0.1);
+  unsigned int near = store.intern(statement("near", "a", "b", 0.5));
+  std::vector<unsigned int> added, removed, updated;
+  store.setSource("geometry", ids(near));
+  store.takeDelta(added, removed, updated);
+
+  // noise within the tolerance of the reported value gives empty deltas
+  const double noise[] = {0.55, 0.45, 0.58, 0.42};
+  for (unsigned int i = 0; i < 4; ++i) {
+    store.intern(statement("near", "a", "b", noise[i]));
+    store.setSource("geometry", ids(near));
+    store.takeDelta(added, removed, updated);
+    EXPECT_TRUE(added.empty());
+    EXPECT_TRUE(removed.empty());
+    EXPECT_TRUE(updated.empty());
+  }
+
+  // a slow drift is reported once it is past the tolerance of the last reported value
+  store.intern(statement("near", "a", "b", 0.65));
+  store.takeDelta(added, removed, updated);
+  EXPECT_EQ(ids(near), updated);
+  store.intern(statement("near", "a", "b", 0.7));
+  store.takeDelta(added, removed, updated);
+  EXPECT_TRUE(updated.empty());
+
+  // moving away and back before a delta is no update
+  store.intern(statement("near", "a", "b", 1.0));
+  store.intern(statement("near", "a", "b", 0.66));
+  store.takeDelta(added, removed, updated);
+  EXPECT_TRUE(updated.empty());
+}
+
+TEST(PredicateStore, Find) {
+  PredicateStore store;
+  unsigned int near = store.intern(statement("near", "a", "b", 0.5));
+  unsigned int id;
+
+  // find leaves the value alone
+  EXPECT_TRUE(store.find(statement("near", "a", "b", 0.25), id));
+  EXPECT_EQ(near, id);
+  EXPECT_EQ(0.5, store.statement(near).value);
+
+  EXPECT_FALSE(store.find(statement("near", "b", "a"), id));
+  EXPECT_FALSE(store.find(statement("far", "a", "b"), id));
+}
+
+TEST(PredicateStore, Match) {
+  PredicateStore store;
+  unsigned int ab = store.intern(statement("near", "a", "b"));
+  unsigned int ac = store.intern(statement("near", "a", "c"));
+  unsigned int cb = store.intern(statement("near", "c", "b"));
+  unsigned int left = store.intern(statement("left_of", "a", "b"));
+  std::vector<unsigned int> all;
+  all.push_back(ab);
+  all.push_back(ac);
+  all.push_back(left);
+  store.setSource("geometry", all);
+
+  std::vector<unsigned int> out;
+  store.match(statement("near", "a", "b"), out);
+  EXPECT_EQ(ids(ab), out);
+  store.match(statement("near", "a", "*"), out);
+  EXPECT_EQ(ids(ab, ac), out);
+  store.match(statement("near", "*", "b"), out);
+  EXPECT_EQ(ids(ab), out);
+
+  // no parameters match every statement of the predicate
+  PredicateStatement any;
+  any.predicate = "near";
+  store.match(any, out);
+  EXPECT_EQ(ids(ab, ac), out);
+
+  // only true statements match
+  store.match(statement("near", "c", "b"), out);
+  EXPECT_TRUE(out.empty());
+  store.match(statement("near", "unknown", "*"), out);
+  EXPECT_TRUE(out.empty());
+  EXPECT_FALSE(store.isTrue(cb));
+
+  std::vector<unsigned int> every;
+  store.all(every);
+  EXPECT_EQ(all, every);
+}
@@ -0,0 +1,108 @@
+#ifndef _PP_JOINT_INDEX
+#define _PP_JOINT_INDEX
+
+#include <vector>
+#include <limits>
+#include <cstddef>
+
+namespace predicator_planning {
+
+  /**
+   * JointIndex
+   * Incremental kd-tree over joint positions, used to find the closest node of the search tree.
+   * Nodes are never removed or rebalanced; the planner inserts random samples, so the depth stays O(log n) in practice.
+   */
+  class JointIndex {
+  public:
+
+    JointIndex(unsigned int dim = 0) : dim(dim) {}
+
+    void clear(unsigned int _dim) {
+      dim = _dim;
+      nodes.clear();
+      points.clear();
+    }
+
+    size_t size() const {
+      return nodes.size();
+    }
+
+    void insert(const std::vector<double> &point, unsigned int id) {
+      Node node;
+      node.id = id;
+      node.left = -1;
+      node.right = -1;
+      node.axis = 0;
+
+      int cur = nodes.empty() ? -1 : 0;
+      unsigned int depth = 0;
+      while (cur >= 0) {
+        Node &parent = nodes[cur];
+        bool left = point[parent.axis] < points[cur * dim + parent.axis];
+        int next = left ? parent.left : parent.right;
+        ++depth;
+        if (next < 0) {
+          if (left) {
+            parent.left = nodes.size();
+          } else {
+            parent.right = nodes.size();
+          }
+        }
+        cur = next;
+      }
+
+      node.axis = dim > 0 ? depth % dim : 0;
+      nodes.push_back(node);
+      points.insert(points.end(), point.begin(), point.begin() + dim);
+    }
+
+    /*
+     * nearest()
+     * id of the closest point by euclidean distance in joint space, the index must not be empty
+     */
+    unsigned int nearest(const std::vector<double> &point) const {
+      unsigned int best = 0;
+      double best_dist = std::numeric_limits<double>::max();
+      search(0, &point[0], best, best_dist);
+      return nodes[best].id;
+    }
+
+  private:
+
+    struct Node {
+      unsigned int id;
+      int left, right;
+      unsigned int axis;
+    };
+
+    void search(int cur, const double *point, unsigned int &best, double &best_dist) const {
+      if (cur < 0) {
+        return;
+      }
+
+      const double *p = &points[cur * dim];
+      double dist = 0;
+      for (unsigned int k = 0; k < dim; ++k) {
+        dist += (p[k] - point[k]) * (p[k] - point[k]);
+      }
+      if (dist < best_dist) {
+        best_dist = dist;
+        best = cur;
+      }
+
+      const Node &node = nodes[cur];
+      double diff = point[node.axis] - p[node.axis];
+      search(diff < 0 ? node.left : node.right, point, best, best_dist);
+      // the other side can only hold something closer if the splitting plane is within best_dist
+      if (diff * diff < best_dist) {
+        search(diff < 0 ? node.right : node.left, point, best, best_dist);
+      }
+    }
+
+    unsigned int dim;
+    std::vector<Node> nodes;
+    std::vector<double> points;
+  };
+}
+
+#endif
@@ -9,12 +9,57 @@
 
 // standard libraries for random
 #include <cstdlib>
-#include <unordered_set>
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
 
 namespace predicator_planning {
 
-  Planner::Planner(PredicateContext *_context, unsigned int _max_iter, double _step, double _chance, double _skip, double _search_volume) :
-    context(_context), max_iter(_max_iter), step(_step), chance(_chance), skip_distance(_skip), search_volume(_search_volume)
+  /*
+   * isTrue()
+   * is_true is indexed by statement id; statements the context never produces are never true
+   */
+  static inline bool isTrue(const PredicateContext *context, const std::vector<char> &is_true, const PredicateStatement &ps) {
+    unsigned int id;
+    return context->findHeuristic(ps, id) && is_true[id];
+  }
+
+  /*
+   * resolveGoals()
+   * helper for GoalIds, appends the known statements to ids
+   */
+  static void resolveGoals(const std::vector<PredicateStatement> &statements, const PredicateContext *context,
+                           std::vector<unsigned int> &ids, std::vector<int> &positions)
+  {
+    for (const PredicateStatement &ps: statements) {
+      unsigned int id;
+      if (context->findHeuristic(ps, id)) {
+        positions.push_back(ids.size());
+        ids.push_back(id);
+      } else {
+        ROS_WARN("Predicate \"%s\" with arguments (%s, %s, %s) is never produced", ps.predicate.c_str(),
+                 ps.params[0].c_str(),
+                 ps.params[1].c_str(),
+                 ps.params[2].c_str());
+        positions.push_back(-1);
+      }
+    }
+  }
+
+  Planner::GoalIds::GoalIds(const PredicatePlan::Request &req, const PredicateContext *context) {
+    resolveGoals(req.required_true, context, ids, required_true);
+    resolveGoals(req.required_false, context, ids, required_false);
+    resolveGoals(req.goal_true, context, ids, goal_true);
+    resolveGoals(req.goal_false, context, ids, goal_false);
+    context->goalPairs(ids, exact_pairs);
+    context->goalLinks(ids, goal_links);
+  }
+
+  Planner::Planner(PredicateContext *_context, unsigned int _max_iter, double _step, double _chance, double _skip, double _search_volume,
+                   unsigned int _batch_size, bool _goal_predicates_only) :
+    context(_context), max_iter(_max_iter), step(_step), chance(_chance), skip_distance(_skip), search_volume(_search_volume),
+    batch_size(_batch_size > 0 ? _batch_size : 1), goal_predicates_only(_goal_predicates_only)
   {
     ros::NodeHandle nh;
     planServer = nh.advertiseService("predicator/plan", &Planner::plan, this);
@@ -35,46 +80,63 @@ namespace predicator_planning {
       if (parent == NULL || dist < shortest_dist) {
         parent = search[i];
         cost = parent->cost + dist;
+        shortest_dist = dist;
       }
     }
   }
 
+  // initialize with a known parent
+  Planner::SearchPose::SearchPose(SearchPose *_parent, RobotState *_state) :
+    count_best(0), parent(_parent), child(NULL), state(_state), cost(0), count_met(0), hsum(0.)
+  {
+    if (parent != NULL) {
+      cost = parent->cost + parent->state->distance(*state);
+    }
+  }
+
   // update with information from the context
-  bool Planner::SearchPose::checkPredicates(PredicatePlan::Request &req, PredicateContext *context, unsigned int idx, bool &goals) {
+  bool Planner::SearchPose::checkPredicates(PredicatePlan::Request &req, PredicateContext *context, unsigned int idx, bool &goals,
+                                            const GoalIds *goal_ids) {
 
     // get starting states
     // these are the states as recorded in the context
     // they will be updated as we go on if this takes a while -- might be bad
-    std::vector<RobotState *> states = context->states;
+    context->updateRobotStates();
+    return checkPredicates(req, context, context->states, idx, goals, goal_ids);
+  }
+
+  // update with information from the context, using the given copies of the robot states
+  bool Planner::SearchPose::checkPredicates(PredicatePlan::Request &req, PredicateContext *context, std::vector<RobotState *> states,
+                                            unsigned int idx, bool &goals, const GoalIds *goal_ids) {
     states[idx] = state; // set to this state
 
     std::vector<double> all_heuristics(context->numHeuristics());
     PredicateList list;
 
-    context->updateRobotStates();
-
     //if (!state->satisfiesBounds()) {
     //  return false;
     //}
 
-    context->addCollisionPredicates(list, all_heuristics, states);
-    context->addGeometryPredicates(list, all_heuristics, states);
+    context->addCollisionPredicates(list, all_heuristics, states, ~0, false, goal_ids != NULL ? &goal_ids->exact_pairs : NULL);
+    context->addGeometryPredicates(list, all_heuristics, states, false, goal_ids != NULL ? &goal_ids->goal_links : NULL);
     context->addReachabilityPredicates(list, all_heuristics, states);
 
-
-    std::unordered_set<PredicateStatement, Hash, Equals> lookup;
+    std::vector<char> lookup(all_heuristics.size(), 0);
 
     for (PredicateStatement &ps: list.statements) {
       //ROS_INFO("%s(%s,%s,%s)",ps.predicate.c_str(),
       //         ps.params[0].c_str(),
       //         ps.params[1].c_str(),
       //         ps.params[2].c_str());
-      lookup.insert(ps);
+      unsigned int id;
+      if (context->findHeuristic(ps, id)) {
+        lookup[id] = 1;
+      }
     }
 
     // check requirements
     for (PredicateStatement &ps: req.required_true) {
-      if (lookup.find(ps) == lookup.end()) {
+      if (!isTrue(context, lookup, ps)) {
         return false;
       } else {
         ROS_INFO("found goal state for predicate %s(%s,%s,%s)",ps.predicate.c_str(),
@@ -84,7 +146,7 @@ namespace predicator_planning {
       }
     }
     for (PredicateStatement &ps: req.required_false) {
-      if (lookup.find(ps) != lookup.end()) {
+      if (isTrue(context, lookup, ps)) {
         return false;
       }
     }
@@ -98,7 +160,7 @@ namespace predicator_planning {
 
       double val = context->getHeuristic(ps, all_heuristics);
 
-      if(lookup.find(ps) == lookup.end()) {
+      if(!isTrue(context, lookup, ps)) {
         goals = false;
       } else if (val < 0) {
         val = 0;
@@ -112,7 +174,7 @@ namespace predicator_planning {
       // get a heuristic value from context
       double val = -1 * context->getHeuristic(ps, all_heuristics);
 
-      if(lookup.find(ps) != lookup.end()) {
+      if(isTrue(context, lookup, ps)) {
         goals = false;
       } else if (val < 0) {
         val = 0;
@@ -122,22 +184,80 @@ namespace predicator_planning {
       heuristics.push_back(val);
     }
 
-    std::cout << "values = [";
+    score(goals);
+    return true;
+  }
+
+  // only evaluates the statements named in the request
+  bool Planner::SearchPose::checkGoals(const GoalIds &goal_ids, const PredicateContext *context, std::vector<RobotState *> states,
+                                       unsigned int idx, bool &goals) {
+    states[idx] = state; // set to this state
+
+    std::vector<double> values;
+    std::vector<char> truth;
+    context->evaluateStatements(goal_ids.ids, states, values, truth);
+
+    // check requirements
+    for (int k: goal_ids.required_true) {
+      if (k < 0 || !truth[k]) {
+        return false;
+      }
+    }
+    for (int k: goal_ids.required_false) {
+      if (k >= 0 && truth[k]) {
+        return false;
+      }
+    }
+
+    goals = true;
+
+    for (int k: goal_ids.goal_true) {
+      double val = k < 0 ? 0 : values[k];
+      if (k < 0 || !truth[k]) {
+        goals = false;
+      } else if (val < 0) {
+        val = 0;
+      }
+      heuristics.push_back(val);
+    }
+    for (int k: goal_ids.goal_false) {
+      double val = k < 0 ? 0 : -1 * values[k];
+      if (k >= 0 && truth[k]) {
+        goals = false;
+      } else if (val < 0) {
+        val = 0;
+      }
+      heuristics.push_back(val);
+    }
+
+    score(goals);
+    return true;
+  }
+
+  // fill count_met and hsum from heuristics
+  void Planner::SearchPose::score(bool goals) {
     for (double &d: heuristics) {
-      std::cout << d << ", ";
       if (d >= 0) {
         ++count_met;
       } else {
         hsum += d;
       }
     }
-    std::cout << "]";
-    if (goals == true) {
-      std::cout << " (MEETS GOALS)";
-    }
-    std::cout << std::endl;
 
-    return true;
+#ifdef USE_OPENMP
+#pragma omp critical
+#endif
+    {
+      std::cout << "values = [";
+      for (double &d: heuristics) {
+        std::cout << d << ", ";
+      }
+      std::cout << "]";
+      if (goals == true) {
+        std::cout << " (MEETS GOALS)";
+      }
+      std::cout << std::endl;
+    }
   }
 
   bool Planner::plan(predicator_planning::PredicatePlan::Request &req,
@@ -174,88 +294,130 @@ namespace predicator_planning {
     }
     ROS_INFO("Found group \"%s\" for robot \"%s\".", req.group.c_str(), req.robot.c_str());
 
+    const GoalIds goal_ids(req, context);
+
     SearchPose *first = new SearchPose();
     bool goals_found = false;
     first->state = new RobotState(*context->states[idx]);
-    first->checkPredicates(req, context, idx, goals_found);
+    first->checkPredicates(req, context, idx, goals_found, &goal_ids);
     search.push_back(first);
 
     ROS_INFO("Added first state.");
 
+    // search tree in joint space, for finding the closest node to a sample
+    std::vector<double> positions;
+    first->state->copyJointGroupPositions(group, positions);
+    JointIndex index(positions.size());
+    index.insert(positions, 0);
+
+    // the node with the most goals met and highest heuristics, kept up to date as nodes are added
+    SearchPose *best = first;
+
+    // every thread checks predicates against its own copy of the world
+    int num_threads = 1;
+#ifdef USE_OPENMP
+    if (batch_size > 1) {
+      num_threads = omp_get_max_threads();
+    }
+#endif
+    std::vector<std::vector<RobotState *> > thread_states(num_threads);
+    for (int t = 0; t < num_threads; ++t) {
+      for (RobotState *rs: context->states) {
+        thread_states[t].push_back(new RobotState(*rs));
+      }
+    }
+
     // loop over 
-    for (unsigned int iter = 0; iter < max_iter && !res.found; ++iter) {
+    for (unsigned int iter = 0; iter < max_iter && !res.found; iter += batch_size) {
+      unsigned int batch = std::min(batch_size, max_iter - iter);
+      std::vector<SearchPose *> candidates(batch);
+
       // either generate a starting position at random or...
       // step in a direction from a "good" position (as determined by high heuristics)
+      // sampling stays serial, neither rand() nor the index are thread safe
+      for (unsigned int b = 0; b < batch; ++b) {
+        double choose_op = (double)rand() / (double)RAND_MAX;
+        std::cout << "Iteration " << (iter + b) << "(" << (choose_op > chance) << ")" << std::endl;
 
-      double choose_op = (double)rand() / (double)RAND_MAX;
-      std::cout << "Iteration " << iter << "(" << (choose_op > chance) << ") :";
-      if(choose_op > chance) {
-        // spawn children from the thing with the highest heuristic
-        // first, iterate over all poses
-        // track the best number of goals met and best values for unmet goals
-        SearchPose *best = NULL;
-        unsigned int best_met = 0;
-        double best_hsum = 99999.9;
-        for (std::deque<SearchPose *>::iterator it = search.begin();
-             it != search.end();
-             ++it) {
-          if (((*it)->count_met > best_met) ||
-               (((*it)->count_met == best_met) && (*it)->hsum > best_hsum) ||
-              best == NULL)
-          {
-            best = *it;
-            best_hsum = best->hsum;
-            best_met = best->count_met;
-            //ROS_INFO("expanding from sum=%f, count=%u", best_hsum, best_met);
-          }
-        }
-
-        // find the BEST state and step from there
-        // best being defined as "the most matching predicates and highest heuristics"
         RobotState *rs = new RobotState(context->robots[idx]);
-        rs->setToRandomPositionsNearBy(group, *best->state, search_volume);
-        SearchPose *new_sp = new SearchPose(search, rs);
-        new_sp->parent->state->interpolate(*rs, step, *rs, group);
-
-        // check and add or delete
-        if (new_sp->checkPredicates(req, context, idx, goals_found)) {
-          search.push_back(new_sp);
-          res.found = goals_found;
+        if(choose_op > chance) {
+          // find the BEST state and step from there
+          // best being defined as "the most matching predicates and highest heuristics"
+          rs->setToRandomPositionsNearBy(group, *best->state, search_volume);
         } else {
-          ROS_INFO("Deleting illegal state.");
-          delete new_sp->state;
-          delete new_sp;
+          // case 2: choose a random position
+          rs->setToRandomPositions(group);
         }
 
-
-      } else {
-        // case 2: choose a random position
-        RobotState *rs = new RobotState(context->robots[idx]);
-        rs->setToRandomPositions(group);
-
         // find the nearest state to this step
         // then step in the direction of this state rs
-        // NOTE: should be interpolating from some other state, not the initial one here
-        SearchPose *new_sp = new SearchPose(search, rs);
-
+        rs->copyJointGroupPositions(group, positions);
+        SearchPose *new_sp = new SearchPose(search[index.nearest(positions)], rs);
         new_sp->parent->state->interpolate(*rs, step, *rs, group);
+        candidates[b] = new_sp;
+      }
 
-        goals_found = false;
+      // the rest of the world as it is right now
+      context->updateRobotStates();
+      for (int t = 0; t < num_threads; ++t) {
+        for (unsigned int k = 0; k < context->states.size(); ++k) {
+          *thread_states[t][k] = *context->states[k];
+        }
+      }
 
-        if (new_sp->checkPredicates(req, context, idx, goals_found)) {
-          search.push_back(new_sp);
-          res.found = goals_found;
+      std::vector<char> valid(batch, 0);
+      std::vector<char> reached(batch, 0);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+#endif
+      for (int b = 0; b < (int)batch; ++b) {
+        int t = 0;
+#ifdef USE_OPENMP
+        t = omp_get_thread_num();
+#endif
+        bool sample_goals = false;
+        if (goal_predicates_only) {
+          valid[b] = candidates[b]->checkGoals(goal_ids, context, thread_states[t], idx, sample_goals);
         } else {
-          ROS_INFO("Deleting illegal state.");
+          valid[b] = candidates[b]->checkPredicates(req, context, thread_states[t], idx, sample_goals, &goal_ids);
+        }
+        reached[b] = sample_goals;
+      }
+
+      // check and add or delete, in the order the samples were drawn
+      for (unsigned int b = 0; b < batch; ++b) {
+        SearchPose *new_sp = candidates[b];
+        if (!res.found) {
+          res.iter = iter + b;
+        }
+
+        if (res.found || !valid[b]) {
+          if (!valid[b]) {
+            ROS_INFO("Deleting illegal state.");
+          }
           delete new_sp->state;
           delete new_sp;
+          continue;
         }
-      }
 
-      res.iter = iter;
+        new_sp->state->copyJointGroupPositions(group, positions);
+        index.insert(positions, search.size());
+        search.push_back(new_sp);
 
-      if (res.found == true) {
-        break;
+        if ((new_sp->count_met > best->count_met) ||
+            ((new_sp->count_met == best->count_met) && new_sp->hsum > best->hsum))
+        {
+          best = new_sp;
+        }
+
+        res.found = reached[b];
+      }
+    }
+
+    for (int t = 0; t < num_threads; ++t) {
+      for (RobotState *rs: thread_states[t]) {
+        delete rs;
       }
     }
 
@@ -8,6 +8,7 @@
 #include <predicator_planning/PredicatePlan.h>
 
 #include "predicator.h"
+#include "joint_index.hpp"
 
 // deque more efficient for long arrays
 #include <deque>
@@ -17,6 +18,23 @@ namespace predicator_planning {
 
   struct Planner {
 
+    /**
+     * GoalIds
+     * Statement ids of a planning request, resolved once per request.
+     * Entries of the four lists are positions in ids, or -1 for statements the context never produces.
+     */
+    struct GoalIds {
+      std::vector<unsigned int> ids;
+      std::vector<int> required_true;
+      std::vector<int> required_false;
+      std::vector<int> goal_true;
+      std::vector<int> goal_false;
+      std::vector<char> exact_pairs; // robot pairs the statements need the exact distance of, see PredicateContext::goalPairs()
+      std::vector<std::vector<unsigned int> > goal_links; // link pairs the statements need geometry predicates of, see PredicateContext::goalLinks()
+
+      GoalIds(const PredicatePlan::Request &req, const PredicateContext *context);
+    };
+
     /**
      * SearchPose
      * Struct holding information on how good this RobotState is.
@@ -41,8 +59,24 @@ namespace predicator_planning {
       SearchPose(std::deque<SearchPose *> &search,
                  RobotState *state);
 
+      // initialize with a known parent
+      SearchPose(SearchPose *parent, RobotState *state);
+
       // update with information from the context
-      bool checkPredicates(PredicatePlan::Request &req, PredicateContext *context, unsigned int idx, bool &goals_reached);
+      // the pairs goals name get their exact distance and geometry predicates even when the broad phases cull them
+      bool checkPredicates(PredicatePlan::Request &req, PredicateContext *context, unsigned int idx, bool &goals_reached,
+                           const GoalIds *goals = NULL);
+
+      // same, with states holding a private copy of every robot state; states[idx] is replaced by this pose
+      bool checkPredicates(PredicatePlan::Request &req, PredicateContext *context, std::vector<RobotState *> states, unsigned int idx,
+                           bool &goals_reached, const GoalIds *goals = NULL);
+
+      // only evaluates the statements named in the request, does not modify the context
+      bool checkGoals(const GoalIds &goals, const PredicateContext *context, std::vector<RobotState *> states, unsigned int idx,
+                      bool &goals_reached);
+
+      // fill count_met and hsum from heuristics
+      void score(bool goals_reached);
     };
 
     // context contains information about the world and will produce new predicates
@@ -55,12 +89,16 @@ namespace predicator_planning {
     double step; // distance to move
     double chance; // percent of the time to move at random
     double skip_distance; // used to smooth trajectories
+    unsigned int batch_size; // samples generated and then checked in parallel per iteration
+    bool goal_predicates_only; // only evaluate the predicates named in the request for each sample
 
     Planner(PredicateContext *context, unsigned int max_iter = 10000,
             double step = 0.05,
             double chance = 0.2,
             double skip_distance = 0.5,
-            double search_volume = 0.5);
+            double search_volume = 0.5,
+            unsigned int batch_size = 1,
+            bool goal_predicates_only = false);
 
     bool plan(predicator_planning::PredicatePlan::Request &req,
               predicator_planning::PredicatePlan::Response &res);
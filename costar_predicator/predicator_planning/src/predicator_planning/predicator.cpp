@@ -45,11 +45,19 @@ namespace predicator_planning {
     XmlRpc::XmlRpcValue descriptions;
     XmlRpc::XmlRpcValue topics;
     XmlRpc::XmlRpcValue floating; // set of floating root joints that need to be updated
+    XmlRpc::XmlRpcValue reachability_list; // reachability map files
+    XmlRpc::XmlRpcValue watch_list; // frame pairs that always get geometry predicates
 
 
     nh_tilde.param("verbosity", verbosity, 0);
     nh_tilde.param("padding", padding, 0.01);
     nh_tilde.param("world_frame", world_frame, std::string("/world"));
+    nh_tilde.param("motion_tolerance", motion_tolerance, 1e-4);
+    nh_tilde.param("broadphase_margin", broadphase_margin, 0.1);
+    nh_tilde.param("max_contacts", max_contacts, 1000);
+    nh_tilde.param("reachability_ik", reachability_ik, true);
+    nh_tilde.param("ik_attempts", ik_attempts, 4);
+    nh_tilde.param("ik_timeout", ik_timeout, 0.005);
 
     // should we publish predicate messages?
     // or what?
@@ -63,6 +71,7 @@ namespace predicator_planning {
     nh_tilde.param("rel_z_threshold", rel_z_threshold, 0.1);
     nh_tilde.param("near_2D_threshold", near_2d_threshold, 0.2);
     nh_tilde.param("near_3D_threshold", near_3d_threshold, 0.2);
+    nh_tilde.param("geometry_range", geometry_range, 1.0);
 
     if(nh_tilde.hasParam("description_list")) {
       nh_tilde.param("description_list", descriptions, descriptions);
@@ -93,6 +102,16 @@ namespace predicator_planning {
       ROS_INFO("No list of robots with floating root joints given.");
     }
 
+    if(nh_tilde.hasParam("geometry_watch_list")) {
+      nh_tilde.param("geometry_watch_list", watch_list, watch_list);
+    }
+
+    bool load_reachability = false;
+    if(nh_tilde.hasParam("reachability_map_list")) {
+      nh_tilde.param("reachability_map_list", reachability_list, reachability_list);
+      load_reachability = true;
+    }
+
     if(descriptions.size() != topics.size()) {
       ROS_WARN("An unequal number of joint state and robot topics was provided!");
     }
@@ -110,6 +129,7 @@ namespace predicator_planning {
     pval.predicates.push_back("behind");
     pval.predicates.push_back("above");
     pval.predicates.push_back("below");
+    pval.predicates.push_back("reachable");
 
     // read in topics and descriptions
     for(unsigned int i = 0; i < descriptions.size(); ++i) {
@@ -193,6 +213,35 @@ namespace predicator_planning {
       }
     }
 
+    if (load_reachability) {
+      for(unsigned int i = 0; i < reachability_list.size(); ++i) {
+        if(reachability_list[i].getType() != XmlRpc::XmlRpcValue::TypeString) {
+          ROS_WARN("Reachability map entry %u was not of type \"string\"!", i);
+          continue;
+        }
+        std::string filename = static_cast<std::string>(reachability_list[i]);
+
+        ReachabilityMap map;
+        if (!map.load(filename)) {
+          ROS_WARN("Could not load reachability map \"%s\"!", filename.c_str());
+          continue;
+        }
+
+        unsigned int r = 0;
+        for (; r < robots.size() && robots[r]->getName().compare(map.robot) != 0; ++r);
+        if (r >= robots.size() || !robots[r]->hasJointModelGroup(map.group)) {
+          ROS_WARN("Reachability map \"%s\" is for unknown robot/group %s/%s!", filename.c_str(), map.robot.c_str(), map.group.c_str());
+          continue;
+        }
+
+        if (verbosity > 0) {
+          std::cout << "Loaded reachability map for " << map.robot << "/" << map.tip << ": " << filename << std::endl;
+        }
+        reachability_maps.push_back(map);
+        reachability_robots.push_back(r);
+      }
+    }
+
     // print out information on all the different joints
     unsigned int i = 0;
     for (typename std::vector<PlanningScene *>::iterator it1 = scenes.begin();
@@ -218,19 +267,78 @@ namespace predicator_planning {
       ROS_INFO("creating list of heuristic indices for possible values");
     }
     updateIndices();
+    initDirtyTracking();
+
+    // resolve the watched frame pairs to links through the ids of their left_of statements
+    std::vector<unsigned int> watch_ids;
+    for(unsigned int i = 0; i < watch_list.size(); ++i) {
+      if(watch_list[i].getType() != XmlRpc::XmlRpcValue::TypeArray || watch_list[i].size() != 2) {
+        ROS_WARN("Geometry watch list entry %u is not a pair of frames!", i);
+        continue;
+      }
+      std::string frame1 = static_cast<std::string>(watch_list[i][0]);
+      std::string frame2 = static_cast<std::string>(watch_list[i][1]);
+
+      unsigned int id1, id2;
+      if (!findHeuristic(createStatement("left_of", 0, frame1, frame2), id1)
+          || !findHeuristic(createStatement("left_of", 0, frame2, frame1), id2)) {
+        ROS_WARN("No geometry predicates between \"%s\" and \"%s\"!", frame1.c_str(), frame2.c_str());
+        continue;
+      }
+      watch_ids.push_back(id1);
+      watch_ids.push_back(id2);
+    }
+    goalLinks(watch_ids, watched_links);
   }
 
   /**
-   * checkAndUpdate
-   * helper function
+   * initDirtyTracking()
+   * Size the per-link and per-pair caches used by tick()
    */
-  static inline void checkAndUpdate(const PredicateStatement &pred,
-                                    heuristic_map_t &indices,
-                                    unsigned int &next_idx)
-  {
-    if (indices.find(pred) == indices.end()) {
-      indices[pred] = next_idx++;
-      //std::cout << next_idx << " ";
+  void PredicateContext::initDirtyTracking() {
+    evaluated_transforms.assign(num_links, Eigen::Affine3d::Identity());
+    link_dirty.assign(num_links, true);
+    robot_dirty.assign(states.size(), true);
+    collision_cache.assign(scenes.size() * scenes.size(), std::vector<PredicateStatement>());
+    geometry_cache.assign(num_links * num_links, std::vector<PredicateStatement>());
+    cached_heuristics.assign(predicate_ids.size(), 0.);
+    broadphase_order.clear();
+    for (unsigned int i = 0; i < states.size(); ++i) {
+      broadphase_order.push_back(i);
+    }
+    cache_valid = false;
+  }
+
+  /**
+   * updateDirtyLinks()
+   * Marks the links whose world transform changed by more than motion_tolerance since their predicates were computed
+   * Transforms are compared against the last evaluated one, so slow drifts are still picked up
+   */
+  void PredicateContext::updateDirtyLinks() {
+    for (unsigned int i = 0; i < states.size(); ++i) {
+      states[i]->update(true);
+      robot_dirty[i] = false;
+
+      const std::vector<std::string> &names = states[i]->getRobotModel()->getLinkModelNames();
+      for (unsigned int a = 0; a < names.size(); ++a) {
+        unsigned int g = link_offsets[i] + a;
+        Eigen::Affine3d tf = getLinkTransform(states[i], names[a]);
+        const Eigen::Affine3d &prev = evaluated_transforms[g];
+
+        bool moved = !cache_valid || motion_tolerance <= 0
+          || (tf.translation() - prev.translation()).norm() > motion_tolerance
+          || Eigen::AngleAxisd(prev.linear().transpose() * tf.linear()).angle() > motion_tolerance;
+
+        link_dirty[g] = moved;
+        if (moved) {
+          evaluated_transforms[g] = tf;
+          robot_dirty[i] = true;
+        }
+      }
+
+      if (verbosity > 2 && robot_dirty[i]) {
+        std::cout << states[i]->getRobotModel()->getName() << " moved" << std::endl;
+      }
     }
   }
 
@@ -238,85 +346,112 @@ namespace predicator_planning {
    * updateIndices()
    * Records where the values we can use as heuristics are going to be stored.
    * May also look at things like waypoints, etc.
+   * Every statement is interned once here, so the per-tick loops only work with ids.
    */
   void PredicateContext::updateIndices() {
-    unsigned int idx = 0;
-    unsigned int i = 0;
-    for(typename std::vector<RobotState *>::const_iterator it = states.begin();
-        it != states.end();
-        ++it, ++i)
-    {
+    num_links = 0;
+    link_offsets.clear();
+    link_robot.clear();
+    link_valid.clear();
+    for (unsigned int i = 0; i < states.size(); ++i) {
+      const std::vector<std::string> &names = states[i]->getRobotModel()->getLinkModelNames();
+      link_offsets.push_back(num_links);
+      num_links += names.size();
+      for (unsigned int a = 0; a < names.size(); ++a) {
+        link_robot.push_back(i);
+        link_valid.push_back(names[a].compare(std::string("world")) != 0);
+      }
+    }
 
-      // get the list of joints for the robot state
-      for (typename std::vector<std::string>::const_iterator link1 = (*it)->getRobotModel()->getLinkModelNames().begin();
-           link1 != (*it)->getRobotModel()->getLinkModelNames().end();
-           ++link1)
-      {
-        if (link1->compare(std::string("world")) == 0) {
-          continue;
-        }
+    geometry_ids.assign(num_links * num_links * NUM_GEOMETRY_PREDICATES, 0);
+    robot_touching_ids.assign(states.size() * states.size(), 0);
 
-        //std::cout << *link1 << std::endl;
+    for (unsigned int i = 0; i < states.size(); ++i) {
+      const std::string &robot1 = states[i]->getRobotModel()->getName();
+      for (unsigned int j = 0; j < states.size(); ++j) {
+        const std::string &robot2 = states[j]->getRobotModel()->getName();
+        predicate_ids.intern("near_mesh", robot1, robot2);
+        robot_touching_ids[i * states.size() + j] = predicate_ids.intern("touching", robot1, robot2);
+      }
+    }
 
-        // access world coordinates
-        // NOTE: does not work for the ring yet!
-        Eigen::Affine3d tf1 = getLinkTransform(*it, *link1);
+    // everything interned above is either computed per robot pair or not at all
+    StatementSource none = {StatementSource::NONE, 0, 0};
+    id_sources.assign(predicate_ids.size(), none);
+    for (unsigned int i = 0; i < states.size(); ++i) {
+      for (unsigned int j = 0; j < states.size(); ++j) {
+        StatementSource src = {StatementSource::ROBOTS, i, j};
+        id_sources[robot_touching_ids[i * states.size() + j]] = src;
+      }
+    }
+
+    for (unsigned int i = 0; i < states.size(); ++i) {
+      const std::vector<std::string> &links1 = states[i]->getRobotModel()->getLinkModelNames();
+
+      for (unsigned int a = 0; a < links1.size(); ++a) {
+        if (links1[a].compare(std::string("world")) == 0) {
+          continue;
+        }
+        unsigned int g1 = link_offsets[i] + a;
 
         // loop over the other objects in the world
         // this does NOT include waypoints or anything like that -- we need a separate loop
         // the second loop can handle abstract entities like these
-        unsigned int j = 0;
-        for(typename std::vector<RobotState *>::const_iterator it2 = states.begin();
-            it2 != states.end();
-            ++it2, ++j)
-        {
-
-          PredicateStatement near_mesh = createStatement("near_mesh",0,(*it)->getRobotModel()->getName(),(*it2)->getRobotModel()->getName());
-          PredicateStatement touching_robot = createStatement("touching",0,(*it)->getRobotModel()->getName(),(*it2)->getRobotModel()->getName());
-
-          //std::cout << heuristic_indices.size() << ", idx = " << idx << std::endl;
-
-          checkAndUpdate(near_mesh, heuristic_indices, idx);
-          checkAndUpdate(touching_robot, heuristic_indices, idx);
-
-          //std::cout << (*it)->getRobotModel()->getName() << ", " << (*it2)->getRobotModel()->getName() << std::endl;
+        for (unsigned int j = 0; j < states.size(); ++j) {
+          const std::vector<std::string> &links2 = states[j]->getRobotModel()->getLinkModelNames();
 
           // loop over the non-world links of this object
-          // get the list of joints for the robot state
-          for (typename std::vector<std::string>::const_iterator link2 = (*it2)->getRobotModel()->getLinkModelNames().begin();
-               link2 != (*it2)->getRobotModel()->getLinkModelNames().end();
-               ++link2)
-          {
-            if (link2->compare(std::string("world")) == 0) {
+          for (unsigned int b = 0; b < links2.size(); ++b) {
+            if (links2[b].compare(std::string("world")) == 0) {
               continue;
             }
+            unsigned int g2 = link_offsets[j] + b;
+            unsigned int *ids = &geometry_ids[(g1 * num_links + g2) * NUM_GEOMETRY_PREDICATES];
+
+            ids[LEFT_OF] = predicate_ids.intern("left_of",links1[a],links2[b],"world");
+            ids[RIGHT_OF] = predicate_ids.intern("right_of",links1[a],links2[b],"world");
+            ids[IN_FRONT_OF] = predicate_ids.intern("in_front_of",links1[a],links2[b],"world");
+            ids[BEHIND] = predicate_ids.intern("behind",links1[a],links2[b],"world");
+            ids[ABOVE] = predicate_ids.intern("above",links1[a],links2[b],"world");
+            ids[BELOW] = predicate_ids.intern("below",links1[a],links2[b],"world");
+            ids[TOUCHING] = predicate_ids.intern("touching",links1[a],links2[b]);
+            ids[NEAR] = predicate_ids.intern("near",links1[a],links2[b]);
+            ids[NEAR_XY] = predicate_ids.intern("near_xy",links1[a],links2[b]);
+
+            id_sources.resize(predicate_ids.size());
+            for (unsigned int k = 0; k < NUM_GEOMETRY_PREDICATES; ++k) {
+              StatementSource src = {k, g1, g2};
+              id_sources[ids[k]] = src;
+            }
+          }
+        }
+      }
+    }
 
-            // create the predicates
-            PredicateStatement left = createStatement("left_of",0,*link1,*link2,"world");
-            PredicateStatement right = createStatement("right_of",0,*link1,*link2,"world");
-            PredicateStatement front = createStatement("in_front_of",0,*link1,*link2,"world");
-            PredicateStatement back = createStatement("behind",0,*link1,*link2,"world");
-            PredicateStatement up = createStatement("above",0,*link1,*link2,"world");
-            PredicateStatement down = createStatement("below",0,*link1,*link2,"world");
-            PredicateStatement touching = createStatement("touching",0,*link1,*link2);
-            PredicateStatement near = createStatement("near",0,*link1,*link2);
-            PredicateStatement near_xy = createStatement("near_xy",0,*link1,*link2);
-
-            checkAndUpdate(left, heuristic_indices, idx);
-            checkAndUpdate(right, heuristic_indices, idx);
-            checkAndUpdate(front, heuristic_indices, idx);
-            checkAndUpdate(back, heuristic_indices, idx);
-            checkAndUpdate(up, heuristic_indices, idx);
-            checkAndUpdate(down, heuristic_indices, idx);
-            checkAndUpdate(touching, heuristic_indices, idx);
-            checkAndUpdate(near, heuristic_indices, idx);
-            checkAndUpdate(near_xy, heuristic_indices, idx);
-
-            //std::cout << *link1 << ", " << *link2 << std::endl;
+    // reachable(frame, robot) for every frame of interest that is a link of another robot
+    reachability_targets.assign(reachability_maps.size(), std::vector<std::pair<unsigned int, unsigned int> >());
+    for (unsigned int m = 0; m < reachability_maps.size(); ++m) {
+      unsigned int r = reachability_robots[m];
+      for (unsigned int f = 0; f < frames.size(); ++f) {
+        for (unsigned int g = 0; g < num_links; ++g) {
+          unsigned int r2 = link_robot[g];
+          if (!link_valid[g] || r2 == r || states[r2]->getRobotModel()->getLinkModelNames()[g - link_offsets[r2]] != frames[f]) {
+            continue;
           }
+
+          unsigned int id = predicate_ids.intern("reachable", frames[f], robots[r]->getName());
+          StatementSource src = {StatementSource::REACHABLE, m, g};
+          id_sources.resize(predicate_ids.size());
+          id_sources[id] = src;
+          reachability_targets[m].push_back(std::make_pair(g, id));
+          break;
         }
       }
     }
+
+    if (verbosity > 0) {
+      ROS_INFO("%lu predicate statements over %u links", predicate_ids.size(), num_links);
+    }
   }
 
   /**
@@ -390,23 +525,178 @@ namespace predicator_planning {
   }
 
   /**
-   * updateHeuristics
-   * helper function to store heuristic values
+   * addTouching
+   * helper function to store and publish a touching predicate reported by a contact
    */
-  static inline void updateHeuristics(const PredicateStatement &pred, const heuristic_map_t &indices, std::vector<double> &heuristics) {
-    if (indices.find(pred) == indices.end()) {
-      ROS_ERROR("(UPDATE) Failed to look up predicate \"%s\" with arguments (%s, %s, %s)", pred.predicate.c_str(),
-                pred.params[0].c_str(),
-                pred.params[1].c_str(),
-                pred.params[2].c_str());
-    } else if (indices.at(pred) > heuristics.size()) {
-      ROS_ERROR("(UPDATE) Indexing error from predicate \"%s\" with arguments (%s, %s, %s)", pred.predicate.c_str(),
-                pred.params[0].c_str(),
-                pred.params[1].c_str(),
-                pred.params[2].c_str());
-      ROS_ERROR("index = %u, length=%lu", indices.at(pred), heuristics.size());
+  static inline void addTouching(const PredicateTable &ids, const std::string &link1, const std::string &link2, double value,
+                                 PredicateList &output, std::vector<double> &heuristics)
+  {
+    unsigned int id;
+    if (!ids.find("touching", link1, link2, "", id)) {
+      ROS_ERROR("(UPDATE) Failed to look up predicate \"touching\" with arguments (%s, %s)", link1.c_str(), link2.c_str());
+      output.statements.push_back(createStatement("touching", value, link1, link2));
+      return;
+    }
+    heuristics[id] = value;
+    output.statements.push_back(ids.statement(id, value));
+  }
+
+  /**
+   * boxGap
+   * helper function, distance between two boxes from computeBounds(), 0 if they overlap
+   */
+  static inline double boxGap(const double *b1, const double *b2) {
+    double sum = 0;
+    for (unsigned int k = 0; k < 3; ++k) {
+      double gap = std::max(b1[2*k] - b2[2*k+1], b2[2*k] - b1[2*k+1]);
+      if (gap > 0) {
+        sum += gap * gap;
+      }
+    }
+    return sqrt(sum);
+  }
+
+  /**
+   * computeBounds()
+   * World axis aligned box of every robot, stored as (minx, maxx, miny, maxy, minz, maxz)
+   */
+  void PredicateContext::computeBounds(const std::vector<RobotState *> &states, std::vector<double> &bounds) const {
+    bounds.resize(6 * states.size());
+    for (unsigned int i = 0; i < states.size(); ++i) {
+      std::vector<double> aabb;
+      states[i]->update(true);
+      states[i]->computeAABB(aabb);
+      if (aabb.size() != 6) {
+        // no collision geometry, this robot can not be culled
+        aabb.assign(6, 0.);
+        for (unsigned int k = 0; k < 3; ++k) {
+          aabb[2*k] = -std::numeric_limits<double>::max();
+          aabb[2*k+1] = std::numeric_limits<double>::max();
+        }
+      }
+      for (unsigned int k = 0; k < 3; ++k) {
+        bounds[6*i + 2*k] = aabb[2*k] - padding;
+        bounds[6*i + 2*k+1] = aabb[2*k+1] + padding;
+      }
+    }
+  }
+
+  /**
+   * sweepAndPrune()
+   * Flags the scene pairs whose boxes overlap once grown by broadphase_margin
+   */
+  void PredicateContext::sweepAndPrune(const std::vector<double> &bounds, std::vector<unsigned int> &order, std::vector<char> &candidates) const {
+    const unsigned int n = bounds.size() / 6;
+    candidates.assign(n * n, 0);
+
+    if (order.size() != n) {
+      order.clear();
+      for (unsigned int i = 0; i < n; ++i) {
+        order.push_back(i);
+      }
+    }
+
+    // insertion sort on minx
+    for (unsigned int a = 1; a < n; ++a) {
+      unsigned int cur = order[a];
+      unsigned int b = a;
+      for (; b > 0 && bounds[6*order[b-1]] > bounds[6*cur]; --b) {
+        order[b] = order[b-1];
+      }
+      order[b] = cur;
+    }
+
+    // sweep along x, then test the other two axes
+    for (unsigned int a = 0; a < n; ++a) {
+      const double *b1 = &bounds[6*order[a]];
+      for (unsigned int b = a + 1; b < n; ++b) {
+        const double *b2 = &bounds[6*order[b]];
+        if (b2[0] > b1[1] + broadphase_margin) {
+          break;
+        }
+        if (b2[2] > b1[3] + broadphase_margin || b1[2] > b2[3] + broadphase_margin ||
+            b2[4] > b1[5] + broadphase_margin || b1[4] > b2[5] + broadphase_margin)
+        {
+          continue;
+        }
+        candidates[order[a] * n + order[b]] = 1;
+        candidates[order[b] * n + order[a]] = 1;
+      }
+    }
+  }
+
+  /**
+   * checkPair()
+   * Fused collision and distance query between scenes i and j
+   */
+  double PredicateContext::checkPair(unsigned int i, unsigned int j, const std::vector<RobotState *> &states, collision_detection::CollisionResult &res) const {
+    collision_detection::CollisionRobotConstPtr robot1 = scenes[i]->getCollisionRobot();
+    collision_detection::CollisionRobotConstPtr robot2 = scenes[j]->getCollisionRobot();
+
+    // force an update
+    // source: https://groups.google.com/forum/#!topic/moveit-users/O9CEef6sxbE
+    states[i]->update(true);
+    states[j]->update(true);
+
+    // a positive distance proves there is nothing to collide, so separated pairs take a single narrow phase walk
+    double dist = robot1->distanceOther(*states[i], *robot2, *states[j]);
+    if (dist > 0) {
+      return dist;
+    }
+
+    // a collision needs at least one contact for its penetration depth
+    collision_detection::CollisionRequest req;
+    req.contacts = true;
+    req.max_contacts = std::max(max_contacts, 1);
+
+    robot1->checkOtherCollision(req, res, *states[i], *robot2, *states[j]);
+
+    // report the deepest penetration
+    if (res.collision) {
+      dist = 0;
+      for(collision_detection::CollisionResult::ContactMap::const_iterator cit = res.contacts.begin();
+          cit != res.contacts.end();
+          ++cit)
+      {
+        for (unsigned int k = 0; k < cit->second.size(); ++k) {
+          dist = std::min(dist, -1.0 * cit->second[k].depth);
+        }
+      }
+    }
+    return dist;
+  }
+
+  /**
+   * goalPairs()
+   * Flags the robot pairs (i * num_scenes + j, both ways) whose distance one of the statements ids depends on
+   */
+  void PredicateContext::goalPairs(const std::vector<unsigned int> &ids, std::vector<char> &pairs) const {
+    pairs.assign(scenes.size() * scenes.size(), 0);
+    for (unsigned int k = 0; k < ids.size(); ++k) {
+      const StatementSource &src = id_sources[ids[k]];
+      if (src.type != StatementSource::ROBOTS && src.type != TOUCHING) {
+        continue;
+      }
+      unsigned int r1 = src.type == StatementSource::ROBOTS ? src.first : link_robot[src.first];
+      unsigned int r2 = src.type == StatementSource::ROBOTS ? src.second : link_robot[src.second];
+      pairs[r1 * scenes.size() + r2] = 1;
+      pairs[r2 * scenes.size() + r1] = 1;
+    }
+  }
+
+  /**
+   * goalLinks()
+   * links[g1] lists the links g2 whose geometry predicates with g1 one of the statements ids needs
+   */
+  void PredicateContext::goalLinks(const std::vector<unsigned int> &ids, std::vector<std::vector<unsigned int> > &links) const {
+    links.assign(num_links, std::vector<unsigned int>());
+    for (unsigned int k = 0; k < ids.size(); ++k) {
+      const StatementSource &src = id_sources[ids[k]];
+      if (src.type >= NUM_GEOMETRY_PREDICATES || src.type == TOUCHING) {
+        continue;
+      }
+      links[src.first].push_back(src.second);
     }
-    heuristics[indices.at(pred)] = pred.value;
   }
 
   /**
@@ -415,7 +705,21 @@ namespace predicator_planning {
    * checks for all pairs of objects, determines collisions and distances
    * publishes the relationships between all of these objects
    */
-  void PredicateContext::addCollisionPredicates(PredicateList &output, std::vector<double> &heuristics, const std::vector<RobotState *> &states, unsigned int idx) {
+  void PredicateContext::addCollisionPredicates(PredicateList &output, std::vector<double> &heuristics, const std::vector<RobotState *> &states, unsigned int idx,
+                                                bool use_cache, const std::vector<char> *exact_pairs) {
+
+    // broad phase, only pairs whose boxes are within broadphase_margin reach FCL
+    std::vector<double> bounds;
+    std::vector<char> candidates;
+    if (broadphase_margin >= 0) {
+      computeBounds(states, bounds);
+      if (use_cache) {
+        sweepAndPrune(bounds, broadphase_order, candidates);
+      } else {
+        std::vector<unsigned int> order = broadphase_order;
+        sweepAndPrune(bounds, order, candidates);
+      }
+    }
 
     unsigned i = 0;
     for(typename std::vector<PlanningScene *>::iterator it1 = scenes.begin();
@@ -440,65 +744,69 @@ namespace predicator_planning {
 
         if (i == j) continue;
 
-        collision_detection::CollisionRobotConstPtr robot2 = (*it2)->getCollisionRobot();
-
-        collision_detection::CollisionRequest req;
-        collision_detection::CollisionResult res;
-        req.contacts = true;
-        req.max_contacts = 1000;
+        // neither robot moved since the last tick, re-emit the cached result
+        std::vector<PredicateStatement> *cache = use_cache ? &collision_cache[i * scenes.size() + j] : NULL;
+        if (cache != NULL && cache_valid && !robot_dirty[i] && !robot_dirty[j]) {
+          output.statements.insert(output.statements.end(), cache->begin(), cache->end());
+          continue;
+        }
+        size_t first_statement = output.statements.size();
 
-        // force an update
-        // source: https://groups.google.com/forum/#!topic/moveit-users/O9CEef6sxbE
-        states[i]->update(true);
-        states[j]->update(true);
+        collision_detection::CollisionRobotConstPtr robot2 = (*it2)->getCollisionRobot();
 
-        robot1->checkOtherCollision(req, res, *states[i], *robot2, *states[j]);
-        double dist = robot1->distanceOther(*states[i], *robot2, *states[j]);
+        unsigned int id1 = robot_touching_ids[i * scenes.size() + j];
+        unsigned int id2 = robot_touching_ids[j * scenes.size() + i];
+
+        // the boxes are too far apart to touch, so there is nothing to publish and no collision to check.
+        // tick() never reads the distance; the planner gets the box gap, a lower bound of it,
+        // and the exact distance only for the pairs its goals name
+        if (broadphase_margin >= 0 && !candidates[i * scenes.size() + j]) {
+          double gap = boxGap(&bounds[6*i], &bounds[6*j]);
+          if (!use_cache) {
+            double dist = gap;
+            if (exact_pairs != NULL && (*exact_pairs)[i * scenes.size() + j]) {
+              states[i]->update(true);
+              states[j]->update(true);
+              dist = robot1->distanceOther(*states[i], *robot2, *states[j]);
+            }
+            heuristics[id1] = -1.0 * dist;
+            heuristics[id2] = -1.0 * dist;
+          }
+          if (cache != NULL) {
+            cache->clear();
+          }
+          if (verbosity > 2) {
+            std::cout << "(" << robot1->getRobotModel()->getName()
+              << ", " << robot2->getRobotModel()->getName()
+              << ") : culled, box gap: " << gap << std::endl;
+          }
+          continue;
+        }
 
-        PredicateStatement ps = createStatement("touching", -1.0 * dist,
-                                                robot1->getRobotModel()->getName(),
-                                                robot2->getRobotModel()->getName());
-        PredicateStatement ps2 = createStatement("touching", -1.0 * dist,
-                                                 robot2->getRobotModel()->getName(),
-                                                 robot1->getRobotModel()->getName());
+        collision_detection::CollisionResult res;
+        double dist = checkPair(i, j, states, res);
 
-        updateHeuristics(ps, heuristic_indices, heuristics);
-        updateHeuristics(ps2, heuristic_indices, heuristics);
+        heuristics[id1] = -1.0 * dist;
+        heuristics[id2] = -1.0 * dist;
 
         if (dist <= 0) {
-          output.statements.push_back(ps);
-          output.statements.push_back(ps2);
+          output.statements.push_back(predicate_ids.statement(id1, -1.0 * dist));
+          output.statements.push_back(predicate_ids.statement(id2, -1.0 * dist));
         }
 
         if (verbosity > 4) {
           std::cout << res.contacts.size() << " contacts found" << std::endl;
         }
 
-        // iterate over all collisions
+        // iterate over all collisions, there are no link level predicates without a contact budget
         for(collision_detection::CollisionResult::ContactMap::const_iterator cit = res.contacts.begin(); 
-            cit != res.contacts.end(); 
+            max_contacts > 0 && cit != res.contacts.end(); 
             ++cit)
         {
           // write the correct predicate
-          predicator_msgs::PredicateStatement ps;
-          ps.predicate = "touching";
-          ps.value = -1.0 * dist;
-          ps.num_params = 2;
-          ps.params[0] = cit->first.first;
-          ps.params[1] = cit->first.second;
-          output.statements.push_back(ps);
-
           // the reverse is also true, so update it
-          predicator_msgs::PredicateStatement ps2;
-          ps2.predicate = "touching";
-          ps2.value = -1.0 * dist;
-          ps2.num_params = 2;
-          ps2.params[0] = cit->first.second;
-          ps2.params[1] = cit->first.first;
-          output.statements.push_back(ps2);
-
-          updateHeuristics(ps, heuristic_indices, heuristics);
-          updateHeuristics(ps2, heuristic_indices, heuristics);
+          addTouching(predicate_ids, cit->first.first, cit->first.second, -1.0 * dist, output, heuristics);
+          addTouching(predicate_ids, cit->first.second, cit->first.first, -1.0 * dist, output, heuristics);
         }
 
         if (verbosity > 1) {
@@ -506,6 +814,10 @@ namespace predicator_planning {
             << ", " << robot2->getRobotModel()->getName()
             << ") : Distance to collision: " << dist << std::endl;
         }
+
+        if (cache != NULL) {
+          cache->assign(output.statements.begin() + first_statement, output.statements.end());
+        }
       }
     }
 
@@ -515,7 +827,7 @@ namespace predicator_planning {
    * numHeuristics()
    */
   size_t PredicateContext::numHeuristics() const {
-    return heuristic_indices.size();
+    return predicate_ids.size();
   }
 
   /**
@@ -523,21 +835,104 @@ namespace predicator_planning {
    * Looks up a score from a vector of possible values
    */
   double PredicateContext::getHeuristic(const PredicateStatement &pred, const std::vector<double> &heuristics) const {
-    if (heuristic_indices.find(pred) == heuristic_indices.end()) {
+    unsigned int id;
+    if (!predicate_ids.find(pred, id)) {
       ROS_ERROR("(GET) Failed to lookup predicate \"%s\" with arguments (%s, %s, %s)", pred.predicate.c_str(),
                 pred.params[0].c_str(),
                 pred.params[1].c_str(),
                 pred.params[2].c_str());
       return 0;
-    } else if (heuristic_indices.at(pred) > heuristics.size()) {
+    } else if (id >= heuristics.size()) {
       ROS_ERROR("(GET) Indexing error from predicate \"%s\" with arguments (%s, %s, %s)", pred.predicate.c_str(),
                 pred.params[0].c_str(),
                 pred.params[1].c_str(),
                 pred.params[2].c_str());
-      ROS_ERROR("index = %u, length=%lu", heuristic_indices.at(pred), heuristics.size());
+      ROS_ERROR("index = %u, length=%lu", id, heuristics.size());
       return 0;
     }
-    return heuristics.at(heuristic_indices.at(pred));
+    return heuristics[id];
+  }
+
+  /**
+   * evaluateStatements()
+   * Computes the value of only the given statement ids for a set of states
+   * Each robot pair that is needed gets a single collision query.
+   */
+  void PredicateContext::evaluateStatements(const std::vector<unsigned int> &ids, const std::vector<RobotState *> &states,
+                                            std::vector<double> &values, std::vector<char> &truth) const
+  {
+    values.assign(ids.size(), 0.);
+    truth.assign(ids.size(), 0);
+
+    // collision results by robot pair, first < second
+    std::map<std::pair<unsigned int, unsigned int>, std::pair<double, collision_detection::CollisionResult> > collisions;
+
+    for (unsigned int k = 0; k < ids.size(); ++k) {
+      const StatementSource &src = id_sources[ids[k]];
+      if (src.type == StatementSource::NONE) {
+        continue;
+      } else if (src.type == StatementSource::REACHABLE) {
+        bool reachable = false;
+        values[k] = checkReachable(src.first, src.second, states, reachable);
+        truth[k] = reachable;
+        continue;
+      }
+
+      unsigned int r1 = src.type == StatementSource::ROBOTS ? src.first : link_robot[src.first];
+      unsigned int r2 = src.type == StatementSource::ROBOTS ? src.second : link_robot[src.second];
+      if (r1 == r2) {
+        continue;
+      }
+
+      if (src.type == StatementSource::ROBOTS || src.type == TOUCHING) {
+        std::pair<unsigned int, unsigned int> key(std::min(r1, r2), std::max(r1, r2));
+        if (collisions.find(key) == collisions.end()) {
+          std::pair<double, collision_detection::CollisionResult> &entry = collisions[key];
+          entry.first = checkPair(key.first, key.second, states, entry.second);
+        }
+        const std::pair<double, collision_detection::CollisionResult> &entry = collisions[key];
+
+        values[k] = -1.0 * entry.first;
+        if (src.type == StatementSource::ROBOTS) {
+          truth[k] = entry.first <= 0;
+        } else {
+          const std::string &link1 = robots[r1]->getLinkModelNames()[src.first - link_offsets[r1]];
+          const std::string &link2 = robots[r2]->getLinkModelNames()[src.second - link_offsets[r2]];
+          truth[k] = max_contacts > 0 && (entry.second.contacts.find(std::make_pair(link1, link2)) != entry.second.contacts.end()
+            || entry.second.contacts.find(std::make_pair(link2, link1)) != entry.second.contacts.end());
+        }
+        continue;
+      }
+
+      Eigen::Affine3d tf1 = getLinkTransform(states[r1], robots[r1]->getLinkModelNames()[src.first - link_offsets[r1]]);
+      Eigen::Affine3d tf2 = getLinkTransform(states[r2], robots[r2]->getLinkModelNames()[src.second - link_offsets[r2]]);
+
+      double xdiff = tf1.translation()[1] - tf2.translation()[1]; // x = red = front/back from stage
+      double ydiff = tf1.translation()[0] - tf2.translation()[0]; // y = green = left/right?
+      double zdiff = tf1.translation()[2] - tf2.translation()[2]; // z = blue = up/down
+
+      switch (src.type) {
+        case LEFT_OF: values[k] = xdiff - rel_x_threshold; break;
+        case RIGHT_OF: values[k] = -1.0 * xdiff - rel_x_threshold; break;
+        case IN_FRONT_OF: values[k] = ydiff - rel_y_threshold; break;
+        case BEHIND: values[k] = -1.0 * ydiff - rel_y_threshold; break;
+        case ABOVE: values[k] = zdiff - rel_z_threshold; break;
+        case BELOW: values[k] = -1.0 * zdiff - rel_z_threshold; break;
+        case NEAR: values[k] = -1.0 * sqrt((xdiff*xdiff) + (ydiff*ydiff) + (zdiff*zdiff)) + near_3d_threshold; break;
+        case NEAR_XY: values[k] = -1.0 * sqrt((xdiff*xdiff) + (ydiff*ydiff)) + near_2d_threshold; break;
+      }
+
+      // every geometry predicate is published exactly when its value is positive
+      truth[k] = values[k] > 0;
+    }
+  }
+
+  /**
+   * findHeuristic
+   * Looks up the id of a statement, i.e. its index in the heuristics array
+   */
+  bool PredicateContext::findHeuristic(const PredicateStatement &pred, unsigned int &id) const {
+    return predicate_ids.find(pred, id);
   }
 
   /**
@@ -548,14 +943,19 @@ namespace predicator_planning {
     predicator_msgs::PredicateList output;
     output.pheader.source = ros::this_node::getName();
 
-    std::vector<double> heuristics;
-    heuristics.resize(heuristic_indices.size());
+    // pairs that are not recomputed keep their values from the last tick
+    std::vector<double> heuristics = cached_heuristics;
+    heuristics.resize(predicate_ids.size());
 
     updateRobotStates();
-    addCollisionPredicates(output, heuristics, states);
-    addGeometryPredicates(output, heuristics, states);
+    updateDirtyLinks();
+    addCollisionPredicates(output, heuristics, states, ~0, true);
+    addGeometryPredicates(output, heuristics, states, true);
     addReachabilityPredicates(output, heuristics, states);
 
+    cached_heuristics = heuristics;
+    cache_valid = true;
+
     pub.publish(output);
     vpub.publish(pval);
   }
@@ -569,6 +969,69 @@ namespace predicator_planning {
     // use a service call to predicator to get the relevant waypoints
 
     // compute whether or not that point can be reached
+    for (unsigned int m = 0; m < reachability_maps.size(); ++m) {
+      for (unsigned int t = 0; t < reachability_targets[m].size(); ++t) {
+        unsigned int id = reachability_targets[m][t].second;
+        bool reachable = false;
+        heuristics[id] = checkReachable(m, reachability_targets[m][t].first, states, reachable);
+        if (reachable) {
+          list.statements.push_back(predicate_ids.statement(id, heuristics[id]));
+        }
+      }
+    }
+  }
+
+  /**
+   * checkReachable()
+   * Looks up link g in reachability map m
+   * The map only answers to the voxel, so in boundary voxels IK gets the final say.
+   */
+  double PredicateContext::checkReachable(unsigned int m, unsigned int g, const std::vector<RobotState *> &states, bool &reachable) const {
+    const ReachabilityMap &map = reachability_maps[m];
+    unsigned int r = reachability_robots[m];
+    unsigned int r2 = link_robot[g];
+
+    Eigen::Affine3d base = getLinkTransform(states[r], robots[r]->getRootLinkName());
+    Eigen::Affine3d target = getLinkTransform(states[r2], robots[r2]->getLinkModelNames()[g - link_offsets[r2]]);
+
+    int v = map.voxel(base.inverse() * target.translation());
+    reachable = v >= 0 && map.mask(v) != 0;
+    double value = reachable ? map.reachability(v) : -1.0;
+
+    if (!reachability_ik || v < 0 || !map.isBoundary(v)) {
+      return value;
+    }
+
+    // try the orientations that reached this voxel, or any of them if none did
+    const moveit::core::JointModelGroup *group = robots[r]->getJointModelGroup(map.group);
+    uint32_t bins = map.mask(v) != 0 ? map.mask(v) : ~(uint32_t)0;
+    RobotState ik_state(*states[r]);
+    bool found = false;
+
+    // kinematics solvers are shared between copies of a state
+#ifdef USE_OPENMP
+#pragma omp critical(reachability_ik)
+#endif
+    {
+      int attempts = 0;
+      for (unsigned int bin = 0; bin < ReachabilityMap::NUM_BINS && !found && attempts < ik_attempts; ++bin) {
+        if (!(bins & ((uint32_t)1 << bin))) {
+          continue;
+        }
+        Eigen::Affine3d pose = base;
+        pose.linear() = base.linear() * ReachabilityMap::binOrientation(bin);
+        pose.translation() = target.translation();
+        found = ik_state.setFromIK(group, pose, map.tip, 1, ik_timeout);
+        ++attempts;
+      }
+    }
+
+    if (verbosity > 2) {
+      std::cout << "IK for " << map.robot << " in boundary voxel " << v << ": " << found << std::endl;
+    }
+
+    reachable = found;
+    return found ? std::max(value, 1.0 / ReachabilityMap::NUM_BINS) : -1.0;
   }
 
   /**
@@ -597,116 +1060,140 @@ namespace predicator_planning {
    ring1/ring_link 
    world stage_link 
    */
-  void PredicateContext::addGeometryPredicates(PredicateList &list, std::vector<double> &heuristics, const std::vector<RobotState *> &states) {
-
-    unsigned int i = 0;
-    for(typename std::vector<RobotState *>::const_iterator it = states.begin();
-        it != states.end();
-        ++it, ++i)
-    {
-
-      // get the list of joints for the robot state
-      for (typename std::vector<std::string>::const_iterator link1 = (*it)->getRobotModel()->getLinkModelNames().begin();
-           link1 != (*it)->getRobotModel()->getLinkModelNames().end();
-           ++link1)
-      {
-        if (link1->compare(std::string("world")) == 0) {
+  void PredicateContext::addGeometryPredicates(PredicateList &list, std::vector<double> &heuristics, const std::vector<RobotState *> &states, bool use_cache,
+                                               const std::vector<std::vector<unsigned int> > *goal_links) {
+
+    // gather world coordinates of every link
+    std::vector<double> px(num_links, 0.), py(num_links, 0.), pz(num_links, 0.);
+    for (unsigned int i = 0; i < states.size(); ++i) {
+      const std::vector<std::string> &names = states[i]->getRobotModel()->getLinkModelNames();
+      for (unsigned int a = 0; a < names.size(); ++a) {
+        unsigned int g = link_offsets[i] + a;
+        if (!link_valid[g]) {
           continue;
         }
 
-        // access world coordinates
         // NOTE: does not work for the ring yet!
-        Eigen::Affine3d tf1 = getLinkTransform(*it, *link1);
+        Eigen::Affine3d tf = getLinkTransform(states[i], names[a]);
+        px[g] = tf.translation()[0];
+        py[g] = tf.translation()[1];
+        pz[g] = tf.translation()[2];
+      }
+    }
 
-        // loop over the other objects in the world
-        // this does NOT include waypoints or anything like that -- we need a separate loop
-        // the second loop can handle abstract entities like these
-        unsigned int j = 0;
-        for(typename std::vector<RobotState *>::const_iterator it2 = states.begin();
-            it2 != states.end();
-            ++it2, ++j)
-        {
-          if (i == j) {
+    // pairs closer than the grid cells in xy are in neighbouring cells; dist_xy <= dist, so this covers both near predicates
+    bool all_pairs = geometry_range < 0;
+    SpatialHash grid;
+    if (!all_pairs) {
+      grid.build(px, py, link_valid, std::max(geometry_range, std::max(near_3d_threshold, near_2d_threshold)));
+    }
+
+    std::vector<char> visited(num_links, 0);
+    std::vector<unsigned int> others;
+
+    for (unsigned int g1 = 0; g1 < num_links; ++g1) {
+      if (!link_valid[g1]) {
+        continue;
+      }
+
+      // links g1 gets geometry predicates with: its grid neighbours, the watched links and the ones a goal asks for
+      others.clear();
+      if (all_pairs) {
+        for (unsigned int g2 = 0; g2 < num_links; ++g2) {
+          others.push_back(g2);
+        }
+      } else {
+        grid.neighbors(g1, others);
+        others.insert(others.end(), watched_links[g1].begin(), watched_links[g1].end());
+        if (goal_links != NULL) {
+          others.insert(others.end(), (*goal_links)[g1].begin(), (*goal_links)[g1].end());
+        }
+      }
+
+      // loop over the non-world links of the other objects in the world
+      // this does NOT include waypoints or anything like that -- we need a separate loop
+      for (unsigned int k = 0; k < others.size(); ++k) {
+        unsigned int g2 = others[k];
+        if (visited[g2] || !link_valid[g2] || link_robot[g2] == link_robot[g1]) {
+          continue;
+        }
+        visited[g2] = 1;
+
+        // neither link moved since the last tick, re-emit the cached result
+        std::vector<PredicateStatement> *cache = NULL;
+        if (use_cache) {
+          cache = &geometry_cache[g1 * num_links + g2];
+          if (cache_valid && !link_dirty[g1] && !link_dirty[g2]) {
+            list.statements.insert(list.statements.end(), cache->begin(), cache->end());
             continue;
           }
+        }
+        size_t first_statement = list.statements.size();
 
-          // loop over the non-world links of this object
-          // get the list of joints for the robot state
-          for (typename std::vector<std::string>::const_iterator link2 = (*it2)->getRobotModel()->getLinkModelNames().begin();
-               link2 != (*it2)->getRobotModel()->getLinkModelNames().end();
-               ++link2)
-          {
-            if (link2->compare(std::string("world")) == 0) {
-              continue;
-            }
-
-            Eigen::Affine3d tf2 = getLinkTransform(*it2, *link2);
+        if (verbosity > 3) {
+          std::cout << g1 << ", " << g2 << ": ";
+          std::cout << px[g1] << "," << py[g1] << "," << pz[g1] << " --> ";
+          std::cout << px[g2] << "," << py[g2] << "," << pz[g2] << std::endl;
+        }
 
-            if (verbosity > 2) {
-              std::cout << *link1 << ", " << *link2 << std::endl;
-            }
+        double xdiff = py[g1] - py[g2]; // x = red = front/back from stage
+        double ydiff = px[g1] - px[g2]; // y = green = left/right?
+        double zdiff = pz[g1] - pz[g2]; // z = blue = up/down
+
+        const unsigned int *ids = &geometry_ids[(g1 * num_links + g2) * NUM_GEOMETRY_PREDICATES];
+
+        heuristics[ids[LEFT_OF]] = xdiff - rel_x_threshold;
+        heuristics[ids[RIGHT_OF]] = -1.0 * xdiff - rel_x_threshold;
+        heuristics[ids[IN_FRONT_OF]] = ydiff - rel_y_threshold;
+        heuristics[ids[BEHIND]] = -1.0 * ydiff - rel_y_threshold;
+        heuristics[ids[ABOVE]] = zdiff - rel_z_threshold;
+        heuristics[ids[BELOW]] = -1.0 * zdiff - rel_z_threshold;
+
+        // only the true statements are turned into messages
+        // x is left/right
+        if (xdiff < -1.0 * rel_x_threshold){
+          list.statements.push_back(predicate_ids.statement(ids[RIGHT_OF], heuristics[ids[RIGHT_OF]]));
+        } else if (xdiff > rel_x_threshold) {
+          list.statements.push_back(predicate_ids.statement(ids[LEFT_OF], heuristics[ids[LEFT_OF]]));
+        }
 
-            if (verbosity > 3) {
-              std::cout << tf1.translation()[0] << "," << tf1.translation()[1] << "," << tf1.translation()[2] << " --> ";
-              std::cout << tf2.translation()[0] << "," << tf2.translation()[1] << "," << tf2.translation()[2] << std::endl;
-            }
+        // y is front/back
+        if (ydiff < -1.0 * rel_y_threshold) {
+          list.statements.push_back(predicate_ids.statement(ids[BEHIND], heuristics[ids[BEHIND]]));
+        } else if (ydiff > rel_y_threshold) {
+          list.statements.push_back(predicate_ids.statement(ids[IN_FRONT_OF], heuristics[ids[IN_FRONT_OF]]));
+        }
 
-            double xdiff = tf1.translation()[1] - tf2.translation()[1]; // x = red = front/back from stage
-            double ydiff = tf1.translation()[0] - tf2.translation()[0]; // y = green = left/right?
-            double zdiff = tf1.translation()[2] - tf2.translation()[2]; // z = blue = up/down
-            double dist_xy = sqrt((xdiff*xdiff) + (ydiff*ydiff)); // compute xy distance only
-            double dist = sqrt((xdiff*xdiff) + (ydiff*ydiff) + (zdiff*zdiff)); // compute xyz distance
-
-            PredicateStatement left = createStatement("left_of",xdiff - rel_x_threshold,*link1,*link2,"world");
-            PredicateStatement right = createStatement("right_of",-1.0 * xdiff - rel_x_threshold,*link1,*link2,"world");
-            PredicateStatement front = createStatement("in_front_of",ydiff - rel_y_threshold,*link1,*link2,"world");
-            PredicateStatement back = createStatement("behind",-1.0 * ydiff - rel_y_threshold,*link1,*link2,"world");
-            PredicateStatement up = createStatement("above",zdiff - rel_z_threshold,*link1,*link2,"world");
-            PredicateStatement down = createStatement("below",-1.0 * zdiff - rel_z_threshold,*link1,*link2,"world");
-            PredicateStatement near = createStatement("near",-1.0 * dist + near_3d_threshold,*link1,*link2);
-            PredicateStatement near_xy = createStatement("near_xy",-1.0 * dist_xy + near_2d_threshold,*link1,*link2);
-
-            updateHeuristics(left, heuristic_indices, heuristics);
-            updateHeuristics(right, heuristic_indices, heuristics);
-            updateHeuristics(front, heuristic_indices, heuristics);
-            updateHeuristics(back, heuristic_indices, heuristics);
-            updateHeuristics(up, heuristic_indices, heuristics);
-            updateHeuristics(down, heuristic_indices, heuristics);
-            updateHeuristics(near, heuristic_indices, heuristics);
-            updateHeuristics(near_xy, heuristic_indices, heuristics);
-
-            // x is left/right
-            if (xdiff < -1.0 * rel_x_threshold){
-              list.statements.push_back(right);
-            } else if (xdiff > rel_x_threshold) {
-              list.statements.push_back(left);
-            }
+        // z is front/back
+        if (zdiff < -1.0 * rel_z_threshold) {
+          list.statements.push_back(predicate_ids.statement(ids[BELOW], heuristics[ids[BELOW]]));
+        } else if (zdiff > rel_z_threshold) {
+          list.statements.push_back(predicate_ids.statement(ids[ABOVE], heuristics[ids[ABOVE]]));
+        }
 
-            // y is front/back
-            if (ydiff < -1.0 * rel_y_threshold) {
-              list.statements.push_back(back);
-            } else if (ydiff > rel_y_threshold) {
-              list.statements.push_back(front);
-            }
+        double dist_xy = sqrt((xdiff*xdiff) + (ydiff*ydiff)); // compute xy distance only
+        double dist = sqrt((dist_xy*dist_xy) + (zdiff*zdiff)); // compute xyz distance
 
-            // z is front/back
-            if (zdiff < -1.0 * rel_z_threshold) {
-              list.statements.push_back(down);
-            } else if (zdiff > rel_z_threshold) {
-              list.statements.push_back(up);
-            }
+        heuristics[ids[NEAR]] = -1.0 * dist + near_3d_threshold;
+        heuristics[ids[NEAR_XY]] = -1.0 * dist_xy + near_2d_threshold;
 
-            if (dist < near_3d_threshold) {
-              list.statements.push_back(near);
-            }
+        if (dist < near_3d_threshold) {
+          list.statements.push_back(predicate_ids.statement(ids[NEAR], heuristics[ids[NEAR]]));
+        }
 
-            if (dist_xy < near_2d_threshold) {
-              list.statements.push_back(near_xy);
-            }
+        if (dist_xy < near_2d_threshold) {
+          list.statements.push_back(predicate_ids.statement(ids[NEAR_XY], heuristics[ids[NEAR_XY]]));
+        }
 
-            // somehow we need to do this from other points of view as well... but maybe not for now
-          }
+        if (cache != NULL) {
+          cache->assign(list.statements.begin() + first_statement, list.statements.end());
         }
+
+        // somehow we need to do this from other points of view as well... but maybe not for now
+      }
+
+      for (unsigned int k = 0; k < others.size(); ++k) {
+        visited[others[k]] = 0;
       }
     }
   }
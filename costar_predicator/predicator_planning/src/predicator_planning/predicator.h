@@ -13,6 +13,8 @@
 // stl
 #include <vector>
 #include <set>
+#include <limits>
+#include <algorithm>
 
 // MoveIt!
 #include <moveit/collision_detection/collision_robot.h>
@@ -32,6 +34,7 @@
 #include <boost/bind/bind.hpp>
 
 #include "utility.hpp"
+#include "reachability_map.h"
 
 using planning_scene::PlanningScene;
 using robot_model_loader::RobotModelLoader;
@@ -41,10 +44,36 @@ using collision_detection::CollisionRobot;
 
 namespace predicator_planning {
 
-  typedef std::unordered_map<predicator_msgs::PredicateStatement,
-          unsigned int,
-          predicator_planning::Hash,
-          predicator_planning::Equals> heuristic_map_t;
+  /*
+   * geometry predicates computed for every ordered pair of links
+   * used as offsets into PredicateContext::geometry_ids
+   */
+  enum GeometryPredicate {
+    LEFT_OF = 0,
+    RIGHT_OF,
+    IN_FRONT_OF,
+    BEHIND,
+    ABOVE,
+    BELOW,
+    TOUCHING,
+    NEAR,
+    NEAR_XY,
+    NUM_GEOMETRY_PREDICATES
+  };
+
+  /*
+   * StatementSource
+   * What a statement id is computed from, so single statements can be evaluated without the full predicate pass
+   */
+  struct StatementSource {
+    static const unsigned int ROBOTS = NUM_GEOMETRY_PREDICATES; // touching between two whole robots
+    static const unsigned int REACHABLE = NUM_GEOMETRY_PREDICATES + 1; // a link reachable by the group of a reachability map
+    static const unsigned int NONE = NUM_GEOMETRY_PREDICATES + 2; // not computed by the context, e.g. near_mesh
+
+    unsigned int type; // a GeometryPredicate, ROBOTS, REACHABLE or NONE
+    unsigned int first; // link index, robot index for ROBOTS or map index for REACHABLE
+    unsigned int second;
+  };
 
   /*
    * joint_state_callback()
@@ -88,17 +117,65 @@ namespace predicator_planning {
     double rel_z_threshold;
     double near_2d_threshold;
     double near_3d_threshold;
+    double geometry_range; // link pairs farther apart than this in xy get no geometry predicates unless watched or asked for, negative computes every pair
 
     tf::TransformListener listener;
 
     double padding; // how much padding do we give robot links?
     int verbosity; // how much should get printed for debugging purposes
+    double motion_tolerance; // links that moved less than this (m or rad) keep their predicates from the last tick
+    double broadphase_margin; // scene pairs whose bounding boxes are farther apart than this skip the narrow phase, negative disables
+    int max_contacts; // contact budget of each collision check, 0 only reports the robot level touching predicates (one contact is still requested for the depth)
+
+    // robots sorted by the lower x bound of their box, kept between ticks so the sweep only has to repair it
+    std::vector<unsigned int> broadphase_order;
+
+    /*
+     * link_offsets[i] is the index of the first link of robot i in all flat per-link arrays
+     */
+    std::vector<unsigned int> link_offsets;
+    std::vector<unsigned int> link_robot; // robot of each link
+    std::vector<char> link_valid; // false for the "world" links, which get no geometry predicates
+    unsigned int num_links;
 
     /*
-     * heuristic_indices
-     * Stores the locations in a double array of the indices for different features (heuristics)
+     * dirty tracking for tick()
+     * evaluated_transforms holds the transform each link had when its predicates were last computed
      */
-    heuristic_map_t heuristic_indices;
+    std::vector<Eigen::Affine3d, Eigen::aligned_allocator<Eigen::Affine3d> > evaluated_transforms;
+    std::vector<bool> link_dirty;
+    std::vector<bool> robot_dirty;
+    bool cache_valid;
+
+    // statements produced by each scene pair and each link pair during the last tick
+    std::vector<std::vector<PredicateStatement> > collision_cache;
+    std::vector<std::vector<PredicateStatement> > geometry_cache;
+    std::vector<double> cached_heuristics;
+
+    /*
+     * predicate_ids
+     * Every statement we can produce has an id, which is also its location in the heuristics array
+     * geometry_ids holds the NUM_GEOMETRY_PREDICATES ids of each link pair at (g1 * num_links + g2) * NUM_GEOMETRY_PREDICATES
+     * robot_touching_ids holds the touching(robot1, robot2) id at i * num_robots + j
+     */
+    PredicateTable predicate_ids;
+    std::vector<unsigned int> geometry_ids;
+    std::vector<unsigned int> robot_touching_ids;
+    std::vector<StatementSource> id_sources; // indexed by id
+
+    /*
+     * reachability maps, loaded from reachability_map_list
+     * reachability_targets holds (link index, statement id) of every frame checked against each map
+     */
+    std::vector<ReachabilityMap> reachability_maps;
+    std::vector<unsigned int> reachability_robots;
+    std::vector<std::vector<std::pair<unsigned int, unsigned int> > > reachability_targets;
+    bool reachability_ik; // run IK for targets in boundary voxels
+    int ik_attempts; // orientation bins tried by IK per target
+    double ik_timeout;
+
+    // watched_links[g1] lists the links g1 always gets geometry predicates with, from geometry_watch_list
+    std::vector<std::vector<unsigned int> > watched_links;
 
     std::map<std::string, std::string> floating_frames;
     std::string world_frame;
@@ -149,6 +226,51 @@ namespace predicator_planning {
      */
     void updateRobotStates();
 
+    /**
+     * initDirtyTracking()
+     * Size the per-link and per-pair caches used by tick()
+     */
+    void initDirtyTracking();
+
+    /**
+     * updateDirtyLinks()
+     * Marks the links whose world transform changed by more than motion_tolerance since their predicates were computed
+     */
+    void updateDirtyLinks();
+
+    /**
+     * computeBounds()
+     * World axis aligned box of every robot, stored as (minx, maxx, miny, maxy, minz, maxz)
+     */
+    void computeBounds(const std::vector<RobotState *> &states, std::vector<double> &bounds) const;
+
+    /**
+     * sweepAndPrune()
+     * Flags the scene pairs (i * num_scenes + j) whose boxes overlap once grown by broadphase_margin.
+     * order is re-sorted in place with an insertion sort, which is linear when little moved since the last call.
+     */
+    void sweepAndPrune(const std::vector<double> &bounds, std::vector<unsigned int> &order, std::vector<char> &candidates) const;
+
+    /**
+     * checkPair()
+     * Fused collision and distance query between scenes i and j. When they touch, res gets up to max_contacts contacts, and at least one.
+     * Returns the distance between the two robots, or minus the deepest penetration if they collide.
+     * The collision query only runs when the distance query finds the robots touching.
+     */
+    double checkPair(unsigned int i, unsigned int j, const std::vector<RobotState *> &states, collision_detection::CollisionResult &res) const;
+
+    /**
+     * goalPairs()
+     * Flags the robot pairs (i * num_scenes + j, both ways) whose distance one of the statements ids depends on
+     */
+    void goalPairs(const std::vector<unsigned int> &ids, std::vector<char> &pairs) const;
+
+    /**
+     * goalLinks()
+     * links[g1] lists the links g2 whose geometry predicates with g1 one of the statements ids needs
+     */
+    void goalLinks(const std::vector<unsigned int> &ids, std::vector<std::vector<unsigned int> > &links) const;
+
     /**
      * addCollisionPredicates()
      * main collision checking loop
@@ -157,21 +279,38 @@ namespace predicator_planning {
      *
      * @param idx is the index of a particular PlanningScene.
      * When doing planning, we don't really need to recompute all of the world collisions, just the ones that might be changing.
+     * Pairs rejected by the broad phase skip the collision check. Without use_cache their heuristic is minus the gap between their boxes,
+     * a lower bound of the distance; tick() does not read it.
+     * @param use_cache re-emits the last result for pairs where neither robot moved. Only valid for the context's own states.
+     * @param exact_pairs optional goalPairs() mask, rejected pairs flagged in it get their exact distance instead of the box gap
      */
-    void addCollisionPredicates(PredicateList &list, std::vector<double> &heuristics, const std::vector<RobotState *> &states, unsigned int idx=~0);
+    void addCollisionPredicates(PredicateList &list, std::vector<double> &heuristics, const std::vector<RobotState *> &states, unsigned int idx=~0,
+                                bool use_cache=false, const std::vector<char> *exact_pairs=NULL);
 
     /**
      * addGeometryPredicates()
      * compute the set of geometry predicates
+     * Link positions are gathered into flat x/y/z arrays first. Only pairs found in neighbouring cells of a SpatialHash with cells of
+     * geometry_range (at least the near thresholds), the watched_links and the goal_links are computed; the heuristics of other pairs are left alone.
+     * @param use_cache re-emits the last result for link pairs where neither link moved. Only valid for the context's own states.
+     * @param goal_links optional goalLinks() lists of pairs that are computed wherever they are
      */
-    void addGeometryPredicates(PredicateList &list, std::vector<double> &heuristic, const std::vector<RobotState *> &states);
+    void addGeometryPredicates(PredicateList &list, std::vector<double> &heuristic, const std::vector<RobotState *> &states, bool use_cache=false,
+                               const std::vector<std::vector<unsigned int> > *goal_links=NULL);
 
     /**
      * addReachabilityPredicates()
      * compute whether or not we can reach certain points or waypoints
+     * Produces reachable(frame, robot) by looking up the frame in the robot's reachability map, with IK only in boundary voxels
      */
     void addReachabilityPredicates(PredicateList &list, std::vector<double> &heuristics, const std::vector<RobotState *> &states);
 
+    /**
+     * checkReachable()
+     * Looks up link g in reachability map m. Returns the fraction of orientation bins that reached its voxel, or -1.
+     */
+    double checkReachable(unsigned int m, unsigned int g, const std::vector<RobotState *> &states, bool &reachable) const;
+
     /**
      * getLinkTransform
      * Check to see if this is in the list of floating transfoms
@@ -192,6 +331,20 @@ namespace predicator_planning {
      * Looks up a score from a vector of possible values
      */
     double getHeuristic(const PredicateStatement &pred, const std::vector<double> &heuristics) const;
+
+    /**
+     * evaluateStatements()
+     * Computes the value of only the given statement ids for a set of states, the same as the add*Predicates functions would.
+     * truth[k] is set if the statement would have been published. Does not modify the context, so it can be called from several threads.
+     */
+    void evaluateStatements(const std::vector<unsigned int> &ids, const std::vector<RobotState *> &states,
+                            std::vector<double> &values, std::vector<char> &truth) const;
+
+    /**
+     * findHeuristic
+     * Looks up the id of a statement, i.e. its index in the heuristics array. Returns false if we never produce it.
+     */
+    bool findHeuristic(const PredicateStatement &pred, unsigned int &id) const;
   };
 }
 
@@ -19,6 +19,8 @@ int main(int argc, char **argv) {
   double chance = 0.30;
   double skip_distance = 0.75;
   double search_volume = 0.50;
+  int batch_size = 1;
+  bool goal_predicates_only = false;
 
   ros::NodeHandle nh("~");
   nh.param("max_iter", max_iter, int(5000));
@@ -26,8 +28,11 @@ int main(int argc, char **argv) {
   nh.param("chance", chance, double(0.40));
   nh.param("skip_distance", skip_distance, double(0.75));
   nh.param("search_volume", search_volume, double(0.50));
+  nh.param("batch_size", batch_size, int(1));
+  nh.param("goal_predicates_only", goal_predicates_only, false);
 
-  predicator_planning::Planner planner(&pc, (unsigned int)max_iter, step, chance, skip_distance, search_volume);
+  predicator_planning::Planner planner(&pc, (unsigned int)max_iter, step, chance, skip_distance, search_volume,
+                                       (unsigned int)std::max(batch_size, 1), goal_predicates_only);
 
   // define spin rate
   ros::Rate rate(30);
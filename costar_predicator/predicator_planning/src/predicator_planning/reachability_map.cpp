@@ -0,0 +1,182 @@
+#include "reachability_map.h"
+
+#include <fstream>
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+namespace predicator_planning {
+
+  ReachabilityMap::ReachabilityMap() : resolution(0.05), origin(Eigen::Vector3d::Zero()), nx(0), ny(0), nz(0) {}
+
+  /*
+   * orientationBin()
+   * polar angle major, azimuth minor
+   */
+  unsigned int ReachabilityMap::orientationBin(const Eigen::Matrix3d &rotation) {
+    Eigen::Vector3d dir = rotation.col(2);
+    double theta = acos(std::max(-1.0, std::min(1.0, dir[2])));
+    double phi = atan2(dir[1], dir[0]) + M_PI;
+
+    unsigned int p = std::min((unsigned int)(theta / M_PI * POLAR_BINS), POLAR_BINS - 1);
+    unsigned int a = std::min((unsigned int)(phi / (2 * M_PI) * AZIMUTH_BINS), AZIMUTH_BINS - 1);
+    return p * AZIMUTH_BINS + a;
+  }
+
+  Eigen::Matrix3d ReachabilityMap::binOrientation(unsigned int bin) {
+    double theta = ((bin / AZIMUTH_BINS) + 0.5) * M_PI / POLAR_BINS;
+    double phi = ((bin % AZIMUTH_BINS) + 0.5) * 2 * M_PI / AZIMUTH_BINS - M_PI;
+    Eigen::Vector3d dir(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
+    return Eigen::Quaterniond::FromTwoVectors(Eigen::Vector3d::UnitZ(), dir).toRotationMatrix();
+  }
+
+  void ReachabilityMap::build(const std::vector<Eigen::Vector3d> &positions, const std::vector<unsigned char> &bins, double _resolution) {
+    resolution = _resolution;
+    masks.clear();
+    boundary.clear();
+    nx = ny = nz = 0;
+    if (positions.empty()) {
+      return;
+    }
+
+    Eigen::Vector3d lower = positions[0];
+    Eigen::Vector3d upper = positions[0];
+    for (unsigned int i = 1; i < positions.size(); ++i) {
+      lower = lower.cwiseMin(positions[i]);
+      upper = upper.cwiseMax(positions[i]);
+    }
+
+    // one empty voxel of margin on every side, so the outer reachable voxels are boundary voxels
+    origin = lower - Eigen::Vector3d::Constant(resolution);
+    nx = (int)floor((upper[0] - origin[0]) / resolution) + 2;
+    ny = (int)floor((upper[1] - origin[1]) / resolution) + 2;
+    nz = (int)floor((upper[2] - origin[2]) / resolution) + 2;
+
+    masks.assign((size_t)nx * ny * nz, 0);
+    for (unsigned int i = 0; i < positions.size(); ++i) {
+      int v = voxel(positions[i]);
+      if (v >= 0) {
+        masks[v] |= (uint32_t)1 << bins[i];
+      }
+    }
+
+    computeBoundary();
+  }
+
+  int ReachabilityMap::voxel(const Eigen::Vector3d &position) const {
+    int x = (int)floor((position[0] - origin[0]) / resolution);
+    int y = (int)floor((position[1] - origin[1]) / resolution);
+    int z = (int)floor((position[2] - origin[2]) / resolution);
+    if (x < 0 || y < 0 || z < 0 || x >= nx || y >= ny || z >= nz) {
+      return -1;
+    }
+    return (z * ny + y) * nx + x;
+  }
+
+  double ReachabilityMap::reachability(int voxel) const {
+    uint32_t m = masks[voxel];
+    unsigned int count = 0;
+    for (; m; m &= m - 1) {
+      ++count;
+    }
+    return (double)count / NUM_BINS;
+  }
+
+  void ReachabilityMap::computeBoundary() {
+    boundary.assign(masks.size(), 0);
+    const int offsets[6][3] = {{-1,0,0}, {1,0,0}, {0,-1,0}, {0,1,0}, {0,0,-1}, {0,0,1}};
+
+    for (int z = 0; z < nz; ++z) {
+      for (int y = 0; y < ny; ++y) {
+        for (int x = 0; x < nx; ++x) {
+          int v = (z * ny + y) * nx + x;
+          bool reachable = masks[v] != 0;
+          for (unsigned int k = 0; k < 6 && !boundary[v]; ++k) {
+            int x2 = x + offsets[k][0], y2 = y + offsets[k][1], z2 = z + offsets[k][2];
+            bool other = x2 >= 0 && y2 >= 0 && z2 >= 0 && x2 < nx && y2 < ny && z2 < nz
+              && masks[(z2 * ny + y2) * nx + x2] != 0;
+            boundary[v] = other != reachable;
+          }
+        }
+      }
+    }
+  }
+
+  static void writeString(std::ofstream &out, const std::string &str) {
+    unsigned int len = str.size();
+    out.write((char*)&len, sizeof(unsigned int));
+    out.write(str.c_str(), len);
+  }
+
+  static bool readString(std::ifstream &in, std::string &str) {
+    unsigned int len = 0;
+    in.read((char*)&len, sizeof(unsigned int));
+    if (!in || len > 4096) {
+      return false;
+    }
+    str.resize(len);
+    if (len > 0) {
+      in.read(&str[0], len);
+    }
+    return (bool)in;
+  }
+
+  bool ReachabilityMap::save(const std::string &filename) const {
+    std::ofstream out(filename.c_str(), std::ios::out|std::ios::binary);
+    if (out.is_open() == false) {
+      return false;
+    }
+
+    unsigned int num_bins = NUM_BINS;
+    writeString(out, robot);
+    writeString(out, group);
+    writeString(out, tip);
+    out.write((char*)&num_bins, sizeof(unsigned int));
+    out.write((char*)&resolution, sizeof(double));
+    out.write((char*)origin.data(), 3 * sizeof(double));
+    out.write((char*)&nx, sizeof(int));
+    out.write((char*)&ny, sizeof(int));
+    out.write((char*)&nz, sizeof(int));
+    if (!masks.empty()) {
+      out.write((char*)&masks[0], sizeof(uint32_t) * masks.size());
+    }
+    out.close();
+    return true;
+  }
+
+  bool ReachabilityMap::load(const std::string &filename) {
+    std::ifstream in(filename.c_str(), std::ios::in|std::ios::binary);
+    if (in.is_open() == false) {
+      return false;
+    }
+
+    unsigned int num_bins = 0;
+    bool ok = readString(in, robot) && readString(in, group) && readString(in, tip);
+    in.read((char*)&num_bins, sizeof(unsigned int));
+    in.read((char*)&resolution, sizeof(double));
+    in.read((char*)origin.data(), 3 * sizeof(double));
+    in.read((char*)&nx, sizeof(int));
+    in.read((char*)&ny, sizeof(int));
+    in.read((char*)&nz, sizeof(int));
+    if (!ok || !in || num_bins != NUM_BINS || resolution <= 0 || nx < 0 || ny < 0 || nz < 0) {
+      std::cerr << "Invalid reachability map: " << filename << std::endl;
+      masks.clear();
+      boundary.clear();
+      return false;
+    }
+
+    masks.resize((size_t)nx * ny * nz);
+    if (!masks.empty()) {
+      in.read((char*)&masks[0], sizeof(uint32_t) * masks.size());
+    }
+    if (!in) {
+      std::cerr << "Truncated reachability map: " << filename << std::endl;
+      masks.clear();
+      boundary.clear();
+      return false;
+    }
+
+    computeBoundary();
+    return true;
+  }
+}
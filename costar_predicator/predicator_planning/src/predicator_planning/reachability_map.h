@@ -0,0 +1,70 @@
+#ifndef _PREDICATOR_REACHABILITY_MAP
+#define _PREDICATOR_REACHABILITY_MAP
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <Eigen/Geometry>
+
+namespace predicator_planning {
+
+  /**
+   * ReachabilityMap
+   * Voxel grid over the workspace of one robot group, in the frame of the robot's root link.
+   * Each voxel stores a bit mask of the end effector orientations that reached it while sampling,
+   * binned by the direction of the tip's z axis.
+   */
+  class ReachabilityMap {
+  public:
+    static const unsigned int AZIMUTH_BINS = 8;
+    static const unsigned int POLAR_BINS = 4;
+    static const unsigned int NUM_BINS = AZIMUTH_BINS * POLAR_BINS;
+
+    std::string robot; // robot model name
+    std::string group; // joint model group that was sampled
+    std::string tip; // end effector link
+
+    ReachabilityMap();
+
+    /*
+     * build()
+     * positions are tip positions relative to the root link, bins the matching orientationBin()
+     */
+    void build(const std::vector<Eigen::Vector3d> &positions, const std::vector<unsigned char> &bins, double resolution);
+
+    bool save(const std::string &filename) const;
+    bool load(const std::string &filename);
+
+    bool empty() const { return masks.empty(); }
+    size_t numVoxels() const { return masks.size(); }
+
+    // orientation bin of the z axis of rotation
+    static unsigned int orientationBin(const Eigen::Matrix3d &rotation);
+
+    // a rotation whose z axis points at the center of bin
+    static Eigen::Matrix3d binOrientation(unsigned int bin);
+
+    // index of the voxel holding position, -1 if it is outside of the map
+    int voxel(const Eigen::Vector3d &position) const;
+
+    uint32_t mask(int voxel) const { return masks[voxel]; }
+
+    // reachable voxel next to an unreachable one or the other way around, where the voxel answer is least reliable
+    bool isBoundary(int voxel) const { return boundary[voxel] != 0; }
+
+    // fraction of orientation bins that reached voxel
+    double reachability(int voxel) const;
+
+  private:
+    void computeBoundary();
+
+    double resolution;
+    Eigen::Vector3d origin;
+    int nx, ny, nz;
+    std::vector<uint32_t> masks;
+    std::vector<char> boundary;
+  };
+}
+
+#endif
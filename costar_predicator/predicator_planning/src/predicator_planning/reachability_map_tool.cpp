@@ -0,0 +1,92 @@
+// ROS
+#include <ros/ros.h>
+
+// for debugging
+#include <iostream>
+
+// MoveIt!
+#include <moveit/robot_model_loader/robot_model_loader.h>
+#include <moveit/robot_state/robot_state.h>
+
+#include "reachability_map.h"
+
+using predicator_planning::ReachabilityMap;
+
+/**
+ * predicator_reachability_map
+ * Offline tool, samples random configurations of a joint model group and stores where its tip went
+ * as a ReachabilityMap for the reachable() predicates of predicator_planning_node.
+ */
+int main(int argc, char **argv) {
+
+  ros::init(argc, argv, "predicator_reachability_map");
+  ros::NodeHandle nh_tilde("~");
+
+  std::string description;
+  std::string group_name;
+  std::string tip;
+  std::string filename;
+  double resolution;
+  int samples;
+
+  nh_tilde.param("robot_description", description, std::string("robot_description"));
+  nh_tilde.param("group", group_name, std::string("arm"));
+  nh_tilde.param("tip", tip, std::string(""));
+  nh_tilde.param("resolution", resolution, 0.05);
+  nh_tilde.param("samples", samples, 1000000);
+  nh_tilde.param("filename", filename, std::string("reachability.map"));
+
+  robot_model_loader::RobotModelLoader robot_model_loader(description);
+  robot_model::RobotModelPtr model = robot_model_loader.getModel();
+  if (!model) {
+    ROS_ERROR("Could not load robot description \"%s\"!", description.c_str());
+    return -1;
+  }
+
+  if (!model->hasJointModelGroup(group_name)) {
+    ROS_ERROR("Unable to get group \"%s\" for robot \"%s\"!", group_name.c_str(), model->getName().c_str());
+    return -1;
+  }
+  const moveit::core::JointModelGroup *group = model->getJointModelGroup(group_name);
+
+  // default to the last link of the group
+  if (tip.size() == 0) {
+    tip = group->getLinkModelNames().back();
+  }
+
+  robot_state::RobotState state(model);
+  state.setToDefaultValues();
+
+  std::vector<Eigen::Vector3d> positions;
+  std::vector<unsigned char> bins;
+  positions.reserve(samples);
+  bins.reserve(samples);
+
+  for (int i = 0; i < samples; ++i) {
+    state.setToRandomPositions(group);
+    state.update(true);
+
+    // relative to the root link, so the map stays valid wherever the robot is placed
+    Eigen::Affine3d pose = state.getGlobalLinkTransform(model->getRootLinkName()).inverse() * state.getGlobalLinkTransform(tip);
+    positions.push_back(pose.translation());
+    bins.push_back(ReachabilityMap::orientationBin(pose.linear()));
+
+    if ((i + 1) % 100000 == 0) {
+      ROS_INFO("%d samples", i + 1);
+    }
+  }
+
+  ReachabilityMap map;
+  map.robot = model->getName();
+  map.group = group_name;
+  map.tip = tip;
+  map.build(positions, bins, resolution);
+
+  if (!map.save(filename)) {
+    ROS_ERROR("Failed to write \"%s\"!", filename.c_str());
+    return -1;
+  }
+  ROS_INFO("Wrote %lu voxels for %s/%s to \"%s\"", map.numVoxels(), map.robot.c_str(), tip.c_str(), filename.c_str());
+
+  return 0;
+}
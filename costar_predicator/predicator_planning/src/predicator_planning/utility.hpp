@@ -2,12 +2,15 @@
 #define _PP_UTILITY
 
 #include <unordered_map>
+#include <vector>
 #include <predicator_msgs/PredicateStatement.h>
 #include <predicator_msgs/PredicateSet.h>
 #include <predicator_msgs/PredicateList.h>
 #include <predicator_msgs/PredicateAssignment.h>
 #include <string>
 #include <functional>
+#include <cmath>
+#include <algorithm>
 
 using std::string;
 using std::unordered_map;
@@ -44,6 +47,196 @@ namespace predicator_planning {
         msg1.params[2] == msg2.params[2];
     }
   };
+
+  /**
+   * SymbolTable
+   * Interns predicate names and parameters as dense integer ids.
+   * Id 0 is always the empty string, which is used for unset parameters.
+   */
+  class SymbolTable {
+  public:
+    SymbolTable() {
+      intern(std::string());
+    }
+
+    unsigned int intern(const std::string &name) {
+      unordered_map<std::string, unsigned int>::const_iterator it = ids.find(name);
+      if (it != ids.end()) {
+        return it->second;
+      }
+      unsigned int id = names.size();
+      ids[name] = id;
+      names.push_back(name);
+      return id;
+    }
+
+    // returns false if name was never interned
+    bool find(const std::string &name, unsigned int &id) const {
+      unordered_map<std::string, unsigned int>::const_iterator it = ids.find(name);
+      if (it == ids.end()) {
+        return false;
+      }
+      id = it->second;
+      return true;
+    }
+
+    const std::string &name(unsigned int id) const {
+      return names[id];
+    }
+
+    size_t size() const {
+      return names.size();
+    }
+
+  private:
+    unordered_map<std::string, unsigned int> ids;
+    std::vector<std::string> names;
+  };
+
+  /**
+   * PredicateKey
+   * A predicate statement with all of its strings replaced by symbol ids
+   */
+  struct PredicateKey {
+    unsigned int predicate;
+    unsigned int params[3];
+
+    bool operator==(const PredicateKey &other) const {
+      return predicate == other.predicate &&
+        params[0] == other.params[0] &&
+        params[1] == other.params[1] &&
+        params[2] == other.params[2];
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const PredicateKey &key) const {
+      size_t res = key.predicate;
+      for (unsigned int i = 0; i < 3; ++i) {
+        res = res * 31 + key.params[i];
+      }
+      return res;
+    }
+  };
+
+  /**
+   * PredicateTable
+   * Gives every known predicate statement a dense id, so that values can be stored in flat arrays indexed by id.
+   * Strings are only compared when a statement is looked up by message and only built when one is published.
+   */
+  class PredicateTable {
+  public:
+
+    unsigned int intern(const std::string &predicate, const std::string &param1, const std::string &param2, const std::string &param3 = "") {
+      PredicateKey key;
+      key.predicate = symbols.intern(predicate);
+      key.params[0] = symbols.intern(param1);
+      key.params[1] = symbols.intern(param2);
+      key.params[2] = symbols.intern(param3);
+
+      unordered_map<PredicateKey, unsigned int, KeyHash>::const_iterator it = ids.find(key);
+      if (it != ids.end()) {
+        return it->second;
+      }
+      unsigned int id = keys.size();
+      ids[key] = id;
+      keys.push_back(key);
+      return id;
+    }
+
+    // returns false if the statement was never interned
+    bool find(const std::string &predicate, const std::string &param1, const std::string &param2, const std::string &param3, unsigned int &id) const {
+      PredicateKey key;
+      if (!symbols.find(predicate, key.predicate) ||
+          !symbols.find(param1, key.params[0]) ||
+          !symbols.find(param2, key.params[1]) ||
+          !symbols.find(param3, key.params[2]))
+      {
+        return false;
+      }
+
+      unordered_map<PredicateKey, unsigned int, KeyHash>::const_iterator it = ids.find(key);
+      if (it == ids.end()) {
+        return false;
+      }
+      id = it->second;
+      return true;
+    }
+
+    bool find(const PredicateStatement &msg, unsigned int &id) const {
+      return find(msg.predicate, msg.params[0], msg.params[1], msg.params[2], id);
+    }
+
+    /*
+     * statement()
+     * Build the message for a statement, this is the only place its strings are copied
+     */
+    PredicateStatement statement(unsigned int id, double value) const {
+      const PredicateKey &key = keys[id];
+      PredicateStatement ps;
+      ps.predicate = symbols.name(key.predicate);
+      ps.params[0] = symbols.name(key.params[0]);
+      ps.params[1] = symbols.name(key.params[1]);
+      ps.params[2] = symbols.name(key.params[2]);
+      ps.num_params = key.params[2] == 0 ? 2 : 3;
+      ps.value = value;
+      return ps;
+    }
+
+    size_t size() const {
+      return keys.size();
+    }
+
+  private:
+    SymbolTable symbols;
+    unordered_map<PredicateKey, unsigned int, KeyHash> ids;
+    std::vector<PredicateKey> keys;
+  };
+
+  /**
+   * SpatialHash
+   * Uniform grid over points in the xy plane.
+   * Two points closer than cell_size in xy always fall in the same or in adjacent cells.
+   */
+  class SpatialHash {
+  public:
+
+    void build(const std::vector<double> &x, const std::vector<double> &y, const std::vector<char> &valid, double cell_size) {
+      inv_cell = 1.0 / std::max(cell_size, 1e-6);
+      cx.assign(x.size(), 0);
+      cy.assign(x.size(), 0);
+      cells.clear();
+      for (unsigned int i = 0; i < x.size(); ++i) {
+        if (!valid[i]) {
+          continue;
+        }
+        cx[i] = (long long)floor(x[i] * inv_cell);
+        cy[i] = (long long)floor(y[i] * inv_cell);
+        cells[key(cx[i], cy[i])].push_back(i);
+      }
+    }
+
+    // appends every point in the 3x3 block of cells around point i, including i itself
+    void neighbors(unsigned int i, std::vector<unsigned int> &out) const {
+      for (long long dx = -1; dx <= 1; ++dx) {
+        for (long long dy = -1; dy <= 1; ++dy) {
+          unordered_map<unsigned long long, std::vector<unsigned int> >::const_iterator it = cells.find(key(cx[i] + dx, cy[i] + dy));
+          if (it != cells.end()) {
+            out.insert(out.end(), it->second.begin(), it->second.end());
+          }
+        }
+      }
+    }
+
+  private:
+    static unsigned long long key(long long x, long long y) {
+      return ((unsigned long long)x << 32) ^ (unsigned long long)(unsigned int)y;
+    }
+
+    double inv_cell;
+    std::vector<long long> cx, cy;
+    unordered_map<unsigned long long, std::vector<unsigned int> > cells;
+  };
 }
 
 #endif
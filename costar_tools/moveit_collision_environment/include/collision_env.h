@@ -8,6 +8,8 @@
 #include <geometric_shapes/shape_operations.h>
 #include <shape_msgs/Mesh.h>
 #include <moveit_msgs/CollisionObject.h>
+#include <boost/shared_ptr.hpp>
+#include <map>
 
 // use detected object list instead of tf name convention
 #include <costar_objrec_msgs/DetectedObject.h>
@@ -18,6 +20,14 @@ struct objectTF {
     geometry_msgs::Pose pose;
 };
 
+// what the planning scene holds for one collision object id
+typedef boost::shared_ptr<const shape_msgs::Mesh> MeshConstPtr;
+
+struct sceneObjectState {
+    std::string frame_id;
+    std::string geometry; // mesh file location, or a description of the primitives
+};
+
 class collision_environment
 {
 	protected:
@@ -31,6 +41,25 @@ class collision_environment
 		std::vector<objectTF> detectedObjectsTF;
         std::vector<moveit_msgs::CollisionObject>* segmentedObjects;
         moveit_msgs::CollisionObject tableObject;
+
+        // meshes loaded so far, keyed by file location
+        std::map<std::string, MeshConstPtr> meshCache;
+        // geometry key and cached mesh of each entry of segmentedObjects, whose meshes are only copied into ADD updates
+        std::vector<std::string> segmentedGeometry;
+        std::vector<MeshConstPtr> segmentedMeshes;
+        // collision objects as of the last published update, keyed by id
+        std::map<std::string, sceneObjectState> sceneObjects;
+        std::vector<moveit_msgs::CollisionObject> sceneUpdates;
+
+        // mesh representation for planning and for predicates: full, decimated, hull or box
+        std::string planningRepresentation, predicateRepresentation;
+        std::map<std::string, std::string> meshFileOf; // object class/representation -> mesh file actually used
+        // the same as above for the scene used by predicates, only filled if hasPredicateScene()
+        std::vector<moveit_msgs::CollisionObject> predicateObjects;
+        std::vector<std::string> predicateGeometry;
+        std::vector<MeshConstPtr> predicateMeshes;
+        std::map<std::string, sceneObjectState> predicateSceneObjects;
+        std::vector<moveit_msgs::CollisionObject> predicateSceneUpdates;
         
         std::string tableTFname, parentTableTF, baseLinkName;
 		std::string mesh_source, file_extension;
@@ -42,8 +71,22 @@ class collision_environment
         bool defineParent;
         std::string definedParent;
         double tableSize, baseLinkWallDistance;
+        std::map<std::string, objectTF> lastObjectTF; // last resolved pose of each object frame, used while a frame is late
+        std::vector<objectTF> deferredObjectTF; // frames that were late in the last update, retried at deferredStamp
+        ros::Time deferredStamp;
 
         bool getTable();
+        MeshConstPtr getMesh(const std::string &file_location);
+        void resolveObjectTF(std::vector<objectTF> &candidates, const ros::Time &stamp);
+        bool lookupObjectTF(objectTF &object, const ros::Time &stamp);
+        MeshConstPtr getObjectMesh(const std::string &name, const std::string &representation,
+            std::string &file_location);
+        void addDetectedObjects(const std::string &representation, std::vector<moveit_msgs::CollisionObject> &objects,
+            std::vector<std::string> &geometry, std::vector<MeshConstPtr> &meshes);
+        void computeSceneUpdates(const std::vector<moveit_msgs::CollisionObject> &objects,
+            const std::vector<std::string> &geometry, const std::vector<MeshConstPtr> &meshes,
+            std::map<std::string, sceneObjectState> &sceneObjects, std::vector<moveit_msgs::CollisionObject> &sceneUpdates,
+            const bool &fullScene);
         void addSurroundingWalls(
         	moveit_msgs::CollisionObject &targetCollisionObject, const tf::Transform &centerOfObject,
         	const double &distanceToWalls,const double &wallHeights, bool flippedBackWall = false);
@@ -59,10 +102,13 @@ class collision_environment
 		void getAllObjectTF();
         void getAllObjectTFfromDetectedObjectMsgs(const costar_objrec_msgs::DetectedObjectList &detectedObject);
         
-		void updateCollisionObjects(const bool &updateFrame = true);
+		void updateCollisionObjects(const bool &updateFrame = true, const bool &fullScene = false);
         std::vector<std::string> getListOfTF() const;
         const std::vector<moveit_msgs::CollisionObject> getCollisionObjects() const;
         const std::vector<moveit_msgs::CollisionObject> generateOldObjectToRemove() const;
+        const std::vector<moveit_msgs::CollisionObject> &getSceneUpdates() const;
+        bool hasPredicateScene() const;
+        const std::vector<moveit_msgs::CollisionObject> &getPredicateSceneUpdates() const;
 };
 
 std::vector<std::string> stringVectorSeparator (const std::string &input,
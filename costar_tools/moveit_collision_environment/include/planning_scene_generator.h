@@ -21,11 +21,18 @@ class moveitPlanningSceneGenerator
 protected:
     ros::NodeHandle nh;
     ros::Publisher planning_scene_diff_publisher;
+    ros::Publisher predicate_scene_diff_publisher;
     ;
 private:
     moveit_msgs::PlanningScene planning_scene;
     collision_environment collisionObjectGenerator;
     bool useDetectedObjectMsgs;
+    double fullSceneUpdatePeriod; // seconds between updates that send every object again, 0 to only send them to new subscribers
+    ros::Time lastFullSceneUpdate;
+    bool fullSceneRequested; // a subscriber connected since the last full update
+    bool fullSceneDue();
+    void publishPredicateScene();
+    void subscriberConnected(const ros::SingleSubscriberPublisher &pub);
     ros::Subscriber getDetectedObject; 
     boost::mutex mtx; // for locking detectedObjectList
     costar_objrec_msgs::DetectedObjectList detectedObjectList;
@@ -71,6 +71,9 @@ void collision_environment::setNodeHandle(const ros::NodeHandle &nh)
     nh.param("useBaseLinkWall",useBaseLinkWall,true);    
     nh.param("tableSize",tableSize,1.0);
     nh.param("baseLinkWallDistance",baseLinkWallDistance,1.0);
+    // mesh used for the detected objects: full, decimated, hull or box (see simplify_collision_mesh)
+    nh.param("planningRepresentation",planningRepresentation,std::string("full"));
+    nh.param("predicateRepresentation",predicateRepresentation,planningRepresentation);
     
     if (defineParent) {
         nh.param("parentFrameName",definedParent,std::string("base_link"));
@@ -85,9 +88,10 @@ void collision_environment::setNodeHandle(const ros::NodeHandle &nh)
     getAllObjectTF();
 }
 
-void collision_environment::updateCollisionObjects(const bool &updateFrame)
+void collision_environment::updateCollisionObjects(const bool &updateFrame, const bool &fullScene)
 {
-    // This function will update the collision object list based on the list of object TF
+    // This function will update the collision object list based on the list of object TF.
+    // With fullScene, the scene updates add every object again instead of only sending what changed
     if (!classReady)
     {
         std::cerr << "ERROR, class has no nodehandle to subscribe.\n";
@@ -97,6 +101,11 @@ void collision_environment::updateCollisionObjects(const bool &updateFrame)
     
     // Remove all collision objects from cache
     segmentedObjects->clear();
+    segmentedGeometry.clear();
+    segmentedMeshes.clear();
+    predicateObjects.clear();
+    predicateGeometry.clear();
+    predicateMeshes.clear();
     
     bool updateTable;
     // Renew table param determine whether the table will be updated after it is detected for the first time
@@ -113,57 +122,209 @@ void collision_environment::updateCollisionObjects(const bool &updateFrame)
         if (hasTableTF)
             segmentedObjects->push_back(this->tableObject);
     }
+    if (segmentedObjects->size() > 0) {
+        // the table box, walls and ground only move, their sizes are fixed by the params
+        std::stringstream geometry;
+        geometry << "primitives:" << tableObject.primitives.size();
+        segmentedGeometry.push_back(geometry.str());
+        segmentedMeshes.push_back(MeshConstPtr());
+        predicateObjects = *segmentedObjects;
+        predicateGeometry = segmentedGeometry;
+        predicateMeshes = segmentedMeshes;
+    }
         
     
     if (debug)
         std::cerr << "Number of object after add table: " << segmentedObjects->size() <<std::endl;
 
 	// update list of object TF when updateCollisionObjects method is called
+    bool hasFrames = true;
     if (updateFrame) {
         getAllObjectTF();
         if (listOfTF.size() == 0) {
             hasObjects = false;
+            hasFrames = false;
             std::cerr << "No Object TF available.\n";
-            return;
         }
         else hasObjects = true;
     }
     
     // Add the collision objects based on available object TF
+    if (hasFrames) {
+        addDetectedObjects(planningRepresentation, *segmentedObjects, segmentedGeometry, segmentedMeshes);
+        if (hasPredicateScene())
+            addDetectedObjects(predicateRepresentation, predicateObjects, predicateGeometry, predicateMeshes);
+    }
+    
+    computeSceneUpdates(*segmentedObjects, segmentedGeometry, segmentedMeshes, sceneObjects, sceneUpdates, fullScene);
+    if (hasPredicateScene())
+        computeSceneUpdates(predicateObjects, predicateGeometry, predicateMeshes, predicateSceneObjects, predicateSceneUpdates, fullScene);
+
+    if (debug) {
+        std::cerr << "Number of object after add objects: ";
+        std::cerr << segmentedObjects->size() <<std::endl;
+        std::cerr << "Collision Object Published\n";
+    }
+};
+
+void collision_environment::addDetectedObjects(const std::string &representation, std::vector<moveit_msgs::CollisionObject> &objects,
+    std::vector<std::string> &geometry, std::vector<MeshConstPtr> &meshes)
+{
+    // This function will add one mesh collision object per detected object TF, using the given mesh representation.
+    // The mesh itself stays in the cache, computeSceneUpdates only copies it into the objects that are added
     for (int i = 0; i < detectedObjectsTF.size(); i++) {
         moveit_msgs::CollisionObject co;
         // name of collision object = TF name
         co.id = detectedObjectsTF.at(i).frame_id;
         co.header.frame_id = parentFrame;
-        std::stringstream file_location, ss;
-        // read the location of the mesh file
-
-        file_location << mesh_source << "/" << detectedObjectsTF.at(i).name << "." << file_extension;
-        if (!boost::filesystem::exists( file_location.str() ))
-        {
-            std::cerr << "Warning: Mesh file not found at: " << file_location.str() << std::endl;
-            continue;
-        }
-        ss << "file://" << file_location.str();
         
-        // Generate moveit mesh from mesh file
-        shapes::Mesh * tmpMesh = shapes::createMeshFromResource(ss.str());
-        shape_msgs::Mesh co_mesh;
-        shapes::ShapeMsg co_mesh_msg;
-        shapes::constructMsgFromShape(tmpMesh,co_mesh_msg);
-        co_mesh = boost::get<shape_msgs::Mesh>(co_mesh_msg);
-        co.meshes.push_back(co_mesh);
+        // Get moveit mesh from mesh file, only loaded the first time this object class shows up
+        std::string file_location;
+        MeshConstPtr co_mesh = getObjectMesh(detectedObjectsTF.at(i).name, representation, file_location);
+        if (!co_mesh)
+            continue;
         co.mesh_poses.push_back(detectedObjectsTF.at(i).pose);
         co.operation = co.ADD;
-        segmentedObjects->push_back(co);
+        objects.push_back(co);
+        geometry.push_back(file_location);
+        meshes.push_back(co_mesh);
     }
-    
-    if (debug) {
-        std::cerr << "Number of object after add objects: ";
-        std::cerr << segmentedObjects->size() <<std::endl;
-        std::cerr << "Collision Object Published\n";
+}
+
+MeshConstPtr collision_environment::getObjectMesh(const std::string &name, const std::string &representation,
+    std::string &file_location)
+{
+    // This function will find the mesh of an object class in the requested representation.
+    // Simplified meshes that were not generated fall back to the next finer one: box, hull, decimated, full.
+    const std::string representations[4] = {"box", "hull", "decimated", "full"};
+    std::string key = name + "/" + representation;
+    std::map<std::string, std::string>::const_iterator found = meshFileOf.find(key);
+    if (found != meshFileOf.end()) {
+        file_location = found->second;
+        return getMesh(file_location);
     }
-};
+
+    int start = 3;
+    for (int i = 0; i < 4; i++)
+        if (representations[i] == representation)
+            start = i;
+    if (representations[start] != representation)
+        std::cerr << "Warning: Unknown mesh representation: " << representation << ", using full\n";
+
+    for (int i = start; i < 4; i++) {
+        std::stringstream location;
+        if (i < 3)
+            location << mesh_source << "/" << name << "_" << representations[i] << ".stl";
+        else
+            location << mesh_source << "/" << name << "." << file_extension;
+
+        // only files that loaded are remembered, so meshes added while running still show up
+        if (i < 3 && !boost::filesystem::exists( location.str() ))
+            continue;
+        MeshConstPtr mesh = getMesh(location.str());
+        if (!mesh)
+            return mesh;
+
+        file_location = location.str();
+        meshFileOf[key] = file_location;
+        if (i != start)
+            std::cerr << "Warning: No " << representation << " mesh for " << name << ", using " << representations[i] << std::endl;
+        return mesh;
+    }
+    return MeshConstPtr();
+}
+
+MeshConstPtr collision_environment::getMesh(const std::string &file_location)
+{
+    // This function will return the mesh message for a mesh file, and keep it for the next update
+    std::map<std::string, MeshConstPtr>::const_iterator it = meshCache.find(file_location);
+    if (it != meshCache.end())
+        return it->second;
+
+    if (!boost::filesystem::exists( file_location ))
+    {
+        std::cerr << "Warning: Mesh file not found at: " << file_location << std::endl;
+        return MeshConstPtr();
+    }
+
+    // Generate moveit mesh from mesh file
+    shapes::Mesh * tmpMesh = shapes::createMeshFromResource("file://" + file_location);
+    if (tmpMesh == NULL)
+    {
+        std::cerr << "Warning: Fail to load mesh: " << file_location << std::endl;
+        return MeshConstPtr();
+    }
+    shapes::ShapeMsg co_mesh_msg;
+    shapes::constructMsgFromShape(tmpMesh,co_mesh_msg);
+    delete tmpMesh;
+
+    MeshConstPtr mesh(new shape_msgs::Mesh(boost::get<shape_msgs::Mesh>(co_mesh_msg)));
+    meshCache[file_location] = mesh;
+    if (debug)
+        std::cerr << "Cached mesh: " << file_location << std::endl;
+    return mesh;
+}
+
+void collision_environment::computeSceneUpdates(const std::vector<moveit_msgs::CollisionObject> &objects,
+    const std::vector<std::string> &geometry, const std::vector<MeshConstPtr> &meshes,
+    std::map<std::string, sceneObjectState> &sceneObjects, std::vector<moveit_msgs::CollisionObject> &sceneUpdates,
+    const bool &fullScene)
+{
+    // This function will compare the new collision objects with what the planning scene already has.
+    // Objects with the same geometry are only moved, so MoveIt does not have to rebuild their collision geometry.
+    // New objects and objects with different geometry are added, objects that disappeared are removed.
+    // A full scene adds every object again, an ADD replaces an object MoveIt already has. It repairs scenes
+    // that missed an update, such as a MoveIt that restarted or subscribed late.
+    sceneUpdates.clear();
+    std::map<std::string, sceneObjectState> newSceneObjects;
+
+    for (unsigned int i = 0; i < objects.size(); i++) {
+        const moveit_msgs::CollisionObject &co = objects.at(i);
+        sceneObjectState state;
+        state.frame_id = co.header.frame_id;
+        state.geometry = geometry.at(i);
+        newSceneObjects[co.id] = state;
+
+        std::map<std::string, sceneObjectState>::const_iterator old = sceneObjects.find(co.id);
+        if (!fullScene && old != sceneObjects.end() && old->second.frame_id == state.frame_id && old->second.geometry == state.geometry) {
+            moveit_msgs::CollisionObject move;
+            move.id = co.id;
+            move.header.frame_id = co.header.frame_id;
+            move.primitive_poses = co.primitive_poses;
+            move.mesh_poses = co.mesh_poses;
+            move.operation = move.MOVE;
+            sceneUpdates.push_back(move);
+            continue;
+        }
+
+        if (!fullScene && old != sceneObjects.end()) {
+            // same id with a different shape, replace it
+            moveit_msgs::CollisionObject remove;
+            remove.id = co.id;
+            remove.header.frame_id = old->second.frame_id;
+            remove.operation = remove.REMOVE;
+            sceneUpdates.push_back(remove);
+        }
+        sceneUpdates.push_back(co);
+        if (meshes.at(i))
+            sceneUpdates.back().meshes.push_back(*meshes.at(i));
+    }
+
+    for (std::map<std::string, sceneObjectState>::const_iterator it = sceneObjects.begin(); it != sceneObjects.end(); ++it) {
+        if (newSceneObjects.find(it->first) == newSceneObjects.end()) {
+            moveit_msgs::CollisionObject remove;
+            remove.id = it->first;
+            remove.header.frame_id = it->second.frame_id;
+            remove.operation = remove.REMOVE;
+            sceneUpdates.push_back(remove);
+        }
+    }
+
+    sceneObjects.swap(newSceneObjects);
+
+    if (debug)
+        std::cerr << "Number of planning scene updates: " << sceneUpdates.size() << std::endl;
+}
 
 void collision_environment::getAllObjectTFfromDetectedObjectMsgs(const costar_objrec_msgs::DetectedObjectList &detectedObjectList)
 {
@@ -186,22 +347,15 @@ void collision_environment::getAllObjectTFfromDetectedObjectMsgs(const costar_ob
         hasParent = true;
     }
 
-    // get and save the TF name and pose in the class variable
+    // get and save the TF name and pose in the class variable, all objects at the time of the detection
+    std::vector<objectTF> candidates;
     for (unsigned int i = 0; i < detectedObjectList.objects.size(); i++) {
-        std::string currentObjectFrameId = detectedObjectList.objects.at(i).id;
-        if (listener.waitForTransform(currentObjectFrameId,parentFrame,now,ros::Duration(1.0)))
-        {
-            objectTF detectedObject;
-            detectedObject.name = detectedObjectList.objects.at(i).object_class;
-            detectedObject.frame_id = currentObjectFrameId;
-            listOfTF.push_back(detectedObject.frame_id);
-            tf::StampedTransform transform;
-            listener.lookupTransform(parentFrame,currentObjectFrameId,ros::Time(0),transform);
-            tf::poseTFToMsg(transform,detectedObject.pose);
-            detectedObjectsTF.push_back(detectedObject);
-        }
-        else std::cerr << "Fail to get: " << currentObjectFrameId << " transform to " << parentFrame << std::endl;
+        objectTF detectedObject;
+        detectedObject.name = detectedObjectList.objects.at(i).object_class;
+        detectedObject.frame_id = detectedObjectList.objects.at(i).id;
+        candidates.push_back(detectedObject);
     }
+    resolveObjectTF(candidates, detectedObjectList.header.stamp.isZero() ? now : detectedObjectList.header.stamp);
     
     // update the list of TF to contain only newest set of object TF frames
     
@@ -260,19 +414,16 @@ void collision_environment::getAllObjectTF()
             }
         }
     
-	detectedObjectsTF.clear();
-    std::vector<std::string> newestListOfTF;
-    
-    ros::Time now = ros::Time::now();
-    
     if (!hasParent) {
         // something wrong going on here, probably no object frame found or no new TF frame for this object
         std::cerr << "TF fail to get any Object frames\n";
+        detectedObjectsTF.clear();
         listOfTF.clear();
         return;
     }
 
-    // get and save the TF name and pose in the class variable
+    // collect the object frames, then resolve all of them at once
+    std::vector<objectTF> candidates;
     for (unsigned int i = 0; i < listOfTF.size(); i++) {
 
         // if the beginning character of TF is not the same character as object tf signature, skip it
@@ -285,22 +436,16 @@ void collision_environment::getAllObjectTF()
         std::vector<std::string> tmp = stringVectorSeparator(listOfTF.at(i), charToFind, debug);
         if (tmp.size() > objectNameFormatIndex)
         {
-            if (listener.waitForTransform(listOfTF.at(i),parentFrame,now,ros::Duration(0.5)))
-            {
-                objectTF detectedObject;
-                detectedObject.name = tmp.at(objectNameFormatIndex-1);
-                detectedObject.frame_id = listOfTF.at(i);
-                newestListOfTF.push_back(detectedObject.frame_id);
-                tf::StampedTransform transform;
-                listener.lookupTransform(parentFrame,listOfTF.at(i),ros::Time(0),transform);
-                tf::poseTFToMsg(transform,detectedObject.pose);
-                detectedObjectsTF.push_back(detectedObject);
-            }
+            objectTF detectedObject;
+            detectedObject.name = tmp.at(objectNameFormatIndex-1);
+            detectedObject.frame_id = listOfTF.at(i);
+            candidates.push_back(detectedObject);
         }
 	}
     
-    // update the list of TF to contain only newest set of object TF frames
-    listOfTF = newestListOfTF;
+    // update the list of TF to contain only newest set of object TF frames.
+    // There is no detection time here and now is never in the buffer yet, use the newest pose of each frame
+    resolveObjectTF(candidates, ros::Time(0));
     
 	// Print out the object tf list
     if (debug) {
@@ -310,6 +455,71 @@ void collision_environment::getAllObjectTF()
     }
 };
 
+void collision_environment::resolveObjectTF(std::vector<objectTF> &candidates, const ros::Time &stamp)
+{
+    // This function will look up the pose of every candidate object frame at the same time stamp.
+    // It never waits for TF: a frame that is not available yet keeps its last pose for this update,
+    // and is looked up again at its stamp on the next update, when TF has caught up.
+    detectedObjectsTF.clear();
+    listOfTF.clear();
+
+    // the frames deferred by the last update
+    for (unsigned int i = 0; i < deferredObjectTF.size(); i++) {
+        objectTF deferred = deferredObjectTF.at(i);
+        if (lookupObjectTF(deferred, deferredStamp))
+            lastObjectTF[deferred.frame_id] = deferred;
+    }
+    deferredObjectTF.clear();
+    deferredStamp = stamp;
+
+    std::vector<bool> resolved(candidates.size(), false);
+    for (unsigned int i = 0; i < candidates.size(); i++) {
+        resolved.at(i) = lookupObjectTF(candidates.at(i), stamp);
+        if (!resolved.at(i))
+            deferredObjectTF.push_back(candidates.at(i));
+    }
+
+    std::map<std::string, objectTF> newestObjectTF;
+    for (unsigned int i = 0; i < candidates.size(); i++) {
+        const objectTF &candidate = candidates.at(i);
+        std::map<std::string, objectTF>::const_iterator last = lastObjectTF.find(candidate.frame_id);
+        if (resolved.at(i))
+            newestObjectTF[candidate.frame_id] = candidate;
+        else if (last != lastObjectTF.end() && last->second.name == candidate.name) {
+            if (debug)
+                std::cerr << "Deferring: " << candidate.frame_id << " transform to " << parentFrame << ", using its last pose\n";
+            newestObjectTF[candidate.frame_id] = last->second;
+        }
+        else {
+            std::cerr << "Fail to get: " << candidate.frame_id << " transform to " << parentFrame << std::endl;
+            continue;
+        }
+
+        listOfTF.push_back(candidate.frame_id);
+        detectedObjectsTF.push_back(newestObjectTF[candidate.frame_id]);
+    }
+
+    // forget frames that are gone
+    lastObjectTF.swap(newestObjectTF);
+}
+
+bool collision_environment::lookupObjectTF(objectTF &object, const ros::Time &stamp)
+{
+    // This function will set the pose of object at stamp if TF has it, without waiting
+    if (!listener.canTransform(parentFrame,object.frame_id,stamp))
+        return false;
+
+    tf::StampedTransform transform;
+    try {
+        listener.lookupTransform(parentFrame,object.frame_id,stamp,transform);
+    }
+    catch (tf::TransformException &ex) {
+        return false;
+    }
+    tf::poseTFToMsg(transform,object.pose);
+    return true;
+}
+
 const std::vector<moveit_msgs::CollisionObject> collision_environment::generateOldObjectToRemove() const
 {
     // This function will generate list of collision objects generated from prior iteration
@@ -326,7 +536,29 @@ const std::vector<moveit_msgs::CollisionObject> collision_environment::generateO
 
 const std::vector<moveit_msgs::CollisionObject> collision_environment::getCollisionObjects() const
 {
-    return *segmentedObjects;
+    std::vector<moveit_msgs::CollisionObject> objects = *segmentedObjects;
+    for (unsigned int i = 0; i < objects.size(); i++)
+        if (segmentedMeshes.at(i))
+            objects.at(i).meshes.push_back(*segmentedMeshes.at(i));
+    return objects;
+}
+
+const std::vector<moveit_msgs::CollisionObject> &collision_environment::getSceneUpdates() const
+{
+    // ADD, MOVE and REMOVE operations since the last call of updateCollisionObjects
+    return sceneUpdates;
+}
+
+bool collision_environment::hasPredicateScene() const
+{
+    // predicates use their own copy of the scene only if they want different meshes than planning
+    return predicateRepresentation != planningRepresentation;
+}
+
+const std::vector<moveit_msgs::CollisionObject> &collision_environment::getPredicateSceneUpdates() const
+{
+    // same as getSceneUpdates, with the meshes of predicateRepresentation
+    return predicateSceneUpdates;
 }
 
 std::vector<std::string> collision_environment::getListOfTF() const
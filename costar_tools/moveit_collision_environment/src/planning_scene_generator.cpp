@@ -1,4 +1,5 @@
 #include "planning_scene_generator.h"
+#include <boost/bind.hpp>
 
 void moveitPlanningSceneGenerator::addCollisionObjects(const std::vector<moveit_msgs::CollisionObject>& collision_objects)
 {
@@ -18,23 +19,22 @@ bool moveitPlanningSceneGenerator::updateCollisionObject (std_srvs::Empty::Reque
     // Keep the node from updating collision object with autoUpdate if the service call is running first
     mtx.lock();
 
-    // remove old collision objects
     planning_scene.world.collision_objects.clear();
-    std::cerr << "Number of old object to remove: ";
-    this->addCollisionObjects(collisionObjectGenerator.generateOldObjectToRemove());
     
-    // add new collision objects
+    // update collision objects
     std::cerr << "Updating objects.\n";
+    bool fullScene = this->fullSceneDue();
     if(useDetectedObjectMsgs)
     {
         collisionObjectGenerator.getAllObjectTFfromDetectedObjectMsgs(detectedObjectList);
-        collisionObjectGenerator.updateCollisionObjects(false);
+        collisionObjectGenerator.updateCollisionObjects(false, fullScene);
     }
     else
-        collisionObjectGenerator.updateCollisionObjects();
+        collisionObjectGenerator.updateCollisionObjects(true, fullScene);
     
-    std::cerr << "Number of new object to add: ";
-    this->addCollisionObjects(collisionObjectGenerator.getCollisionObjects());
+    // only send what changed since the last update: moves, new objects and removed objects, or every object if fullSceneDue
+    std::cerr << "Number of collision object updates: ";
+    this->addCollisionObjects(collisionObjectGenerator.getSceneUpdates());
     
     bool anyUpdate = planning_scene.world.collision_objects.size() > 0;
     if (anyUpdate) {
@@ -43,7 +43,9 @@ bool moveitPlanningSceneGenerator::updateCollisionObject (std_srvs::Empty::Reque
         std::cerr << "Update done\n";
     }
     else
-        std::cerr << "No update done since there is no object TF detected\n";
+        std::cerr << "No update done since there is no object TF detected or removed\n";
+    // the predicate meshes may change without a planning scene update
+    this->publishPredicateScene();
     std::cerr << std::endl;
     mtx.unlock();
     return anyUpdate;
@@ -60,18 +62,17 @@ void moveitPlanningSceneGenerator::autoUpdateScene(const costar_objrec_msgs::Det
     this->detectedObjectList = detectedObject;
 
     planning_scene.world.collision_objects.clear();
-    std::cerr << "Number of old object to remove: ";
-    this->addCollisionObjects(collisionObjectGenerator.generateOldObjectToRemove());
 
     // Get update of tf names from detected object msgs
     std::cerr << "Updating objects.\n";
     collisionObjectGenerator.getAllObjectTFfromDetectedObjectMsgs(detectedObjectList);
 
     // Update collision objects without updating frame (because we already update it from the msgs)
-    collisionObjectGenerator.updateCollisionObjects(false);
+    collisionObjectGenerator.updateCollisionObjects(false, this->fullSceneDue());
 
-    std::cerr << "Number of new object to add: ";
-    this->addCollisionObjects(collisionObjectGenerator.getCollisionObjects());
+    // only send what changed since the last update: moves, new objects and removed objects, or every object if fullSceneDue
+    std::cerr << "Number of collision object updates: ";
+    this->addCollisionObjects(collisionObjectGenerator.getSceneUpdates());
     
     bool anyUpdate = planning_scene.world.collision_objects.size() > 0;
     if (anyUpdate) {
@@ -80,18 +81,71 @@ void moveitPlanningSceneGenerator::autoUpdateScene(const costar_objrec_msgs::Det
         std::cerr << "Update done\n";
     }
     else
-        std::cerr << "No update done since there is no object TF detected\n";
+        std::cerr << "No update done since there is no object TF detected or removed\n";
+    // the predicate meshes may change without a planning scene update
+    this->publishPredicateScene();
     std::cerr << std::endl;
     mtx.unlock();
 }
 
+bool moveitPlanningSceneGenerator::fullSceneDue()
+{
+    // This function will decide whether this update sends every object again instead of only what changed.
+    // The diffs are all MoveIt gets, one that was dropped or sent before it subscribed would leave its scene wrong for good
+    ros::Time now = ros::Time::now();
+    bool due = fullSceneRequested || lastFullSceneUpdate.isZero()
+        || (fullSceneUpdatePeriod > 0 && (now - lastFullSceneUpdate).toSec() >= fullSceneUpdatePeriod);
+    if (due) {
+        fullSceneRequested = false;
+        lastFullSceneUpdate = now;
+    }
+    return due;
+}
+
+void moveitPlanningSceneGenerator::subscriberConnected(const ros::SingleSubscriberPublisher &pub)
+{
+    // a new subscriber, e.g. a restarted MoveIt, only has the latched last diff: send it everything on the next update
+    boost::mutex::scoped_lock lock(mtx);
+    std::cerr << pub.getSubscriberName() << " subscribed to " << pub.getTopic() << ", sending the full scene on the next update\n";
+    fullSceneRequested = true;
+}
+
+void moveitPlanningSceneGenerator::publishPredicateScene()
+{
+    // This function will publish the scene with the predicate meshes, if they differ from the planning meshes
+    if (!collisionObjectGenerator.hasPredicateScene())
+        return;
+
+    const std::vector<moveit_msgs::CollisionObject> &updates = collisionObjectGenerator.getPredicateSceneUpdates();
+    if (updates.size() < 1)
+        return;
+
+    moveit_msgs::PlanningScene predicate_scene;
+    predicate_scene.world.collision_objects = updates;
+    predicate_scene.is_diff = true;
+    predicate_scene_diff_publisher.publish(predicate_scene);
+}
+
 moveitPlanningSceneGenerator::moveitPlanningSceneGenerator(const ros::NodeHandle &nh)
 {
     // This will set the nodehandle and publisher of the class
     this->nh = nh;
-    planning_scene_diff_publisher = this->nh.advertise<moveit_msgs::PlanningScene>("/planning_scene", 1);
+    this->nh.param("fullSceneUpdatePeriod", fullSceneUpdatePeriod, 10.0);
+    fullSceneRequested = true;
+
+    // latched, so a subscriber that connects between updates still gets the last one
+    ros::SubscriberStatusCallback connected = boost::bind(&moveitPlanningSceneGenerator::subscriberConnected, this, _1);
+    planning_scene_diff_publisher = this->nh.advertise<moveit_msgs::PlanningScene>("/planning_scene", 1,
+        connected, ros::SubscriberStatusCallback(), ros::VoidConstPtr(), true);
     collisionObjectGenerator.setNodeHandle(this->nh);
 
+    // predicator_collision can subscribe to this instead of /planning_scene to get the predicate meshes
+    std::string predicateSceneTopic;
+    this->nh.param("predicateSceneTopic",predicateSceneTopic,std::string("/predicator/planning_scene"));
+    if (collisionObjectGenerator.hasPredicateScene())
+        predicate_scene_diff_publisher = this->nh.advertise<moveit_msgs::PlanningScene>(predicateSceneTopic, 1,
+            connected, ros::SubscriberStatusCallback(), ros::VoidConstPtr(), true);
+
     this->nh.param("useDetectedObjectMsgs", useDetectedObjectMsgs, false);
     if(useDetectedObjectMsgs){
         std::cerr << "This node will update the planning scene automatically when it receieved the costar object msgs\n";
@@ -0,0 +1,324 @@
+// Offline tool that writes simplified collision meshes next to the full resolution ones.
+// For every <name>.<file_extension> in the mesh folder it writes:
+//   <name>_decimated.stl : vertex clustered mesh, no vertex moves more than maxError
+//   <name>_hull.stl      : convex hull
+//   <name>_box.stl       : oriented bounding box
+// The hull and the box are only written if they stay within maxPrimitiveError of the original surface.
+// collision_environment picks one of them with the planningRepresentation and predicateRepresentation params.
+
+#include <geometric_shapes/mesh_operations.h>
+#include <geometric_shapes/bodies.h>
+#include <boost/filesystem.hpp>
+#include <Eigen/Dense>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cmath>
+#include <map>
+#include <limits>
+#include <vector>
+#include <stdint.h>
+
+struct simpleMesh {
+    std::vector<Eigen::Vector3d> vertices;
+    std::vector<unsigned int> triangles; // 3 vertex indices each
+};
+
+static simpleMesh meshFromShape(const shapes::Mesh *mesh)
+{
+    simpleMesh result;
+    for (unsigned int i = 0; i < mesh->vertex_count; i++)
+        result.vertices.push_back(Eigen::Vector3d(mesh->vertices[3*i], mesh->vertices[3*i+1], mesh->vertices[3*i+2]));
+    result.triangles.assign(mesh->triangles, mesh->triangles + 3 * mesh->triangle_count);
+    return result;
+}
+
+static bool writeSTL(const std::string &filename, const simpleMesh &mesh)
+{
+    // binary STL: 80 byte header, triangle count, then normal, 3 vertices and attribute count per triangle
+    std::ofstream out(filename.c_str(), std::ios::out | std::ios::binary);
+    if (!out.is_open())
+        return false;
+
+    char header[80] = "simplify_collision_mesh";
+    out.write(header, 80);
+    uint32_t count = mesh.triangles.size() / 3;
+    out.write((char*)&count, sizeof(uint32_t));
+    for (unsigned int t = 0; t < count; t++) {
+        const Eigen::Vector3d &a = mesh.vertices[mesh.triangles[3*t]];
+        const Eigen::Vector3d &b = mesh.vertices[mesh.triangles[3*t+1]];
+        const Eigen::Vector3d &c = mesh.vertices[mesh.triangles[3*t+2]];
+        Eigen::Vector3d normal = (b - a).cross(c - a);
+        if (normal.norm() > 0)
+            normal.normalize();
+
+        float data[12];
+        for (unsigned int k = 0; k < 3; k++) {
+            data[k] = normal[k];
+            data[3+k] = a[k];
+            data[6+k] = b[k];
+            data[9+k] = c[k];
+        }
+        uint16_t attribute = 0;
+        out.write((char*)data, sizeof(data));
+        out.write((char*)&attribute, sizeof(uint16_t));
+    }
+    return (bool)out;
+}
+
+static Eigen::Vector3d closestPointOnTriangle(const Eigen::Vector3d &p, const Eigen::Vector3d &a, const Eigen::Vector3d &b, const Eigen::Vector3d &c)
+{
+    // region tests from Ericson, Real-Time Collision Detection 5.1.5
+    Eigen::Vector3d ab = b - a, ac = c - a, ap = p - a;
+    double d1 = ab.dot(ap), d2 = ac.dot(ap);
+    if (d1 <= 0 && d2 <= 0) return a;
+
+    Eigen::Vector3d bp = p - b;
+    double d3 = ab.dot(bp), d4 = ac.dot(bp);
+    if (d3 >= 0 && d4 <= d3) return b;
+
+    double vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0) return a + ab * (d1 / (d1 - d3));
+
+    Eigen::Vector3d cp = p - c;
+    double d5 = ab.dot(cp), d6 = ac.dot(cp);
+    if (d6 >= 0 && d5 <= d6) return c;
+
+    double vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0) return a + ac * (d2 / (d2 - d6));
+
+    double va = d3 * d6 - d5 * d4;
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    double denom = 1.0 / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+static double distanceToMesh(const Eigen::Vector3d &p, const simpleMesh &mesh)
+{
+    double best = std::numeric_limits<double>::max();
+    for (unsigned int t = 0; t + 2 < mesh.triangles.size(); t += 3) {
+        Eigen::Vector3d q = closestPointOnTriangle(p, mesh.vertices[mesh.triangles[t]],
+            mesh.vertices[mesh.triangles[t+1]], mesh.vertices[mesh.triangles[t+2]]);
+        best = std::min(best, (q - p).squaredNorm());
+    }
+    return std::sqrt(best);
+}
+
+static double meshArea(const simpleMesh &mesh)
+{
+    double area = 0;
+    for (unsigned int t = 0; t + 2 < mesh.triangles.size(); t += 3) {
+        const Eigen::Vector3d &a = mesh.vertices[mesh.triangles[t]];
+        const Eigen::Vector3d &b = mesh.vertices[mesh.triangles[t+1]];
+        const Eigen::Vector3d &c = mesh.vertices[mesh.triangles[t+2]];
+        area += 0.5 * (b - a).cross(c - a).norm();
+    }
+    return area;
+}
+
+static void sampleSurface(const simpleMesh &mesh, double spacing, std::vector<Eigen::Vector3d> &samples)
+{
+    // the vertices, plus uniform barycentric samples on every triangle, one per spacing^2 of its area and at least one
+    srand(0);
+    samples = mesh.vertices;
+    for (unsigned int t = 0; t + 2 < mesh.triangles.size(); t += 3) {
+        const Eigen::Vector3d &a = mesh.vertices[mesh.triangles[t]];
+        const Eigen::Vector3d &b = mesh.vertices[mesh.triangles[t+1]];
+        const Eigen::Vector3d &c = mesh.vertices[mesh.triangles[t+2]];
+        double area = 0.5 * (b - a).cross(c - a).norm();
+        unsigned int count = std::max(1, (int)std::ceil(area / (spacing * spacing)));
+        for (unsigned int k = 0; k < count; k++) {
+            double u = rand() / (RAND_MAX + 1.0), v = rand() / (RAND_MAX + 1.0);
+            if (u + v > 1) {
+                u = 1 - u;
+                v = 1 - v;
+            }
+            samples.push_back(a + (b - a) * u + (c - a) * v);
+        }
+    }
+}
+
+static double oneSidedError(const simpleMesh &from, const simpleMesh &to, double spacing)
+{
+    std::vector<Eigen::Vector3d> samples;
+    sampleSurface(from, spacing, samples);
+    double error = 0;
+    for (unsigned int i = 0; i < samples.size(); i++)
+        error = std::max(error, distanceToMesh(samples[i], to));
+    return error;
+}
+
+static double surfaceError(const simpleMesh &approximation, const simpleMesh &original, double spacing)
+{
+    // sampled Hausdorff distance: an approximation can stray from the original, or miss parts of it, e.g. a box dropping a handle
+    // the spacing is grown so that large surfaces get about maxSamples samples
+    const double maxSamples = 20000;
+    spacing = std::max(spacing, std::sqrt(std::max(meshArea(approximation), meshArea(original)) / maxSamples));
+    return std::max(oneSidedError(approximation, original, spacing), oneSidedError(original, approximation, spacing));
+}
+
+struct cellLess {
+    bool operator()(const Eigen::Vector3i &a, const Eigen::Vector3i &b) const {
+        return a[0] != b[0] ? a[0] < b[0] : (a[1] != b[1] ? a[1] < b[1] : a[2] < b[2]);
+    }
+};
+
+static simpleMesh decimate(const simpleMesh &mesh, double maxError)
+{
+    // Vertex clustering: all vertices in one grid cell are merged into their mean,
+    // so no vertex moves further than the cell diagonal.
+    double cell = maxError / std::sqrt(3.0);
+    simpleMesh result;
+    std::map<Eigen::Vector3i, unsigned int, cellLess> clusters;
+    std::vector<unsigned int> remap(mesh.vertices.size());
+    std::vector<unsigned int> clusterSize;
+
+    for (unsigned int i = 0; i < mesh.vertices.size(); i++) {
+        Eigen::Vector3i key((int)std::floor(mesh.vertices[i][0] / cell),
+            (int)std::floor(mesh.vertices[i][1] / cell),
+            (int)std::floor(mesh.vertices[i][2] / cell));
+        std::map<Eigen::Vector3i, unsigned int, cellLess>::iterator it = clusters.find(key);
+        if (it == clusters.end()) {
+            it = clusters.insert(std::make_pair(key, (unsigned int)result.vertices.size())).first;
+            result.vertices.push_back(Eigen::Vector3d::Zero());
+            clusterSize.push_back(0);
+        }
+        remap[i] = it->second;
+        result.vertices[it->second] += mesh.vertices[i];
+        clusterSize[it->second]++;
+    }
+    for (unsigned int i = 0; i < result.vertices.size(); i++)
+        result.vertices[i] /= clusterSize[i];
+
+    // drop triangles that collapsed into a point or an edge
+    for (unsigned int t = 0; t + 2 < mesh.triangles.size(); t += 3) {
+        unsigned int a = remap[mesh.triangles[t]], b = remap[mesh.triangles[t+1]], c = remap[mesh.triangles[t+2]];
+        if (a == b || b == c || a == c)
+            continue;
+        result.triangles.push_back(a);
+        result.triangles.push_back(b);
+        result.triangles.push_back(c);
+    }
+    return result;
+}
+
+static simpleMesh convexHull(const shapes::Mesh *mesh)
+{
+    bodies::ConvexMesh body(mesh);
+    const EigenSTL::vector_Vector3d &vertices = body.getScaledVertices();
+    simpleMesh result;
+    result.vertices.assign(vertices.begin(), vertices.end());
+    result.triangles = body.getTriangles();
+    return result;
+}
+
+static simpleMesh orientedBox(const simpleMesh &mesh)
+{
+    // box along the principal axes of the vertices
+    Eigen::Vector3d mean = Eigen::Vector3d::Zero();
+    for (unsigned int i = 0; i < mesh.vertices.size(); i++)
+        mean += mesh.vertices[i];
+    mean /= mesh.vertices.size();
+
+    Eigen::Matrix3d covariance = Eigen::Matrix3d::Zero();
+    for (unsigned int i = 0; i < mesh.vertices.size(); i++)
+        covariance += (mesh.vertices[i] - mean) * (mesh.vertices[i] - mean).transpose();
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(covariance);
+    Eigen::Matrix3d axes = solver.eigenvectors();
+
+    Eigen::Vector3d lower = Eigen::Vector3d::Constant(std::numeric_limits<double>::max());
+    Eigen::Vector3d upper = -lower;
+    for (unsigned int i = 0; i < mesh.vertices.size(); i++) {
+        Eigen::Vector3d local = axes.transpose() * (mesh.vertices[i] - mean);
+        lower = lower.cwiseMin(local);
+        upper = upper.cwiseMax(local);
+    }
+
+    simpleMesh result;
+    for (unsigned int i = 0; i < 8; i++) {
+        Eigen::Vector3d corner((i & 1) ? upper[0] : lower[0], (i & 2) ? upper[1] : lower[1], (i & 4) ? upper[2] : lower[2]);
+        result.vertices.push_back(mean + axes * corner);
+    }
+    // two triangles per face, counter clockwise seen from outside for a right handed frame
+    const unsigned int faces[12][3] = {
+        {0,2,1}, {1,2,3}, {4,5,6}, {5,7,6},
+        {0,1,4}, {1,5,4}, {2,6,3}, {3,6,7},
+        {0,4,2}, {2,4,6}, {1,3,5}, {3,7,5}};
+    bool flipped = axes.determinant() < 0;
+    for (unsigned int f = 0; f < 12; f++) {
+        result.triangles.push_back(faces[f][0]);
+        result.triangles.push_back(flipped ? faces[f][2] : faces[f][1]);
+        result.triangles.push_back(flipped ? faces[f][1] : faces[f][2]);
+    }
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <mesh folder> [file extension=stl] [maxError=0.002] [maxPrimitiveError=0.01]\n";
+        return 1;
+    }
+
+    std::string mesh_source = argv[1];
+    std::string file_extension = argc > 2 ? argv[2] : "stl";
+    double maxError = argc > 3 ? atof(argv[3]) : 0.002;
+    double maxPrimitiveError = argc > 4 ? atof(argv[4]) : 0.01;
+
+    if (!boost::filesystem::is_directory(mesh_source)) {
+        std::cerr << "ERROR, mesh folder not found: " << mesh_source << std::endl;
+        return 1;
+    }
+
+    const std::string suffixes[3] = {"_decimated", "_hull", "_box"};
+    for (boost::filesystem::directory_iterator it(mesh_source); it != boost::filesystem::directory_iterator(); ++it) {
+        boost::filesystem::path path = it->path();
+        if (path.extension().string() != "." + file_extension)
+            continue;
+
+        // skip our own output
+        std::string name = path.stem().string();
+        bool generated = false;
+        for (unsigned int i = 0; i < 3; i++)
+            generated = generated || (name.size() > suffixes[i].size() && name.compare(name.size() - suffixes[i].size(), suffixes[i].size(), suffixes[i]) == 0);
+        if (generated)
+            continue;
+
+        shapes::Mesh *shape = shapes::createMeshFromResource("file://" + boost::filesystem::absolute(path).string());
+        if (shape == NULL) {
+            std::cerr << "Warning: Fail to load mesh: " << path.string() << std::endl;
+            continue;
+        }
+
+        simpleMesh original = meshFromShape(shape);
+        simpleMesh approximations[3];
+        approximations[0] = decimate(original, maxError);
+        approximations[1] = convexHull(shape);
+        approximations[2] = orientedBox(original);
+        delete shape;
+
+        std::cerr << name << ": " << original.triangles.size() / 3 << " triangles\n";
+        for (unsigned int i = 0; i < 3; i++) {
+            // sample at half the tolerance the result is checked against
+            double error = surfaceError(approximations[i], original, (i > 0 ? maxPrimitiveError : maxError) / 2);
+            std::string filename = (boost::filesystem::path(mesh_source) / (name + suffixes[i] + ".stl")).string();
+
+            // the decimated mesh is bounded by construction, the hull and the box only by their measured error
+            if (i > 0 && error > maxPrimitiveError) {
+                std::cerr << "  " << suffixes[i] << ": error " << error << " above " << maxPrimitiveError << ", skipped\n";
+                boost::filesystem::remove(filename);
+                continue;
+            }
+            if (!writeSTL(filename, approximations[i])) {
+                std::cerr << "ERROR, fail to write: " << filename << std::endl;
+                return 1;
+            }
+            std::cerr << "  " << suffixes[i] << ": " << approximations[i].triangles.size() / 3 << " triangles, error " << error << std::endl;
+        }
+    }
+    return 0;
+}